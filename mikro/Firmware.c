@@ -14,18 +14,23 @@
 #include <avr/interrupt.h>
 #include "PWM.h"
 #include "UART.h"
+#include "ServoProtocol.h"
 #include <stdbool.h>
 
-bool newUartData = false;
-unsigned char recievedData = 0;
+/* Set by the UART interrupt when a complete packet has arrived */
+volatile bool newPacket = false;
+volatile unsigned char packetX = 80;
+volatile unsigned char packetY = 80;
+ServoParser parser;
+
 int main(void){
 	DDRD = 0xFF;
 	PORTD = 0xFF;
+	ServoParserInit(&parser);
 	sei();
 	UART_Init(MYUBRR);
 	DDRC = 0xFF;
 	PWMInit();
-	int state = 0;
 	int posX = 80;
 	int posY = 80;
 	int dataRecieved = 0;
@@ -34,39 +39,13 @@ int main(void){
 	_delay_ms(1000);
     while(1)
     {	
-		if(newUartData){
-			switch (state){
-				case 0:
-					if(recievedData == 0xFF){
-						 state = 1;
-						newUartData = false;
-						dataRecieved = 0;
-					}
-					else state = 0;
-					break;
-				
-				case 1:
-					if(recievedData == 0xFF) state = 0;
-						else{
-							posX = recievedData;
-							newUartData = false;
-							state = 2;
-						}
-					break;
-				
-				case 2:
-					if(recievedData == 0xFF) state = 0;
-					else{
-						posY = recievedData;
-						newUartData = false;
-						state = 0;
-					}
-					break;
-				
-				default:
-					state = 0;
-					break;
-			}			
+		if(newPacket){
+			cli();
+			posX = packetX;
+			posY = packetY;
+			newPacket = false;
+			sei();
+			dataRecieved = 0;
 		}
 		
 		if(posX > 160) PWMSetX(2200);
@@ -86,10 +65,13 @@ int main(void){
 	}
 }
 
+/* Packets are parsed as the bytes arrive, so none are lost while the main loop waits */
 ISR(USART_RX_vect){
+	unsigned char x, y;
 	
-	newUartData = true;
-	recievedData = UART_Receive();
-	
-	
+	if(ServoParserFeed(&parser, UART_Receive(), &x, &y)){
+		packetX = x;
+		packetY = y;
+		newPacket = true;
+	}
 }
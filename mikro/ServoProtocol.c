@@ -0,0 +1,72 @@
+/*
+ * ServoProtocol.c
+ *
+ * Servo pose packets from the PC, shared by the firmware and the PC program.
+ */ 
+
+#include "ServoProtocol.h"
+
+unsigned char ServoCrc8(const unsigned char* data, unsigned char size){
+	unsigned char crc = 0;
+	unsigned char i, bit;
+
+	for(i = 0; i < size; i++){
+		crc ^= data[i];
+		for(bit = 0; bit < 8; bit++){
+			if(crc & 0x80) crc = (crc << 1) ^ 0x07;
+			else crc <<= 1;
+		}
+	}
+	return crc;
+}
+
+void ServoPacketBuild(unsigned char* packet, unsigned char sequence, unsigned char x, unsigned char y){
+	packet[0] = SERVO_PACKET_SYNC;
+	packet[1] = sequence;
+	packet[2] = x;
+	packet[3] = y;
+	packet[4] = ServoCrc8(packet + 1, 3);
+}
+
+void ServoParserInit(ServoParser* parser){
+	parser->count = 0;
+	parser->lastSequence = 0;
+	parser->hasSequence = 0;
+	parser->packets = 0;
+	parser->lostPackets = 0;
+	parser->skippedBytes = 0;
+}
+
+/* Drops the oldest byte of the window */
+static void shiftWindow(ServoParser* parser){
+	unsigned char i;
+
+	for(i = 1; i < parser->count; i++){
+		parser->window[i - 1] = parser->window[i];
+	}
+	parser->count--;
+	parser->skippedBytes++;
+}
+
+unsigned char ServoParserFeed(ServoParser* parser, unsigned char data, unsigned char* x, unsigned char* y){
+	/* A full window here held a bad packet; look for the next sync byte in it */
+	if(parser->count == SERVO_PACKET_SIZE) shiftWindow(parser);
+	parser->window[parser->count++] = data;
+
+	while(parser->count > 0 && parser->window[0] != SERVO_PACKET_SYNC) shiftWindow(parser);
+
+	if(parser->count < SERVO_PACKET_SIZE) return 0;
+	if(ServoCrc8(parser->window + 1, 3) != parser->window[4]) return 0;
+
+	if(parser->hasSequence){
+		parser->lostPackets += (unsigned char)(parser->window[1] - parser->lastSequence - 1);
+	}
+	parser->lastSequence = parser->window[1];
+	parser->hasSequence = 1;
+	parser->packets++;
+
+	*x = parser->window[2];
+	*y = parser->window[3];
+	parser->count = 0;
+	return 1;
+}
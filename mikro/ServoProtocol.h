@@ -0,0 +1,57 @@
+/*
+ * ServoProtocol.h
+ *
+ * Servo pose packets from the PC, shared by the firmware and the PC program.
+ */ 
+
+#ifndef SERVOPROTOCOL_H_
+#define SERVOPROTOCOL_H_
+
+/*
+ * Packet layout, 5 bytes:
+ *
+ *   SERVO_PACKET_SYNC, sequence, x, y, crc
+ *
+ * x and y are servo positions from 0 to 160, 80 being the centre. The sequence
+ * number goes up by one for every packet, so the receiver can count lost ones.
+ * The CRC-8 (polynomial 0x07, initial value 0) covers sequence, x and y.
+ *
+ * The sync byte can also turn up in the data, so a packet is only accepted when
+ * its CRC matches. Otherwise the parser moves on to the next sync byte.
+ */
+
+#define SERVO_PACKET_SYNC 0xA5
+#define SERVO_PACKET_SIZE 5
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+	unsigned char window[SERVO_PACKET_SIZE];
+	unsigned char count;
+	unsigned char lastSequence;
+	unsigned char hasSequence;
+
+	/* Statistics, for the PC side and debugging */
+	unsigned int packets;
+	unsigned int lostPackets;
+	unsigned int skippedBytes;
+} ServoParser;
+
+unsigned char ServoCrc8(const unsigned char* data, unsigned char size);
+
+/* Writes a packet of SERVO_PACKET_SIZE bytes to packet */
+void ServoPacketBuild(unsigned char* packet, unsigned char sequence, unsigned char x, unsigned char y);
+
+void ServoParserInit(ServoParser* parser);
+
+/* Feeds one received byte. Returns 1 and sets x and y when it completes a valid packet */
+unsigned char ServoParserFeed(ServoParser* parser, unsigned char data, unsigned char* x, unsigned char* y);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SERVOPROTOCOL_H_ */
@@ -0,0 +1,959 @@
+#include "CpuDistortion.h"
+#include "CpuFeatures.h"
+#include "Swizzle.h"
+
+#include <Kernel/OVR_Timer.h>
+#include <Kernel/OVR_SysFile.h>
+#include <Kernel/OVR_Log.h>
+
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <emmintrin.h> // SSE2
+#include <immintrin.h> // AVX
+
+using namespace OVR;
+using namespace OVR::Util::Render;
+
+typedef CpuDistortion::Params Params;
+
+
+//-------------------------------------------------------------------------------------
+// ***** Implementations
+
+// Rows are processed in chunks: first the distorted texture coordinates of every
+// pixel are computed, then the source is sampled at them. The coordinate arrays are
+// padded so that vector versions can always work on whole vectors.
+enum { ChunkSize = 64 };
+
+struct CoordChunk
+{
+	float   GX[ChunkSize], GY[ChunkSize];
+	float   RX[ChunkSize], RY[ChunkSize];
+	float   BX[ChunkSize], BY[ChunkSize];
+	UInt32  Inside[ChunkSize];  // ~0 for pixels within the eye's half of the screen
+};
+
+typedef void (*CoordFn)(const Params& p, int x, int y, int count, CoordChunk& c);
+typedef void (*SampleFn)(const CpuImage& src, const Params& p, const CoordChunk& c, int count, UInt32* dest);
+
+// All versions do the same float operations in the same order, so their results are
+// identical given IEEE single precision math.
+static void coordsScalar(const Params& p, int x, int y, int count, CoordChunk& c)
+{
+	float thy = ((float(y) + 0.5f) * p.InvDestHeight - p.LensCenter[1]) * p.ScaleIn[1];
+
+	for (int i = 0; i < count; i++)
+	{
+		float thx = ((float(x + i) + 0.5f) * p.InvDestWidth - p.LensCenter[0]) * p.ScaleIn[0];
+		float rsq = thx * thx + thy * thy;
+		float k   = p.HmdWarp[0] + rsq * (p.HmdWarp[1] + rsq * (p.HmdWarp[2] + rsq * p.HmdWarp[3]));
+		float dx  = thx * k * p.Scale[0];
+		float dy  = thy * k * p.Scale[1];
+		float cr  = p.ChromAb[0] + p.ChromAb[1] * rsq;
+		float cb  = p.ChromAb[2] + p.ChromAb[3] * rsq;
+
+		c.GX[i] = p.LensCenter[0] + dx;
+		c.GY[i] = p.LensCenter[1] + dy;
+		c.RX[i] = p.LensCenter[0] + dx * cr;
+		c.RY[i] = p.LensCenter[1] + dy * cr;
+		c.BX[i] = p.LensCenter[0] + dx * cb;
+		c.BY[i] = p.LensCenter[1] + dy * cb;
+
+		// Blue is scaled out the furthest, so decides what is visible.
+		c.Inside[i] = (c.BX[i] >= p.ScreenMin[0] && c.BX[i] <= p.ScreenMax[0] &&
+		               c.BY[i] >= p.ScreenMin[1] && c.BY[i] <= p.ScreenMax[1]) ? ~0u : 0;
+	}
+}
+
+static inline UInt32 fetchTexel(const CpuImage& src, int x, int y)
+{
+	// Sample_ClampBorder, with a black border.
+	if ((unsigned)x >= (unsigned)src.Width || (unsigned)y >= (unsigned)src.Height)
+	{
+		return 0;
+	}
+	return src.pPixels[y * src.Pitch + x];
+}
+
+// (a * (256 - w) + b * w) >> 8 for each channel, two channels at a time.
+static inline UInt32 lerpTexel(UInt32 a, UInt32 b, UInt32 w)
+{
+	UInt32 rb = (((a & 0xFF00FF) * (256 - w) + (b & 0xFF00FF) * w) >> 8) & 0xFF00FF;
+	UInt32 ga = ((((a >> 8) & 0xFF00FF) * (256 - w) + ((b >> 8) & 0xFF00FF) * w) >> 8) & 0xFF00FF;
+	return rb | (ga << 8);
+}
+
+static inline UInt32 sampleBilinear(const CpuImage& src, const Params& p, float tx, float ty)
+{
+	// Texel centres are at half texel offsets. Coordinates are never below -1 here.
+	float fx = tx * p.SrcWidth - 0.5f;
+	float fy = ty * p.SrcHeight - 0.5f;
+	int   x0 = (int)(fx + 1.0f) - 1;
+	int   y0 = (int)(fy + 1.0f) - 1;
+	UInt32 wx = (UInt32)(int)((fx - float(x0)) * 256.0f);
+	UInt32 wy = (UInt32)(int)((fy - float(y0)) * 256.0f);
+
+	UInt32 top    = lerpTexel(fetchTexel(src, x0, y0),     fetchTexel(src, x0 + 1, y0),     wx);
+	UInt32 bottom = lerpTexel(fetchTexel(src, x0, y0 + 1), fetchTexel(src, x0 + 1, y0 + 1), wx);
+	return lerpTexel(top, bottom, wy);
+}
+
+static void sampleScalar(const CpuImage& src, const Params& p, const CoordChunk& c, int count, UInt32* dest)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (!c.Inside[i])
+		{
+			dest[i] = 0;
+			continue;
+		}
+
+		UInt32 green = sampleBilinear(src, p, c.GX[i], c.GY[i]);
+		if (p.UseChromAb)
+		{
+			UInt32 red  = sampleBilinear(src, p, c.RX[i], c.RY[i]);
+			UInt32 blue = sampleBilinear(src, p, c.BX[i], c.BY[i]);
+			green = (red & 0xFF) | (green & 0xFF00FF00) | (blue & 0xFF0000);
+		}
+		dest[i] = green;
+	}
+}
+
+static void coordsSSE2(const Params& p, int x, int y, int count, CoordChunk& c)
+{
+	const __m128 lcx  = _mm_set1_ps(p.LensCenter[0]), lcy  = _mm_set1_ps(p.LensCenter[1]);
+	const __m128 minx = _mm_set1_ps(p.ScreenMin[0]),  miny = _mm_set1_ps(p.ScreenMin[1]);
+	const __m128 maxx = _mm_set1_ps(p.ScreenMax[0]),  maxy = _mm_set1_ps(p.ScreenMax[1]);
+	const __m128 sx   = _mm_set1_ps(p.Scale[0]),      sy   = _mm_set1_ps(p.Scale[1]);
+	const __m128 k0   = _mm_set1_ps(p.HmdWarp[0]),    k1   = _mm_set1_ps(p.HmdWarp[1]);
+	const __m128 k2   = _mm_set1_ps(p.HmdWarp[2]),    k3   = _mm_set1_ps(p.HmdWarp[3]);
+	const __m128 ca0  = _mm_set1_ps(p.ChromAb[0]),    ca1  = _mm_set1_ps(p.ChromAb[1]);
+	const __m128 ca2  = _mm_set1_ps(p.ChromAb[2]),    ca3  = _mm_set1_ps(p.ChromAb[3]);
+	const __m128 thy  = _mm_set1_ps(((float(y) + 0.5f) * p.InvDestHeight - p.LensCenter[1]) * p.ScaleIn[1]);
+	const __m128 thy2 = _mm_mul_ps(thy, thy);
+
+	for (int i = 0; i < count; i += 4)
+	{
+		__m128 px  = _mm_add_ps(_mm_cvtepi32_ps(_mm_setr_epi32(x + i, x + i + 1, x + i + 2, x + i + 3)),
+		                        _mm_set1_ps(0.5f));
+		__m128 thx = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(px, _mm_set1_ps(p.InvDestWidth)), lcx),
+		                        _mm_set1_ps(p.ScaleIn[0]));
+		__m128 rsq = _mm_add_ps(_mm_mul_ps(thx, thx), thy2);
+		__m128 k   = _mm_add_ps(k0, _mm_mul_ps(rsq, _mm_add_ps(k1, _mm_mul_ps(rsq, _mm_add_ps(k2, _mm_mul_ps(rsq, k3))))));
+		__m128 dx  = _mm_mul_ps(_mm_mul_ps(thx, k), sx);
+		__m128 dy  = _mm_mul_ps(_mm_mul_ps(thy, k), sy);
+		__m128 cr  = _mm_add_ps(ca0, _mm_mul_ps(ca1, rsq));
+		__m128 cb  = _mm_add_ps(ca2, _mm_mul_ps(ca3, rsq));
+		__m128 bx  = _mm_add_ps(lcx, _mm_mul_ps(dx, cb));
+		__m128 by  = _mm_add_ps(lcy, _mm_mul_ps(dy, cb));
+
+		_mm_storeu_ps(c.GX + i, _mm_add_ps(lcx, dx));
+		_mm_storeu_ps(c.GY + i, _mm_add_ps(lcy, dy));
+		_mm_storeu_ps(c.RX + i, _mm_add_ps(lcx, _mm_mul_ps(dx, cr)));
+		_mm_storeu_ps(c.RY + i, _mm_add_ps(lcy, _mm_mul_ps(dy, cr)));
+		_mm_storeu_ps(c.BX + i, bx);
+		_mm_storeu_ps(c.BY + i, by);
+
+		__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(bx, minx), _mm_cmple_ps(bx, maxx)),
+		                           _mm_and_ps(_mm_cmpge_ps(by, miny), _mm_cmple_ps(by, maxy)));
+		_mm_storeu_ps((float*)(c.Inside + i), inside);
+	}
+}
+
+CPU_TARGET("avx")
+static void coordsAVX(const Params& p, int x, int y, int count, CoordChunk& c)
+{
+	const __m256 lcx  = _mm256_set1_ps(p.LensCenter[0]), lcy  = _mm256_set1_ps(p.LensCenter[1]);
+	const __m256 minx = _mm256_set1_ps(p.ScreenMin[0]),  miny = _mm256_set1_ps(p.ScreenMin[1]);
+	const __m256 maxx = _mm256_set1_ps(p.ScreenMax[0]),  maxy = _mm256_set1_ps(p.ScreenMax[1]);
+	const __m256 sx   = _mm256_set1_ps(p.Scale[0]),      sy   = _mm256_set1_ps(p.Scale[1]);
+	const __m256 k0   = _mm256_set1_ps(p.HmdWarp[0]),    k1   = _mm256_set1_ps(p.HmdWarp[1]);
+	const __m256 k2   = _mm256_set1_ps(p.HmdWarp[2]),    k3   = _mm256_set1_ps(p.HmdWarp[3]);
+	const __m256 ca0  = _mm256_set1_ps(p.ChromAb[0]),    ca1  = _mm256_set1_ps(p.ChromAb[1]);
+	const __m256 ca2  = _mm256_set1_ps(p.ChromAb[2]),    ca3  = _mm256_set1_ps(p.ChromAb[3]);
+	const __m256 thy  = _mm256_set1_ps(((float(y) + 0.5f) * p.InvDestHeight - p.LensCenter[1]) * p.ScaleIn[1]);
+	const __m256 thy2 = _mm256_mul_ps(thy, thy);
+	const __m256 step = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+
+	for (int i = 0; i < count; i += 8)
+	{
+		// float(x + i) + n + 0.5 is exact for any realistic x, so this matches the others.
+		__m256 px  = _mm256_add_ps(_mm256_set1_ps(float(x + i)), step);
+		__m256 thx = _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(px, _mm256_set1_ps(p.InvDestWidth)), lcx),
+		                           _mm256_set1_ps(p.ScaleIn[0]));
+		__m256 rsq = _mm256_add_ps(_mm256_mul_ps(thx, thx), thy2);
+		__m256 k   = _mm256_add_ps(k0, _mm256_mul_ps(rsq, _mm256_add_ps(k1, _mm256_mul_ps(rsq, _mm256_add_ps(k2, _mm256_mul_ps(rsq, k3))))));
+		__m256 dx  = _mm256_mul_ps(_mm256_mul_ps(thx, k), sx);
+		__m256 dy  = _mm256_mul_ps(_mm256_mul_ps(thy, k), sy);
+		__m256 cr  = _mm256_add_ps(ca0, _mm256_mul_ps(ca1, rsq));
+		__m256 cb  = _mm256_add_ps(ca2, _mm256_mul_ps(ca3, rsq));
+		__m256 bx  = _mm256_add_ps(lcx, _mm256_mul_ps(dx, cb));
+		__m256 by  = _mm256_add_ps(lcy, _mm256_mul_ps(dy, cb));
+
+		_mm256_storeu_ps(c.GX + i, _mm256_add_ps(lcx, dx));
+		_mm256_storeu_ps(c.GY + i, _mm256_add_ps(lcy, dy));
+		_mm256_storeu_ps(c.RX + i, _mm256_add_ps(lcx, _mm256_mul_ps(dx, cr)));
+		_mm256_storeu_ps(c.RY + i, _mm256_add_ps(lcy, _mm256_mul_ps(dy, cr)));
+		_mm256_storeu_ps(c.BX + i, bx);
+		_mm256_storeu_ps(c.BY + i, by);
+
+		__m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(bx, minx, _CMP_GE_OQ), _mm256_cmp_ps(bx, maxx, _CMP_LE_OQ)),
+		                              _mm256_and_ps(_mm256_cmp_ps(by, miny, _CMP_GE_OQ), _mm256_cmp_ps(by, maxy, _CMP_LE_OQ)));
+		_mm256_storeu_ps((float*)(c.Inside + i), inside);
+	}
+	// Sampling is SSE2; avoid the AVX to SSE transition penalty.
+	_mm256_zeroupper();
+}
+
+// Per channel (a * (256 - w) + b * w) >> 8 of four pixels, w being one weight per pixel.
+static inline __m128i lerpTexels4(__m128i a, __m128i b, __m128i w)
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	__m128i w16  = _mm_or_si128(w, _mm_slli_epi32(w, 16));
+	__m128i wlo  = _mm_unpacklo_epi32(w16, w16);
+	__m128i whi  = _mm_unpackhi_epi32(w16, w16);
+	__m128i iwlo = _mm_sub_epi16(_mm_set1_epi16(256), wlo);
+	__m128i iwhi = _mm_sub_epi16(_mm_set1_epi16(256), whi);
+
+	__m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), iwlo),
+	                           _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), wlo));
+	__m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), iwhi),
+	                           _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), whi));
+	return _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+}
+
+static inline __m128i sampleBilinear4(const CpuImage& src, const Params& p, const float* tx, const float* ty)
+{
+	const __m128  half = _mm_set1_ps(0.5f), one = _mm_set1_ps(1.0f);
+	const __m128i onei = _mm_set1_epi32(1);
+
+	__m128  fx = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(tx), _mm_set1_ps(p.SrcWidth)), half);
+	__m128  fy = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(ty), _mm_set1_ps(p.SrcHeight)), half);
+	__m128i x0 = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(fx, one)), onei);
+	__m128i y0 = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(fy, one)), onei);
+	__m128i wx = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(fx, _mm_cvtepi32_ps(x0)), _mm_set1_ps(256.0f)));
+	__m128i wy = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(fy, _mm_cvtepi32_ps(y0)), _mm_set1_ps(256.0f)));
+
+	int xs[4], ys[4];
+	_mm_storeu_si128((__m128i*)xs, x0);
+	_mm_storeu_si128((__m128i*)ys, y0);
+
+	// No gathers in SSE2.
+	UInt32 c00[4], c10[4], c01[4], c11[4];
+	for (int j = 0; j < 4; j++)
+	{
+		c00[j] = fetchTexel(src, xs[j],     ys[j]);
+		c10[j] = fetchTexel(src, xs[j] + 1, ys[j]);
+		c01[j] = fetchTexel(src, xs[j],     ys[j] + 1);
+		c11[j] = fetchTexel(src, xs[j] + 1, ys[j] + 1);
+	}
+
+	__m128i top    = lerpTexels4(_mm_loadu_si128((const __m128i*)c00), _mm_loadu_si128((const __m128i*)c10), wx);
+	__m128i bottom = lerpTexels4(_mm_loadu_si128((const __m128i*)c01), _mm_loadu_si128((const __m128i*)c11), wx);
+	return lerpTexels4(top, bottom, wy);
+}
+
+static void sampleSSE2(const CpuImage& src, const Params& p, const CoordChunk& c, int count, UInt32* dest)
+{
+	const __m128i redMask   = _mm_set1_epi32(0x000000FF);
+	const __m128i greenMask = _mm_set1_epi32(0xFF00FF00);
+	const __m128i blueMask  = _mm_set1_epi32(0x00FF0000);
+
+	UInt32 out[ChunkSize];
+	for (int i = 0; i < count; i += 4)
+	{
+		__m128i inside = _mm_loadu_si128((const __m128i*)(c.Inside + i));
+		if (_mm_movemask_epi8(inside) == 0)
+		{
+			_mm_storeu_si128((__m128i*)(out + i), inside);
+			continue;
+		}
+
+		__m128i color = sampleBilinear4(src, p, c.GX + i, c.GY + i);
+		if (p.UseChromAb)
+		{
+			__m128i red  = sampleBilinear4(src, p, c.RX + i, c.RY + i);
+			__m128i blue = sampleBilinear4(src, p, c.BX + i, c.BY + i);
+			color = _mm_or_si128(_mm_and_si128(color, greenMask),
+			                     _mm_or_si128(_mm_and_si128(red, redMask), _mm_and_si128(blue, blueMask)));
+		}
+		_mm_storeu_si128((__m128i*)(out + i), _mm_and_si128(color, inside));
+	}
+	memcpy(dest, out, count * sizeof(UInt32));
+}
+
+static const CoordFn CoordFns[CpuDistortion_Count] =
+{
+	coordsScalar, coordsSSE2, coordsAVX
+};
+
+static const SampleFn SampleFns[CpuDistortion_Count] =
+{
+	sampleScalar, sampleSSE2, sampleSSE2
+};
+
+static const char* ImplNames[CpuDistortion_Count] =
+{
+	"Scalar", "SSE2", "AVX"
+};
+
+
+//-------------------------------------------------------------------------------------
+// ***** CpuDistortion
+
+CpuDistortion::CpuDistortion()
+	: Impl(CpuDistortion_Scalar), JobGeneration(0), BusyWorkers(0), Exiting(false)
+{
+	for (int i = CpuDistortion_Count - 1; i > CpuDistortion_Scalar; i--)
+	{
+		if (IsImplSupported((CpuDistortionImpl)i))
+		{
+			Impl = (CpuDistortionImpl)i;
+			break;
+		}
+	}
+}
+
+CpuDistortion::~CpuDistortion()
+{
+	Stop();
+}
+
+bool CpuDistortion::Start(int threadCount)
+{
+	Stop();
+
+	if (threadCount <= 0)
+	{
+		threadCount = Thread::GetCPUCount();
+	}
+
+	// Workers start out having seen generation 0.
+	Exiting       = false;
+	JobGeneration = 0;
+	for (int i = 1; i < threadCount; i++)
+	{
+		Ptr<Thread> worker = *new Thread(workerFn, this);
+		if (!worker->Start())
+		{
+			// Don't leave a partial pool behind; Render runs on the caller alone.
+			Stop();
+			return false;
+		}
+		Workers.PushBack(worker);
+	}
+	return true;
+}
+
+void CpuDistortion::Stop()
+{
+	if (Workers.GetSize() == 0)
+	{
+		return;
+	}
+
+	{
+		Mutex::Locker lock(&JobLock);
+		Exiting = true;
+		JobReady.NotifyAll();
+	}
+	for (UPInt i = 0; i < Workers.GetSize(); i++)
+	{
+		while (!Workers[i]->IsFinished())
+		{
+			Thread::MSleep(1);
+		}
+	}
+	Workers.Clear();
+}
+
+bool CpuDistortion::IsImplSupported(CpuDistortionImpl impl)
+{
+	switch (impl)
+	{
+	case CpuDistortion_Scalar: return true;
+	case CpuDistortion_SSE2:   return HasCpuFeature(CpuFeature_SSE2);
+	case CpuDistortion_AVX:    return HasCpuFeature(CpuFeature_AVX);
+	default:                   return false;
+	}
+}
+
+const char* CpuDistortion::GetImplName(CpuDistortionImpl impl)
+{
+	return (impl >= CpuDistortion_Scalar && impl < CpuDistortion_Count) ? ImplNames[impl] : "Unknown";
+}
+
+bool CpuDistortion::SetImpl(CpuDistortionImpl impl)
+{
+	if (!IsImplSupported(impl))
+	{
+		return false;
+	}
+	Impl = impl;
+	return true;
+}
+
+void CpuDistortion::Render(const CpuImage& dest, const CpuImage& src, const Viewport& eyeVP,
+                           const DistortionConfig& distortion, bool chromAb)
+{
+	// Same setup as the shader uniforms in RenderDevice::FinishScene1.
+	float w = float(eyeVP.w) / float(dest.Width),
+	      h = float(eyeVP.h) / float(dest.Height),
+	      x = float(eyeVP.x) / float(dest.Width),
+	      y = float(eyeVP.y) / float(dest.Height);
+	float as = float(eyeVP.w) / float(eyeVP.h);
+	float scaleFactor = 1.0f / distortion.Scale;
+
+	Params& p = JobParams;
+	p.LensCenter[0] = x + (w + distortion.XCenterOffset * 0.5f)*0.5f;
+	p.LensCenter[1] = y + h*0.5f;
+	p.ScreenMin[0]  = x + w*0.5f - 0.25f;
+	p.ScreenMin[1]  = y + h*0.5f - 0.5f;
+	p.ScreenMax[0]  = x + w*0.5f + 0.25f;
+	p.ScreenMax[1]  = y + h*0.5f + 0.5f;
+	p.Scale[0]      = (w/2) * scaleFactor;
+	p.Scale[1]      = (h/2) * scaleFactor * as;
+	p.ScaleIn[0]    = (2/w);
+	p.ScaleIn[1]    = (2/h) / as;
+	for (int i = 0; i < 4; i++)
+	{
+		p.HmdWarp[i] = distortion.K[i];
+		p.ChromAb[i] = chromAb ? distortion.ChromaticAberration[i] : ((i & 1) ? 0.0f : 1.0f);
+	}
+	p.UseChromAb    = chromAb;
+	p.SrcWidth      = float(src.Width);
+	p.SrcHeight     = float(src.Height);
+	p.InvDestWidth  = 1.0f / float(dest.Width);
+	p.InvDestHeight = 1.0f / float(dest.Height);
+
+	JobDest = dest;
+	JobSrc  = src;
+	JobVP   = eyeVP;
+	NextRow = 0;
+
+	if (Workers.GetSize() == 0)
+	{
+		runRows();
+		return;
+	}
+
+	{
+		Mutex::Locker lock(&JobLock);
+		BusyWorkers = (int)Workers.GetSize();
+		JobGeneration++;
+		JobReady.NotifyAll();
+	}
+
+	runRows();
+
+	Mutex::Locker lock(&JobLock);
+	while (BusyWorkers > 0)
+	{
+		JobDone.Wait(&JobLock);
+	}
+}
+
+int CpuDistortion::workerFn(Thread* pthread, void* h)
+{
+	CpuDistortion* self = (CpuDistortion*)h;
+	pthread->SetThreadName("CpuDistortion");
+
+	UInt32 seenGeneration = 0;
+	for (;;)
+	{
+		{
+			Mutex::Locker lock(&self->JobLock);
+			while (self->JobGeneration == seenGeneration && !self->Exiting)
+			{
+				self->JobReady.Wait(&self->JobLock);
+			}
+			if (self->Exiting)
+			{
+				break;
+			}
+			seenGeneration = self->JobGeneration;
+		}
+
+		self->runRows();
+
+		Mutex::Locker lock(&self->JobLock);
+		if (--self->BusyWorkers == 0)
+		{
+			self->JobDone.Notify();
+		}
+	}
+	return 0;
+}
+
+void CpuDistortion::runRows()
+{
+	for (;;)
+	{
+		int row = NextRow.ExchangeAdd_Sync(RowsPerTask);
+		if (row >= JobVP.h)
+		{
+			break;
+		}
+
+		int end = Alg::Min(row + (int)RowsPerTask, JobVP.h);
+		for (; row < end; row++)
+		{
+			renderRow(JobVP.y + row);
+		}
+	}
+}
+
+void CpuDistortion::renderRow(int y)
+{
+	CoordFn  coords = CoordFns[Impl];
+	SampleFn sample = SampleFns[Impl];
+	UInt32*  dest   = JobDest.GetRow(y);
+
+	CoordChunk chunk;
+	for (int x = JobVP.x; x < JobVP.x + JobVP.w; x += ChunkSize)
+	{
+		int count = Alg::Min((int)ChunkSize, JobVP.x + JobVP.w - x);
+		coords(JobParams, x, y, count, chunk);
+		sample(JobSrc, JobParams, chunk, count, dest + x);
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+// ***** Benchmark and reference images
+
+// Checkerboard with colour gradients, so both the warp and the channel separation
+// show.
+static void fillTestImage(const CpuImage& image)
+{
+	for (int y = 0; y < image.Height; y++)
+	{
+		UInt32* row = image.GetRow(y);
+		for (int x = 0; x < image.Width; x++)
+		{
+			UInt32 r = (UInt32)(x * 255 / image.Width);
+			UInt32 b = (UInt32)(y * 255 / image.Height);
+			UInt32 g = (((x >> 5) + (y >> 5)) & 1) ? 0xFF : 0x20;
+			row[x] = r | (g << 8) | (b << 16) | 0xFF000000;
+		}
+	}
+}
+
+static int maxChannelDifference(const CpuImage& a, const CpuImage& b)
+{
+	int maxDiff = 0;
+	for (int y = 0; y < a.Height; y++)
+	{
+		const UByte* pa = (const UByte*)a.GetRow(y);
+		const UByte* pb = (const UByte*)b.GetRow(y);
+		for (int i = 0; i < a.Width * 4; i++)
+		{
+			maxDiff = Alg::Max(maxDiff, abs((int)pa[i] - (int)pb[i]));
+		}
+	}
+	return maxDiff;
+}
+
+// Both eyes of the test image, set up the way the renderer distorts them.
+struct DistortionTestScene
+{
+	Array<UInt32>    SrcPixels;
+	CpuImage         Src;
+	Viewport         Full;
+	Viewport         EyeVP[2];
+	DistortionConfig Distortion[2];
+
+	DistortionTestScene(StereoConfig& config)
+	{
+		Full = config.GetFullViewport();
+		int srcWidth  = (int)ceil(config.GetDistortionScale() * Full.w),
+		    srcHeight = (int)ceil(config.GetDistortionScale() * Full.h);
+		SrcPixels.Resize(srcWidth * srcHeight);
+		Src = CpuImage(&SrcPixels[0], srcWidth, srcHeight);
+		fillTestImage(Src);
+
+		Distortion[0] = Distortion[1] = config.GetDistortionConfig();
+		Distortion[1].XCenterOffset = -Distortion[1].XCenterOffset;
+		EyeVP[0] = config.GetEyeRenderParams(StereoEye_Left).VP;
+		EyeVP[1] = config.GetEyeRenderParams(StereoEye_Right).VP;
+	}
+
+	void Render(CpuDistortion& distorter, const CpuImage& dest) const
+	{
+		for (int eye = 0; eye < 2; eye++)
+		{
+			distorter.Render(dest, Src, EyeVP[eye], Distortion[eye], true);
+		}
+	}
+};
+
+void BenchmarkCpuDistortion(StereoConfig& config, const char* goldenPath)
+{
+	const int iterations = 10;
+
+	DistortionTestScene scene(config);
+	const Viewport&     full = scene.Full;
+
+	Array<UInt32> refPixels, destPixels;
+	refPixels.Resize(full.w * full.h);
+	destPixels.Resize(full.w * full.h);
+
+	CpuImage ref(&refPixels[0], full.w, full.h);
+	CpuImage dest(&destPixels[0], full.w, full.h);
+
+	double megapixels = double(scene.EyeVP[0].w * scene.EyeVP[0].h + scene.EyeVP[1].w * scene.EyeVP[1].h) *
+	                    iterations / 1000000.0;
+
+	LogText("\nCPU Distortion Benchmark\n------------------------\n");
+	LogText("%ix%i from %ix%i, chromatic aberration, %i frames\n", full.w, full.h,
+	        scene.Src.Width, scene.Src.Height, iterations);
+
+	CpuDistortion distorter;
+	double scalarMPps = 0;
+
+	for (int threaded = 0; threaded < 2; threaded++)
+	{
+		distorter.Start(threaded ? 0 : 1);
+
+		for (int i = 0; i < CpuDistortion_Count; i++)
+		{
+			CpuDistortionImpl impl = (CpuDistortionImpl)i;
+			if (!distorter.SetImpl(impl))
+			{
+				continue;
+			}
+
+			// The first scalar run is the reference the others are compared to.
+			const CpuImage& out = (impl == CpuDistortion_Scalar && !threaded) ? ref : dest;
+			memset(out.pPixels, 0xCD, out.Height * out.Pitch * sizeof(UInt32));
+
+			UInt64 start = Timer::GetTicks();
+			for (int n = 0; n < iterations; n++)
+			{
+				scene.Render(distorter, out);
+			}
+			double seconds = double(Timer::GetTicks() - start) / Timer::MksPerSecond;
+			double mpps    = megapixels / seconds;
+			if (impl == CpuDistortion_Scalar && !threaded)
+			{
+				scalarMPps = mpps;
+			}
+
+			LogText("%-6s %2i thread(s): %7.1f MP/s (%5.2fx scalar), max diff %i\n",
+			        CpuDistortion::GetImplName(impl), distorter.GetThreadCount(), mpps,
+			        mpps / scalarMPps, (&out == &ref) ? 0 : maxChannelDifference(ref, dest));
+		}
+	}
+	distorter.Stop();
+
+	if (goldenPath)
+	{
+		if (SaveCpuImageTga(goldenPath, ref))
+			LogText("Reference image saved to %s\n", goldenPath);
+		else
+			LogText("Couldn't save reference image to %s\n", goldenPath);
+	}
+}
+
+bool CheckCpuDistortion(StereoConfig& config, const char* goldenPath)
+{
+	// Other compilers may round the last bit of a channel differently.
+	const int tolerance = 1;
+
+	LogText("\nCPU Distortion Check\n--------------------\n");
+
+	DistortionTestScene scene(config);
+	Array<UInt32>       goldenPixels;
+	int                 goldenWidth = 0, goldenHeight = 0;
+	if (!LoadCpuImageTga(goldenPath, &goldenPixels, &goldenWidth, &goldenHeight))
+	{
+		LogText("Couldn't load reference image %s\n", goldenPath);
+		return false;
+	}
+	if (goldenWidth != scene.Full.w || goldenHeight != scene.Full.h)
+	{
+		LogText("Reference image %s is %ix%i, the output %ix%i\n", goldenPath,
+		        goldenWidth, goldenHeight, scene.Full.w, scene.Full.h);
+		return false;
+	}
+	LogText("%ix%i against %s, within %i per channel\n", scene.Full.w, scene.Full.h, goldenPath, tolerance);
+
+	Array<UInt32> destPixels;
+	destPixels.Resize(scene.Full.w * scene.Full.h);
+	CpuImage golden(&goldenPixels[0], goldenWidth, goldenHeight);
+	CpuImage dest(&destPixels[0], scene.Full.w, scene.Full.h);
+
+	CpuDistortion distorter;
+	bool          ok = true;
+	for (int threaded = 0; threaded < 2; threaded++)
+	{
+		if (!distorter.Start(threaded ? 0 : 1))
+		{
+			LogText("Couldn't start the distortion threads\n");
+			return false;
+		}
+
+		for (int i = 0; i < CpuDistortion_Count; i++)
+		{
+			CpuDistortionImpl impl = (CpuDistortionImpl)i;
+			if (!distorter.SetImpl(impl))
+			{
+				continue;
+			}
+
+			memset(dest.pPixels, 0xCD, dest.Height * dest.Pitch * sizeof(UInt32));
+			scene.Render(distorter, dest);
+
+			int diff = maxChannelDifference(golden, dest);
+			LogText("%-6s %2i thread(s): max diff %i, %s\n", CpuDistortion::GetImplName(impl),
+			        distorter.GetThreadCount(), diff, diff <= tolerance ? "matches" : "DIFFERS");
+			ok = ok && diff <= tolerance;
+		}
+	}
+	distorter.Stop();
+	return ok;
+}
+
+// Twice the signed area of a triangle; positive when it is clockwise on screen, y down.
+static float triangleCross(const Vector2f& a, const Vector2f& b, const Vector2f& c)
+{
+	return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+// Checks one eye's mesh against DistortionFn, and its triangles. Returns the number
+// of problems found, logging the first of each kind.
+static int checkEyeDistortionMesh(const DistortionConfig& distortion, const Viewport& vp,
+                                  const Viewport& full, int gridW, int gridH)
+{
+	DistortionMesh mesh;
+	mesh.Generate(distortion, vp, full.w, full.h, gridW, gridH);
+	int stride = gridW + 1;
+	if (mesh.GridW != gridW || mesh.GridH != gridH || (int)mesh.Vertices.GetSize() != stride * (gridH + 1))
+	{
+		LogText("%ix%i grid: %u vertices\n", gridW, gridH, (UInt32)mesh.Vertices.GetSize());
+		return 1;
+	}
+
+	// The shader's uniforms, as RenderDevice::FinishScene1 sets them.
+	float w = float(vp.w) / float(full.w),
+	      h = float(vp.h) / float(full.h),
+	      x = float(vp.x) / float(full.w),
+	      y = float(vp.y) / float(full.h);
+	float    as = float(vp.w) / float(vp.h);
+	Vector2f lensCenter(x + (w + distortion.XCenterOffset * 0.5f)*0.5f, y + h*0.5f);
+	Vector2f scale((w/2) / distortion.Scale, (h/2) / distortion.Scale * as);
+	Vector2f scaleIn((2/w), (2/h) / as);
+
+	// Every vertex on the grid over the viewport, with its texture coordinates the
+	// same direction from the lens centre as it, at the distorted radius.
+	int errors = 0;
+	for (int j = 0; j <= gridH; j++)
+	{
+		for (int i = 0; i <= gridW; i++)
+		{
+			const DistortionMeshVertex& v = mesh.Vertices[j * stride + i];
+			Vector2f pos(x + w * float(i) / float(gridW), y + h * float(j) / float(gridH));
+
+			Vector2f theta((pos.x - lensCenter.x) * scaleIn.x, (pos.y - lensCenter.y) * scaleIn.y);
+			Vector2f thetaG((v.TexG.x - lensCenter.x) / scale.x, (v.TexG.y - lensCenter.y) / scale.y);
+			Vector2f thetaR((v.TexR.x - lensCenter.x) / scale.x, (v.TexR.y - lensCenter.y) / scale.y);
+			Vector2f thetaB((v.TexB.x - lensCenter.x) / scale.x, (v.TexB.y - lensCenter.y) / scale.y);
+			float r   = theta.Length();
+			float rsq = r * r;
+			float rG  = distortion.DistortionFn(r);
+
+			float tolerance = 1e-4f * Alg::Max(1.0f, rG);
+			bool  ok = fabsf(v.Pos.x - pos.x) <= 1e-6f && fabsf(v.Pos.y - pos.y) <= 1e-6f &&
+			           fabsf(thetaG.Length() - rG) <= tolerance &&
+			           fabsf(thetaR.Length() - rG * distortion.ChromAbScaleRedRSq(rsq)) <= tolerance &&
+			           fabsf(thetaB.Length() - rG * distortion.ChromAbScaleBlueRSq(rsq)) <= tolerance &&
+			           fabsf(theta.x * thetaG.y - theta.y * thetaG.x) <= tolerance * Alg::Max(1.0f, r) &&
+			           theta.Dot(thetaG) >= 0;
+			if (!ok && errors++ == 0)
+			{
+				LogText("%ix%i grid: vertex (%i, %i) at r %.4f has texture coordinates at r %.4f, %.4f, "
+				        "%.4f (red, green, blue), DistortionFn gives %.4f, %.4f, %.4f\n",
+				        gridW, gridH, i, j, r, thetaR.Length(), thetaG.Length(), thetaB.Length(),
+				        rG * distortion.ChromAbScaleRedRSq(rsq), rG, rG * distortion.ChromAbScaleBlueRSq(rsq));
+			}
+		}
+	}
+
+	// Two clockwise triangles a cell, covering the viewport once, that stay clockwise in
+	// the texture so the distortion doesn't fold the mesh over. Indices are appended
+	// after baseVertex is added.
+	const int     baseVertex = 5;
+	Array<UInt16> indices;
+	indices.PushBack(0);
+	mesh.GetTriangleIndices(indices, baseVertex);
+	if ((int)indices.GetSize() != 1 + gridW * gridH * 6)
+	{
+		LogText("%ix%i grid: %u indices\n", gridW, gridH, (UInt32)indices.GetSize() - 1);
+		return errors + 1;
+	}
+
+	Array<UInt32> edges;
+	float area = 0;
+	int   badTriangles = 0;
+	for (UPInt t = 1; t < indices.GetSize(); t += 3)
+	{
+		int corner[3];
+		for (int k = 0; k < 3; k++)
+			corner[k] = indices[t + k] - baseVertex;
+		if (corner[0] < 0 || corner[1] < 0 || corner[2] < 0 ||
+		    corner[0] >= (int)mesh.Vertices.GetSize() || corner[1] >= (int)mesh.Vertices.GetSize() ||
+		    corner[2] >= (int)mesh.Vertices.GetSize())
+		{
+			badTriangles++;
+			continue;
+		}
+
+		const DistortionMeshVertex& a = mesh.Vertices[corner[0]];
+		const DistortionMeshVertex& b = mesh.Vertices[corner[1]];
+		const DistortionMeshVertex& c = mesh.Vertices[corner[2]];
+		float cross = triangleCross(a.Pos, b.Pos, c.Pos);
+		area += cross * 0.5f;
+		if (cross <= 0 || triangleCross(a.TexG, b.TexG, c.TexG) <= 0)
+			badTriangles++;
+
+		for (int k = 0; k < 3; k++)
+		{
+			int e0 = corner[k], e1 = corner[(k + 1) % 3];
+			edges.PushBack(e0 < e1 ? (UInt32)(e0 << 16 | e1) : (UInt32)(e1 << 16 | e0));
+		}
+	}
+	if (badTriangles)
+	{
+		LogText("%ix%i grid: %i triangles out of range, counter-clockwise or folded over\n",
+		        gridW, gridH, badTriangles);
+		errors += badTriangles;
+	}
+	if (fabsf(area - w * h) > 1e-4f * w * h)
+	{
+		LogText("%ix%i grid: triangles cover %.6f of the target, the viewport %.6f\n", gridW, gridH, area, w * h);
+		errors++;
+	}
+
+	// Inside, every edge is shared by two triangles; around the viewport, by one.
+	Alg::QuickSort(edges);
+	int boundary = 0, badEdges = 0;
+	for (UPInt e = 0; e < edges.GetSize(); )
+	{
+		UPInt run = 1;
+		while (e + run < edges.GetSize() && edges[e + run] == edges[e])
+			run++;
+
+		int e0 = edges[e] >> 16, e1 = edges[e] & 0xFFFF;
+		int i0 = e0 % stride, j0 = e0 / stride, i1 = e1 % stride, j1 = e1 / stride;
+		bool onBoundary = (i0 == i1 && (i0 == 0 || i0 == gridW)) ||
+		                  (j0 == j1 && (j0 == 0 || j0 == gridH));
+		if (run != (onBoundary ? 1u : 2u))
+			badEdges++;
+		if (onBoundary)
+			boundary++;
+		e += run;
+	}
+	if (badEdges || boundary != 2 * (gridW + gridH))
+	{
+		LogText("%ix%i grid: %i edges shared by the wrong number of triangles, %i on the boundary\n",
+		        gridW, gridH, badEdges, boundary);
+		errors += badEdges + 1;
+	}
+	return errors;
+}
+
+bool CheckDistortionMesh(StereoConfig& config)
+{
+	LogText("\nDistortion Mesh Check\n---------------------\n");
+
+	DistortionTestScene scene(config);
+	static const int grids[][2] = { { 32, 32 }, { 7, 5 }, { 1, 1 } };
+
+	int errors = 0;
+	for (int g = 0; g < 3; g++)
+	{
+		for (int eye = 0; eye < 2; eye++)
+		{
+			errors += checkEyeDistortionMesh(scene.Distortion[eye], scene.EyeVP[eye], scene.Full,
+			                                 grids[g][0], grids[g][1]);
+
+			// And with the DK1's chromatic aberration, so red and blue differ.
+			DistortionConfig chromAb = scene.Distortion[eye];
+			chromAb.SetChromaticAberration(0.996f, -0.004f, 1.014f, 0.0f);
+			errors += checkEyeDistortionMesh(chromAb, scene.EyeVP[eye], scene.Full,
+			                                 grids[g][0], grids[g][1]);
+		}
+	}
+
+	LogText("%ix%i target, both eyes at 32x32, 7x5 and 1x1, with and without chromatic "
+	        "aberration: %s\n", scene.Full.w, scene.Full.h, errors ? "FAILED" : "ok");
+	return errors == 0;
+}
+
+bool SaveCpuImageTga(const char* path, const CpuImage& image)
+{
+	SysFile file;
+	if (!file.Open(path, File::Open_Write | File::Open_Create | File::Open_Truncate))
+	{
+		return false;
+	}
+
+	// Uncompressed true colour, 8 bits of alpha, rows top-down.
+	UByte header[18];
+	memset(header, 0, sizeof(header));
+	header[2]  = 2;
+	header[12] = (UByte)(image.Width & 0xFF);
+	header[13] = (UByte)(image.Width >> 8);
+	header[14] = (UByte)(image.Height & 0xFF);
+	header[15] = (UByte)(image.Height >> 8);
+	header[16] = 32;
+	header[17] = 0x28;
+	bool ok = file.Write(header, sizeof(header)) == sizeof(header);
+
+	// TGA stores BGRA.
+	Array<UInt32> row;
+	row.Resize(image.Width);
+	for (int y = 0; ok && y < image.Height; y++)
+	{
+		SwizzleCopyBGRA(&row[0], image.GetRow(y), image.Width);
+		int size = image.Width * 4;
+		ok = file.Write((const UByte*)&row[0], size) == size;
+	}
+
+	file.Close();
+	return ok;
+}
+
+bool LoadCpuImageTga(const char* path, Array<UInt32>* pixels, int* width, int* height)
+{
+	SysFile file;
+	if (!file.Open(path, File::Open_Read))
+	{
+		return false;
+	}
+
+	// Only what SaveCpuImageTga writes: uncompressed, 32 bit, rows top-down.
+	UByte header[18];
+	if (file.Read(header, sizeof(header)) != sizeof(header) ||
+	    header[2] != 2 || header[16] != 32 || !(header[17] & 0x20))
+	{
+		return false;
+	}
+	file.SkipBytes(header[0]);
+
+	int w = header[12] | (header[13] << 8),
+	    h = header[14] | (header[15] << 8);
+	pixels->Resize(w * h);
+	if (w * h == 0 || file.Read((UByte*)&(*pixels)[0], w * h * 4) != w * h * 4)
+	{
+		return false;
+	}
+
+	// TGA stores BGRA.
+	SwizzleBGRA(&(*pixels)[0], w * h);
+	*width  = w;
+	*height = h;
+	return true;
+}
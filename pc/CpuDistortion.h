@@ -0,0 +1,127 @@
+#ifndef CPU_DISTORTION_H
+#define CPU_DISTORTION_H
+
+#include "OVR.h"
+#include <Kernel/OVR_Threads.h>
+
+// CPU version of the lens distortion post-process in RenderDevice::FinishScene1, as
+// a fallback for machines without a usable GPU and for producing reference images of
+// what the distortion shaders and mesh should output.
+//
+// Pixels are 32 bit RGBA with rows top-down, as in the D3D renderer. The distortion
+// is symmetric vertically, so the GL output only differs by its row order.
+
+struct CpuImage
+{
+	OVR::UInt32* pPixels;
+	int          Width, Height;
+	int          Pitch;          // In pixels
+
+	CpuImage() : pPixels(0), Width(0), Height(0), Pitch(0) {}
+	CpuImage(OVR::UInt32* pixels, int width, int height, int pitch = 0)
+		: pPixels(pixels), Width(width), Height(height), Pitch(pitch ? pitch : width) {}
+
+	OVR::UInt32* GetRow(int y) const { return pPixels + y * Pitch; }
+};
+
+enum CpuDistortionImpl
+{
+	CpuDistortion_Scalar,
+	CpuDistortion_SSE2,     // 4 pixels at a time
+	CpuDistortion_AVX,      // 8 pixels at a time for the coordinates, sampling as SSE2
+	CpuDistortion_Count
+};
+
+class CpuDistortion
+{
+public:
+	CpuDistortion();
+	~CpuDistortion();
+
+	// Starts threadCount - 1 worker threads; the thread calling Render does its share
+	// too. 0 uses one thread per CPU. Without Start, Render runs on the calling thread.
+	bool    Start(int threadCount = 0);
+	void    Stop();
+	int     GetThreadCount() const { return (int)Workers.GetSize() + 1; }
+
+	// Implementation in use; defaults to the fastest one the CPU supports.
+	CpuDistortionImpl GetImpl() const { return Impl; }
+	bool    SetImpl(CpuDistortionImpl impl);
+
+	static bool        IsImplSupported(CpuDistortionImpl impl);
+	static const char* GetImplName(CpuDistortionImpl impl);
+
+	// Distorts the scene in src into the eyeVP area of dest, like FinishScene1 does
+	// with the scene texture. eyeVP is in dest pixels; src is the scene render target
+	// and may be larger than dest (see StereoConfig::GetDistortionScale). distortion is
+	// the eye's own, with XCenterOffset mirrored for the right eye as
+	// RenderDevice::SetDistortionConfig does. Pixels outside the lens are black.
+	void    Render(const CpuImage& dest, const CpuImage& src,
+	               const OVR::Util::Render::Viewport& eyeVP,
+	               const OVR::Util::Render::DistortionConfig& distortion, bool chromAb);
+
+	// Shader parameters of a render, in [0,1] units of the render target.
+	struct Params
+	{
+		float LensCenter[2];
+		float ScreenMin[2], ScreenMax[2];   // The eye's half of the screen
+		float Scale[2], ScaleIn[2];
+		float HmdWarp[4];
+		float ChromAb[4];                   // (1,0,1,0) without chromatic aberration
+		bool  UseChromAb;
+		float SrcWidth, SrcHeight;
+		float InvDestWidth, InvDestHeight;
+	};
+
+private:
+	static int  workerFn(OVR::Thread* pthread, void* h);
+	void        runRows();
+	void        renderRow(int y);
+
+	enum { RowsPerTask = 4 };
+
+	CpuDistortionImpl                    Impl;
+	OVR::Array<OVR::Ptr<OVR::Thread> >   Workers;
+
+	// Current job. Rows are handed out through NextRow; the job is done when every
+	// worker has seen it through (BusyWorkers is back to 0).
+	Params                               JobParams;
+	CpuImage                             JobDest, JobSrc;
+	OVR::Util::Render::Viewport          JobVP;
+	OVR::AtomicInt<int>                  NextRow;
+
+	OVR::Mutex                           JobLock;
+	OVR::WaitCondition                   JobReady, JobDone;
+	OVR::UInt32                          JobGeneration;
+	int                                  BusyWorkers;
+	bool                                 Exiting;
+};
+
+// Renders both eyes of a generated test image with every implementation the CPU
+// supports, single threaded and with a thread per CPU, and logs the megapixels per
+// second of each next to the scalar version, along with the largest difference of
+// any channel from the scalar output. If goldenPath is given, the scalar output is
+// saved there as a reference image.
+void BenchmarkCpuDistortion(OVR::Util::Render::StereoConfig& config, const char* goldenPath = 0);
+
+// Renders both eyes of the same test image with every implementation the CPU supports,
+// single threaded and with a thread per CPU, and compares each output with the
+// reference image at goldenPath, as saved by BenchmarkCpuDistortion with the same
+// config. Logs the largest channel difference of each, and returns false if any is
+// more than 1 or the reference couldn't be loaded or is a different size.
+bool CheckCpuDistortion(OVR::Util::Render::StereoConfig& config, const char* goldenPath);
+
+// Generates DistortionMesh for both eyes of config at a few grid sizes and checks that
+// the vertices lie on the grid over the eye's viewport with the texture coordinates of
+// every channel where DistortionConfig::DistortionFn puts them, and that the triangles
+// from GetTriangleIndices are clockwise, cover the viewport once, share every inner edge
+// with one neighbour and don't fold over in the texture. Returns false on any mismatch.
+bool CheckDistortionMesh(OVR::Util::Render::StereoConfig& config);
+
+// Writes a 32 bit uncompressed TGA.
+bool SaveCpuImageTga(const char* path, const CpuImage& image);
+
+// Reads a TGA as written by SaveCpuImageTga into pixels, as RGBA.
+bool LoadCpuImageTga(const char* path, OVR::Array<OVR::UInt32>* pixels, int* width, int* height);
+
+#endif
@@ -0,0 +1,61 @@
+#include "CpuFeatures.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+static void cpuid(int leaf, int subleaf, int regs[4])
+{
+#if defined(_MSC_VER)
+	__cpuidex(regs, leaf, subleaf);
+#else
+	unsigned a = 0, b = 0, c = 0, d = 0;
+	__cpuid_count(leaf, subleaf, a, b, c, d);
+	regs[0] = (int)a; regs[1] = (int)b; regs[2] = (int)c; regs[3] = (int)d;
+#endif
+}
+
+static unsigned long long xgetbv0()
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	unsigned a, d;
+	__asm__ volatile ("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+	return ((unsigned long long)d << 32) | a;
+#endif
+}
+
+bool HasCpuFeature(CpuFeature feature)
+{
+	int regs[4];
+	cpuid(0, 0, regs);
+	int maxLeaf = regs[0];
+
+	cpuid(1, 0, regs);
+	bool sse2  = (regs[3] & (1 << 26)) != 0;
+	bool ssse3 = (regs[2] & (1 << 9)) != 0;
+	bool avx   = (regs[2] & (1 << 28)) != 0;
+
+	// The OS also has to save the YMM registers on context switches.
+	bool osxsave = (regs[2] & (1 << 27)) != 0;
+	bool ymm     = osxsave && (xgetbv0() & 0x6) == 0x6;
+
+	switch (feature)
+	{
+	case CpuFeature_SSE2:  return sse2;
+	case CpuFeature_SSSE3: return ssse3;
+	case CpuFeature_AVX:   return avx && ymm;
+	case CpuFeature_AVX2:
+		if (!ymm || maxLeaf < 7)
+		{
+			return false;
+		}
+		cpuid(7, 0, regs);
+		return (regs[1] & (1 << 5)) != 0;
+	default:
+		return false;
+	}
+}
@@ -0,0 +1,27 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+// x86 instruction set extensions, for picking SIMD code paths at run time.
+
+enum CpuFeature
+{
+	CpuFeature_SSE2,
+	CpuFeature_SSSE3,
+	CpuFeature_AVX,
+	CpuFeature_AVX2
+};
+
+// True if both the CPU and the OS support the feature (the OS has to save the YMM
+// registers for AVX).
+bool HasCpuFeature(CpuFeature feature);
+
+// Functions using instructions beyond the compiler's baseline are marked with
+// CPU_TARGET("avx2") and so on. GCC/Clang only emit such instructions in functions
+// that ask for them; MSVC emits whatever intrinsics are used.
+#if defined(_MSC_VER)
+#define CPU_TARGET(x)
+#else
+#define CPU_TARGET(x) __attribute__((target(x)))
+#endif
+
+#endif
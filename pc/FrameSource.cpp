@@ -0,0 +1,432 @@
+#include "FrameSource.h"
+#include "Swizzle.h"
+
+#include <Kernel/OVR_SysFile.h>
+#include <Kernel/OVR_Log.h>
+#include <string.h>
+
+using namespace OVR;
+
+
+//-------------------------------------------------------------------------------------
+// ***** FrameTripleBuffer
+
+FrameTripleBuffer::FrameTripleBuffer()
+	: pStorage(0), Capacity(0), BackIndex(0), FrontIndex(1), Middle(2), Sequence(0), Dropped(0)
+{
+}
+
+FrameTripleBuffer::~FrameTripleBuffer()
+{
+	if (pStorage)
+	{
+		OVR_FREE_ALIGNED(pStorage);
+	}
+}
+
+bool FrameTripleBuffer::Init(int width, int height, int bytesPerPixel)
+{
+	OVR_ASSERT(!pStorage);
+
+	// Keep every frame 64 byte aligned for the vector copy routines.
+	Capacity = (width * height * bytesPerPixel + 63) & ~63;
+	pStorage = (UByte*)OVR_ALLOC_ALIGNED(Capacity * 3, 64);
+	if (!pStorage)
+	{
+		return false;
+	}
+
+	for (int i = 0; i < 3; i++)
+	{
+		Frames[i].pData  = pStorage + Capacity * i;
+		Frames[i].Width  = width;
+		Frames[i].Height = height;
+	}
+	return true;
+}
+
+void FrameTripleBuffer::EndWrite(int size, UInt64 captureTicks)
+{
+	VideoFrame& frame  = Frames[BackIndex];
+	frame.Size         = size;
+	frame.CaptureTicks = captureTicks;
+	frame.Sequence     = Sequence.ExchangeAdd_Sync(1) + 1;
+
+	// Publish the back buffer and take whatever was in the middle as the new back buffer.
+	UInt32 old = Middle.Exchange_Sync(BackIndex | Fresh);
+	if (old & Fresh)
+	{
+		Dropped++;
+	}
+	BackIndex = old & IndexMask;
+}
+
+VideoFrame* FrameTripleBuffer::AcquireLatest()
+{
+	if (!(Middle.Load_Acquire() & Fresh))
+	{
+		return 0;
+	}
+
+	// Only the producer can change Middle from here on, and it always leaves it Fresh.
+	UInt32 old = Middle.Exchange_Sync(FrontIndex);
+	FrontIndex = old & IndexMask;
+	return &Frames[FrontIndex];
+}
+
+
+//-------------------------------------------------------------------------------------
+// ***** FrameSource
+
+bool FrameSource::initBuffer(int width, int height, FramePixelFormat format)
+{
+	Width       = width;
+	Height      = height;
+	PixelFormat = format;
+	BufferReady = Buffer.Init(width, height, GetFrameBytesPerPixel(format));
+	return BufferReady;
+}
+
+void FrameSource::DeliverFrame(const void* data, int size, UInt64 captureTicks)
+{
+	if (size > Buffer.GetCapacity())
+	{
+		size = Buffer.GetCapacity();
+	}
+
+	if (SwapRedBlue && PixelFormat == FramePixel_BGRA)
+	{
+		// The copy out of the capture buffer has to happen anyway, so convert on the way.
+		SwizzleCopyBGRA(Buffer.BeginWrite(), data, size / 4);
+	}
+	else
+	{
+		memcpy(Buffer.BeginWrite(), data, size);
+	}
+	Buffer.EndWrite(size, captureTicks);
+}
+
+
+//-------------------------------------------------------------------------------------
+// ***** PacedFrameSource
+
+PacedFrameSource::PacedFrameSource(int width, int height, FramePixelFormat format, float framesPerSecond)
+	: FramesPerSecond(framesPerSecond)
+{
+	// Start fails if this does.
+	initBuffer(width, height, format);
+}
+
+PacedFrameSource::~PacedFrameSource()
+{
+	Stop();
+}
+
+bool PacedFrameSource::Start()
+{
+	if (pThread)
+	{
+		return true;
+	}
+	if (!BufferReady)
+	{
+		return false;
+	}
+
+	pThread = *new Thread(threadFn, this);
+	if (!pThread->Start())
+	{
+		pThread.Clear();
+		return false;
+	}
+	return true;
+}
+
+void PacedFrameSource::Stop()
+{
+	if (!pThread)
+	{
+		return;
+	}
+
+	pThread->SetExitFlag(true);
+	while (!pThread->IsFinished())
+	{
+		Thread::MSleep(1);
+	}
+	pThread.Clear();
+}
+
+int PacedFrameSource::threadFn(Thread* pthread, void* h)
+{
+	PacedFrameSource* self = (PacedFrameSource*)h;
+	pthread->SetThreadName("FrameSource");
+
+	UInt64 period = (UInt64)(Timer::MksPerSecond / self->FramesPerSecond);
+	UInt64 next   = Timer::GetTicks();
+
+	while (!pthread->GetExitFlag())
+	{
+		UByte* dest = self->Buffer.BeginWrite();
+		int    size = self->produceFrame(dest, self->Buffer.GetCapacity());
+		if (size <= 0)
+		{
+			break;
+		}
+		if (self->SwapRedBlue && self->PixelFormat == FramePixel_BGRA)
+		{
+			SwizzleBGRA(dest, size / 4);
+		}
+		self->Buffer.EndWrite(size, Timer::GetTicks());
+
+		next += period;
+		UInt64 now = Timer::GetTicks();
+		if (next > now)
+		{
+			Thread::MSleep((unsigned)((next - now) / Timer::MksPerMs));
+		}
+		else
+		{
+			// Fell behind; don't try to catch up with a burst of frames.
+			next = now;
+		}
+	}
+	return 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+// ***** SyntheticFrameSource
+
+int SyntheticFrameSource::produceFrame(UByte* dest, int capacity)
+{
+	int size = Width * Height * GetFrameBytesPerPixel(PixelFormat);
+	OVR_ASSERT(size <= capacity);
+	OVR_UNUSED(capacity);
+
+	// Diagonal gradient scrolling one pixel per frame, with a bar sweeping
+	// across so dropped or torn frames are easy to spot.
+	int bar = (int)(FrameIndex * 4 % Width);
+
+	if (PixelFormat != FramePixel_BGRA)
+	{
+		// Same pattern in luma, with chroma varying down the frame.
+		int yOffset = (PixelFormat == FramePixel_YUY2) ? 0 : 1;
+		for (int y = 0; y < Height; y++)
+		{
+			UByte* row = dest + y * Width * 2;
+			UByte  u   = (UByte)(y * 255 / Height);
+			for (int x = 0; x < Width; x++)
+			{
+				bool onBar = (x >= bar && x < bar + 8);
+				row[x * 2 + yOffset]     = onBar ? 235 : (UByte)(16 + (UByte)(x + y + FrameIndex) * 219 / 255);
+				row[x * 2 + 1 - yOffset] = (x & 1) ? (UByte)(255 - u) : u;
+			}
+		}
+
+		FrameIndex++;
+		return size;
+	}
+
+	for (int y = 0; y < Height; y++)
+	{
+		UByte* row = dest + y * Width * 4;
+		for (int x = 0; x < Width; x++)
+		{
+			UByte v = (UByte)(x + y + FrameIndex);
+			bool  onBar = (x >= bar && x < bar + 8);
+			row[x * 4 + 0] = onBar ? 255 : v;
+			row[x * 4 + 1] = onBar ? 255 : (UByte)(y * 255 / Height);
+			row[x * 4 + 2] = onBar ? 255 : (UByte)(255 - v);
+			row[x * 4 + 3] = 255;
+		}
+	}
+
+	FrameIndex++;
+	return size;
+}
+
+
+//-------------------------------------------------------------------------------------
+// ***** FileFrameSource
+
+FileFrameSource::FileFrameSource(const char* path, int width, int height, FramePixelFormat format,
+                                 float framesPerSecond)
+	: PacedFrameSource(width, height, format, framesPerSecond), Path(path)
+{
+}
+
+bool FileFrameSource::Start()
+{
+	pFile = *new SysFile(Path);
+	if (!pFile->IsValid() || pFile->GetLength() < Width * Height * GetFrameBytesPerPixel(PixelFormat))
+	{
+		pFile.Clear();
+		return false;
+	}
+	return PacedFrameSource::Start();
+}
+
+int FileFrameSource::produceFrame(UByte* dest, int capacity)
+{
+	int size = Width * Height * GetFrameBytesPerPixel(PixelFormat);
+	OVR_ASSERT(size <= capacity);
+	OVR_UNUSED(capacity);
+
+	if (pFile->Read(dest, size) < size)
+	{
+		pFile->Seek(0);
+		if (pFile->Read(dest, size) < size)
+		{
+			return 0;
+		}
+	}
+	return size;
+}
+
+
+//-------------------------------------------------------------------------------------
+// ***** Benchmark
+
+// Regenerates any frame a SyntheticFrameSource delivers, to compare against.
+class SyntheticReferenceFrames : public SyntheticFrameSource
+{
+public:
+	SyntheticReferenceFrames(int width, int height, FramePixelFormat format)
+		: SyntheticFrameSource(width, height, format) {}
+
+	int Generate(UByte* dest, int capacity, UInt32 frameIndex)
+	{
+		FrameIndex = frameIndex;
+		return produceFrame(dest, capacity);
+	}
+};
+
+bool BenchmarkFramePipeline(float seconds)
+{
+	struct Case
+	{
+		const char*      Name;
+		FramePixelFormat Format;
+		bool             SwapRedBlue;
+		float            FramesPerSecond;
+	};
+	static const Case cases[] =
+	{
+		{ "BGRA 30 fps",      FramePixel_BGRA, false, 30.0f  },
+		{ "BGRA>RGBA 30 fps", FramePixel_BGRA, true,  30.0f  },
+		{ "YUY2 30 fps",      FramePixel_YUY2, false, 30.0f  },
+		{ "BGRA 120 fps",     FramePixel_BGRA, false, 120.0f }
+	};
+	enum { SourceCount = 2, Width = 720, Height = 576 };
+	const UInt64 renderPeriod = Timer::MksPerSecond / 60;
+
+	LogText("\nFrame Pipeline Benchmark\n------------------------\n");
+	LogText("%i synthetic sources at %ix%i, picked up by a 60 Hz render loop for %.1f s each\n",
+	        (int)SourceCount, (int)Width, (int)Height, seconds);
+
+	bool ok = true;
+	for (int c = 0; c < (int)(sizeof(cases) / sizeof(cases[0])); c++)
+	{
+		const Case& cs      = cases[c];
+		int         size    = Width * Height * GetFrameBytesPerPixel(cs.Format);
+		UByte*      staging = (UByte*)OVR_ALLOC_ALIGNED(size, 64);
+		UByte*      expect  = (UByte*)OVR_ALLOC_ALIGNED(size, 64);
+
+		SyntheticReferenceFrames reference(Width, Height, cs.Format);
+		Ptr<SyntheticFrameSource> sources[SourceCount];
+		bool started = staging && expect;
+		for (int i = 0; i < SourceCount && started; i++)
+		{
+			sources[i] = *new SyntheticFrameSource(Width, Height, cs.Format, cs.FramesPerSecond);
+			sources[i]->SetSwapRedBlue(cs.SwapRedBlue);
+			started = sources[i]->Start();
+		}
+		if (!started)
+		{
+			LogText("%-16s couldn't start\n", cs.Name);
+			ok = false;
+		}
+
+		UInt32 shown = 0, mismatched = 0;
+		UInt64 copyTicks = 0, latencyTicks = 0, latencyMax = 0;
+		UInt64 start = Timer::GetTicks(), next = start;
+		while (started && Timer::GetTicks() - start < (UInt64)(seconds * Timer::MksPerSecond))
+		{
+			for (int i = 0; i < SourceCount; i++)
+			{
+				VideoFrame* frame = sources[i]->GetLatestFrame();
+				if (!frame)
+				{
+					continue;
+				}
+
+				// The copy stands in for the texture upload the render thread does.
+				UInt64 pickup  = Timer::GetTicks();
+				UInt64 latency = pickup - frame->CaptureTicks;
+				memcpy(staging, frame->pData, frame->Size);
+				copyTicks    += Timer::GetTicks() - pickup;
+				latencyTicks += latency;
+				latencyMax    = Alg::Max(latencyMax, latency);
+				shown++;
+
+				// Sequence n is the source's frame n - 1; anything else in the buffer
+				// means a frame was torn or handed out twice.
+				reference.Generate(expect, size, frame->Sequence - 1);
+				if (cs.SwapRedBlue)
+				{
+					SwizzleBGRA(expect, size / 4);
+				}
+				if (frame->Size != size || memcmp(staging, expect, size) != 0)
+				{
+					mismatched++;
+				}
+			}
+
+			next += renderPeriod;
+			UInt64 now = Timer::GetTicks();
+			if (next > now)
+			{
+				Thread::MSleep((unsigned)((next - now) / Timer::MksPerMs));
+			}
+			else
+			{
+				next = now;
+			}
+		}
+
+		UInt32 delivered = 0, dropped = 0;
+		for (int i = 0; i < SourceCount; i++)
+		{
+			if (sources[i])
+			{
+				sources[i]->Stop();
+				delivered += sources[i]->HasFrame() ? 1 : 0;
+				dropped   += sources[i]->GetDroppedCount();
+			}
+		}
+
+		if (started)
+		{
+			double copyUs = shown ? double(copyTicks) / shown : 0.0;
+			LogText("%-16s %5u shown, %4u dropped, copy %6.0f us (%5.0f MB/s), capture to pickup %5.1f ms avg, %5.1f ms max, %u mismatched\n",
+			        cs.Name, shown, dropped, copyUs, copyUs > 0 ? size / copyUs : 0.0,
+			        shown ? double(latencyTicks) / shown / Timer::MksPerMs : 0.0,
+			        double(latencyMax) / Timer::MksPerMs, mismatched);
+			if (mismatched || delivered < (UInt32)SourceCount)
+			{
+				ok = false;
+			}
+		}
+
+		if (staging)
+		{
+			OVR_FREE_ALIGNED(staging);
+		}
+		if (expect)
+		{
+			OVR_FREE_ALIGNED(expect);
+		}
+	}
+	return ok;
+}
@@ -0,0 +1,189 @@
+#ifndef FRAME_SOURCE_H
+#define FRAME_SOURCE_H
+
+#include "OVR.h"
+#include <Kernel/OVR_Threads.h>
+#include <Kernel/OVR_Timer.h>
+#include <Kernel/OVR_File.h>
+
+enum FramePixelFormat
+{
+	FramePixel_BGRA,    // 32 bit, rows bottom-up like a DIB
+	FramePixel_YUY2,    // Packed 4:2:2, 16 bit, rows top-down
+	FramePixel_UYVY
+};
+
+inline int GetFrameBytesPerPixel(FramePixelFormat format)
+{
+	return format == FramePixel_BGRA ? 4 : 2;
+}
+
+// A captured video frame, in the source's pixel format. BGRA frames are RGBA if
+// the source was asked to swap red and blue.
+struct VideoFrame
+{
+	OVR::UByte*  pData;
+	int          Width, Height;
+	int          Size;           // Bytes of valid data in pData
+	OVR::UInt64  CaptureTicks;   // Timer::GetTicks() when the frame was delivered
+	OVR::UInt32  Sequence;
+
+	VideoFrame() : pData(0), Width(0), Height(0), Size(0), CaptureTicks(0), Sequence(0) {}
+};
+
+
+//-------------------------------------------------------------------------------------
+// ***** FrameTripleBuffer
+
+// Single producer, single consumer triple buffer. The producer always has a back
+// buffer to write into and the consumer always owns the front buffer it renders from;
+// the third buffer holds the newest complete frame and is swapped atomically by
+// either side, so neither ever blocks or sees a half written frame.
+
+class FrameTripleBuffer
+{
+public:
+	FrameTripleBuffer();
+	~FrameTripleBuffer();
+
+	bool    Init(int width, int height, int bytesPerPixel = 4);
+	int     GetCapacity() const { return Capacity; }
+
+	// Producer side. EndWrite publishes the back buffer as the newest frame.
+	OVR::UByte* BeginWrite() { return Frames[BackIndex].pData; }
+	void    EndWrite(int size, OVR::UInt64 captureTicks);
+
+	// Consumer side. Returns the newest frame if one completed since the last call,
+	// otherwise NULL; the returned frame stays valid until the next successful call.
+	VideoFrame* AcquireLatest();
+	VideoFrame* GetCurrent() { return Frames[FrontIndex].Sequence ? &Frames[FrontIndex] : 0; }
+
+	// Frames that were overwritten before the consumer picked them up.
+	OVR::UInt32 GetDroppedCount() const { return Dropped; }
+	OVR::UInt32 GetDeliveredCount() const { return Sequence.Load_Acquire(); }
+
+private:
+	enum { Fresh = 0x4, IndexMask = 0x3 };
+
+	VideoFrame                   Frames[3];
+	OVR::UByte*                  pStorage;
+	int                          Capacity;
+	int                          BackIndex;   // Owned by producer
+	int                          FrontIndex;  // Owned by consumer
+	OVR::AtomicInt<OVR::UInt32>  Middle;      // Index of the shared buffer | Fresh
+	OVR::AtomicInt<OVR::UInt32>  Sequence;    // Written by producer, read by either side
+	OVR::AtomicInt<OVR::UInt32>  Dropped;
+};
+
+
+//-------------------------------------------------------------------------------------
+// ***** FrameSource
+
+// A FrameSource delivers frames from a capture thread (or callback) into a triple
+// buffer; the render thread picks up the newest one with GetLatestFrame.
+
+class FrameSource : public OVR::RefCountBase<FrameSource>
+{
+public:
+	FrameSource() : Width(0), Height(0), PixelFormat(FramePixel_BGRA), SwapRedBlue(false), BufferReady(false) {}
+	virtual ~FrameSource() {}
+
+	virtual bool Start() = 0;
+	virtual void Stop() {}
+
+	int  GetWidth() const  { return Width; }
+	int  GetHeight() const { return Height; }
+	FramePixelFormat GetPixelFormat() const { return PixelFormat; }
+	bool HasFrame() const  { return Buffer.GetDeliveredCount() > 0; }
+
+	// Render thread; never blocks.
+	VideoFrame* GetLatestFrame()  { return Buffer.AcquireLatest(); }
+	VideoFrame* GetCurrentFrame() { return Buffer.GetCurrent(); }
+
+	OVR::UInt32 GetDroppedCount() const { return Buffer.GetDroppedCount(); }
+
+	// Converts BGRA frames to RGBA as they come in, for renderers without BGRA
+	// textures. Set before Start.
+	void SetSwapRedBlue(bool swap) { SwapRedBlue = swap; }
+	bool GetSwapRedBlue() const    { return SwapRedBlue; }
+
+	// Capture thread; copies a frame in and publishes it.
+	void DeliverFrame(const void* data, int size, OVR::UInt64 captureTicks);
+
+protected:
+	// Sets BufferReady; sources refuse to start without a buffer to deliver into.
+	bool initBuffer(int width, int height, FramePixelFormat format = FramePixel_BGRA);
+
+	int                 Width, Height;
+	FramePixelFormat    PixelFormat;
+	bool                SwapRedBlue;
+	bool                BufferReady;
+	FrameTripleBuffer   Buffer;
+};
+
+
+//-------------------------------------------------------------------------------------
+// ***** PacedFrameSource
+
+// Base for sources without capture hardware. Runs its own thread and produces
+// frames at a fixed rate, straight into the back buffer.
+
+class PacedFrameSource : public FrameSource
+{
+public:
+	PacedFrameSource(int width, int height, FramePixelFormat format, float framesPerSecond);
+	~PacedFrameSource();
+
+	virtual bool Start();
+	virtual void Stop();
+
+protected:
+	// Fills dest with the next frame. Returns the number of bytes written, or 0 to stop.
+	virtual int  produceFrame(OVR::UByte* dest, int capacity) = 0;
+
+private:
+	static int   threadFn(OVR::Thread* pthread, void* h);
+
+	OVR::Ptr<OVR::Thread>  pThread;
+	float                  FramesPerSecond;
+};
+
+// Moving test pattern.
+class SyntheticFrameSource : public PacedFrameSource
+{
+public:
+	SyntheticFrameSource(int width, int height, FramePixelFormat format = FramePixel_BGRA,
+	                     float framesPerSecond = 30.0f)
+		: PacedFrameSource(width, height, format, framesPerSecond), FrameIndex(0) {}
+
+protected:
+	virtual int  produceFrame(OVR::UByte* dest, int capacity);
+
+	OVR::UInt32  FrameIndex;
+};
+
+// Raw frames of the given size and format, back to back in a file. Loops at the end.
+class FileFrameSource : public PacedFrameSource
+{
+public:
+	FileFrameSource(const char* path, int width, int height, FramePixelFormat format = FramePixel_BGRA,
+	                float framesPerSecond = 30.0f);
+
+	virtual bool Start();
+
+protected:
+	virtual int  produceFrame(OVR::UByte* dest, int capacity);
+
+	OVR::String          Path;
+	OVR::Ptr<OVR::File>  pFile;
+};
+
+// Runs two SyntheticFrameSources for the given time per case, in BGRA, BGRA swapped
+// to RGBA, YUY2, and BGRA at 120 fps to force overwrites, while this thread picks up
+// their frames at 60 Hz the way the render loop does. Logs frames shown and dropped,
+// the time to copy a frame out and the latency from capture to pickup. Every frame
+// picked up is compared with the one its sequence number should hold; returns false
+// if any differs, or if a source couldn't start or delivered nothing.
+bool BenchmarkFramePipeline(float seconds = 3.0f);
+
+#endif
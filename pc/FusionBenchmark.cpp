@@ -0,0 +1,1819 @@
+#include "FusionBenchmark.h"
+#include "ServoSender.h"
+#include "FrameSource.h"
+
+#include <Kernel/OVR_Threads.h>
+#include <Kernel/OVR_Timer.h>
+#include <Kernel/OVR_Log.h>
+#include <OVR_SensorFusionBatch.h>
+#include <OVR_OrientationPredictor.h>
+#include <OVR_ThreadCommandQueue.h>
+#include <OVR_VirtualTracker.h>
+#include <OVR_SensorTimeFilter.h>
+
+#if defined(OVR_OS_LINUX)
+#include <OVR_Linux_DeviceManager.h>
+#include <OVR_Linux_HIDReportRing.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#endif
+
+#include <string.h>
+
+using namespace OVR;
+
+
+// Read latencies are counted in buckets of BucketNs, up to MaxNs; anything longer
+// only counts towards the maximum.
+enum
+{
+	BucketNs    = 10,
+	MaxNs       = 200000,
+	BucketCount = MaxNs / BucketNs + 1
+};
+
+struct FusionBenchmark
+{
+	SensorFusion    Fusion;
+	Lock            FusionLock;     // Stands in for the handler lock in locked mode
+	bool            UseLock;
+	volatile bool   Done;
+	double          NsPerRawTick;
+
+	UInt32          WriterSamples;
+};
+
+struct FusionBenchmarkReader
+{
+	FusionBenchmark* pBench;
+	UInt32           Buckets[BucketCount];
+	UInt64           Reads;
+	UInt64           MaxNs;
+};
+
+static int writerFn(Thread*, void* h)
+{
+	FusionBenchmark* bench = (FusionBenchmark*)h;
+
+	MessageBodyFrame msg(0);
+	msg.Acceleration = Vector3f(0, 9.81f, 0);
+	msg.RotationRate = Vector3f(0, 1.0f, 0);
+	msg.TimeDelta    = 0.001f;
+
+	UInt64 next = Timer::GetTicks();
+	while (!bench->Done)
+	{
+		msg.AbsoluteTimeMks = Timer::GetTicks();
+		if (bench->UseLock)
+		{
+			Lock::Locker lock(&bench->FusionLock);
+			bench->Fusion.OnMessage(msg);
+		}
+		else
+		{
+			bench->Fusion.OnMessage(msg);
+		}
+		bench->WriterSamples++;
+
+		// Hold 1 kHz on average; sleep granularity makes single periods vary.
+		next += Timer::MksPerSecond / 1000;
+		UInt64 now = Timer::GetTicks();
+		if (next > now + 1000)
+			Thread::MSleep((unsigned)((next - now) / 1000));
+		while (Timer::GetTicks() < next && !bench->Done)
+			Thread::MSleep(0);
+	}
+	return 0;
+}
+
+static int readerFn(Thread*, void* h)
+{
+	FusionBenchmarkReader* reader = (FusionBenchmarkReader*)h;
+	FusionBenchmark*       bench  = reader->pBench;
+
+	while (!bench->Done)
+	{
+		UInt64 start = Timer::GetRawTicks();
+		Quatf  q;
+		if (bench->UseLock)
+		{
+			Lock::Locker lock(&bench->FusionLock);
+			q = bench->Fusion.GetOrientation();
+		}
+		else
+		{
+			q = bench->Fusion.GetOrientation();
+		}
+		UInt64 ns = (UInt64)((Timer::GetRawTicks() - start) * bench->NsPerRawTick);
+
+		reader->Buckets[ns < MaxNs ? ns / BucketNs : BucketCount - 1]++;
+		reader->Reads++;
+		if (ns > reader->MaxNs)
+			reader->MaxNs = ns;
+	}
+	return 0;
+}
+
+// Latency below which the given fraction of reads finished.
+static double percentileNs(const UInt32* buckets, UInt64 reads, double fraction)
+{
+	UInt64 target = (UInt64)(reads * fraction), count = 0;
+	for (int i = 0; i < BucketCount; i++)
+	{
+		count += buckets[i];
+		if (count > target)
+			return (i + 1) * (double)BucketNs;
+	}
+	return MaxNs;
+}
+
+void BenchmarkSensorFusionReads(int readerCount, float seconds)
+{
+	LogText("\nSensor Fusion Read Benchmark\n----------------------------\n");
+
+	if (readerCount < 1)
+	{
+		readerCount = 1;
+	}
+
+	FusionBenchmark* bench = new FusionBenchmark;
+	bench->NsPerRawTick = 1000000000.0 / (double)Timer::GetRawFrequency();
+	LogText("1 writer at 1 kHz, %i reader(s), %.1f s each, timer resolution %.0f ns\n",
+	        readerCount, seconds, bench->NsPerRawTick);
+
+	Array<FusionBenchmarkReader> readers;
+	readers.Resize(readerCount);
+
+	for (int locked = 1; locked >= 0; locked--)
+	{
+		bench->UseLock       = locked != 0;
+		bench->Done          = false;
+		bench->WriterSamples = 0;
+
+		Array<Ptr<Thread> > threads;
+		threads.PushBack(*new Thread(writerFn, bench));
+		for (int i = 0; i < readerCount; i++)
+		{
+			memset(&readers[i], 0, sizeof(FusionBenchmarkReader));
+			readers[i].pBench = bench;
+			threads.PushBack(*new Thread(readerFn, &readers[i]));
+		}
+		for (UPInt i = 0; i < threads.GetSize(); i++)
+		{
+			threads[i]->Start();
+		}
+
+		Thread::MSleep((unsigned)(seconds * 1000));
+		bench->Done = true;
+		for (UPInt i = 0; i < threads.GetSize(); i++)
+		{
+			while (!threads[i]->IsFinished())
+			{
+				Thread::MSleep(1);
+			}
+		}
+
+		// Merge the readers.
+		UInt32* buckets = readers[0].Buckets;
+		UInt64  reads   = readers[0].Reads, maxNs = readers[0].MaxNs;
+		for (int i = 1; i < readerCount; i++)
+		{
+			for (int b = 0; b < BucketCount; b++)
+			{
+				buckets[b] += readers[i].Buckets[b];
+			}
+			reads += readers[i].Reads;
+			maxNs  = Alg::Max(maxNs, readers[i].MaxNs);
+		}
+		if (reads == 0)
+		{
+			continue;
+		}
+
+		LogText("%-8s %6.0f writes/s, %9.0f reads/s, p50 %6.0f ns, p99 %6.0f ns, p99.9 %7.0f ns, p99.99 %7.0f ns, max %8.0f ns\n",
+		        locked ? "Locked" : "Snapshot", bench->WriterSamples / seconds, reads / seconds,
+		        percentileNs(buckets, reads, 0.5), percentileNs(buckets, reads, 0.99),
+		        percentileNs(buckets, reads, 0.999), percentileNs(buckets, reads, 0.9999), (double)maxNs);
+	}
+
+	delete bench;
+}
+
+void SweepSensorFusionGains(const char* tracePath, const char* referencePath, int threadCount)
+{
+	LogText("\nSensor Fusion Gain Sweep\n------------------------\n");
+
+	Util::SensorTraceReader reader;
+	Array<Util::SensorTraceRecord> trace;
+	Array<Util::OrientationTraceRecord> reference;
+	if (!reader.Open(tracePath) || !reader.ReadAll(&trace))
+	{
+		LogText("Couldn't load trace %s\n", tracePath);
+		return;
+	}
+	if (!Util::LoadOrientationTrace(referencePath, &reference))
+	{
+		LogText("Couldn't load reference %s\n", referencePath);
+		return;
+	}
+
+	// The defaults first, then every combination of the grid.
+	static const float accelGains[]        = { 0.02f, 0.05f, 0.1f, 0.2f };
+	static const float integralGains[]     = { 0.005f, 0.0125f, 0.025f };
+	static const float spikeThresholds[]   = { 0.005f, 0.01f, 0.02f };
+	static const float gravityThresholds[] = { 0.05f, 0.1f, 0.2f };
+
+	Array<SensorFusionConfig> configs;
+	configs.PushBack(SensorFusionConfig());
+	for (int a = 0; a < 4; a++)
+		for (int i = 0; i < 3; i++)
+			for (int s = 0; s < 3; s++)
+				for (int g = 0; g < 3; g++)
+				{
+					SensorFusionConfig config;
+					config.AccelGain          = accelGains[a];
+					config.TiltIntegralGain   = integralGains[i];
+					config.TiltSpikeThreshold = spikeThresholds[s];
+					config.GravityThreshold   = gravityThresholds[g];
+					configs.PushBack(config);
+				}
+
+	Util::SensorFusionFarm farm;
+	Array<Util::SensorFusionFarmResult> results;
+	farm.Run(trace, reference, configs, &results, threadCount);
+
+	double seconds = farm.GetLastRunSeconds();
+	LogText("%u configurations of %u samples in %.2f s on %i thread(s), %.1f M samples/s\n",
+	        (unsigned)configs.GetSize(), (unsigned)trace.GetSize(), seconds,
+	        threadCount > 0 ? threadCount : Thread::GetCPUCount(),
+	        seconds > 0 ? configs.GetSize() * trace.GetSize() / seconds / 1000000.0 : 0.0);
+	LogText("Default: RMS error %.3f, max %.3f degrees over %u points\n",
+	        results[0].RmsError, results[0].MaxError, results[0].Compared);
+
+	// Best five by RMS error.
+	Array<int> order;
+	for (int i = 0; i < (int)results.GetSize(); i++)
+	{
+		order.PushBack(i);
+	}
+	for (int i = 0; i < Alg::Min(5, (int)order.GetSize()); i++)
+	{
+		for (int j = i + 1; j < (int)order.GetSize(); j++)
+		{
+			if (results[order[j]].RmsError < results[order[i]].RmsError)
+			{
+				Alg::Swap(order[i], order[j]);
+			}
+		}
+		const SensorFusionConfig& c = configs[order[i]];
+		const Util::SensorFusionFarmResult& r = results[order[i]];
+		LogText("AccelGain %.3f TiltIntegralGain %.4f TiltSpikeThreshold %.3f GravityThreshold %.2f: RMS %.3f, max %.3f\n",
+		        c.AccelGain, c.TiltIntegralGain, c.TiltSpikeThreshold, c.GravityThreshold, r.RmsError, r.MaxError);
+	}
+}
+
+static float nextNoise(UInt32* seed)
+{
+	*seed = *seed * 1664525 + 1013904223;
+	return ((*seed >> 8) / 16777216.0f - 0.5f) * 0.02f;
+}
+
+// A minute at 1 kHz of a head looking around, with gyro bias and noise, and the
+// occasional bump in the accelerometer so the spike and acceleration tests trigger.
+static void makeSyntheticSamples(Array<Vector3f>* accel, Array<Vector3f>* gyro, Array<float>* deltaT)
+{
+	const int   count = 60000;
+	const float dt    = 0.001f;
+	Vector3f    bias(0.01f, -0.005f, 0.008f);
+	Quatf       q;
+	UInt32      seed = 12345;
+
+	accel->Resize(count);
+	gyro->Resize(count);
+	deltaT->Resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		float t = i * dt;
+		Vector3f rate(0.8f * sinf(1.3f * t), 1.5f * sinf(0.7f * t + 1.0f), 0.4f * sinf(2.1f * t));
+		q = q * Quatf(rate, rate.Length() * dt);
+		q.Normalize();
+
+		Vector3f noise(nextNoise(&seed), nextNoise(&seed), nextNoise(&seed));
+		Vector3f a = q.Inverted().Rotate(Vector3f(0, 9.81f, 0));
+		if (i % 5000 < 50)
+			a += Vector3f(2.0f, 0, -1.5f);
+
+		(*accel)[i]  = a + noise * 5.0f;
+		(*gyro)[i]   = rate + bias + noise;
+		(*deltaT)[i] = dt;
+	}
+}
+
+void BenchmarkSensorFusionBatch(const char* tracePath, int laneCount)
+{
+	LogText("\nSensor Fusion Batch Benchmark\n-----------------------------\n");
+
+	Array<Vector3f> accel, gyro;
+	Array<float>    deltaT;
+	if (tracePath)
+	{
+		Util::SensorTraceReader reader;
+		Array<Util::SensorTraceRecord> trace;
+		if (!reader.Open(tracePath) || !reader.ReadAll(&trace))
+		{
+			LogText("Couldn't load trace %s\n", tracePath);
+			return;
+		}
+		for (UPInt i = 0; i < trace.GetSize(); i++)
+		{
+			accel.PushBack(trace[i].Acceleration);
+			gyro.PushBack(trace[i].RotationRate);
+			deltaT.PushBack(trace[i].TimeDelta);
+		}
+	}
+	else
+	{
+		makeSyntheticSamples(&accel, &gyro, &deltaT);
+	}
+
+	int samples = (int)accel.GetSize();
+	if (samples == 0 || laneCount < 1)
+	{
+		return;
+	}
+
+	// Gains spread around the defaults, the way a sweep would pick them.
+	Array<SensorFusionConfig> configs;
+	for (int i = 0; i < laneCount; i++)
+	{
+		SensorFusionConfig config;
+		config.AccelGain          = 0.02f + 0.01f * (i % 8);
+		config.TiltIntegralGain   = 0.005f + 0.005f * ((i / 8) % 4);
+		config.TiltSpikeThreshold = (i % 3 == 0) ? 0.005f : 0.01f;
+		configs.PushBack(config);
+	}
+
+	// Both paths are compared every BlockSize samples, as a recorder or farm would
+	// hand them over.
+	const int blockSize  = 1000;
+	const int blockCount = (samples + blockSize - 1) / blockSize;
+
+	// Scalar path, one SensorFusion per configuration.
+	Array<Quatf> scalarResults;
+	scalarResults.Resize(laneCount * blockCount);
+	UInt64 start = Timer::GetTicks();
+	for (int lane = 0; lane < laneCount; lane++)
+	{
+		SensorFusion fusion;
+		fusion.SetConfig(configs[lane]);
+		fusion.SetYawCorrectionEnabled(false);
+		MessageBodyFrame msg(0);
+		for (int i = 0; i < samples; i++)
+		{
+			msg.Acceleration = accel[i];
+			msg.RotationRate = gyro[i];
+			msg.TimeDelta    = deltaT[i];
+			fusion.OnMessage(msg);
+			if ((i + 1) % blockSize == 0 || i + 1 == samples)
+			{
+				scalarResults[lane * blockCount + i / blockSize] = fusion.GetOrientation();
+			}
+		}
+	}
+	double scalarSeconds = (Timer::GetTicks() - start) / 1000000.0;
+
+	SensorFusionBatch batch;
+	batch.Reset(&configs[0], laneCount);
+	Array<Quatf> batchResults;
+	batchResults.Resize(laneCount * blockCount);
+	double batchSeconds = 0;
+	for (int block = 0; block < blockCount; block++)
+	{
+		int i = block * blockSize;
+		start = Timer::GetTicks();
+		batch.ProcessSamples(&accel[i], &gyro[i], &deltaT[i], Alg::Min(blockSize, samples - i));
+		batchSeconds += (Timer::GetTicks() - start) / 1000000.0;
+		for (int lane = 0; lane < laneCount; lane++)
+		{
+			batchResults[lane * blockCount + block] = batch.GetOrientation(lane);
+		}
+	}
+
+	float maxError = 0, sumError = 0;
+	for (int i = 0; i < laneCount * blockCount; i++)
+	{
+		Quatf a = scalarResults[i], b = batchResults[i];
+		a.Normalize();
+		b.Normalize();
+		Quatf d = a.Inverted() * b;
+		float error = RadToDegree(2 * atan2f(sqrtf(d.x * d.x + d.y * d.y + d.z * d.z), fabsf(d.w)));
+		maxError = Alg::Max(maxError, error);
+		sumError += error;
+	}
+
+	double total = (double)samples * laneCount;
+	LogText("%i samples x %i configurations\n", samples, laneCount);
+	LogText("Scalar:    %.3f s, %.2f M samples/s\n", scalarSeconds, total / scalarSeconds / 1000000.0);
+	LogText("Batch %s x%i: %.3f s, %.2f M samples/s (%.1fx)\n", SensorFusionBatch::GetKernelName(),
+	        SensorFusionBatch::GetKernelWidth(), batchSeconds, total / batchSeconds / 1000000.0,
+	        batchSeconds > 0 ? scalarSeconds / batchSeconds : 0.0);
+	LogText("Difference from the scalar path over %i checkpoints: mean %.5f, max %.5f degrees\n",
+	        laneCount * blockCount, sumError / (laneCount * blockCount), maxError);
+}
+
+// SensorFilter::Median() as it was: copies the window and selection sorts half of it.
+template <int N>
+static Vector3f selectionSortMedian(const SensorFilter<N>& filter, float* sortx, float* sorty, float* sortz)
+{
+	int count = filter.GetSize();
+	int halfWindow = count / 2;
+	for (int i = 0; i < count; i++)
+	{
+		Vector3f e = filter.GetPrev(i);
+		sortx[i] = e.x;
+		sorty[i] = e.y;
+		sortz[i] = e.z;
+	}
+	for (int j = 0; j <= halfWindow; j++)
+	{
+		int minx = j, miny = j, minz = j;
+		for (int k = j + 1; k < count; k++)
+		{
+			if (sortx[k] < sortx[minx]) minx = k;
+			if (sorty[k] < sorty[miny]) miny = k;
+			if (sortz[k] < sortz[minz]) minz = k;
+		}
+		Alg::Swap(sortx[j], sortx[minx]);
+		Alg::Swap(sorty[j], sorty[miny]);
+		Alg::Swap(sortz[j], sortz[minz]);
+	}
+	return Vector3f(sortx[halfWindow], sorty[halfWindow], sortz[halfWindow]);
+}
+
+template <int N>
+static void benchmarkMedianWindow(const Array<Vector3f>& input)
+{
+	int samples = (int)input.GetSize();
+	float sortx[N], sorty[N], sortz[N];
+
+	// The filters hold their window inline, which gets large for the bigger sizes.
+	SensorFilter<N>* oldFilter   = new SensorFilter<N>;
+	SensorFilter<N>* newFilter   = new SensorFilter<N>;
+	SensorFilter<N>* checkFilter = new SensorFilter<N>;
+	Vector3f oldSum, newSum;
+	int mismatches = 0;
+
+	UInt64 start = Timer::GetTicks();
+	for (int i = 0; i < samples; i++)
+	{
+		oldFilter->AddElement(input[i]);
+		oldSum += selectionSortMedian(*oldFilter, sortx, sorty, sortz);
+	}
+	double oldUs = (double)(Timer::GetTicks() - start) / samples;
+
+	start = Timer::GetTicks();
+	for (int i = 0; i < samples; i++)
+	{
+		newFilter->AddElement(input[i]);
+		newSum += newFilter->Median();
+	}
+	double newUs = (double)(Timer::GetTicks() - start) / samples;
+
+	// Compare every step separately so the timing loops stay clean.
+	for (int i = 0; i < samples; i++)
+	{
+		checkFilter->AddElement(input[i]);
+		Vector3f a = selectionSortMedian(*checkFilter, sortx, sorty, sortz);
+		Vector3f b = checkFilter->Median();
+		if (a != b)
+			mismatches++;
+	}
+
+	if (oldSum != newSum)
+		mismatches++;
+
+	LogText("Window %4i: selection sort %8.2f us, heaps %6.3f us per sample (%.0fx), %i mismatches\n",
+	        N, oldUs, newUs, newUs > 0 ? oldUs / newUs : 0.0, mismatches);
+
+	delete oldFilter;
+	delete newFilter;
+	delete checkFilter;
+}
+
+void BenchmarkSensorFilterMedian()
+{
+	LogText("\nSensor Filter Median Benchmark\n------------------------------\n");
+
+	// Gyro-like samples with noise and the odd spike, identical for every run.
+	const int samples = 20000;
+	UInt32 seed = 777;
+	Array<Vector3f> input;
+	input.Resize(samples);
+	for (int i = 0; i < samples; i++)
+	{
+		Vector3f v(sinf(i * 0.003f), cosf(i * 0.002f), 0.1f);
+		v += Vector3f(nextNoise(&seed), nextNoise(&seed), nextNoise(&seed)) * 10.0f;
+		if (i % 997 == 0)
+			v.y += 5.0f;
+		input[i] = v;
+	}
+
+	benchmarkMedianWindow<20>(input);
+	benchmarkMedianWindow<100>(input);
+	benchmarkMedianWindow<300>(input);
+	benchmarkMedianWindow<1000>(input);
+}
+
+void BenchmarkMagReferenceLookup()
+{
+	LogText("\nMagnetometer Reference Benchmark\n--------------------------------\n");
+
+	// Samples are binned by how many references there were when they were processed,
+	// and counted in BucketNs wide latency buckets, as in BenchmarkSensorFusionReads.
+	enum { BinCount = 5, BinSize = 200 };
+	UInt32* buckets = new UInt32[BinCount * BucketCount];
+	memset(buckets, 0, BinCount * BucketCount * sizeof(UInt32));
+	UInt64 binNs[BinCount] = { 0 }, binMaxNs[BinCount] = { 0 }, binSamples[BinCount] = { 0 };
+	double nsPerTick = 1000000000.0 / (double)Timer::GetRawFrequency();
+
+	SensorFusion* fusion = new SensorFusion;
+	fusion->SetYawCorrectionEnabled(true);
+	fusion->SetMagCalibration(Matrix4f());
+
+	// The reading jumps to a random direction and strength every 20 samples (the
+	// fusion averages over 10), slowly filling the shell the references live in.
+	const int samples = 1000000;
+	UInt32 seed = 4242;
+	MessageBodyFrame msg(0);
+	msg.TimeDelta    = 0.001f;
+	msg.Acceleration = Vector3f(0, 9.81f, 0);
+	Vector3f mag(0.3f, 0, 0);
+
+	for (int i = 0; i < samples; i++)
+	{
+		if (i % 20 == 0)
+		{
+			Vector3f dir(nextNoise(&seed), nextNoise(&seed), nextNoise(&seed));
+			float strength = 0.6f + nextNoise(&seed) * 80.0f;
+			mag = dir.Normalized() * strength;
+		}
+		msg.MagneticField = mag;
+		msg.RotationRate  = Vector3f(nextNoise(&seed), nextNoise(&seed), nextNoise(&seed));
+
+		int bin = Alg::Min(fusion->GetMagReferenceCount() / BinSize, BinCount - 1);
+		UInt64 start = Timer::GetRawTicks();
+		fusion->OnMessage(msg);
+		UInt64 ns = (UInt64)((Timer::GetRawTicks() - start) * nsPerTick);
+
+		buckets[bin * BucketCount + Alg::Min((int)(ns / BucketNs), BucketCount - 1)]++;
+		binNs[bin]     += ns;
+		binMaxNs[bin]   = Alg::Max(binMaxNs[bin], ns);
+		binSamples[bin]++;
+	}
+
+	LogText("%i samples, %i references at the end\n", samples, fusion->GetMagReferenceCount());
+	for (int b = 0; b < BinCount; b++)
+	{
+		if (binSamples[b] == 0)
+			continue;
+		const UInt32* binBuckets = buckets + b * BucketCount;
+		LogText("%4i-%4i references: %7i samples, mean %5.0f ns, 99.9%% %6.0f ns, 99.99%% %6.0f ns, max %7.0f ns\n",
+		        b * BinSize, (b + 1) * BinSize - 1, (int)binSamples[b], (double)binNs[b] / binSamples[b],
+		        percentileNs(binBuckets, binSamples[b], 0.999), percentileNs(binBuckets, binSamples[b], 0.9999),
+		        (double)binMaxNs[b]);
+	}
+
+	delete fusion;
+	delete[] buckets;
+}
+
+// Runs SensorTimeFilter over two minutes of reports every 2 ms from a tracker whose
+// clock drifts by driftPpm, each arriving 800 us after its sample plus up to 300 us of
+// jitter, and up to 5 ms on one in twenty. Returns the largest error against the fixed
+// 800 us once the filter has had 10 s, and the drift it ends up with.
+static double runTimeFilter(double driftPpm, double* driftEstimatePpm)
+{
+	const UInt64 trackerStart = 5000000, hostStart = 123456789000ULL;
+	const double latencyMks   = 800;
+
+	SensorTimeFilter filter;
+	UInt32 seed     = 4242;
+	double maxError = 0;
+	for (UInt64 t = 0; t < 120 * Timer::MksPerSecond; t += 2000)
+	{
+		double hostTrue = hostStart + t * (1.0 + driftPpm * 1e-6);
+		seed = seed * 1664525 + 1013904223;
+		double jitter = (seed >> 8) % 20 == 0 ? (seed >> 12) % 5000 : (seed >> 12) % 300;
+		filter.Update(trackerStart + t, (UInt64)(hostTrue + latencyMks + jitter));
+
+		if (t > 10 * Timer::MksPerSecond)
+		{
+			double error = (double)(SInt64)(filter.ToHostTicks(trackerStart + t) - (UInt64)hostTrue) - latencyMks;
+			maxError = Alg::Max(maxError, fabs(error));
+		}
+	}
+	*driftEstimatePpm = filter.GetDriftPpm();
+	return maxError;
+}
+
+bool CheckSensorTimeFilter()
+{
+	LogText("\nSensor Time Filter Check\n------------------------\n");
+
+	bool ok = true;
+	static const double drifts[] = { 50.0, -50.0, 0.0 };
+	for (int i = 0; i < 3; i++)
+	{
+		double estimate;
+		double maxError = runTimeFilter(drifts[i], &estimate);
+		bool   passed   = maxError <= 50.0 && fabs(estimate - drifts[i]) <= 2.0;
+		LogText("Drift %+5.1f ppm: estimated %+6.2f ppm, max error %4.0f us, %s\n",
+		        drifts[i], estimate, maxError, passed ? "ok" : "FAILED");
+		ok = ok && passed;
+	}
+	return ok;
+}
+
+// Yaw of the fusion's orientation at timeMks, less the yaw expected there, in (-pi, pi].
+static float orientationAtError(const SensorFusion& fusion, UInt64 timeMks, float expectedYaw)
+{
+	float yaw, pitch, roll;
+	fusion.GetOrientationAt(timeMks).GetEulerAngles<Axis_Y, Axis_X, Axis_Z>(&yaw, &pitch, &roll);
+	float error = fmodf(yaw - expectedYaw, 2 * Math<float>::Pi);
+	if (error > Math<float>::Pi)
+		error -= 2 * Math<float>::Pi;
+	else if (error <= -Math<float>::Pi)
+		error += 2 * Math<float>::Pi;
+	return error;
+}
+
+bool CheckOrientationHistory()
+{
+	LogText("\nOrientation History Check\n-------------------------\n");
+
+	// Turning at 1 rad/s, so the yaw is the time in seconds since the start.
+	SensorFusion fusion;
+	fusion.SetGravityEnabled(false);
+	MessageBodyFrame msg(0);
+	msg.RotationRate = Vector3f(0, 1.0f, 0);
+	msg.Acceleration = Vector3f(0, 9.81f, 0);
+	msg.TimeDelta    = 0.001f;
+
+	const UInt64 start = 10 * Timer::MksPerSecond;
+	for (int i = 1; i <= 500; i++)
+	{
+		msg.AbsoluteTimeMks = start + i * 1000;
+		fusion.OnMessage(msg);
+	}
+
+	// Between samples, and clamped to the ends of the history.
+	float maxError = 0;
+	for (int i = 1; i < 500; i += 7)
+	{
+		UInt64 t = start + i * 1000 + 400;
+		maxError = Alg::Max(maxError, fabsf(orientationAtError(fusion, t, (i + 0.4f) * 0.001f)));
+	}
+	maxError = Alg::Max(maxError, fabsf(orientationAtError(fusion, start, 0.001f)));
+	maxError = Alg::Max(maxError, fabsf(orientationAtError(fusion, start + Timer::MksPerSecond, 0.5f)));
+	LogText("Interpolated: max error %.5f rad\n", maxError);
+	bool ok = maxError < 0.001f;
+
+	// Host time goes back 2 s, as when the time filter restarts its mapping; the
+	// history must follow the new times rather than keep the old ones.
+	const UInt64 restart = start - 2 * Timer::MksPerSecond;
+	for (int i = 1; i <= 200; i++)
+	{
+		msg.AbsoluteTimeMks = restart + i * 1000;
+		fusion.OnMessage(msg);
+	}
+	float restartError = 0;
+	for (int i = 1; i < 200; i += 7)
+	{
+		UInt64 t = restart + i * 1000 + 400;
+		restartError = Alg::Max(restartError, fabsf(orientationAtError(fusion, t, 0.5f + (i + 0.4f) * 0.001f)));
+	}
+	LogText("After time went back: max error %.5f rad\n", restartError);
+	ok = ok && restartError < 0.001f;
+
+	LogText("%s\n", ok ? "ok" : "FAILED");
+	return ok;
+}
+
+void EvaluateOrientationPredictors(const char* tracePath)
+{
+	LogText("\nOrientation Predictor Evaluation\n--------------------------------\n");
+
+	Array<Vector3f> accel, gyro;
+	Array<float>    deltaT;
+	if (tracePath)
+	{
+		Util::SensorTraceReader reader;
+		Array<Util::SensorTraceRecord> trace;
+		if (!reader.Open(tracePath) || !reader.ReadAll(&trace))
+		{
+			LogText("Couldn't load trace %s\n", tracePath);
+			return;
+		}
+		for (UPInt i = 0; i < trace.GetSize(); i++)
+		{
+			accel.PushBack(trace[i].Acceleration);
+			gyro.PushBack(trace[i].RotationRate);
+			deltaT.PushBack(trace[i].TimeDelta);
+		}
+	}
+	else
+	{
+		makeSyntheticSamples(&accel, &gyro, &deltaT);
+	}
+	int samples = (int)gyro.GetSize();
+
+	// The orientation the fusion settles on is the truth the predictions are scored against.
+	Array<Quatf>  orientations;
+	Array<double> times;
+	orientations.Resize(samples);
+	times.Resize(samples);
+	{
+		SensorFusion fusion;
+		MessageBodyFrame msg(0);
+		double time = 0;
+		for (int i = 0; i < samples; i++)
+		{
+			msg.Acceleration = accel[i];
+			msg.RotationRate = gyro[i];
+			msg.TimeDelta    = deltaT[i];
+			fusion.OnMessage(msg);
+			time += deltaT[i];
+			orientations[i] = fusion.GetOrientation();
+			times[i]        = time;
+		}
+	}
+
+	ConstantVelocityPredictor     constantVelocity;
+	ConstantVelocityPredictor     constantVelocityFixed(false);
+	ConstantAccelerationPredictor constantAcceleration;
+	KalmanPredictor               kalman;
+	OrientationPredictor* predictors[] = { &constantVelocity, &constantVelocityFixed, &constantAcceleration, &kalman };
+	const int predictorCount = sizeof(predictors) / sizeof(predictors[0]);
+
+	static const float horizons[] = { 0.02f, 0.04f, 0.06f, 0.08f };
+	const int horizonCount = sizeof(horizons) / sizeof(horizons[0]);
+
+	LogText("%i samples, %.1f s; prediction error in degrees\n", samples, samples ? times[samples - 1] : 0.0);
+	for (int p = 0; p < predictorCount; p++)
+	{
+		OrientationPredictor* predictor = predictors[p];
+		predictor->Reset();
+
+		Array<float> errors[horizonCount];
+		int          target[horizonCount] = { 0 };
+		PredictionState state;
+
+		for (int i = 0; i < samples; i++)
+		{
+			predictor->Update(gyro[i], deltaT[i], &state);
+
+			for (int h = 0; h < horizonCount; h++)
+			{
+				// First sample at or after the horizon.
+				double when = times[i] + horizons[h] - 0.0000005;
+				if (target[h] < i)
+					target[h] = i;
+				while (target[h] < samples && times[target[h]] < when)
+					target[h]++;
+				if (target[h] >= samples)
+					continue;
+
+				Quatf predicted = predictor->Predict(orientations[i], state, (float)(times[target[h]] - times[i]));
+				Quatf actual    = orientations[target[h]];
+				predicted.Normalize();
+				actual.Normalize();
+				Quatf d = predicted.Inverted() * actual;
+				errors[h].PushBack(RadToDegree(2 * atan2f(sqrtf(d.x * d.x + d.y * d.y + d.z * d.z), fabsf(d.w))));
+			}
+		}
+
+		LogText("%s\n", predictor->GetName());
+		for (int h = 0; h < horizonCount; h++)
+		{
+			Array<float>& e = errors[h];
+			if (e.GetSize() == 0)
+				continue;
+			double sum = 0, sumSq = 0;
+			for (UPInt i = 0; i < e.GetSize(); i++)
+			{
+				sum   += e[i];
+				sumSq += e[i] * e[i];
+			}
+			Alg::QuickSort(e);
+			LogText("  %2.0f ms: mean %.3f, RMS %.3f, 99%% %.3f, max %.3f\n", horizons[h] * 1000.0f,
+			        sum / e.GetSize(), sqrt(sumSq / e.GetSize()), e[(UPInt)(e.GetSize() * 0.99)], e[e.GetSize() - 1]);
+		}
+	}
+}
+
+
+struct ServoBenchmarkSensor
+{
+	SensorFusion     Fusion;
+	volatile bool    Done;
+};
+
+// Turns the head left and right at 0.5 Hz, with samples at 1 kHz.
+static int servoSensorFn(Thread*, void* h)
+{
+	ServoBenchmarkSensor* sensor = (ServoBenchmarkSensor*)h;
+
+	MessageBodyFrame msg(0);
+	msg.Acceleration = Vector3f(0, 9.81f, 0);
+	msg.TimeDelta    = 0.001f;
+
+	UInt64 start = Timer::GetTicks(), next = start;
+	while (!sensor->Done)
+	{
+		msg.AbsoluteTimeMks = Timer::GetTicks();
+		msg.RotationRate    = Vector3f(0, 2.0f * cosf(Math<float>::Pi * (next - start) / Timer::MksPerSecond), 0);
+		sensor->Fusion.OnMessage(msg);
+
+		next += Timer::MksPerSecond / 1000;
+		UInt64 now = Timer::GetTicks();
+		if (next > now + 1000)
+			Thread::MSleep((unsigned)((next - now) / 1000));
+	}
+	return 0;
+}
+
+bool BenchmarkServoSender(ServoTransport* transport, UInt32 periodMks, float seconds)
+{
+	LogText("\nServo Sender Benchmark\n----------------------\n");
+	LogText("%s transport, %.1f s of 16 ms frames with a 250 ms stall every second\n",
+	        transport->GetName(), seconds);
+
+	ServoBenchmarkSensor sensor;
+	sensor.Done = false;
+	Ptr<Thread> sensorThread = *new Thread(servoSensorFn, &sensor);
+	sensorThread->Start();
+
+	ServoLink link;
+	link.SetTransport(transport);
+	Ptr<ServoSender> sender = *new ServoSender(&link, &sensor.Fusion, periodMks);
+	sender->SetPredictionTime(0.1f);
+	sender->Start();
+
+	// The render loop, with the old send schedule played alongside it.
+	ServoJitterHistogram renderLoop;
+	VideoTimewarp        timewarp;
+	UInt64 start = Timer::GetTicks(), end = start + (UInt64)(seconds * Timer::MksPerSecond);
+	UInt64 lastRenderSend = 0;
+	UInt32 frame = 0, posesTaken = 0, posesOutOfOrder = 0;
+	UInt64 lastPoseTicks = 0;
+
+	while (Timer::GetTicks() < end)
+	{
+		UInt64 now = Timer::GetTicks();
+		if (lastRenderSend == 0 || now - lastRenderSend >= 15000)
+		{
+			UInt32 interval = lastRenderSend ? (UInt32)(now - lastRenderSend) : 0;
+			renderLoop.Add(interval > 15000 ? interval - 15000 : 0, interval);
+			lastRenderSend = now;
+		}
+
+		ServoPose pose;
+		while (sender->PopSentPose(&pose))
+		{
+			if (pose.Ticks < lastPoseTicks)
+				posesOutOfOrder++;
+			lastPoseTicks = pose.Ticks;
+			timewarp.RecordServoPose(pose.Ticks, pose.Yaw, pose.Pitch);
+			posesTaken++;
+		}
+
+		Thread::MSleep((++frame % 60) == 0 ? 250 : 16);
+	}
+
+	sender->Stop();
+	sensor.Done = true;
+	while (!sensorThread->IsFinished())
+		Thread::MSleep(1);
+
+	ServoJitterHistogram jitter;
+	sender->GetJitter(&jitter);
+	jitter.Log("Servo sender thread", periodMks);
+	renderLoop.Log("Sending from the render loop", 15000);
+	LogText("%u packets sent, %u failed; %u poses taken by the render loop, %u out of order\n",
+	        link.GetSentCount(), link.GetFailedCount(), posesTaken, posesOutOfOrder);
+	return link.GetSentCount() > 0 && link.GetFailedCount() == 0 && posesOutOfOrder == 0;
+}
+
+
+bool SaveVideoTimewarpTraces(const char* headTracePath, const char* servoTracePath)
+{
+	Util::SensorTraceRecorder recorder;
+	if (!recorder.Open(headTracePath))
+	{
+		LogText("Couldn't write %s\n", headTracePath);
+		return false;
+	}
+
+	// Yaw and pitch swinging at different rates, as body frames at 1 kHz, with the
+	// gyro rates in the head's frame.
+	SensorFusion     fusion;
+	MessageBodyFrame msg(0);
+	Array<ServoPose> commands;
+	UInt32           seed = 777;
+	const float      dt   = 0.001f;
+	for (int i = 1; i <= 3000; i++)
+	{
+		float t         = i * dt;
+		float yawRate   = 0.7f * 2 * Math<float>::Pi * 0.4f * cosf(2 * Math<float>::Pi * 0.4f * t);
+		float pitch     = 0.3f * sinf(2 * Math<float>::Pi * 0.6f * t);
+		float pitchRate = 0.3f * 2 * Math<float>::Pi * 0.6f * cosf(2 * Math<float>::Pi * 0.6f * t);
+		Quatf q         = fusion.GetOrientation();
+
+		msg.AbsoluteTimeMks = (UInt64)i * 1000;
+		msg.TimeDelta       = dt;
+		msg.RotationRate    = Quatf(Vector3f(1, 0, 0), -pitch).Rotate(Vector3f(0, yawRate, 0)) +
+		                      Vector3f(pitchRate, 0, 0) + Vector3f(nextNoise(&seed), nextNoise(&seed), 0);
+		msg.Acceleration    = q.Inverted().Rotate(Vector3f(0, 9.81f, 0));
+		recorder.OnMessage(msg);
+		fusion.OnMessage(msg);
+
+		// What the servo sender sends without prediction, every 15 ms, but nothing
+		// from 1.2 to 1.6 s as if it had stalled.
+		if (msg.AbsoluteTimeMks % 15000 == 0 &&
+		    (msg.AbsoluteTimeMks <= 1200000 || msg.AbsoluteTimeMks >= 1600000))
+		{
+			UByte x, y;
+			ServoSender::GetServoPosition(fusion.GetOrientation(), &x, &y);
+			commands.PushBack(ServoPose(msg.AbsoluteTimeMks,
+			                            DegreeToRad((float)(x - SERVO_MEDIAN_BOUNDARY)),
+			                            DegreeToRad((float)(SERVO_MEDIAN_BOUNDARY - y))));
+		}
+	}
+	recorder.Close();
+
+	if (!SaveServoTrace(servoTracePath, commands))
+	{
+		LogText("Couldn't write %s\n", servoTracePath);
+		return false;
+	}
+	LogText("Wrote %u samples to %s and %u servo commands to %s\n",
+	        recorder.GetRecordCount(), headTracePath, (UInt32)commands.GetSize(), servoTracePath);
+	return true;
+}
+
+// Frames checked by CheckVideoTimewarp, and the largest errors found.
+struct TimewarpCheckStats
+{
+	UInt32  Frames;
+	float   PoseError, OffsetError;
+
+	TimewarpCheckStats() : Frames(0), PoseError(0), OffsetError(0) {}
+
+	void Add(float poseError, float offsetError)
+	{
+		Frames++;
+		PoseError   = Alg::Max(PoseError, poseError);
+		OffsetError = Alg::Max(OffsetError, offsetError);
+	}
+};
+
+bool CheckVideoTimewarp(const char* headTracePath, const char* servoTracePath)
+{
+	LogText("\nVideo Timewarp Check\n--------------------\n");
+
+	Util::SensorTraceReader        reader;
+	Array<Util::SensorTraceRecord> head;
+	Array<ServoPose>               commands;
+	if (!reader.Open(headTracePath) || !reader.ReadAll(&head) || head.GetSize() == 0 ||
+	    !LoadServoTrace(servoTracePath, &commands) || commands.GetSize() == 0)
+	{
+		LogText("Couldn't load %s and %s\n", headTracePath, servoTracePath);
+		return false;
+	}
+
+	// The head's orientation after every sample, for frames captured while the
+	// servos got no commands.
+	Array<Quatf> orientations;
+	{
+		SensorFusion     fusion;
+		MessageBodyFrame msg(0);
+		for (UPInt i = 0; i < head.GetSize(); i++)
+		{
+			head[i].ToMessage(&msg);
+			fusion.OnMessage(msg);
+			orientations.PushBack(fusion.GetOrientation());
+		}
+	}
+
+	Ptr<SyntheticFrameSource> source = *new SyntheticFrameSource(320, 240, FramePixel_BGRA, 30.0f);
+	if (!source->Start())
+	{
+		LogText("Couldn't start the frame source\n");
+		return false;
+	}
+
+	// The traces are played in real time, shifted to start now, while this thread
+	// picks up frames at 60 Hz the way the render loop does.
+	SensorFusion     fusion;
+	VideoTimewarp    timewarp;
+	MessageBodyFrame msg(0);
+	timewarp.SetOrientationHistory(&fusion);
+
+	const float  tanHalfFov   = tanf(DegreeToRad(30.0f));
+	const UInt64 latencyTicks = (UInt64)(timewarp.GetServoLatency() * Timer::MksPerSecond);
+	const UInt64 traceStart   = head[0].AbsoluteTimeMks;
+	const UInt64 hostStart    = Timer::GetTicks();
+	UPInt nextSample = 0, nextCommand = 0;
+
+	TimewarpCheckStats fromCommands, fromHistory;
+	UInt32             wrong = 0;
+	while (nextSample < head.GetSize())
+	{
+		// Picked up before the sensor catches up to now, so the history covers it.
+		VideoFrame* frame = source->GetLatestFrame();
+
+		UInt64 now = traceStart + (Timer::GetTicks() - hostStart);
+		for (; nextSample < head.GetSize() && head[nextSample].AbsoluteTimeMks <= now; nextSample++)
+		{
+			head[nextSample].ToMessage(&msg);
+			msg.AbsoluteTimeMks = hostStart + (head[nextSample].AbsoluteTimeMks - traceStart);
+			fusion.OnMessage(msg);
+		}
+		for (; nextCommand < commands.GetSize() && commands[nextCommand].Ticks <= now; nextCommand++)
+		{
+			const ServoPose& c = commands[nextCommand];
+			timewarp.RecordServoPose(hostStart + (c.Ticks - traceStart), c.Yaw, c.Pitch);
+		}
+
+		if (frame && frame->CaptureTicks >= hostStart)
+		{
+			// Where the cameras looked: the last command sent the servo latency before
+			// capture, unless that is long gone, then the servo position for the head
+			// at capture.
+			UInt64    captured = traceStart + (frame->CaptureTicks - hostStart);
+			ServoPose expected;
+			bool      commanded = false;
+			for (UPInt i = 0; i < commands.GetSize() && commands[i].Ticks + latencyTicks <= captured; i++)
+			{
+				expected  = commands[i];
+				commanded = captured - latencyTicks - commands[i].Ticks <= 50000;
+			}
+			if (!commanded)
+			{
+				UPInt i = 0;
+				while (i + 1 < head.GetSize() && head[i + 1].AbsoluteTimeMks <= captured)
+					i++;
+				UByte x, y;
+				ServoSender::GetServoPosition(orientations[i], &x, &y);
+				expected = ServoPose(captured, DegreeToRad((float)(x - SERVO_MEDIAN_BOUNDARY)),
+				                     DegreeToRad((float)(SERVO_MEDIAN_BOUNDARY - y)));
+			}
+
+			float headYaw, headPitch, headRoll;
+			fusion.GetOrientation().GetEulerAngles<Axis_Y, Axis_X, Axis_Z>(&headYaw, &headPitch, &headRoll);
+			Vector2f expectedOffset(tanf(headYaw - expected.Yaw) / tanHalfFov,
+			                        tanf(headPitch - expected.Pitch) / tanHalfFov);
+
+			ServoPose pose;
+			if (!timewarp.GetFramePose(frame->CaptureTicks, &pose))
+			{
+				wrong++;
+			}
+			else
+			{
+				Vector2f offset      = timewarp.GetFrameOffset(frame->CaptureTicks, headYaw, headPitch, tanHalfFov);
+				float    poseError   = Alg::Max(fabsf(pose.Yaw - expected.Yaw), fabsf(pose.Pitch - expected.Pitch));
+				float    offsetError = Alg::Max(fabsf(offset.x - expectedOffset.x), fabsf(offset.y - expectedOffset.y));
+
+				// From the history, the servo position may round to the next degree
+				// where the sample picked here and the interpolated one differ.
+				float poseTolerance   = commanded ? 1e-6f : DegreeToRad(1.5f);
+				float offsetTolerance = commanded ? 1e-4f : 0.05f;
+				if (poseError > poseTolerance || offsetError > offsetTolerance)
+					wrong++;
+				(commanded ? fromCommands : fromHistory).Add(poseError, offsetError);
+			}
+		}
+
+		Thread::MSleep(16);
+	}
+	source->Stop();
+
+	LogText("%u frames from servo commands: max pose error %.6f rad, offset error %.6f\n",
+	        fromCommands.Frames, fromCommands.PoseError, fromCommands.OffsetError);
+	LogText("%u frames from the orientation history: max pose error %.4f rad, offset error %.4f\n",
+	        fromHistory.Frames, fromHistory.PoseError, fromHistory.OffsetError);
+
+	// At 30 fps the trace has about 75 frames from commands and 15 from its start and the stall.
+	bool ok = wrong == 0 && fromCommands.Frames >= 30 && fromHistory.Frames >= 3;
+	LogText("%u wrong, %s\n", wrong, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+
+// Consumer of the queue benchmark, woken through an Event the way the Win32
+// DeviceManagerThread is.
+class BenchmarkCommandThread : public Thread, public ThreadCommandQueue
+{
+public:
+	Event   CommandEvent;
+	UInt64  Executed;
+
+	BenchmarkCommandThread() : Executed(0) { }
+
+	virtual void OnPushNonEmpty_Locked() { CommandEvent.SetEvent(); }
+	virtual void OnPopEmpty_Locked()     { CommandEvent.ResetEvent(); }
+
+	virtual int Run()
+	{
+		ThreadCommand::PopBuffer command;
+		while (!IsExiting())
+		{
+			if (PopCommand(&command))
+				command.Execute();
+			else
+				CommandEvent.Wait();
+		}
+		return 0;
+	}
+
+	UInt64  Count()                 { return ++Executed; }
+	UInt32  Echo(UInt32 value)      { return value; }
+};
+
+struct BenchmarkCommandProducer
+{
+	BenchmarkCommandThread* pConsumer;
+	UInt32                  Commands;
+	bool                    RoundTrip;
+	double                  NsPerRawTick;
+	UInt32                  Buckets[BucketCount];
+	UInt64                  MaxNs;
+};
+
+static int commandProducerFn(Thread*, void* h)
+{
+	BenchmarkCommandProducer* producer = (BenchmarkCommandProducer*)h;
+	BenchmarkCommandThread*   consumer = producer->pConsumer;
+
+	for (UInt32 i = 0; i < producer->Commands; i++)
+	{
+		if (!producer->RoundTrip)
+		{
+			consumer->PushCall(&BenchmarkCommandThread::Count);
+			continue;
+		}
+
+		UInt64 start = Timer::GetRawTicks();
+		UInt32 result = 0;
+		consumer->PushCallAndWaitResult(&BenchmarkCommandThread::Echo, &result, i);
+		UInt64 ns = (UInt64)((Timer::GetRawTicks() - start) * producer->NsPerRawTick);
+		OVR_ASSERT(result == i);
+
+		producer->Buckets[ns < MaxNs ? ns / BucketNs : BucketCount - 1]++;
+		producer->MaxNs = Alg::Max(producer->MaxNs, ns);
+	}
+	return 0;
+}
+
+void BenchmarkThreadCommandQueue(UInt32 commandsPerRun, UInt32 roundTripsPerRun)
+{
+	LogText("\nThread Command Queue Benchmark\n------------------------------\n");
+
+	double nsPerRawTick = 1000000000.0 / (double)Timer::GetRawFrequency();
+	Ptr<BenchmarkCommandThread> consumer = *new BenchmarkCommandThread;
+	consumer->Start();
+
+	Array<BenchmarkCommandProducer> producers;
+	producers.Resize(8);
+
+	for (int producerCount = 1; producerCount <= 8; producerCount *= 2)
+	{
+		for (int roundTrip = 0; roundTrip <= 1; roundTrip++)
+		{
+			UInt32 total = roundTrip ? roundTripsPerRun : commandsPerRun;
+			UInt64 executedBefore = consumer->Executed;
+
+			Array<Ptr<Thread> > threads;
+			for (int i = 0; i < producerCount; i++)
+			{
+				BenchmarkCommandProducer& p = producers[i];
+				memset(&p, 0, sizeof(p));
+				p.pConsumer    = consumer;
+				p.Commands     = total / producerCount;
+				p.RoundTrip    = roundTrip != 0;
+				p.NsPerRawTick = nsPerRawTick;
+				threads.PushBack(*new Thread(commandProducerFn, &p));
+			}
+
+			UInt64 start = Timer::GetRawTicks();
+			for (int i = 0; i < producerCount; i++)
+				threads[i]->Start();
+			for (int i = 0; i < producerCount; i++)
+			{
+				while (!threads[i]->IsFinished())
+					Thread::MSleep(1);
+			}
+
+			// Commands run in order, so this returns once the rest have run.
+			consumer->PushCall(&BenchmarkCommandThread::Count, true);
+			double seconds = (Timer::GetRawTicks() - start) * nsPerRawTick * 1e-9;
+			UInt64 executed = consumer->Executed - executedBefore - 1;
+
+			if (!roundTrip)
+			{
+				LogText("%i producer(s): %9.0f commands/s", producerCount, executed / seconds);
+				continue;
+			}
+
+			UInt32* buckets = producers[0].Buckets;
+			UInt64  maxNs   = producers[0].MaxNs;
+			for (int i = 1; i < producerCount; i++)
+			{
+				for (int b = 0; b < BucketCount; b++)
+					buckets[b] += producers[i].Buckets[b];
+				maxNs = Alg::Max(maxNs, producers[i].MaxNs);
+			}
+			UInt64 calls = (UInt64)(total / producerCount) * producerCount;
+			LogText(", %8.0f round trips/s, p50 %6.0f ns, p99 %7.0f ns, max %8.0f ns\n",
+			        calls / seconds, percentileNs(buckets, calls, 0.5), percentileNs(buckets, calls, 0.99),
+			        (double)maxNs);
+		}
+	}
+
+	consumer->PushExitCommand(true);
+	while (!consumer->IsFinished())
+		Thread::MSleep(1);
+}
+
+
+#if defined(OVR_OS_LINUX)
+
+// A pipe standing in for a hidraw node, read by the manager thread.
+struct BenchmarkFakeDevice : public Linux::DeviceManagerThread::Notifier
+{
+	enum { ReportSize = 62 };
+
+	int     Fds[2];
+	double  NsPerRawTick;
+	UInt32  Buckets[BucketCount];
+	UInt64  Reports;
+	UInt64  LongestNs;
+
+	virtual void OnEvent(int, int fd)
+	{
+		UByte report[ReportSize];
+		if (read(fd, report, ReportSize) != ReportSize)
+			return;
+
+		UInt64 sent;
+		memcpy(&sent, report, sizeof(sent));
+		UInt64 ns = (UInt64)((Timer::GetRawTicks() - sent) * NsPerRawTick);
+
+		Buckets[ns < MaxNs ? ns / BucketNs : BucketCount - 1]++;
+		Reports++;
+		if (ns > LongestNs)
+			LongestNs = ns;
+	}
+};
+
+// Asks to be called back every PeriodMks and records how late each call is. Calls
+// before then are counted apart and don't move the time it is due.
+struct BenchmarkTicksNotifier : public Linux::DeviceManagerThread::Notifier
+{
+	enum { PeriodMks = 10000 };
+
+	UInt64          DueMks;
+	Array<UInt32>   LateMks;
+	UInt32          EarlyCalls;
+
+	BenchmarkTicksNotifier() : DueMks(0), EarlyCalls(0) { }
+
+	virtual void OnEvent(int, int) { }
+
+	virtual UInt64 OnTicks(UInt64 ticksMks)
+	{
+		if (ticksMks < DueMks)
+		{
+			EarlyCalls++;
+			return DueMks - ticksMks;
+		}
+		if (DueMks)
+			LateMks.PushBack((UInt32)(ticksMks - DueMks));
+		DueMks = ticksMks + PeriodMks;
+		return PeriodMks;
+	}
+};
+
+struct BenchmarkDispatchWriter
+{
+	BenchmarkFakeDevice*    pDevices;
+	int                     DeviceCount;
+	volatile bool           Done;
+};
+
+static int dispatchWriterFn(Thread*, void* h)
+{
+	BenchmarkDispatchWriter* writer = (BenchmarkDispatchWriter*)h;
+
+	UByte report[BenchmarkFakeDevice::ReportSize];
+	memset(report, 0, sizeof(report));
+	while (!writer->Done)
+	{
+		for (int i = 0; i < writer->DeviceCount; i++)
+		{
+			UInt64 now = Timer::GetRawTicks();
+			memcpy(report, &now, sizeof(now));
+			if (write(writer->pDevices[i].Fds[1], report, sizeof(report)) != sizeof(report))
+				return 1;
+		}
+		Thread::MSleep(1);
+	}
+	return 0;
+}
+
+void BenchmarkDeviceManagerDispatch(int deviceCount, float seconds)
+{
+	LogText("\nDevice Manager Dispatch Benchmark\n---------------------------------\n");
+
+	typedef Linux::DeviceManagerThread::Notifier Notifier;
+
+	Ptr<Linux::DeviceManagerThread> manager = *new Linux::DeviceManagerThread;
+	manager->Start();
+
+	Array<BenchmarkFakeDevice> devices;
+	devices.Resize(deviceCount);
+	for (int i = 0; i < deviceCount; i++)
+	{
+		BenchmarkFakeDevice& d = devices[i];
+		memset(d.Buckets, 0, sizeof(d.Buckets));
+		d.Reports      = 0;
+		d.LongestNs    = 0;
+		d.NsPerRawTick = 1000000000.0 / (double)Timer::GetRawFrequency();
+		if (pipe(d.Fds) != 0)
+		{
+			LogText("Couldn't create a pipe for fake device %i\n", i);
+			deviceCount = i;
+			break;
+		}
+
+		bool added = false;
+		manager->PushCallAndWaitResult(manager.GetPtr(), &Linux::DeviceManagerThread::AddSelectFd,
+		                               &added, (Notifier*)&d, d.Fds[0]);
+		OVR_ASSERT(added);
+	}
+
+	BenchmarkTicksNotifier ticks;
+	bool added = false;
+	manager->PushCallAndWaitResult(manager.GetPtr(), &Linux::DeviceManagerThread::AddTicksNotifier,
+	                               &added, (Notifier*)&ticks);
+
+	BenchmarkDispatchWriter writer;
+	writer.pDevices    = &devices[0];
+	writer.DeviceCount = deviceCount;
+	writer.Done        = false;
+	Ptr<Thread> writerThread = *new Thread(dispatchWriterFn, &writer);
+	writerThread->Start();
+
+	Thread::MSleep((unsigned)(seconds * 1000));
+	writer.Done = true;
+	while (!writerThread->IsFinished())
+		Thread::MSleep(1);
+
+	manager->PushCallAndWaitResult(manager.GetPtr(), &Linux::DeviceManagerThread::RemoveTicksNotifier,
+	                               &added, (Notifier*)&ticks);
+	for (int i = 0; i < deviceCount; i++)
+	{
+		manager->PushCallAndWaitResult(manager.GetPtr(), &Linux::DeviceManagerThread::RemoveSelectFd,
+		                               &added, (Notifier*)&devices[i], devices[i].Fds[0]);
+		close(devices[i].Fds[0]);
+		close(devices[i].Fds[1]);
+	}
+	manager->PushExitCommand(true);
+	while (!manager->IsFinished())
+		Thread::MSleep(1);
+
+	for (int i = 0; i < deviceCount; i++)
+	{
+		BenchmarkFakeDevice& d = devices[i];
+		LogText("device %i: %6u reports, dispatch p50 %6.0f ns, p99 %7.0f ns, max %8.0f ns\n",
+		        i, (UInt32)d.Reports, percentileNs(d.Buckets, d.Reports, 0.5),
+		        percentileNs(d.Buckets, d.Reports, 0.99), (double)d.LongestNs);
+	}
+
+	UPInt calls = ticks.LateMks.GetSize();
+	if (calls == 0)
+	{
+		LogText("ticks: never called when due, %u early calls\n", ticks.EarlyCalls);
+		return;
+	}
+	Alg::QuickSort(ticks.LateMks);
+	LogText("ticks: %u calls every %u ms, late by p50 %u us, p99 %u us, max %u us; %u early calls\n",
+	        (UInt32)calls, (UInt32)BenchmarkTicksNotifier::PeriodMks / 1000,
+	        ticks.LateMks[calls / 2], ticks.LateMks[calls * 99 / 100], ticks.LateMks[calls - 1],
+	        ticks.EarlyCalls);
+}
+
+
+// Reads the stand-in hidraw socket either a report per wake-up or through the ring,
+// and checks the sequence number in each report for gaps.
+struct BenchmarkReportReader : public Linux::DeviceManagerThread::Notifier,
+                               public HIDDevice::HIDHandler
+{
+	enum { QueueLength = 64 };
+
+	bool                UseRing;
+	Linux::HIDReportRing Ring;
+	UByte               ReadBuffer[Linux::HIDReportRing::SlotSize];
+
+	UInt32              Wakeups;
+	UInt32              NextSequence;
+	UInt32              Gaps;
+	AtomicInt<UInt32>   Consumed;
+
+	BenchmarkReportReader(bool useRing)
+		: UseRing(useRing), Wakeups(0), NextSequence(0), Gaps(0), Consumed(0) { }
+
+	virtual void OnEvent(int, int fd)
+	{
+		Wakeups++;
+		if (UseRing)
+		{
+			Ring.Drain(fd, this);
+			return;
+		}
+		int bytes = read(fd, ReadBuffer, sizeof(ReadBuffer));
+		if (bytes > 0)
+			OnInputReport(ReadBuffer, bytes);
+	}
+
+	virtual void OnInputReport(UByte* data, UInt32)
+	{
+		UInt32 sequence;
+		memcpy(&sequence, data + 2, sizeof(sequence));
+		if (sequence != NextSequence)
+			Gaps++;
+		NextSequence = sequence + 1;
+		Consumed.Store_Release(Consumed + 1);
+	}
+};
+
+struct BenchmarkReportWriter
+{
+	int                     Fd;
+	UInt32                  RateHz;
+	BenchmarkReportReader*  pReader;
+	volatile bool           Done;
+	UInt32                  Sent;
+	UInt32                  Dropped;
+};
+
+// Writes RateHz / 1000 reports every millisecond, dropping the ones that find the
+// emulated hidraw queue full, as the kernel does.
+static int reportWriterFn(Thread*, void* h)
+{
+	BenchmarkReportWriter* writer = (BenchmarkReportWriter*)h;
+
+	UByte  report[62];
+	UInt32 sequence = 0;
+	memset(report, 0, sizeof(report));
+	report[0] = 1;
+
+	while (!writer->Done)
+	{
+		for (UInt32 i = 0; i < writer->RateHz / 1000; i++, sequence++)
+		{
+			if (writer->Sent - writer->pReader->Consumed.Load_Acquire() >= BenchmarkReportReader::QueueLength)
+			{
+				writer->Dropped++;
+				continue;
+			}
+			memcpy(report + 2, &sequence, sizeof(sequence));
+			if (send(writer->Fd, report, sizeof(report), MSG_DONTWAIT) == sizeof(report))
+				writer->Sent++;
+			else
+				writer->Dropped++;
+		}
+		Thread::MSleep(1);
+	}
+	return 0;
+}
+
+// Holds up the manager thread, as a slow feature report or device open would.
+struct BenchmarkManagerStall
+{
+	UInt32  StallMs;
+	int     Stall() { Thread::MSleep(StallMs); return 0; }
+};
+
+void BenchmarkHIDReportRing(UInt32 rateHz, UInt32 stallMs, float seconds)
+{
+	LogText("\nHID Report Ring Benchmark\n-------------------------\n");
+	LogText("%u reports/s, manager thread stalled %u ms every 200 ms\n", rateHz, stallMs);
+
+	typedef Linux::DeviceManagerThread::Notifier Notifier;
+
+	for (int useRing = 0; useRing <= 1; useRing++)
+	{
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, fds) != 0)
+		{
+			LogText("Couldn't create a socket pair\n");
+			return;
+		}
+
+		Ptr<Linux::DeviceManagerThread> manager = *new Linux::DeviceManagerThread;
+		manager->Start();
+
+		BenchmarkReportReader reader(useRing != 0);
+		bool added = false;
+		manager->PushCallAndWaitResult(manager.GetPtr(), &Linux::DeviceManagerThread::AddSelectFd,
+		                               &added, (Notifier*)&reader, fds[0]);
+
+		BenchmarkReportWriter writer;
+		writer.Fd      = fds[1];
+		writer.RateHz  = rateHz;
+		writer.pReader = &reader;
+		writer.Done    = false;
+		writer.Sent    = 0;
+		writer.Dropped = 0;
+		Ptr<Thread> writerThread = *new Thread(reportWriterFn, &writer);
+		writerThread->Start();
+
+		BenchmarkManagerStall stall;
+		stall.StallMs = stallMs;
+		for (UInt32 ms = 0; ms < (UInt32)(seconds * 1000); ms += 200)
+		{
+			if (stallMs)
+				manager->PushCall(&stall, &BenchmarkManagerStall::Stall);
+			Thread::MSleep(200);
+		}
+		writer.Done = true;
+		while (!writerThread->IsFinished())
+			Thread::MSleep(1);
+
+		// Let the reader catch up with what was sent before stopping it.
+		for (int i = 0; i < 100 && reader.Consumed < writer.Sent; i++)
+			Thread::MSleep(1);
+
+		manager->PushCallAndWaitResult(manager.GetPtr(), &Linux::DeviceManagerThread::RemoveSelectFd,
+		                               &added, (Notifier*)&reader, fds[0]);
+		manager->PushExitCommand(true);
+		while (!manager->IsFinished())
+			Thread::MSleep(1);
+		close(fds[0]);
+		close(fds[1]);
+
+		UInt32 total = writer.Sent + writer.Dropped;
+		LogText("%s: %u of %u reports dropped (%.2f%%), %u gaps seen, %u wake-ups, %.2f reports per wake-up\n",
+		        useRing ? "ring       " : "single read", writer.Dropped, total,
+		        total ? writer.Dropped * 100.0 / total : 0.0, reader.Gaps, reader.Wakeups,
+		        reader.Wakeups ? (double)reader.Consumed / reader.Wakeups : 0.0);
+		if (useRing)
+		{
+			const Linux::HIDReportRing::Stats& stats = reader.Ring.GetStats();
+			LogText("             ring: at most %u reports at once, %u overruns\n",
+			        stats.MaxBatch, stats.Overruns);
+		}
+	}
+}
+
+#endif
+
+
+//-------------------------------------------------------------------------------------
+// ***** Virtual tracker benchmark
+
+// Counts the body frames SensorDevice hands to the fusion. Called on the manager
+// thread only.
+class BenchmarkFrameCounter : public MessageHandler
+{
+public:
+	UInt64 Frames;
+
+	BenchmarkFrameCounter() : Frames(0) { }
+
+	virtual void OnMessage(const Message& msg)
+	{
+		if (msg.Type == Message_BodyFrame)
+			Frames++;
+	}
+	virtual bool SupportsMessageType(MessageType type) const { return type == Message_BodyFrame; }
+};
+
+// The SensorDevice manager enumerates for a tracker added to its VirtualHIDDeviceManager,
+// or null if it isn't found.
+static SensorDevice* createVirtualSensor(DeviceManager* manager, VirtualTrackerDevice* tracker)
+{
+	for (DeviceEnumerator<SensorDevice> e = manager->EnumerateDevices<SensorDevice>(); e; e.Next())
+	{
+		SensorInfo info;
+		if (e.GetDeviceInfo(&info) && !strcmp(info.SerialNumber, tracker->GetDesc().SerialNumber.ToCStr()))
+			return e.CreateDevice();
+	}
+	return 0;
+}
+
+bool BenchmarkVirtualTracker(DeviceManager* manager, UInt32 maxRateHz, float seconds)
+{
+	LogText("\nVirtual Tracker Benchmark\n-------------------------\n");
+
+	Ptr<VirtualHIDDeviceManager>  hid     = *VirtualHIDDeviceManager::Install(manager);
+	if (!hid)
+	{
+		LogText("Couldn't install the virtual HID device manager\n");
+		return false;
+	}
+
+	// Start just short of the Timestamp wrap-around, so every run goes through it.
+	Ptr<VirtualTrackerMotion>     motion  = *new SyntheticTrackerMotion;
+	Ptr<VirtualTrackerDevice>     tracker = *new VirtualTrackerDevice(motion);
+	tracker->SetFirstTimestamp(0xFF00);
+	hid->AddDevice(tracker);
+
+	Ptr<SensorDevice> sensor = *createVirtualSensor(manager, tracker);
+	if (!sensor)
+	{
+		LogText("The virtual tracker wasn't enumerated\n");
+		return false;
+	}
+
+	// One report per sample, as at 1 kHz on the hardware.
+	sensor->SetReportRate(1000);
+
+	SensorFusion          fusion;
+	BenchmarkFrameCounter counter;
+	fusion.AttachToSensor(sensor);
+	fusion.SetDelegateMessageHandler(&counter);
+
+	bool lossless = true;
+	for (UInt32 rateHz = 1000; rateHz <= maxRateHz; rateHz *= 2)
+	{
+		VirtualTrackerDevice::Stats before = tracker->GetStats();
+		UInt64 framesBefore = counter.Frames;
+
+		double start = Timer::GetSeconds();
+		tracker->Start(rateHz);
+		Thread::MSleep((unsigned)(seconds * 1000));
+		tracker->Stop();
+
+		// Reading the report rate goes through the manager thread, behind any
+		// delivery still queued.
+		sensor->GetReportRate();
+		double elapsed = Timer::GetSeconds() - start;
+
+		VirtualTrackerDevice::Stats after = tracker->GetStats();
+		UInt64 samples    = after.Samples - before.Samples;
+		UInt64 delivered  = after.ReportsDelivered - before.ReportsDelivered;
+		UInt64 dropped    = after.ReportsDropped - before.ReportsDropped;
+		UInt32 deliveries = after.Deliveries - before.Deliveries;
+		UInt64 frames     = counter.Frames - framesBefore;
+
+		LogText("%5u Hz: %.0f reports/s delivered, %.0f body frames/s into the fusion, "
+		        "%llu of %llu reports dropped, %.2f reports per wake-up\n",
+		        rateHz, delivered / elapsed, frames / elapsed,
+		        (unsigned long long)dropped, (unsigned long long)samples,
+		        deliveries ? (double)delivered / deliveries : 0.0);
+
+		// Every sample reported should reach the fusion as a body frame.
+		UInt64 reported = samples - (after.SilentSamples - before.SilentSamples);
+		if (dropped || frames < reported)
+		{
+			LogText("       %llu of %llu samples lost\n",
+			        (unsigned long long)(reported - (frames < reported ? frames : reported)),
+			        (unsigned long long)reported);
+			lossless = false;
+		}
+	}
+
+	VirtualTrackerDevice::Stats stats = tracker->GetStats();
+	LogText("%u feature reports and %u keep-alives received\n", stats.FeatureReports, stats.KeepAlives);
+
+	fusion.AttachToSensor(0);
+	sensor.Clear();
+	hid->RemoveDevice(tracker);
+	return lossless;
+}
+
+bool RecordVirtualTrackerTrace(DeviceManager* manager, const char* tracePath, float seconds)
+{
+	LogText("\nVirtual Tracker Recording\n-------------------------\n");
+
+	Util::SensorTraceRecorder recorder;
+	if (!recorder.Open(tracePath))
+	{
+		LogText("Couldn't write %s\n", tracePath);
+		return false;
+	}
+
+	Ptr<VirtualHIDDeviceManager> hid = *VirtualHIDDeviceManager::Install(manager);
+	if (!hid)
+	{
+		LogText("Couldn't install the virtual HID device manager\n");
+		return false;
+	}
+
+	Ptr<VirtualTrackerMotion> motion  = *new SyntheticTrackerMotion;
+	Ptr<VirtualTrackerDevice> tracker = *new VirtualTrackerDevice(motion);
+	hid->AddDevice(tracker);
+
+	Ptr<SensorDevice> sensor = *createVirtualSensor(manager, tracker);
+	if (!sensor)
+	{
+		LogText("The virtual tracker wasn't enumerated\n");
+		hid->RemoveDevice(tracker);
+		return false;
+	}
+	sensor->SetReportRate(1000);
+
+	// The recorder sees the body frames the fusion does, as in the demo.
+	SensorFusion fusion;
+	fusion.AttachToSensor(sensor);
+	fusion.SetDelegateMessageHandler(&recorder);
+
+	tracker->Start(1000);
+	Thread::MSleep((unsigned)(seconds * 1000));
+	tracker->Stop();
+
+	// Behind any delivery still queued on the manager thread.
+	sensor->GetReportRate();
+
+	fusion.SetDelegateMessageHandler(0);
+	fusion.AttachToSensor(0);
+	sensor.Clear();
+	hid->RemoveDevice(tracker);
+	recorder.Close();
+
+	VirtualTrackerDevice::Stats stats = tracker->GetStats();
+	UInt64 reported = stats.Samples - stats.SilentSamples;
+	LogText("%u body frames recorded to %s, of %llu samples reported\n",
+	        recorder.GetRecordCount(), tracePath, (unsigned long long)reported);
+	return recorder.GetRecordCount() > 0 && recorder.GetRecordCount() >= reported;
+}
+
+bool CheckSensorTraceReplay(const char* tracePath, const char* referencePath)
+{
+	LogText("\nSensor Trace Replay\n-------------------\n");
+
+	SensorFusion                 fusion;
+	Util::SensorTraceReplayStats stats;
+	if (!Util::ReplaySensorTrace(tracePath, fusion, 0, &stats))
+	{
+		LogText("Couldn't load %s\n", tracePath);
+		return false;
+	}
+	LogText("%u samples of %s in %.3f s, %.0f samples/s\n",
+	        stats.Samples, tracePath, stats.Seconds, stats.SamplesPerSecond);
+	if (!referencePath)
+	{
+		return true;
+	}
+
+	// Again, comparing the orientation after every sample with the reference.
+	Util::SensorTraceReader              reader;
+	Array<Util::SensorTraceRecord>       records;
+	Array<Util::OrientationTraceRecord>  reference;
+	if (!reader.Open(tracePath) || !reader.ReadAll(&records) ||
+	    !Util::LoadOrientationTrace(referencePath, &reference))
+	{
+		LogText("Couldn't load %s\n", referencePath);
+		return false;
+	}
+	if (records.GetSize() != reference.GetSize())
+	{
+		LogText("%u samples in the trace but %u in %s, FAILED\n",
+		        (UInt32)records.GetSize(), (UInt32)reference.GetSize(), referencePath);
+		return false;
+	}
+
+	SensorFusion     replay;
+	MessageBodyFrame msg(0);
+	float  maxAngle = 0;
+	UInt32 diverged = 0, firstDiverged = 0;
+	for (UPInt i = 0; i < records.GetSize(); i++)
+	{
+		records[i].ToMessage(&msg);
+		replay.OnMessage(msg);
+
+		// Angle of the rotation between the two, without acos losing small ones.
+		Quatf delta = replay.GetOrientation().Inverted() * reference[i].Orientation;
+		float angle = 2 * asinf(Alg::Min(1.0f, Vector3f(delta.x, delta.y, delta.z).Length()));
+		maxAngle = Alg::Max(maxAngle, angle);
+
+		// Builds may round differently, but not by more than this.
+		if (angle > 1e-4f || reference[i].TimeMks != records[i].AbsoluteTimeMks)
+		{
+			if (diverged++ == 0)
+				firstDiverged = (UInt32)i;
+		}
+	}
+
+	if (diverged)
+	{
+		LogText("%u samples diverge from %s, the first at sample %u; max difference %.6f rad, FAILED\n",
+		        diverged, referencePath, firstDiverged, maxAngle);
+		return false;
+	}
+	LogText("Matches %s, max difference %.6f rad\n", referencePath, maxAngle);
+	return true;
+}
@@ -0,0 +1,116 @@
+#ifndef FUSION_BENCHMARK_H
+#define FUSION_BENCHMARK_H
+
+#include "OVR.h"
+
+class ServoTransport;
+
+// Measures how long reading the head orientation takes while a sensor thread feeds
+// SensorFusion at 1 kHz, as the render thread and servo sender do. Each of readerCount
+// threads reads in a loop for the given time, first the way SensorFusion used to work
+// (a lock shared with the sensor thread, held while it processes a sample) and then
+// through its lock free snapshot, and the latency percentiles of both are logged.
+void BenchmarkSensorFusionReads(int readerCount = 2, float seconds = 2.0f);
+
+// Runs a recorded trace (see Util::SensorTraceRecorder) through SensorFusion with a
+// grid of gravity correction gains, in parallel, and logs the configurations whose
+// orientation is closest to the reference trace (see Util::LoadOrientationTrace), along
+// with how long the sweep took. threadCount 0 uses one thread per CPU.
+void SweepSensorFusionGains(const char* tracePath, const char* referencePath, int threadCount = 0);
+
+// Runs laneCount gain configurations over a trace, or over a minute of synthetic head
+// motion when tracePath is null, once with a SensorFusion per configuration and once
+// with SensorFusionBatch, and logs the throughput of both and the largest orientation
+// difference between them.
+void BenchmarkSensorFusionBatch(const char* tracePath, int laneCount = 32);
+
+// Times adding a sample and taking the median of SensorFilter at window sizes from 20
+// to 1000, against the selection sort it used to run on every Median() call, and
+// checks both give the same result.
+void BenchmarkSensorFilterMedian();
+
+// Feeds SensorFusion, with yaw correction on, magnetometer readings that keep moving
+// to new directions so magnetometer reference points pile up towards the limit, and
+// logs how long handleMessage takes as the number of references grows.
+void BenchmarkMagReferenceLookup();
+
+// Runs SensorTimeFilter over two minutes of simulated reports with jittery latency from
+// trackers whose clocks drift by +50, -50 and 0 ppm against the host's. Returns false
+// if the mapped times are ever more than 50 us off once it has settled, or the drift it
+// measures is more than 2 ppm off.
+bool CheckSensorTimeFilter();
+
+// Feeds SensorFusion samples of a constant turn and checks GetOrientationAt between
+// them, then again after host time has gone back, as when the sensor's time filter
+// restarts. Returns false if any orientation is off by 0.001 rad or more.
+bool CheckOrientationHistory();
+
+// Replays a trace, or synthetic head motion when tracePath is null, through
+// SensorFusion and scores each OrientationPredictor: how far its prediction made at
+// every sample is from the orientation the fusion reaches 20, 40, 60 and 80 ms later.
+void EvaluateOrientationPredictors(const char* tracePath);
+
+// Runs ServoSender over transport for the given time, at periodMks, while this thread
+// plays a render loop of 16 ms frames that stalls for 250 ms every second, with a sensor
+// thread feeding SensorFusion at 1 kHz. Logs the send timing of the sender next to that of
+// sending from the render loop the way the demo used to, every 15 ms of ftime() at most.
+// Returns false if nothing was sent, a send failed or the poses came out of order.
+bool BenchmarkServoSender(ServoTransport* transport, OVR::UInt32 periodMks = 15000, float seconds = 10.0f);
+
+// Writes the traces CheckVideoTimewarp replays: three seconds of a head looking around
+// as a sensor trace, and the servo commands ServoSender would send for it without
+// prediction (see SaveServoTrace), with none for 400 ms in the middle as if it stalled.
+bool SaveVideoTimewarpTraces(const char* headTracePath, const char* servoTracePath);
+
+// Replays a head and a servo trace in real time through SensorFusion and VideoTimewarp,
+// next to a SyntheticFrameSource, and checks the pose and offset it gives every frame
+// picked up against the servo command the frame should show, or the head's orientation
+// when no command was sent around then. Returns false if a trace couldn't be loaded,
+// any frame is off, or too few frames were checked.
+bool CheckVideoTimewarp(const char* headTracePath, const char* servoTracePath);
+
+// Pushes commands to a ThreadCommandQueue consumer thread from 1, 2, 4 and 8 producer
+// threads: first fire-and-forget PushCalls, logging commands executed per second, then
+// PushCallAndWaitResult round trips, logging their latency percentiles.
+void BenchmarkThreadCommandQueue(OVR::UInt32 commandsPerRun = 400000, OVR::UInt32 roundTripsPerRun = 40000);
+
+#if defined(OVR_OS_LINUX)
+
+// Benchmarks of the Linux device manager, run by LinuxBench.
+
+// Registers deviceCount pipes with a DeviceManagerThread as fake hidraw devices and
+// writes a timestamped report to each every millisecond for the given time, logging
+// how long reports take to reach their OnEvent. A ticks notifier asking to be called
+// every 10 ms runs alongside, and how late its calls come is logged too.
+void BenchmarkDeviceManagerDispatch(int deviceCount = 2, float seconds = 5.0f);
+
+// Streams tracker-sized reports at rateHz through a SOCK_SEQPACKET socket standing in
+// for hidraw, whose 64 report queue is emulated by dropping reports while 64 are
+// unread, to a DeviceManagerThread that stalls for stallMs every 200 ms. Runs once
+// reading one report per wake-up, as HIDDevice used to, and once draining through
+// HIDReportRing, and logs reports dropped, wake-ups and the ring counters of both.
+void BenchmarkHIDReportRing(OVR::UInt32 rateHz = 10000, OVR::UInt32 stallMs = 5, float seconds = 5.0f);
+
+#endif
+
+// Runs the whole sensor stack on a VirtualTrackerDevice with synthetic motion,
+// installed into manager: enumeration, SensorDevice with its feature reports and
+// keep-alives, and SensorFusion. The tracker sends a report per sample at 1 kHz and
+// doubling rates up to maxRateHz, for the given time each, and the reports delivered,
+// body frames fused and reports dropped at each rate are logged. Returns false if
+// the tracker couldn't be set up, or if any report was dropped or any sample reported
+// didn't reach the fusion as a body frame.
+bool BenchmarkVirtualTracker(OVR::DeviceManager* manager, OVR::UInt32 maxRateHz = 8000, float seconds = 2.0f);
+
+// Records a sensor trace (see Util::SensorTraceRecorder) of the given length from a
+// VirtualTrackerDevice with synthetic motion, through SensorDevice and SensorFusion as
+// from an HMD. Returns false if the trace couldn't be written or body frames were lost.
+bool RecordVirtualTrackerTrace(OVR::DeviceManager* manager, const char* tracePath, float seconds = 2.0f);
+
+// Replays a sensor trace through SensorFusion as fast as the CPU allows and logs the
+// samples per second. With a reference, as written by Util::ReplaySensorTrace, the
+// orientation after every sample is compared with it; returns false if the trace or
+// reference couldn't be loaded, or any orientation differs by more than 1e-4 rad.
+bool CheckSensorTraceReplay(const char* tracePath, const char* referencePath = 0);
+
+#endif
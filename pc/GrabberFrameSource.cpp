@@ -0,0 +1,85 @@
+#include "GrabberFrameSource.h"
+
+using namespace OVR;
+
+
+GrabberFrameSource::GrabberFrameSource(ISampleGrabber* grabber, IMediaControl* control, int width, int height,
+                                       FramePixelFormat format)
+	: pGrabber(grabber), pControl(control), Running(false)
+{
+	GrabberCallback.pOwner = this;
+	// Start fails if this does.
+	initBuffer(width, height, format);
+}
+
+GrabberFrameSource::~GrabberFrameSource()
+{
+	Stop();
+}
+
+bool GrabberFrameSource::Start()
+{
+	if (Running)
+	{
+		return true;
+	}
+	if (!BufferReady)
+	{
+		return false;
+	}
+
+	// No need for the grabber to keep its own copy of every sample.
+	pGrabber->SetBufferSamples(FALSE);
+	if (FAILED(pGrabber->SetCallback(&GrabberCallback, 1)))
+	{
+		return false;
+	}
+
+	if (FAILED(pControl->Run()))
+	{
+		pGrabber->SetCallback(NULL, 1);
+		return false;
+	}
+	Running = true;
+	return true;
+}
+
+void GrabberFrameSource::Stop()
+{
+	if (!Running)
+	{
+		return;
+	}
+
+	pControl->Stop();
+	pGrabber->SetCallback(NULL, 1);
+	Running = false;
+}
+
+
+STDMETHODIMP GrabberFrameSource::Callback::QueryInterface(REFIID riid, void** ppv)
+{
+	if (riid == IID_ISampleGrabberCB || riid == IID_IUnknown)
+	{
+		*ppv = (ISampleGrabberCB*)this;
+		return S_OK;
+	}
+	*ppv = NULL;
+	return E_NOINTERFACE;
+}
+
+STDMETHODIMP GrabberFrameSource::Callback::SampleCB(double sampleTime, IMediaSample* sample)
+{
+	OVR_UNUSED2(sampleTime, sample);
+	return E_NOTIMPL;
+}
+
+STDMETHODIMP GrabberFrameSource::Callback::BufferCB(double sampleTime, BYTE* buffer, long bufferLen)
+{
+	OVR_UNUSED(sampleTime);
+
+	// Stamp with the host clock rather than the stream time, so it can be
+	// compared against the time the frame is displayed.
+	pOwner->DeliverFrame(buffer, (int)bufferLen, Timer::GetTicks());
+	return S_OK;
+}
@@ -0,0 +1,42 @@
+#ifndef GRABBER_FRAME_SOURCE_H
+#define GRABBER_FRAME_SOURCE_H
+
+#include <dshow.h>
+#include "SampleGrabber.h"
+#include "FrameSource.h"
+
+// Frames from a DirectShow graph ending in a SampleGrabber. The grabber calls
+// BufferCB on the graph's streaming thread for every sample, so the render
+// thread no longer has to poll GetCurrentBuffer.
+class GrabberFrameSource : public FrameSource
+{
+public:
+	GrabberFrameSource(ISampleGrabber* grabber, IMediaControl* control, int width, int height,
+	                   FramePixelFormat format = FramePixel_BGRA);
+	~GrabberFrameSource();
+
+	virtual bool Start();
+	virtual void Stop();
+
+private:
+	// The COM callback lives as long as the source, so it doesn't reference count itself.
+	class Callback : public ISampleGrabberCB
+	{
+	public:
+		GrabberFrameSource* pOwner;
+
+		STDMETHODIMP_(ULONG) AddRef()  { return 2; }
+		STDMETHODIMP_(ULONG) Release() { return 1; }
+		STDMETHODIMP QueryInterface(REFIID riid, void** ppv);
+
+		STDMETHODIMP SampleCB(double sampleTime, IMediaSample* sample);
+		STDMETHODIMP BufferCB(double sampleTime, BYTE* buffer, long bufferLen);
+	};
+
+	Callback        GrabberCallback;
+	ISampleGrabber* pGrabber;
+	IMediaControl*  pControl;
+	bool            Running;
+};
+
+#endif
@@ -0,0 +1,334 @@
+// Headless driver for the benchmarks that exercise the Linux parts of LibOVR, which
+// the demo can't run since it needs Windows. Build it with the Makefile next to this
+// file and run
+//
+//      ./LinuxBench [-dispatchbench] [-reportringbench [reports/s [stall ms]]]
+//                   [-virtualtrackerbench [max Hz]] [-swizzlebench] [-pipelinebench]
+//                   [-distortcheck [golden.tga]] [-distortsave golden.tga] [-meshcheck]
+//                   [-servobench [period ms [seconds]]] [-timecheck]
+//                   [-timewarpcheck [head.trace servo.txt]] [-timewarpsave head.trace servo.txt]
+//                   [-record out.trace [seconds]] [-replay [in.trace [reference.txt]]]
+//                   [-replaysave in.trace reference.txt]
+//
+// With no options every benchmark and check runs; run it from this directory so the
+// reference files in testdata are found. Results are logged to stdout. Exits with 1
+// if the virtual tracker loses reports or body frames, if a swizzle implementation
+// differs from the scalar one, if the frame pipeline hands out a wrong frame, if the
+// CPU distortion differs from its reference image, if the distortion mesh doesn't
+// follow the distortion function, if the servo sender's packets don't all arrive
+// intact, if sensor times or the orientation history are off, if the video timewarp
+// reprojects a frame from the wrong pose, or if replaying a sensor trace diverges
+// from its reference orientations.
+
+#include "FusionBenchmark.h"
+#include "Swizzle.h"
+#include "FrameSource.h"
+#include "CpuDistortion.h"
+#include "ServoLink.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace OVR;
+
+int main(int argc, char** argv)
+{
+	// Input report dispatch latency of the device manager thread (-dispatchbench).
+	bool dispatchBench = false;
+
+	// hidraw report batching, at 10x the tracker rate by default, with the manager
+	// thread stalled for 0, 5 and 20 ms every 200 ms unless a stall is given
+	// (-reportringbench [reports/s [stall ms]]).
+	bool   reportRingBench = false;
+	UInt32 reportRingBenchRate = 10000;
+	int    reportRingBenchStallMs = -1;
+
+	// Whole sensor stack on a virtual tracker, at rates doubling from 1 kHz
+	// (-virtualtrackerbench [max Hz]).
+	bool   virtualTrackerBench = false;
+	UInt32 virtualTrackerBenchRate = 8000;
+
+	// Every BGRA swizzle the CPU supports, checked against the scalar one (-swizzlebench).
+	bool swizzleBench = false;
+
+	// Synthetic cameras through FrameSource's triple buffer to a 60 Hz render loop,
+	// checking every frame picked up (-pipelinebench).
+	bool pipelineBench = false;
+
+	// Every CPU lens distortion implementation against a reference image
+	// (-distortcheck [golden.tga]), or a new reference from the scalar one
+	// (-distortsave golden.tga). Both at 320x200, to keep the reference small.
+	bool        distortCheck      = false;
+	const char* distortGoldenPath = "testdata/CpuDistortion320x200.tga";
+	const char* distortSavePath   = 0;
+
+	// Distortion mesh vertices against DistortionFn, and its triangles, for the same
+	// config (-meshcheck).
+	bool meshCheck = false;
+
+	// Servo sender timing against a render loop that stalls, through the firmware's
+	// packet parser instead of the board (-servobench [period ms [seconds]]).
+	bool   servoBench        = false;
+	UInt32 servoBenchPeriod  = 15000;
+	float  servoBenchSeconds = 10.0f;
+
+	// Sensor to host time mapping against drifting tracker clocks, and orientation
+	// lookups by host time across a time reset (-timecheck).
+	bool timeCheck = false;
+
+	// Video reprojection of synthetic frames against a recorded head and servo trace
+	// (-timewarpcheck [head.trace servo.txt]), or new traces (-timewarpsave head.trace
+	// servo.txt).
+	bool        timewarpCheck     = false;
+	const char* timewarpHeadPath  = "testdata/TimewarpHead.trace";
+	const char* timewarpServoPath = "testdata/TimewarpServo.txt";
+	const char* timewarpSaveHead  = 0;
+	const char* timewarpSaveServo = 0;
+
+	// Sensor traces without an HMD: recorded from a virtual tracker (-record out.trace
+	// [seconds]), replayed through SensorFusion as fast as it goes and compared with
+	// the orientations of an earlier build (-replay [in.trace [reference.txt]]), or a
+	// new reference from this one (-replaysave in.trace reference.txt).
+	const char* recordPath          = 0;
+	float       recordSeconds       = 2.0f;
+	bool        replay              = false;
+	const char* replayPath          = "testdata/VirtualTracker.trace";
+	const char* replayReference     = "testdata/VirtualTrackerOrientations.txt";
+	const char* replaySavePath      = 0;
+	const char* replaySaveReference = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-dispatchbench"))
+		{
+			dispatchBench = true;
+		}
+		else if (!strcmp(argv[i], "-reportringbench"))
+		{
+			reportRingBench = true;
+			if (i < argc - 1 && atoi(argv[i + 1]) > 0)
+			{
+				reportRingBenchRate = (UInt32)atoi(argv[++i]);
+				if (i < argc - 1 && argv[i + 1][0] != '-')
+					reportRingBenchStallMs = atoi(argv[++i]);
+			}
+		}
+		else if (!strcmp(argv[i], "-virtualtrackerbench"))
+		{
+			virtualTrackerBench = true;
+			if (i < argc - 1 && atoi(argv[i + 1]) > 0)
+				virtualTrackerBenchRate = (UInt32)atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-swizzlebench"))
+		{
+			swizzleBench = true;
+		}
+		else if (!strcmp(argv[i], "-pipelinebench"))
+		{
+			pipelineBench = true;
+		}
+		else if (!strcmp(argv[i], "-distortcheck"))
+		{
+			distortCheck = true;
+			if (i < argc - 1 && argv[i + 1][0] != '-')
+				distortGoldenPath = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-distortsave") && i < argc - 1)
+		{
+			distortSavePath = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-meshcheck"))
+		{
+			meshCheck = true;
+		}
+		else if (!strcmp(argv[i], "-servobench"))
+		{
+			servoBench = true;
+			if (i < argc - 1 && atoi(argv[i + 1]) > 0)
+			{
+				servoBenchPeriod = (UInt32)atoi(argv[++i]) * 1000;
+				if (i < argc - 1 && atof(argv[i + 1]) > 0)
+					servoBenchSeconds = (float)atof(argv[++i]);
+			}
+		}
+		else if (!strcmp(argv[i], "-timecheck"))
+		{
+			timeCheck = true;
+		}
+		else if (!strcmp(argv[i], "-timewarpcheck"))
+		{
+			timewarpCheck = true;
+			if (i < argc - 2 && argv[i + 1][0] != '-' && argv[i + 2][0] != '-')
+			{
+				timewarpHeadPath  = argv[++i];
+				timewarpServoPath = argv[++i];
+			}
+		}
+		else if (!strcmp(argv[i], "-timewarpsave") && i < argc - 2)
+		{
+			timewarpSaveHead  = argv[++i];
+			timewarpSaveServo = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-record") && i < argc - 1)
+		{
+			recordPath = argv[++i];
+			if (i < argc - 1 && atof(argv[i + 1]) > 0)
+				recordSeconds = (float)atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-replay"))
+		{
+			replay = true;
+			if (i < argc - 1 && argv[i + 1][0] != '-')
+			{
+				replayPath      = argv[++i];
+				replayReference = 0;
+				if (i < argc - 1 && argv[i + 1][0] != '-')
+					replayReference = argv[++i];
+			}
+		}
+		else if (!strcmp(argv[i], "-replaysave") && i < argc - 2)
+		{
+			replaySavePath      = argv[++i];
+			replaySaveReference = argv[++i];
+		}
+		else
+		{
+			fprintf(stderr, "Unknown option %s\n", argv[i]);
+			return 2;
+		}
+	}
+
+	if (argc == 1)
+	{
+		dispatchBench       = true;
+		reportRingBench     = true;
+		virtualTrackerBench = true;
+		swizzleBench        = true;
+		pipelineBench       = true;
+		distortCheck        = true;
+		meshCheck           = true;
+		servoBench          = true;
+		timeCheck           = true;
+		timewarpCheck       = true;
+		replay              = true;
+	}
+
+	System::Init(Log::ConfigureDefaultLog(LogMask_All));
+
+	if (dispatchBench)
+	{
+		BenchmarkDeviceManagerDispatch();
+	}
+
+	if (reportRingBench)
+	{
+		if (reportRingBenchStallMs >= 0)
+		{
+			BenchmarkHIDReportRing(reportRingBenchRate, (UInt32)reportRingBenchStallMs);
+		}
+		else
+		{
+			BenchmarkHIDReportRing(reportRingBenchRate, 0);
+			BenchmarkHIDReportRing(reportRingBenchRate, 5);
+			BenchmarkHIDReportRing(reportRingBenchRate, 20);
+		}
+	}
+
+	bool failed = false;
+	if (virtualTrackerBench)
+	{
+		Ptr<DeviceManager> manager = *DeviceManager::Create();
+		if (!manager || !BenchmarkVirtualTracker(manager, virtualTrackerBenchRate))
+			failed = true;
+	}
+
+	if (swizzleBench && !BenchmarkSwizzle())
+	{
+		failed = true;
+	}
+
+	if (pipelineBench && !BenchmarkFramePipeline())
+	{
+		failed = true;
+	}
+
+	if (distortCheck || distortSavePath || meshCheck)
+	{
+		Util::Render::StereoConfig config(Util::Render::Stereo_LeftRight_Multipass,
+		                                  Util::Render::Viewport(0, 0, 320, 200));
+		if (distortSavePath)
+		{
+			BenchmarkCpuDistortion(config, distortSavePath);
+		}
+		if (distortCheck && !CheckCpuDistortion(config, distortGoldenPath))
+		{
+			failed = true;
+		}
+		if (meshCheck && !CheckDistortionMesh(config))
+		{
+			failed = true;
+		}
+	}
+
+	if (servoBench)
+	{
+		Ptr<LoopbackServoTransport> loopback = *new LoopbackServoTransport;
+		if (!BenchmarkServoSender(loopback, servoBenchPeriod, servoBenchSeconds))
+		{
+			failed = true;
+		}
+
+		const ServoParser& parser = loopback->GetParser();
+		LogText("Loopback parser: %u packets, %u lost, %u bytes skipped\n",
+		        parser.packets, parser.lostPackets, parser.skippedBytes);
+		if (parser.packets == 0 || parser.lostPackets || parser.skippedBytes)
+		{
+			failed = true;
+		}
+	}
+
+	if (timeCheck)
+	{
+		if (!CheckSensorTimeFilter())
+			failed = true;
+		if (!CheckOrientationHistory())
+			failed = true;
+	}
+
+	if (timewarpSaveHead && !SaveVideoTimewarpTraces(timewarpSaveHead, timewarpSaveServo))
+	{
+		failed = true;
+	}
+	if (timewarpCheck && !CheckVideoTimewarp(timewarpHeadPath, timewarpServoPath))
+	{
+		failed = true;
+	}
+
+	if (recordPath)
+	{
+		Ptr<DeviceManager> manager = *DeviceManager::Create();
+		if (!manager || !RecordVirtualTrackerTrace(manager, recordPath, recordSeconds))
+			failed = true;
+	}
+	if (replaySavePath)
+	{
+		SensorFusion fusion;
+		if (Util::ReplaySensorTrace(replaySavePath, fusion, replaySaveReference))
+		{
+			LogText("Wrote the orientations for %s to %s\n", replaySavePath, replaySaveReference);
+		}
+		else
+		{
+			LogText("Couldn't replay %s into %s\n", replaySavePath, replaySaveReference);
+			failed = true;
+		}
+	}
+	if (replay && !CheckSensorTraceReplay(replayPath, replayReference))
+	{
+		failed = true;
+	}
+
+	System::Destroy();
+	return failed ? 1 : 0;
+}
@@ -35,10 +35,14 @@ limitations under the License.
 #include "../Src/OVR_DeviceConstants.h"
 #include "../Src/OVR_DeviceHandle.h"
 #include "../Src/OVR_DeviceMessages.h"
+#include "../Src/OVR_OrientationPredictor.h"
 #include "../Src/OVR_SensorFusion.h"
+#include "../Src/OVR_SensorFusionBatch.h"
 #include "../Src/OVR_Profile.h"
 #include "../Src/Util/Util_LatencyTest.h"
 #include "../Src/Util/Util_Render_Stereo.h"
+#include "../Src/Util/Util_SensorTrace.h"
+#include "../Src/Util/Util_SensorFusionFarm.h"
 
 #endif
 
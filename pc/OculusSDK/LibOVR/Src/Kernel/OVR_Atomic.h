@@ -34,6 +34,7 @@ limitations under the License.
 // Include System thread functionality.
 #if defined(OVR_OS_WIN32)
 #include <windows.h>
+#include <intrin.h>
 #else
 #include <pthread.h>
 #endif
@@ -591,6 +592,22 @@ public:
 };
 
 
+// Keeps the loads before it from being moved past the loads after it, by the compiler
+// or the CPU. X86 doesn't reorder loads, so there it only stops the compiler.
+inline void AtomicLoadFence()
+{
+#if defined(OVR_ENABLE_THREADS)
+#  if defined(OVR_CC_MSVC)
+    _ReadBarrier();
+#  elif defined(OVR_CPU_X86) || defined(OVR_CPU_X86_64)
+    asm volatile("" ::: "memory");
+#  else
+    __sync_synchronize();
+#  endif
+#endif
+}
+
+
 
 // Atomic value base class - implements operations shared for integers and pointers.
 template<class T>
@@ -412,7 +412,16 @@ public:
 
     virtual HIDDeviceManager* GetHIDDeviceManager() const
     {
-        return HidDeviceManager;
+        return HidDeviceManagerOverride ? HidDeviceManagerOverride.GetPtr() : HidDeviceManager.GetPtr();
+    }
+
+    // Makes devices enumerate and open through manager instead of the platform
+    // HIDDeviceManager, or through the platform one again when manager is null.
+    // Must be called on the manager thread. Used to add virtual devices; see
+    // VirtualHIDDeviceManager.
+    void SetHIDDeviceManagerOverride(HIDDeviceManager* manager)
+    {
+        HidDeviceManagerOverride = manager;
     }
 
     // Adds device (DeviceCreateDesc*) into Devices. Returns NULL, 
@@ -434,6 +443,7 @@ public:
 
 protected:
     Ptr<HIDDeviceManager>   HidDeviceManager;
+    Ptr<HIDDeviceManager>   HidDeviceManagerOverride;
     Ptr<ProfileManager>     pProfileManager;
 };
 
@@ -93,7 +93,7 @@ class MessageBodyFrame : public Message
 {
 public:
     MessageBodyFrame(DeviceBase* dev)
-        : Message(Message_BodyFrame, dev), Temperature(0.0f), TimeDelta(0.0f)
+        : Message(Message_BodyFrame, dev), Temperature(0.0f), TimeDelta(0.0f), AbsoluteTimeMks(0)
     {
     }
 
@@ -102,6 +102,7 @@ public:
     Vector3f MagneticField;  // Magnetic field strength in Gauss.
     float    Temperature;    // Temperature reading on sensor surface, in degrees Celsius.
     float    TimeDelta;      // Time passed since last Body Frame, in seconds.
+    UInt64   AbsoluteTimeMks;// Host time the sample was taken, in Timer::GetTicks() microseconds.
 };
 
 // Sent when we receive a device status changes (e.g.:
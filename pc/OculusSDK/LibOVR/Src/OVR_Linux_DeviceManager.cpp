@@ -36,6 +36,10 @@ limitations under the License.
 #include "Kernel/OVR_Std.h"
 #include "Kernel/OVR_Log.h"
 
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+
 namespace OVR { namespace Linux {
 
 
@@ -129,55 +133,149 @@ DeviceEnumerator<> DeviceManager::EnumerateDevicesEx(const DeviceEnumerationArgs
 //-------------------------------------------------------------------------------------
 // ***** DeviceManager Thread 
 
+// The thread waits in epoll on the fds of its devices, an eventfd that is signalled
+// when commands are pushed, and a timerfd set for the ticks notifier due first.
+// Device fds are registered with their generation in the high half of the event
+// data; the command and timer fds with none.
+
 DeviceManagerThread::DeviceManagerThread()
-    : Thread(ThreadStackSize)
+    : Thread(ThreadStackSize), NextGeneration(1), TimerDueMks(0)
 {
-    int result = pipe(CommandFd);
-    OVR_ASSERT(!result);
+    EpollFd   = epoll_create1(EPOLL_CLOEXEC);
+    CommandFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    TimerFd   = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    OVR_ASSERT(EpollFd >= 0 && CommandFd >= 0 && TimerFd >= 0);
 
-    AddSelectFd(NULL, CommandFd[0]);
+    addEpollFd(CommandFd, (UInt32)CommandFd);
+    addEpollFd(TimerFd, (UInt32)TimerFd);
 }
 
 DeviceManagerThread::~DeviceManagerThread()
 {
-    if (CommandFd[0])
-    {
-        RemoveSelectFd(NULL, CommandFd[0]);
-        close(CommandFd[0]);
-        close(CommandFd[1]);
-    }
+    if (EpollFd >= 0)
+        close(EpollFd);
+    if (CommandFd >= 0)
+        close(CommandFd);
+    if (TimerFd >= 0)
+        close(TimerFd);
 }
 
-bool DeviceManagerThread::AddSelectFd(Notifier* notify, int fd)
+void DeviceManagerThread::OnPushNonEmpty_Locked()
+{
+    UInt64 one = 1;
+    write(CommandFd, &one, sizeof(one));
+}
+
+UInt64 DeviceManagerThread::getMonotonicMks()
+{
+    // Timer::GetTicks follows the wall clock, which can step; ticks are scheduled
+    // on the monotonic clock the timerfd uses.
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (UInt64)ts.tv_sec * Timer::MksPerSecond + ts.tv_nsec / 1000;
+}
+
+bool DeviceManagerThread::addEpollFd(int fd, UInt64 data)
 {
-    struct pollfd pfd;
-    pfd.fd = fd;
-    pfd.events = POLLIN|POLLHUP|POLLERR;
-    pfd.revents = 0;
+    struct epoll_event event;
+    event.events   = EPOLLIN;
+    event.data.u64 = data;
+    return epoll_ctl(EpollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
 
-    FdNotifiers.PushBack(notify);
-    PollFds.PushBack(pfd);
+bool DeviceManagerThread::AddSelectFd(Notifier* notify, int fd)
+{
+    SelectFd entry;
+    entry.pNotify    = notify;
+    entry.Fd         = fd;
+    entry.Generation = NextGeneration++;
+    entry.Polled     = true;
+    if (NextGeneration == 0)
+        NextGeneration = 1;
+
+    if (!addEpollFd(fd, ((UInt64)entry.Generation << 32) | (UInt32)fd))
+        return false;
 
-    OVR_ASSERT(FdNotifiers.GetSize() == PollFds.GetSize());
+    SelectFds.PushBack(entry);
     return true;
 }
 
 bool DeviceManagerThread::RemoveSelectFd(Notifier* notify, int fd)
 {
-    // [0] is reserved for thread commands with notify of null, but we still
-    // can use this function to remove it.
-    for (UPInt i = 0; i < FdNotifiers.GetSize(); i++)
+    for (UPInt i = 0; i < SelectFds.GetSize(); i++)
     {
-        if ((FdNotifiers[i] == notify) && (PollFds[i].fd == fd))
+        if ((SelectFds[i].pNotify == notify) && (SelectFds[i].Fd == fd))
         {
-            FdNotifiers.RemoveAt(i);
-            PollFds.RemoveAt(i);
+            if (SelectFds[i].Polled)
+            {
+                struct epoll_event event;
+                epoll_ctl(EpollFd, EPOLL_CTL_DEL, fd, &event);
+            }
+            SelectFds.RemoveAt(i);
             return true;
         }
     }
     return false;
 }
 
+int DeviceManagerThread::findSelectFd(UInt64 data) const
+{
+    int    fd         = (int)(UInt32)data;
+    UInt32 generation = (UInt32)(data >> 32);
+
+    for (UPInt i = 0; i < SelectFds.GetSize(); i++)
+    {
+        if ((SelectFds[i].Fd == fd) && (SelectFds[i].Generation == generation))
+            return (int)i;
+    }
+    return -1;
+}
+
+void DeviceManagerThread::dispatchEvent(const struct epoll_event& event, bool* commands)
+{
+    UInt64 count;
+
+    if ((event.data.u64 >> 32) == 0)
+    {
+        if ((int)event.data.u64 == CommandFd)
+        {
+            read(CommandFd, &count, sizeof(count));
+            *commands = true;
+        }
+        else
+        {
+            read(TimerFd, &count, sizeof(count));
+            runTicks();
+        }
+        return;
+    }
+
+    // The fd may have been removed by a notifier called earlier for this wait.
+    int i = findSelectFd(event.data.u64);
+    if (i < 0)
+        return;
+
+    int fd = SelectFds[i].Fd;
+    if (event.events & EPOLLERR)
+    {
+        OVR_DEBUG_LOG(("epoll: error on [%d]: %d", i, fd));
+    }
+    else if (event.events & EPOLLIN)
+    {
+        if (SelectFds[i].pNotify)
+            SelectFds[i].pNotify->OnEvent(i, fd);
+        i = findSelectFd(event.data.u64);
+    }
+
+    // epoll keeps reporting errors and hang-ups, so stop watching the fd until its
+    // owner removes it.
+    if ((i >= 0) && (event.events & (EPOLLERR | EPOLLHUP)))
+    {
+        struct epoll_event unused;
+        epoll_ctl(EpollFd, EPOLL_CTL_DEL, fd, &unused);
+        SelectFds[i].Polled = false;
+    }
+}
 
 
 int DeviceManagerThread::Run()
@@ -202,63 +300,15 @@ int DeviceManagerThread::Run()
             bool commands = 0;
             do
             {
-                int waitMs = -1;
-
-                // If devices have time-dependent logic registered, get the longest wait
-                // allowed based on current ticks.
-                if (!TicksNotifiers.IsEmpty())
-                {
-                    UInt64 ticksMks = Timer::GetTicks();
-                    int  waitAllowed;
-
-                    for (UPInt j = 0; j < TicksNotifiers.GetSize(); j++)
-                    {
-                        waitAllowed = (int)(TicksNotifiers[j]->OnTicks(ticksMks) / Timer::MksPerMs);
-                        if (waitAllowed < waitMs)
-                            waitMs = waitAllowed;
-                    }
-                }
-
-                // wait until there is data available on one of the devices or the timeout expires
-                int n = poll(&PollFds[0], PollFds.GetSize(), waitMs);
-
-                if (n > 0)
-                {
-                    // Iterate backwards through the list so the ordering will not be
-                    // affected if the called object gets removed during the callback
-                    // Also, the HID data streams are located toward the back of the list
-                    // and servicing them first will allow a disconnect to be handled
-                    // and cleaned directly at the device first instead of the general HID monitor
-                    for (int i=PollFds.GetSize()-1; i>=0; i--)
-                    {
-                        if (PollFds[i].revents & POLLERR)
-                        {
-                            OVR_DEBUG_LOG(("poll: error on [%d]: %d", i, PollFds[i].fd));
-                        }
-                        else if (PollFds[i].revents & POLLIN)
-                        {
-                            if (FdNotifiers[i])
-                                FdNotifiers[i]->OnEvent(i, PollFds[i].fd);
-                            else if (i == 0) // command
-                            {
-                                char dummy[128];
-                                read(PollFds[i].fd, dummy, 128);
-                                commands = 1;
-                            }
-                        }
-
-                        if (PollFds[i].revents & POLLHUP)
-                            PollFds[i].events = 0;
-
-                        if (PollFds[i].revents != 0)
-                        {
-                            n--;
-                            if (n == 0)
-                                break;
-                        }
-                    }
-                }
-            } while (PollFds.GetSize() > 0 && !commands);
+                // Wait until there is data available on one of the devices, a ticks
+                // notifier is due or a command is pushed.
+                struct epoll_event events[MaxEventsPerWait];
+                int n = epoll_wait(EpollFd, events, MaxEventsPerWait, -1);
+
+                for (int i = 0; i < n; i++)
+                    dispatchEvent(events[i], &commands);
+
+            } while (!commands);
         }
     }
 
@@ -268,23 +318,112 @@ int DeviceManagerThread::Run()
 
 bool DeviceManagerThread::AddTicksNotifier(Notifier* notify)
 {
-     TicksNotifiers.PushBack(notify);
-     return true;
+    // Called on the next wait.
+    TicksEntry entry;
+    entry.DueMks  = getMonotonicMks();
+    entry.pNotify = notify;
+    pushTicks(entry);
+    armTimer();
+    return true;
 }
 
 bool DeviceManagerThread::RemoveTicksNotifier(Notifier* notify)
 {
     for (UPInt i = 0; i < TicksNotifiers.GetSize(); i++)
     {
-        if (TicksNotifiers[i] == notify)
+        if (TicksNotifiers[i].pNotify == notify)
         {
-            TicksNotifiers.RemoveAt(i);
+            removeTicksAt(i);
+            armTimer();
             return true;
         }
     }
     return false;
 }
 
+void DeviceManagerThread::runTicks()
+{
+    UInt64 nowMks   = getMonotonicMks();
+    UInt64 ticksMks = Timer::GetTicks();
+
+    while (!TicksNotifiers.IsEmpty() && TicksNotifiers[0].DueMks <= nowMks)
+    {
+        Notifier* notify  = TicksNotifiers[0].pNotify;
+        UInt64    waitMks = notify->OnTicks(ticksMks);
+
+        // The notifier may have removed itself, or others, from OnTicks.
+        for (UPInt i = 0; i < TicksNotifiers.GetSize(); i++)
+        {
+            if (TicksNotifiers[i].pNotify == notify)
+            {
+                TicksEntry entry = TicksNotifiers[i];
+                entry.DueMks = nowMks + Alg::Max<UInt64>(waitMks, 1);
+                removeTicksAt(i);
+                pushTicks(entry);
+                break;
+            }
+        }
+    }
+    armTimer();
+}
+
+void DeviceManagerThread::pushTicks(const TicksEntry& entry)
+{
+    UPInt i = TicksNotifiers.GetSize();
+    TicksNotifiers.PushBack(entry);
+    while (i > 0 && TicksNotifiers[(i - 1) / 2].DueMks > entry.DueMks)
+    {
+        TicksNotifiers[i] = TicksNotifiers[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    TicksNotifiers[i] = entry;
+}
+
+void DeviceManagerThread::removeTicksAt(UPInt i)
+{
+    TicksEntry last = TicksNotifiers.Back();
+    TicksNotifiers.PopBack();
+    UPInt size = TicksNotifiers.GetSize();
+    if (i == size)
+        return;
+
+    // Put the last entry in the hole, moving it up or down to where it belongs.
+    while (i > 0 && TicksNotifiers[(i - 1) / 2].DueMks > last.DueMks)
+    {
+        TicksNotifiers[i] = TicksNotifiers[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    while (true)
+    {
+        UPInt child = 2 * i + 1;
+        if (child >= size)
+            break;
+        if (child + 1 < size && TicksNotifiers[child + 1].DueMks < TicksNotifiers[child].DueMks)
+            child++;
+        if (TicksNotifiers[child].DueMks >= last.DueMks)
+            break;
+        TicksNotifiers[i] = TicksNotifiers[child];
+        i = child;
+    }
+    TicksNotifiers[i] = last;
+}
+
+void DeviceManagerThread::armTimer()
+{
+    // Absolute, so the timer fires in the microsecond the top notifier is due. 0
+    // disarms it.
+    UInt64 dueMks = TicksNotifiers.IsEmpty() ? 0 : TicksNotifiers[0].DueMks;
+    if (dueMks == TimerDueMks)
+        return;
+    TimerDueMks = dueMks;
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec  = (time_t)(dueMks / Timer::MksPerSecond);
+    spec.it_value.tv_nsec = (long)(dueMks % Timer::MksPerSecond) * 1000;
+    timerfd_settime(TimerFd, TFD_TIMER_ABSTIME, &spec, 0);
+}
+
 } // namespace Linux
 
 
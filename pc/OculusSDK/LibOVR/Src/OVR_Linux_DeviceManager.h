@@ -30,7 +30,7 @@ limitations under the License.
 #include "OVR_DeviceImpl.h"
 
 #include <unistd.h>
-#include <sys/poll.h>
+#include <sys/epoll.h>
 
 
 namespace OVR { namespace Linux {
@@ -74,13 +74,13 @@ public:
     virtual int Run();
 
     // ThreadCommandQueue notifications for CommandEvent handling.
-    virtual void OnPushNonEmpty_Locked() { write(CommandFd[1], this, 1); }
+    virtual void OnPushNonEmpty_Locked();
     virtual void OnPopEmpty_Locked()     { }
 
     class Notifier
     {
     public:
-        // Called when I/O is received
+        // Called when I/O is received; i is the index the fd was registered at.
         virtual void OnEvent(int i, int fd) = 0;
 
         // Called when timing ticks are updated.
@@ -102,19 +102,54 @@ public:
     bool RemoveTicksNotifier(Notifier* notify);
 
 private:
-    
-    bool threadInitialized() { return CommandFd[0] != 0; }
 
-    // pipe used to signal commands
-    int CommandFd[2];
+    enum { MaxEventsPerWait = 16 };
 
-    Array<struct pollfd>    PollFds;
-    Array<Notifier*>        FdNotifiers;
+    // An fd registered with epoll. The generation, which goes into the epoll event
+    // with the fd, tells events for a removed fd from those of one reusing its number.
+    struct SelectFd
+    {
+        Notifier*   pNotify;
+        int         Fd;
+        UInt32      Generation;
+        bool        Polled;     // Cleared after a hang-up, when epoll stops watching it
+    };
+
+    // A ticks notifier and the monotonic time its OnTicks is next due.
+    struct TicksEntry
+    {
+        UInt64      DueMks;
+        Notifier*   pNotify;
+    };
+
+    bool    addEpollFd(int fd, UInt64 data);
+    int     findSelectFd(UInt64 data) const;
+    void    dispatchEvent(const struct epoll_event& event, bool* commands);
+
+    // Ticks notifiers are kept in a min-heap on DueMks, with the timer armed for the top.
+    void    runTicks();
+    void    pushTicks(const TicksEntry& entry);
+    void    removeTicksAt(UPInt i);
+    void    armTimer();
+
+    static UInt64 getMonotonicMks();
+
+    bool threadInitialized() { return EpollFd >= 0; }
+
+    int EpollFd;
+    // eventfd used to signal commands
+    int CommandFd;
+    // timerfd for the earliest ticks notifier
+    int TimerFd;
+
+    Array<SelectFd>         SelectFds;
+    UInt32                  NextGeneration;
 
     Event                   StartupEvent;
 
     // Ticks notifiers - used for time-dependent events such as keep-alive.
-    Array<Notifier*>        TicksNotifiers;
+    Array<TicksEntry>       TicksNotifiers;
+    UInt64                  TimerDueMks;
 };
 
 }} // namespace Linux::OVR
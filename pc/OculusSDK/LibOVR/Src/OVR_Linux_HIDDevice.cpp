@@ -540,7 +540,7 @@ bool HIDDevice::initInfo()
     OutputReportBufferLength = 0;
     FeatureReportBufferLength = 69;
     
-    if (ReadBufferSize < InputReportBufferLength)
+    if (HIDReportRing::SlotSize < InputReportBufferLength)
     {
         OVR_ASSERT_LOG(false, ("Input report buffer length is bigger than read buffer."));
         return false;
@@ -558,8 +558,9 @@ bool HIDDevice::openDevice(const char* device_path)
         return false;
     }
 
-    // Now open the device
-    DeviceHandle = open(device_path, O_RDWR);
+    // Now open the device. Non-blocking, so that input reports can be read until
+    // there are none left; feature report ioctls still block.
+    DeviceHandle = open(device_path, O_RDWR | O_NONBLOCK);
     if (DeviceHandle < 0)
     {
         OVR_DEBUG_LOG(("Failed 'CreateHIDFile' while opening device, error = 0x%X.", errno));
@@ -616,7 +617,12 @@ void HIDDevice::closeDevice(bool wasUnplugged)
     close(DeviceHandle);  // close the file handle
     DeviceHandle = -1;
         
-    LogText("OVR::Linux::HIDDevice - HID Device Closed '%s'\n", DevDesc.Path.ToCStr());
+    const HIDReportRing::Stats& stats = ReportRing.GetStats();
+    LogText("OVR::Linux::HIDDevice - HID Device Closed '%s'\n"
+            "                    %llu reports in %u wake-ups, at most %u at once, %u ring overruns\n",
+            DevDesc.Path.ToCStr(), (unsigned long long)stats.Reports, stats.Wakeups,
+            stats.MaxBatch, stats.Overruns);
+    ReportRing.ResetStats();
 }
 
 //-----------------------------------------------------------------------------
@@ -670,17 +676,8 @@ UInt64 HIDDevice::OnTicks(UInt64 ticksMks)
 //-----------------------------------------------------------------------------
 void HIDDevice::OnEvent(int i, int fd)
 {
-    // We have data to read from the device
-    int bytes = read(fd, ReadBuffer, ReadBufferSize);
-    if (bytes >= 0)
-    {
-// TODO: I need to handle partial messages and package reconstruction
-        if (Handler)
-        {
-            Handler->OnInputReport(ReadBuffer, bytes);
-        }
-    }
-    else
+    // We have data to read from the device; read and dispatch all of it.
+    if (!ReportRing.Drain(fd, Handler))
     {   // Close the device on read error.
         closeDeviceOnIOError();
     }
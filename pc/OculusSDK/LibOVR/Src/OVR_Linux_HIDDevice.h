@@ -28,6 +28,7 @@ limitations under the License.
 
 #include "OVR_HIDDevice.h"
 #include "OVR_Linux_DeviceManager.h"
+#include "OVR_Linux_HIDReportRing.h"
 #include <libudev.h>
 
 namespace OVR { namespace Linux {
@@ -77,8 +78,8 @@ private:
     int                     DeviceHandle;     // file handle to the device
     HIDDeviceDesc           DevDesc;
     
-    enum { ReadBufferSize = 96 };
-    UByte                   ReadBuffer[ReadBufferSize];
+    // Input reports pending at each wake-up are read into this and dispatched from it.
+    HIDReportRing           ReportRing;
 
     UInt16                  InputReportBufferLength;
     UInt16                  OutputReportBufferLength;
@@ -0,0 +1,124 @@
+/************************************************************************************
+
+Filename    :   OVR_Linux_HIDReportRing.cpp
+Content     :   Batched reading of hidraw input reports into a ring of report slots
+Created     :   
+Authors     :   
+
+Copyright   :   Copyright 2013 Oculus VR, Inc. All Rights reserved.
+
+Licensed under the Oculus VR SDK License Version 2.0 (the "License"); 
+you may not use the Oculus VR SDK except in compliance with the License, 
+which is provided at the time of installation or download, or which 
+otherwise accompanies this software in either electronic or hard copy form.
+
+You may obtain a copy of the License at
+
+http://www.oculusvr.com/licenses/LICENSE-2.0 
+
+Unless required by applicable law or agreed to in writing, the Oculus VR SDK 
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*************************************************************************************/
+
+#include "OVR_Linux_HIDReportRing.h"
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+namespace OVR { namespace Linux {
+
+//-------------------------------------------------------------------------------------
+// ***** HIDReportRing
+
+HIDReportRing::HIDReportRing()
+    : Head(0), Tail(0)
+{
+    OVR_COMPILER_ASSERT((SlotCount & (SlotCount - 1)) == 0);
+    ResetStats();
+}
+
+void HIDReportRing::ResetStats()
+{
+    memset(&Counters, 0, sizeof(Counters));
+}
+
+int HIDReportRing::fill(int fd)
+{
+    int count = 0;
+    while (Tail - Head < SlotCount)
+    {
+        Report& report = Slots[Tail & (SlotCount - 1)];
+        ssize_t bytes  = read(fd, report.Data, SlotSize);
+        if (bytes < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            return -1;
+        }
+        if (bytes == 0)
+        {
+            // End of file: the other end of a stand-in has gone.
+            return (count > 0) ? count : -1;
+        }
+
+        report.Length = (UInt32)bytes;
+        Tail++;
+        count++;
+    }
+    return count;
+}
+
+void HIDReportRing::dispatch(HIDDevice::HIDHandler* handler)
+{
+    while (Head != Tail)
+    {
+        Report& report = Slots[Head & (SlotCount - 1)];
+        if (handler)
+            handler->OnInputReport(report.Data, report.Length);
+        Head++;
+    }
+}
+
+bool HIDReportRing::Drain(int fd, HIDDevice::HIDHandler* handler)
+{
+    UInt32 batch = 0;
+    bool   ok    = true;
+
+    while (true)
+    {
+        int count = fill(fd);
+        if (count < 0)
+        {
+            ok = false;
+            break;
+        }
+        batch += count;
+
+        bool full = (Tail - Head == SlotCount);
+        dispatch(handler);
+        if (!full)
+            break;
+        Counters.Overruns++;
+    }
+
+    // Reports read before an error are still delivered.
+    dispatch(handler);
+
+    if (batch)
+    {
+        Counters.Reports += batch;
+        Counters.Wakeups++;
+        if (batch > Counters.MaxBatch)
+            Counters.MaxBatch = batch;
+    }
+    return ok;
+}
+
+}} // namespace OVR::Linux
@@ -0,0 +1,94 @@
+/************************************************************************************
+
+Filename    :   OVR_Linux_HIDReportRing.h
+Content     :   Batched reading of hidraw input reports into a ring of report slots
+Created     :   
+Authors     :   
+
+Copyright   :   Copyright 2013 Oculus VR, Inc. All Rights reserved.
+
+Licensed under the Oculus VR SDK License Version 2.0 (the "License"); 
+you may not use the Oculus VR SDK except in compliance with the License, 
+which is provided at the time of installation or download, or which 
+otherwise accompanies this software in either electronic or hard copy form.
+
+You may obtain a copy of the License at
+
+http://www.oculusvr.com/licenses/LICENSE-2.0 
+
+Unless required by applicable law or agreed to in writing, the Oculus VR SDK 
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*************************************************************************************/
+
+#ifndef OVR_Linux_HIDReportRing_h
+#define OVR_Linux_HIDReportRing_h
+
+#include "OVR_HIDDevice.h"
+
+namespace OVR { namespace Linux {
+
+//-------------------------------------------------------------------------------------
+// ***** Linux HIDReportRing
+
+// HIDReportRing reads input reports from a non-blocking hidraw fd, and from anything
+// that delivers one report per read() the same way, such as a pipe or a SOCK_SEQPACKET
+// socket. Each wake-up of the device manager thread drains every report pending
+// instead of one, so a thread held up for a while catches up in one go rather than
+// going back to epoll for each report while the kernel queue fills.
+//
+// Reports are read straight into preallocated slots and handed to the handler from
+// there, with no copy. The ring holds as many reports as hidraw queues per reader; if
+// it fills before the fd runs dry, the reports in it are dispatched and reading goes
+// on, and the overrun is counted.
+
+class HIDReportRing
+{
+public:
+    enum
+    {
+        SlotCount = 64,
+        SlotSize  = 96
+    };
+
+    struct Report
+    {
+        UInt32  Length;
+        UByte   Data[SlotSize];
+    };
+
+    struct Stats
+    {
+        UInt64  Reports;        // Reports read
+        UInt32  Wakeups;        // Calls to Drain that found reports
+        UInt32  MaxBatch;       // Most reports read by one Drain
+        UInt32  Overruns;       // Times the ring filled before the fd ran dry
+    };
+
+    HIDReportRing();
+
+    // Reads every report pending on fd and passes each to handler, which may be null.
+    // Returns false on a read error other than there being nothing left to read.
+    bool    Drain(int fd, HIDDevice::HIDHandler* handler);
+
+    const Stats& GetStats() const { return Counters; }
+    void    ResetStats();
+
+private:
+
+    // Reads reports into the free slots; returns the number read, or -1 on an error.
+    int     fill(int fd);
+    void    dispatch(HIDDevice::HIDHandler* handler);
+
+    Report  Slots[SlotCount];
+    UInt32  Head;   // Next slot to dispatch
+    UInt32  Tail;   // Next slot to read into
+    Stats   Counters;
+};
+
+}} // namespace OVR::Linux
+
+#endif // OVR_Linux_HIDReportRing_h
@@ -0,0 +1,184 @@
+/************************************************************************************
+
+Filename    :   OVR_OrientationPredictor.cpp
+Content     :   Motion models used by SensorFusion to predict head orientation
+Created     :   October 17, 2026
+
+Copyright   :   Copyright 2013 Oculus VR, Inc. All Rights reserved.
+
+Licensed under the Oculus VR SDK License Version 2.0 (the "License");
+you may not use the Oculus VR SDK except in compliance with the License,
+which is provided at the time of installation or download, or which
+otherwise accompanies this software in either electronic or hard copy form.
+
+You may obtain a copy of the License at
+
+http://www.oculusvr.com/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, the Oculus VR SDK
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*************************************************************************************/
+
+#include "OVR_OrientationPredictor.h"
+
+namespace OVR {
+
+//-------------------------------------------------------------------------------------
+// ***** OrientationPredictor
+
+Quatf OrientationPredictor::Integrate(const Quatf& orientation, const Vector3f& rate, float dt)
+{
+    float rateLength = rate.Length();
+    if (rateLength <= 0.001f)
+        return orientation;
+
+    Vector3f axis          = rate / rateLength;
+    float    halfRotAngle  = rateLength * dt * 0.5f;
+    float    sinHalfAngle  = sin(halfRotAngle);
+    Quatf    delta(axis.x * sinHalfAngle, axis.y * sinHalfAngle,
+                   axis.z * sinHalfAngle, cos(halfRotAngle));
+    return orientation * delta;
+}
+
+Quatf OrientationPredictor::Predict(const Quatf& orientation, const PredictionState& state, float dt) const
+{
+    // Rotating by the rate at the middle of the interval is exact for a fixed axis
+    // and close enough over tens of milliseconds otherwise.
+    Vector3f midRate = state.AngularVelocity + state.AngularAcceleration * (dt * 0.5f);
+    return Integrate(orientation, midRate, dt);
+}
+
+
+//-------------------------------------------------------------------------------------
+// ***** ConstantVelocityPredictor
+
+const char* ConstantVelocityPredictor::GetName() const
+{
+    return DynamicInterval ? "Constant velocity" : "Constant velocity, fixed interval";
+}
+
+void ConstantVelocityPredictor::Update(const Vector3f& angularVelocity, float deltaT, PredictionState* state)
+{
+    OVR_UNUSED(deltaT);
+    state->AngularVelocity     = angularVelocity;
+    state->AngularAcceleration = Vector3f();
+}
+
+Quatf ConstantVelocityPredictor::Predict(const Quatf& orientation, const PredictionState& state, float dt) const
+{
+    if (DynamicInterval)
+    {
+        // Dynamic prediction interval: Based on angular velocity to reduce vibration
+        const float minPdt   = 0.001f;
+        const float slopePdt = 0.1f;
+        float       tpdt     = minPdt + slopePdt * state.AngularVelocity.Length();
+        if (tpdt < dt)
+            dt = tpdt;
+    }
+    return Integrate(orientation, state.AngularVelocity, dt);
+}
+
+
+//-------------------------------------------------------------------------------------
+// ***** ConstantAccelerationPredictor
+
+const char* ConstantAccelerationPredictor::GetName() const
+{
+    return "Constant acceleration";
+}
+
+void ConstantAccelerationPredictor::Reset()
+{
+    Rates.Clear();
+}
+
+void ConstantAccelerationPredictor::Update(const Vector3f& angularVelocity, float deltaT, PredictionState* state)
+{
+    Rates.AddElement(angularVelocity);
+
+    // Until the window is full, the fit would see the zeros before the first sample.
+    if (Rates.GetSize() < Window || deltaT <= 0)
+    {
+        state->AngularVelocity     = angularVelocity;
+        state->AngularAcceleration = Vector3f();
+        return;
+    }
+    state->AngularVelocity     = Rates.SavitzkyGolaySmooth<Window>();
+    state->AngularAcceleration = Rates.SavitzkyGolayDerivative<Window>() / deltaT;
+}
+
+
+//-------------------------------------------------------------------------------------
+// ***** KalmanPredictor
+
+KalmanPredictor::KalmanPredictor(float jerkNoise, float gyroNoise)
+    : JerkNoise(jerkNoise), GyroVariance(gyroNoise * gyroNoise), Initialized(false)
+{
+}
+
+const char* KalmanPredictor::GetName() const
+{
+    return "Kalman";
+}
+
+void KalmanPredictor::Reset()
+{
+    Initialized = false;
+}
+
+void KalmanPredictor::Update(const Vector3f& angularVelocity, float deltaT, PredictionState* state)
+{
+    const float measured[3] = { angularVelocity.x, angularVelocity.y, angularVelocity.z };
+
+    if (!Initialized)
+    {
+        // Start at the first reading, with no idea of the acceleration.
+        for (int i = 0; i < 3; i++)
+        {
+            AxisFilter& a = Axes[i];
+            a.Rate  = measured[i];
+            a.Accel = 0;
+            a.P00   = GyroVariance;
+            a.P01   = 0;
+            a.P11   = 1000.0f;
+        }
+        Initialized = true;
+    }
+    else
+    {
+        const float dt  = deltaT;
+        const float dt2 = dt * dt;
+        const float q   = JerkNoise;
+
+        for (int i = 0; i < 3; i++)
+        {
+            AxisFilter& a = Axes[i];
+
+            // Predict: x = F x, P = F P F' + Q with F = [1 dt; 0 1]
+            a.Rate += a.Accel * dt;
+            a.P00  += 2 * dt * a.P01 + dt2 * a.P11 + q * dt2 * dt / 3;
+            a.P01  += dt * a.P11 + q * dt2 / 2;
+            a.P11  += q * dt;
+
+            // Correct with the gyro reading, H = [1 0]
+            float innovation = measured[i] - a.Rate;
+            float s          = a.P00 + GyroVariance;
+            float k0         = a.P00 / s;
+            float k1         = a.P01 / s;
+            a.Rate  += k0 * innovation;
+            a.Accel += k1 * innovation;
+            a.P11   -= k1 * a.P01;
+            a.P01   *= 1 - k0;
+            a.P00   *= 1 - k0;
+        }
+    }
+
+    state->AngularVelocity     = Vector3f(Axes[0].Rate, Axes[1].Rate, Axes[2].Rate);
+    state->AngularAcceleration = Vector3f(Axes[0].Accel, Axes[1].Accel, Axes[2].Accel);
+}
+
+} // namespace OVR
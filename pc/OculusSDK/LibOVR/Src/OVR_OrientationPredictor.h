@@ -0,0 +1,133 @@
+/************************************************************************************
+
+PublicHeader:   OVR.h
+Filename    :   OVR_OrientationPredictor.h
+Content     :   Motion models used by SensorFusion to predict head orientation
+Created     :   October 17, 2026
+
+Copyright   :   Copyright 2013 Oculus VR, Inc. All Rights reserved.
+
+Licensed under the Oculus VR SDK License Version 2.0 (the "License");
+you may not use the Oculus VR SDK except in compliance with the License,
+which is provided at the time of installation or download, or which
+otherwise accompanies this software in either electronic or hard copy form.
+
+You may obtain a copy of the License at
+
+http://www.oculusvr.com/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, the Oculus VR SDK
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*************************************************************************************/
+
+#ifndef OVR_OrientationPredictor_h
+#define OVR_OrientationPredictor_h
+
+#include "OVR_SensorFilter.h"
+#include "Kernel/OVR_RefCount.h"
+
+namespace OVR {
+
+//-------------------------------------------------------------------------------------
+// ***** OrientationPredictor
+
+// Motion estimate a predictor keeps up to date on the sensor thread. SensorFusion
+// publishes it with each snapshot, so predictions can be made from any thread.
+struct PredictionState
+{
+    Vector3f    AngularVelocity;        // rad/s, body frame
+    Vector3f    AngularAcceleration;    // rad/s^2, body frame
+};
+
+// Base class of the motion models behind SensorFusion::GetPredictedOrientation.
+// Update runs on the sensor thread for every sample; Predict is const and only uses
+// its arguments, so it may be called from any thread.
+class OrientationPredictor : public RefCountBase<OrientationPredictor>
+{
+public:
+    virtual ~OrientationPredictor() { }
+
+    virtual const char* GetName() const = 0;
+
+    // Forgets the motion history.
+    virtual void    Reset() = 0;
+
+    // Takes the gyro reading of a new sample and its time step, and updates state.
+    virtual void    Update(const Vector3f& angularVelocity, float deltaT, PredictionState* state) = 0;
+
+    // Orientation dt seconds after one with the given motion state. The default
+    // extrapolates with constant angular acceleration.
+    virtual Quatf   Predict(const Quatf& orientation, const PredictionState& state, float dt) const;
+
+    // orientation rotated by rate * dt, rate in the body frame.
+    static Quatf    Integrate(const Quatf& orientation, const Vector3f& rate, float dt);
+};
+
+
+// Constant angular velocity from the latest gyro reading. This is how SensorFusion
+// always predicted; with dynamicInterval the lookahead shrinks when the head turns
+// slowly (to 1 ms + 0.1 s per rad/s), which keeps a still view from vibrating.
+class ConstantVelocityPredictor : public OrientationPredictor
+{
+public:
+    ConstantVelocityPredictor(bool dynamicInterval = true) : DynamicInterval(dynamicInterval) { }
+
+    virtual const char* GetName() const;
+    virtual void    Reset() { }
+    virtual void    Update(const Vector3f& angularVelocity, float deltaT, PredictionState* state);
+    virtual Quatf   Predict(const Quatf& orientation, const PredictionState& state, float dt) const;
+
+private:
+    bool            DynamicInterval;
+};
+
+
+// Constant angular acceleration, with velocity and acceleration taken from a
+// Savitzky-Golay fit over the last Window gyro readings.
+class ConstantAccelerationPredictor : public OrientationPredictor
+{
+public:
+    enum { Window = 20 };
+
+    virtual const char* GetName() const;
+    virtual void    Reset();
+    virtual void    Update(const Vector3f& angularVelocity, float deltaT, PredictionState* state);
+
+private:
+    SensorFilterBase<Vector3f, Window> Rates;
+};
+
+
+// Constant angular acceleration with a Kalman filter per axis over angular velocity
+// and acceleration, driven by white jerk noise and measured through the gyro.
+class KalmanPredictor : public OrientationPredictor
+{
+public:
+    // jerkNoise is the spectral density of the jerk in (rad/s^3)^2/Hz, gyroNoise the
+    // standard deviation of a gyro reading in rad/s.
+    KalmanPredictor(float jerkNoise = 500.0f, float gyroNoise = 0.02f);
+
+    virtual const char* GetName() const;
+    virtual void    Reset();
+    virtual void    Update(const Vector3f& angularVelocity, float deltaT, PredictionState* state);
+
+private:
+    struct AxisFilter
+    {
+        float   Rate, Accel;        // state
+        float   P00, P01, P11;      // covariance, symmetric
+    };
+
+    float           JerkNoise;
+    float           GyroVariance;
+    bool            Initialized;
+    AxisFilter      Axes[3];
+};
+
+} // namespace OVR
+
+#endif
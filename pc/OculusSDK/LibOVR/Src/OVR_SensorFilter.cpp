@@ -26,103 +26,125 @@ limitations under the License.
 *************************************************************************************/
 
 #include "OVR_SensorFilter.h"
+#include "Kernel/OVR_Alg.h"
 
 namespace OVR {
 
-Vector3f SensorFilter::Median() const
+void SensorFilterMedianAxis::Init(int* lower, int* upper, int* heapPos, int axis)
 {
-    int half_window = Count / 2;
-    float* sortx = (float*) OVR_ALLOC(Count * sizeof(float));
-    float* sorty = (float*) OVR_ALLOC(Count * sizeof(float));
-    float* sortz = (float*) OVR_ALLOC(Count * sizeof(float));
-    float resultx = 0.0f, resulty = 0.0f, resultz = 0.0f;
+    Lower      = lower;
+    Upper      = upper;
+    HeapPos    = heapPos;
+    LowerCount = 0;
+    UpperCount = 0;
+    Axis       = axis;
+}
 
-    for (int i = 0; i < Count; i++) 
+// Heap position bookkeeping; Upper positions are stored complemented.
+static inline void setHeapPos(int* heapPos, bool upper, int idx, int pos)
+{
+    heapPos[idx] = upper ? ~pos : pos;
+}
+
+void SensorFilterMedianAxis::siftUp(const Vector3f* elements, bool upper, int pos)
+{
+    int* heap = upper ? Upper : Lower;
+    int  idx  = heap[pos];
+    float v   = value(elements, idx);
+    while (pos > 0)
     {
-        sortx[i] = Elements[i].x;
-        sorty[i] = Elements[i].y;
-        sortz[i] = Elements[i].z;
+        int parent = (pos - 1) / 2;
+        float pv = value(elements, heap[parent]);
+        if (upper ? !(v < pv) : !(v > pv))
+            break;
+        heap[pos] = heap[parent];
+        setHeapPos(HeapPos, upper, heap[pos], pos);
+        pos = parent;
     }
-    for (int j = 0; j <= half_window; j++) 
+    heap[pos] = idx;
+    setHeapPos(HeapPos, upper, idx, pos);
+}
+
+void SensorFilterMedianAxis::siftDown(const Vector3f* elements, bool upper, int pos)
+{
+    int* heap  = upper ? Upper : Lower;
+    int  count = upper ? UpperCount : LowerCount;
+    int  idx   = heap[pos];
+    float v    = value(elements, idx);
+    for (;;)
     {
-        int minx = j;
-        int miny = j;
-        int minz = j;
-        for (int k = j + 1; k < Count; k++) 
+        int child = 2 * pos + 1;
+        if (child >= count)
+            break;
+        float cv = value(elements, heap[child]);
+        if (child + 1 < count)
         {
-            if (sortx[k] < sortx[minx]) minx = k;
-            if (sorty[k] < sorty[miny]) miny = k;
-            if (sortz[k] < sortz[minz]) minz = k;
+            float rv = value(elements, heap[child + 1]);
+            if (upper ? (rv < cv) : (rv > cv))
+            {
+                child++;
+                cv = rv;
+            }
         }
-        const float tempx = sortx[j];
-        const float tempy = sorty[j];
-        const float tempz = sortz[j];
-        sortx[j] = sortx[minx];
-        sortx[minx] = tempx;
-
-        sorty[j] = sorty[miny];
-        sorty[miny] = tempy;
-
-        sortz[j] = sortz[minz];
-        sortz[minz] = tempz;
+        if (upper ? !(cv < v) : !(cv > v))
+            break;
+        heap[pos] = heap[child];
+        setHeapPos(HeapPos, upper, heap[pos], pos);
+        pos = child;
     }
-    resultx = sortx[half_window];
-    resulty = sorty[half_window];
-    resultz = sortz[half_window];
-
-    OVR_FREE(sortx);
-    OVR_FREE(sorty);
-    OVR_FREE(sortz);
-
-    return Vector3f(resultx, resulty, resultz);
+    heap[pos] = idx;
+    setHeapPos(HeapPos, upper, idx, pos);
 }
 
-//  Only the diagonal of the covariance matrix.
-Vector3f SensorFilter::Variance() const
+void SensorFilterMedianAxis::push(const Vector3f* elements, bool upper, int idx)
 {
-    Vector3f mean = Mean();
-    Vector3f total = Vector3f(0.0f, 0.0f, 0.0f);
-    for (int i = 0; i < Count; i++) 
-    {
-        total.x += (Elements[i].x - mean.x) * (Elements[i].x - mean.x);
-        total.y += (Elements[i].y - mean.y) * (Elements[i].y - mean.y);
-        total.z += (Elements[i].z - mean.z) * (Elements[i].z - mean.z);
-    }
-    return total / (float) Count;
+    int pos = upper ? UpperCount++ : LowerCount++;
+    (upper ? Upper : Lower)[pos] = idx;
+    siftUp(elements, upper, pos);
 }
 
-// Should be a 3x3 matrix returned, but OVR_math.h doesn't have one
-Matrix4f SensorFilter::Covariance() const
+int SensorFilterMedianAxis::pop(const Vector3f* elements, bool upper)
 {
-    Vector3f mean = Mean();
-    Matrix4f total = Matrix4f(0.0,0.0,0.0,0.0,0.0,0.0,0.0,0.0,0.0);
-    for (int i = 0; i < Count; i++) 
+    int* heap = upper ? Upper : Lower;
+    int  last = upper ? --UpperCount : --LowerCount;
+    int  top  = heap[0];
+    if (last > 0)
     {
-        total.M[0][0] += (Elements[i].x - mean.x) * (Elements[i].x - mean.x);
-        total.M[1][0] += (Elements[i].y - mean.y) * (Elements[i].x - mean.x);
-        total.M[2][0] += (Elements[i].z - mean.z) * (Elements[i].x - mean.x);
-        total.M[1][1] += (Elements[i].y - mean.y) * (Elements[i].y - mean.y);
-        total.M[2][1] += (Elements[i].z - mean.z) * (Elements[i].y - mean.y);
-        total.M[2][2] += (Elements[i].z - mean.z) * (Elements[i].z - mean.z);
+        heap[0] = heap[last];
+        siftDown(elements, upper, 0);
     }
-    total.M[0][1] = total.M[1][0];
-    total.M[0][2] = total.M[2][0];
-    total.M[1][2] = total.M[2][1];
-    for (int i = 0; i < 3; i++)
-        for (int j = 0; j < 3; j++)
-            total.M[i][j] *= 1.0f / Count;
-    return total;
+    return top;
 }
 
-Vector3f SensorFilter::PearsonCoefficient() const
+void SensorFilterMedianAxis::Insert(const Vector3f* elements, int idx)
 {
-    Matrix4f cov = Covariance();
-    Vector3f pearson = Vector3f();
-    pearson.x = cov.M[0][1]/(sqrt(cov.M[0][0])*sqrt(cov.M[1][1]));
-    pearson.y = cov.M[1][2]/(sqrt(cov.M[1][1])*sqrt(cov.M[2][2]));
-    pearson.z = cov.M[2][0]/(sqrt(cov.M[2][2])*sqrt(cov.M[0][0]));
+    // Route the new element through Lower so it lands in the right half, then
+    // rebalance so Upper holds the same number of elements or one more.
+    push(elements, false, idx);
+    push(elements, true, pop(elements, false));
+    if (UpperCount > LowerCount + 1)
+        push(elements, false, pop(elements, true));
+}
 
-    return pearson;
+void SensorFilterMedianAxis::Replace(const Vector3f* elements, int oldIdx, int idx)
+{
+    // The new element takes the heap slot of the one that left; restore that heap,
+    // then swap the tops if it belongs to the other half. Heap sizes don't change.
+    int  pos   = HeapPos[oldIdx];
+    bool upper = pos < 0;
+    if (upper)
+        pos = ~pos;
+    (upper ? Upper : Lower)[pos] = idx;
+    siftUp(elements, upper, pos);
+    pos = upper ? ~HeapPos[idx] : HeapPos[idx];
+    siftDown(elements, upper, pos);
+
+    if (LowerCount > 0 && value(elements, Lower[0]) > value(elements, Upper[0]))
+    {
+        Alg::Swap(Lower[0], Upper[0]);
+        siftDown(elements, false, 0);
+        siftDown(elements, true, 0);
+    }
 }
 
 } //namespace OVR
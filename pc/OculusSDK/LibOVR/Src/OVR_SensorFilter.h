@@ -33,34 +33,45 @@ limitations under the License.
 
 namespace OVR {
 
-// A simple circular buffer data structure that stores last N elements in an array
-template <typename T>
+// Smallest power of two that is at least N
+template <int N, int P = 1, bool Done = (P >= N)>
+struct CircularBufferStorage
+{
+    enum { Size = CircularBufferStorage<N, P * 2>::Size };
+};
+
+template <int N, int P>
+struct CircularBufferStorage<N, P, true>
+{
+    enum { Size = P };
+};
+
+// A simple circular buffer data structure that stores last N elements in an array.
+// The storage is inline and rounded up to a power of two, so indices wrap with a mask.
+template <typename T, int N>
 class CircularBuffer
 {
-protected:
+public:
     enum
     {
-        DefaultFilterCapacity = 20
+        Capacity    = N,                                // The buffer size (maximum number of elements)
+        StorageSize = CircularBufferStorage<N>::Size,
+        StorageMask = StorageSize - 1
     };
 
-    int         LastIdx;                    // The index of the last element that was added to the buffer
-    int         Capacity;                   // The buffer size (maximum number of elements)
+protected:
+    int         LastIdx;                    // The storage index of the last element that was added
     int         Count;                      // Number of elements in the filter
-    T*          Elements;
+    T           Elements[StorageSize];
 
 public:
-    CircularBuffer(int capacity = DefaultFilterCapacity) 
-        : LastIdx(-1), Capacity(capacity), Count(0)
+    CircularBuffer() 
+        : LastIdx(StorageMask), Count(0)
     {
-        Elements = (T*)OVR_ALLOC(capacity * sizeof(T));
-        for (int i = 0; i < Capacity; i++)
+        for (int i = 0; i < StorageSize; i++)
             Elements[i] = T();
     }
 
-    ~CircularBuffer() {
-        OVR_FREE(Elements);
-    }
-
 private:
     // Make the class non-copyable
     CircularBuffer(const CircularBuffer& other);
@@ -70,52 +81,113 @@ public:
     // Add a new element to the filter
     void AddElement (const T &e)
     {
-        LastIdx = (LastIdx + 1) % Capacity;
+        LastIdx = (LastIdx + 1) & StorageMask;
         Elements[LastIdx] = e;
         if (Count < Capacity)
             Count++;
     }
 
+    // Remove all elements
+    void Clear()
+    {
+        LastIdx = StorageMask;
+        Count   = 0;
+        for (int i = 0; i < StorageSize; i++)
+            Elements[i] = T();
+    }
+
+    // Number of elements in the buffer, at most the capacity
+    int GetSize() const { return Count; }
+
     // Get element i.  0 is the most recent, 1 is one step ago, 2 is two steps ago, ...
     T GetPrev(int i = 0) const
     {
 		OVR_ASSERT(i >= 0);
         if (i >= Count) // return 0 if the filter doesn't have enough elements
             return T();
-        int idx = (LastIdx - i);
-        if (idx < 0) // Fix the wraparound case
-            idx += Capacity;
-		OVR_ASSERT(idx >= 0); // Multiple wraparounds not allowed
-        return Elements[idx];
+        return Elements[(LastIdx - i) & StorageMask];
+    }
+};
+
+// Savitzky-Golay coefficients of a least squares line through the last W elements,
+// element 0 being the most recent: the smoothed value at element 0, and the smoothed
+// derivative per element. All are integer ratios, so they fold to constants.
+template <int W, int I>
+struct SavitzkyGolayCoefficient
+{
+    enum
+    {
+        SmoothNumerator        = 4 * W - 2 - 6 * I,
+        SmoothDenominator      = W * (W + 1),
+        DerivativeNumerator    = 6 * (W - 1 - 2 * I),
+        DerivativeDenominator  = W * (W * W - 1)
+    };
+};
+
+// Weighted sum of elements [I, I + Length) of a window of W, unrolled at compile time.
+// The range is split in halves so the instantiation depth stays logarithmic in W.
+template <typename T, int N, int W, int I, int Length>
+struct SavitzkyGolaySum
+{
+    typedef SavitzkyGolaySum<T, N, W, I, Length / 2>                       Head;
+    typedef SavitzkyGolaySum<T, N, W, I + Length / 2, Length - Length / 2> Tail;
+
+    static T Smooth(const CircularBuffer<T, N>& b)      { return Head::Smooth(b) + Tail::Smooth(b); }
+    static T Derivative(const CircularBuffer<T, N>& b)  { return Head::Derivative(b) + Tail::Derivative(b); }
+};
+
+template <typename T, int N, int W, int I>
+struct SavitzkyGolaySum<T, N, W, I, 1>
+{
+    typedef SavitzkyGolayCoefficient<W, I> C;
+
+    static T Smooth(const CircularBuffer<T, N>& b)
+    {
+        return b.GetPrev(I) * ((float)C::SmoothNumerator / (float)C::SmoothDenominator);
+    }
+    static T Derivative(const CircularBuffer<T, N>& b)
+    {
+        return b.GetPrev(I) * ((float)C::DerivativeNumerator / (float)C::DerivativeDenominator);
     }
 };
 
 // A base class for filters that maintains a buffer of sensor data taken over time and implements
 // various simple filters, most of which are linear functions of the data history.
 // Maintains the running sum of its elements for better performance on large capacity values
-template <typename T>
-class SensorFilterBase : public CircularBuffer<T>
+template <typename T, int N>
+class SensorFilterBase : public CircularBuffer<T, N>
 {
 protected:
     T RunningTotal;               // Cached sum of the elements
+    T Compensation;               // Low order bits lost from RunningTotal (Kahan summation)
+
+    void addToTotal(const T& x)
+    {
+        T y = x - Compensation;
+        T t = RunningTotal + y;
+        Compensation = (t - RunningTotal) - y;
+        RunningTotal = t;
+    }
 
 public:
-    SensorFilterBase(int capacity = CircularBuffer<T>::DefaultFilterCapacity) : CircularBuffer<T>(capacity), RunningTotal() { };
+    SensorFilterBase() : RunningTotal(), Compensation() { };
 
     // Add a new element to the filter
-    // Updates the running sum value
+    // Updates the running sum value; compensated summation keeps its error from
+    // accumulating, so it never has to be recomputed from the elements
     void AddElement (const T &e)
     {
-        int NextIdx = (this->LastIdx + 1) % this->Capacity;
-        RunningTotal += (e - this->Elements[NextIdx]);
-        CircularBuffer<T>::AddElement(e);
-        if (this->LastIdx == 0)
-        {
-            // update the cached total to avoid error accumulation
-            RunningTotal = T();
-            for (int i = 0; i < this->Count; i++)
-                RunningTotal += this->Elements[i];
-        } 
+        if (this->Count == N)
+            addToTotal(T() - this->GetPrev(N - 1));
+        addToTotal(e);
+        CircularBuffer<T, N>::AddElement(e);
+    }
+
+    void Clear()
+    {
+        CircularBuffer<T, N>::Clear();
+        RunningTotal = T();
+        Compensation = T();
     }
 
     // Simple statistics
@@ -129,83 +201,165 @@ public:
         return (this->Count == 0) ? T() : (Total() / (float) this->Count);
     }
 
-    // A popular family of smoothing filters and smoothed derivatives
-    T SavitzkyGolaySmooth8() const
-    {
-        OVR_ASSERT(this->Capacity >= 8);
-        return this->GetPrev(0)*0.41667f +
-                this->GetPrev(1)*0.33333f +
-                this->GetPrev(2)*0.25f +
-                this->GetPrev(3)*0.16667f +
-                this->GetPrev(4)*0.08333f -
-                this->GetPrev(6)*0.08333f -
-                this->GetPrev(7)*0.16667f;
-    }
-
-    T SavitzkyGolayDerivative4() const
-    {
-        OVR_ASSERT(this->Capacity >= 4);
-        return this->GetPrev(0)*0.3f +
-                this->GetPrev(1)*0.1f -
-                this->GetPrev(2)*0.1f -
-                this->GetPrev(3)*0.3f;
-    }
-
-    T SavitzkyGolayDerivative5() const
-    {
-            OVR_ASSERT(this->Capacity >= 5);
-            return this->GetPrev(0)*0.2f +
-                    this->GetPrev(1)*0.1f -
-                    this->GetPrev(3)*0.1f -
-                    this->GetPrev(4)*0.2f;
-    }
-
-    T SavitzkyGolayDerivative12() const
-    {
-        OVR_ASSERT(this->Capacity >= 12);
-        return this->GetPrev(0)*0.03846f +
-                this->GetPrev(1)*0.03147f +
-                this->GetPrev(2)*0.02448f +
-                this->GetPrev(3)*0.01748f +
-                this->GetPrev(4)*0.01049f +
-                this->GetPrev(5)*0.0035f -
-                this->GetPrev(6)*0.0035f -
-                this->GetPrev(7)*0.01049f -
-                this->GetPrev(8)*0.01748f -
-                this->GetPrev(9)*0.02448f -
-                this->GetPrev(10)*0.03147f -
-                this->GetPrev(11)*0.03846f;
-    } 
-
-    T SavitzkyGolayDerivativeN(int n) const
-    {    
-        OVR_ASSERT(this->Capacity >= n);
-        int m = (n-1)/2;
-        T result = T();
-        for (int k = 1; k <= m; k++) 
-        {
-            int ind1 = m - k;
-            int ind2 = n - m + k - 1;
-            result += (this->GetPrev(ind1) - this->GetPrev(ind2)) * (float) k;
-        }
-        float coef = 3.0f/(m*(m+1.0f)*(2.0f*m+1.0f));
-        result = result*coef;
-        return result;
+    // A popular family of smoothing filters and smoothed derivatives, over the last W
+    // elements, e.g. SavitzkyGolaySmooth<8>() or SavitzkyGolayDerivative<12>()
+    template <int W>
+    T SavitzkyGolaySmooth() const
+    {
+        OVR_COMPILER_ASSERT(W >= 2 && W <= N);
+        return SavitzkyGolaySum<T, N, W, 0, W>::Smooth(*this);
     }
+
+    template <int W>
+    T SavitzkyGolayDerivative() const
+    {
+        OVR_COMPILER_ASSERT(W >= 2 && W <= N);
+        return SavitzkyGolaySum<T, N, W, 0, W>::Derivative(*this);
+    }
+};
+
+// The two heaps that keep one axis of a SensorFilter window in order, so its median can
+// be read in O(1) and updated in O(log N). Lower is a max-heap of the smaller half and
+// Upper a min-heap of the larger half, holding the extra element when the count is odd,
+// so the median is always Upper[0]. Both hold storage indices into the filter elements;
+// HeapPos maps a storage index to its heap position, with ~position for Upper, so the
+// element a new sample overwrites can be fixed up in place.
+class SensorFilterMedianAxis
+{
+public:
+    void  Init(int* lower, int* upper, int* heapPos, int axis);
+
+    // Element idx was added to the window, or replaced the element at oldIdx in it
+    // (the two are the same slot when the capacity is a power of two).
+    void  Insert(const Vector3f* elements, int idx);
+    void  Replace(const Vector3f* elements, int oldIdx, int idx);
+
+    float Median(const Vector3f* elements) const { return value(elements, Upper[0]); }
+
+private:
+    float value(const Vector3f* elements, int idx) const
+    {
+        const Vector3f& e = elements[idx];
+        return (Axis == 0) ? e.x : ((Axis == 1) ? e.y : e.z);
+    }
+    void  siftUp(const Vector3f* elements, bool upper, int pos);
+    void  siftDown(const Vector3f* elements, bool upper, int pos);
+    void  push(const Vector3f* elements, bool upper, int idx);
+    int   pop(const Vector3f* elements, bool upper);
+
+    int*  Lower;
+    int*  Upper;
+    int*  HeapPos;
+    int   LowerCount;
+    int   UpperCount;
+    int   Axis;
 };
 
 // This class maintains a buffer of sensor data taken over time and implements
 // various simple filters, most of which are linear functions of the data history.
-class SensorFilter : public SensorFilterBase<Vector3f>
+template <int N>
+class SensorFilter : public SensorFilterBase<Vector3f, N>
 {
+    typedef SensorFilterBase<Vector3f, N> Base;
+
 public:
-    SensorFilter(int capacity = DefaultFilterCapacity) : SensorFilterBase<Vector3f>(capacity) { };
+    SensorFilter()
+    {
+        for (int axis = 0; axis < 3; axis++)
+            Medians[axis].Init(LowerIdx[axis], UpperIdx[axis], HeapPos[axis], axis);
+    }
+
+    // Add a new element to the filter
+    // Updates the running sum and the median order of each axis in O(log N)
+    void AddElement (const Vector3f &e)
+    {
+        bool replace = (this->Count == N);
+        Base::AddElement(e);
+        if (replace)
+        {
+            int leftIdx = (this->LastIdx - N) & Base::StorageMask;
+            for (int axis = 0; axis < 3; axis++)
+                Medians[axis].Replace(this->Elements, leftIdx, this->LastIdx);
+        }
+        else
+        {
+            for (int axis = 0; axis < 3; axis++)
+                Medians[axis].Insert(this->Elements, this->LastIdx);
+        }
+    }
+
+    void Clear()
+    {
+        Base::Clear();
+        for (int axis = 0; axis < 3; axis++)
+            Medians[axis].Init(LowerIdx[axis], UpperIdx[axis], HeapPos[axis], axis);
+    }
 
     // Simple statistics
-    Vector3f Median() const;
-    Vector3f Variance() const; // The diagonal of covariance matrix
-    Matrix4f Covariance() const;
-    Vector3f PearsonCoefficient() const;
+    Vector3f Median() const // The upper median of each axis; O(1)
+    {
+        if (this->Count == 0)
+            return Vector3f();
+        return Vector3f(Medians[0].Median(this->Elements),
+                        Medians[1].Median(this->Elements),
+                        Medians[2].Median(this->Elements));
+    }
+
+    //  Only the diagonal of the covariance matrix.
+    Vector3f Variance() const
+    {
+        Vector3f mean = this->Mean();
+        Vector3f total = Vector3f(0.0f, 0.0f, 0.0f);
+        for (int i = 0; i < this->Count; i++) 
+        {
+            Vector3f d = this->GetPrev(i) - mean;
+            total.x += d.x * d.x;
+            total.y += d.y * d.y;
+            total.z += d.z * d.z;
+        }
+        return total / (float) this->Count;
+    }
+
+    // Should be a 3x3 matrix returned, but OVR_math.h doesn't have one
+    Matrix4f Covariance() const
+    {
+        Vector3f mean = this->Mean();
+        Matrix4f total = Matrix4f(0.0,0.0,0.0,0.0,0.0,0.0,0.0,0.0,0.0);
+        for (int i = 0; i < this->Count; i++) 
+        {
+            Vector3f d = this->GetPrev(i) - mean;
+            total.M[0][0] += d.x * d.x;
+            total.M[1][0] += d.y * d.x;
+            total.M[2][0] += d.z * d.x;
+            total.M[1][1] += d.y * d.y;
+            total.M[2][1] += d.z * d.y;
+            total.M[2][2] += d.z * d.z;
+        }
+        total.M[0][1] = total.M[1][0];
+        total.M[0][2] = total.M[2][0];
+        total.M[1][2] = total.M[2][1];
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+                total.M[i][j] *= 1.0f / this->Count;
+        return total;
+    }
+
+    Vector3f PearsonCoefficient() const
+    {
+        Matrix4f cov = Covariance();
+        Vector3f pearson = Vector3f();
+        pearson.x = cov.M[0][1]/(sqrt(cov.M[0][0])*sqrt(cov.M[1][1]));
+        pearson.y = cov.M[1][2]/(sqrt(cov.M[1][1])*sqrt(cov.M[2][2]));
+        pearson.z = cov.M[2][0]/(sqrt(cov.M[2][2])*sqrt(cov.M[0][0]));
+        return pearson;
+    }
+
+private:
+    // Each half holds at most N/2 + 1 indices, briefly, while Insert rebalances.
+    int                     LowerIdx[3][N/2 + 1];
+    int                     UpperIdx[3][N/2 + 1];
+    int                     HeapPos[3][Base::StorageSize];
+    SensorFilterMedianAxis  Medians[3];
 };
 
 } //namespace OVR
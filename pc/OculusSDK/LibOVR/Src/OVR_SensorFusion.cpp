@@ -40,13 +40,17 @@ namespace OVR {
 SensorFusion::SensorFusion(SensorDevice* sensor)
   : Stage(0), RunningTime(0), DeltaT(0.001f), 
     Handler(getThis()), pDelegate(0),
-    Gain(0.05f), EnableGravity(true), 
-    EnablePrediction(true), PredictionDT(0.03f), PredictionTimeIncrement(0.001f),
-    FRawMag(10), FAngV(20), 
-    GyroOffset(), TiltAngleFilter(1000),
+    EnableGravity(true), 
+    EnablePrediction(true), PredictionTimeIncrement(0.001f),
+    pPredictor(&DefaultPredictor),
+    GyroOffset(),
     EnableYawCorrection(false), MagCalibrated(false), MagNumReferences(0), MagRefIdx(-1), MagRefScore(0),
-    MotionTrackingEnabled(true)
+    MotionTrackingEnabled(true), HistoryNext(0), HistoryCount(0)
 {
+   Snapshots[0].Version = 0;
+   Snapshots[1].Version = 0;
+   SnapshotIdx = 0;
+
    if (sensor)
        AttachToSensor(sensor);
    MagCalibrationMatrix.SetIdentity();
@@ -114,7 +118,89 @@ void SensorFusion::Reset()
     RunningTime           = 0;
     MagNumReferences      = 0;
     MagRefIdx             = -1;
+    MagRefGrid.Clear();
     GyroOffset            = Vector3f();
+    HistoryNext           = 0;
+    HistoryCount          = 0;
+    Prediction            = PredictionState();
+    pPredictor->Reset();
+    publishSnapshot(0);
+}
+
+//-------------------------------------------------------------------------------------
+// ***** SensorFusion::ReferenceGrid
+
+// Grid cell size used when MaxMagRefDist is zero or tiny, to keep cell coordinates in range.
+static const float MinMagRefCellSize = 0.001f;
+
+void SensorFusion::ReferenceGrid::Clear()
+{
+    for (int i = 0; i < BucketCount; i++)
+        Heads[i] = -1;
+}
+
+void SensorFusion::ReferenceGrid::Rebuild(float cellSize, const Vector3f* points, int count)
+{
+    CellSize = cellSize;
+    Clear();
+    for (int i = 0; i < count; i++)
+        Insert(i, points[i]);
+}
+
+int SensorFusion::ReferenceGrid::cellCoord(float v) const
+{
+    return (int)floorf(v / CellSize);
+}
+
+int SensorFusion::ReferenceGrid::bucketOf(int cx, int cy, int cz) const
+{
+    UInt32 h = ((UInt32)cx * 73856093u) ^ ((UInt32)cy * 19349663u) ^ ((UInt32)cz * 83492791u);
+    return (int)(h & (BucketCount - 1));
+}
+
+void SensorFusion::ReferenceGrid::Insert(int idx, const Vector3f& p)
+{
+    int bucket   = bucketOf(cellCoord(p.x), cellCoord(p.y), cellCoord(p.z));
+    Buckets[idx] = (SInt16)bucket;
+    Next[idx]    = Heads[bucket];
+    Heads[bucket] = (SInt16)idx;
+}
+
+void SensorFusion::ReferenceGrid::Remove(int idx)
+{
+    SInt16* link = &Heads[Buckets[idx]];
+    while (*link != idx)
+    {
+        OVR_ASSERT(*link >= 0);
+        link = &Next[*link];
+    }
+    *link = Next[idx];
+}
+
+int SensorFusion::ReferenceGrid::FindNearest(const Vector3f* points, const Vector3f& p, float maxDist) const
+{
+    OVR_ASSERT(maxDist <= CellSize);
+    int   cx = cellCoord(p.x), cy = cellCoord(p.y), cz = cellCoord(p.z);
+    int   best = -1;
+    float bestDist = maxDist;
+
+    // Different cells may share a bucket, so a bucket can be visited twice and hold
+    // references from far away; neither changes the result.
+    for (int dx = -1; dx <= 1; dx++)
+        for (int dy = -1; dy <= 1; dy++)
+            for (int dz = -1; dz <= 1; dz++)
+            {
+                for (int i = Heads[bucketOf(cx + dx, cy + dy, cz + dz)]; i >= 0; i = Next[i])
+                {
+                    float dist = (p - points[i]).Length();
+                    if (bestDist > dist || (bestDist == dist && best > i))
+                    {
+                        bestDist = dist;
+                        best     = i;
+                    }
+                }
+            }
+    return best;
 }
 
 // Compute a rotation required to transform "estimated" into "measured"
@@ -144,7 +230,6 @@ void SensorFusion::handleMessage(const MessageBodyFrame& msg)
 
     // Insert current sensor data into filter history
     FRawMag.AddElement(mag);
-    FAngV.AddElement(gyro);
 
     // Apply the calibration parameters to raw mag
     Vector3f calMag = MagCalibrated ? GetCalibratedMagValue(FRawMag.Mean()) : FRawMag.Mean();
@@ -174,10 +259,10 @@ void SensorFusion::handleMessage(const MessageBodyFrame& msg)
 
     if (EnableGravity)
     {
-        const float spikeThreshold = 0.01f;
-        const float gravityThreshold = 0.1f;
-        float proportionalGain     = 5 * Gain; // Gain parameter should be removed in a future release
-        float integralGain         = 0.0125f;
+        const float spikeThreshold = Config.TiltSpikeThreshold;
+        const float gravityThreshold = Config.GravityThreshold;
+        float proportionalGain     = 5 * Config.AccelGain; // Gain parameter should be removed in a future release
+        float integralGain         = Config.TiltIntegralGain;
 
         Vector3f tiltCorrection = SensorFusion_ComputeCorrection(accel, up);
 
@@ -203,42 +288,43 @@ void SensorFusion::handleMessage(const MessageBodyFrame& msg)
         GyroOffset -= (tiltCorrection * integralGain * DeltaT);
     }
 
-    if (EnableYawCorrection && MagCalibrated && RunningTime > 2.0f)
+    if (EnableYawCorrection && MagCalibrated && RunningTime > Config.YawCorrectionDelay)
     {
-        const float maxMagRefDist = 0.1f;
-        const float maxTiltError = 0.05f;
-        float proportionalGain   = 0.01f;
-        float integralGain       = 0.0005f;
+        const float maxMagRefDist = Config.MaxMagRefDist;
+        const float maxTiltError = Config.MaxMagTiltError;
+        float proportionalGain   = Config.YawProportionalGain;
+        float integralGain       = Config.YawIntegralGain;
 
         // Update the reference point if needed
         if (MagRefIdx < 0 || calMag.Distance(MagRefsInBodyFrame[MagRefIdx]) > maxMagRefDist)
         {
+            // The grid is laid out for the current MaxMagRefDist
+            if (MagRefGrid.GetCellSize() != Alg::Max(maxMagRefDist, MinMagRefCellSize))
+                MagRefGrid.Rebuild(Alg::Max(maxMagRefDist, MinMagRefCellSize), MagRefsInBodyFrame, MagNumReferences);
+
             // Delete a bad point
             if (MagRefIdx >= 0 && MagRefScore < 0)
             {
                 MagNumReferences--;
+                MagRefGrid.Remove(MagRefIdx);
+                if (MagRefIdx != MagNumReferences)
+                {
+                    MagRefGrid.Remove(MagNumReferences);
+                    MagRefGrid.Insert(MagRefIdx, MagRefsInBodyFrame[MagNumReferences]);
+                }
                 MagRefsInBodyFrame[MagRefIdx] = MagRefsInBodyFrame[MagNumReferences];
                 MagRefsInWorldFrame[MagRefIdx] = MagRefsInWorldFrame[MagNumReferences];
             }
             // Find a new one
-            MagRefIdx = -1;
             MagRefScore = 1000;
-            float bestDist = maxMagRefDist;
-            for (int i = 0; i < MagNumReferences; i++)
-            {
-                float dist = calMag.Distance(MagRefsInBodyFrame[i]);
-                if (bestDist > dist)
-                {
-                    bestDist = dist;
-                    MagRefIdx = i;
-                }
-            }
+            MagRefIdx = MagRefGrid.FindNearest(MagRefsInBodyFrame, calMag, maxMagRefDist);
             // Create one if needed
             if (MagRefIdx < 0 && MagNumReferences < MagMaxReferences)
             {
                 MagRefIdx = MagNumReferences;
                 MagRefsInBodyFrame[MagRefIdx] = calMag;
                 MagRefsInWorldFrame[MagRefIdx] = Q.Rotate(calMag).Normalized();
+                MagRefGrid.Insert(MagRefIdx, calMag);
                 MagNumReferences++;
             }
         }
@@ -275,45 +361,133 @@ void SensorFusion::handleMessage(const MessageBodyFrame& msg)
     // so it is periodically normalized.
     if (Stage % 500 == 0)
         Q.Normalize();
+
+    pPredictor->Update(gyro, DeltaT, &Prediction);
+
+    // Messages passed in manually may not have a time; continue from the last one.
+    UInt64 timeMks = msg.AbsoluteTimeMks;
+    if (timeMks == 0 && HistoryCount > 0)
+        timeMks = getHistory(HistoryCount - 1).TimeMks + (UInt64)(DeltaT * 1000000.0f);
+
+    // Host time only goes back past the last entry when the sensor's time filter
+    // restarts its mapping (or a caller restarts its own times). The history is on the
+    // old time base then, and would no longer be sorted for GetOrientationAt; drop it.
+    if (HistoryCount > 0 && timeMks < getHistory(HistoryCount - 1).TimeMks)
+        HistoryCount = 0;
+
+    HistoryEntry& entry = History[HistoryNext];
+    entry.TimeMks     = timeMks;
+    entry.Orientation = Q;
+    HistoryNext = (HistoryNext + 1) & (HistorySize - 1);
+    if (HistoryCount < HistorySize)
+        HistoryCount++;
+
+    publishSnapshot(timeMks);
+}
+
+void SensorFusion::publishSnapshot(UInt64 timeMks)
+{
+    // Write the slot readers aren't directed to; a reader still copying it from two
+    // publishes ago sees the version change and retries.
+    int           next = SnapshotIdx ^ 1;
+    SnapshotSlot& slot = Snapshots[next];
+
+    slot.Version.ExchangeAdd_Sync(1);
+    slot.Data.Orientation     = Q;
+    slot.Data.Acceleration    = A;
+    slot.Data.AngularVelocity = AngV;
+    slot.Data.RawMag          = RawMag;
+    slot.Data.CalMag          = CalMag;
+    slot.Data.Prediction      = Prediction;
+    slot.Data.TimeMks         = timeMks;
+    slot.Version.ExchangeAdd_Sync(1);
+
+    SnapshotIdx.Store_Release(next);
+}
+
+void SensorFusion::GetSnapshot(Snapshot* snapshot) const
+{
+    while (true)
+    {
+        const SnapshotSlot& slot = Snapshots[SnapshotIdx.Load_Acquire()];
+
+        // Readers only load, so they don't contend for the slot's cache line. The
+        // fences keep the copy between the two version reads.
+        UInt32 version = slot.Version.Load_Acquire();
+        if (version & 1)
+            continue;
+        AtomicLoadFence();
+        *snapshot = slot.Data;
+        AtomicLoadFence();
+        if (slot.Version.Load_Acquire() == version)
+            return;
+    }
+}
+
+Quatf SensorFusion::GetOrientationAt(UInt64 timeMks) const
+{
+    Lock::Locker lockScope(Handler.GetHandlerLock());
+
+    if (HistoryCount == 0 || timeMks >= getHistory(HistoryCount - 1).TimeMks)
+        return Q;
+    if (timeMks <= getHistory(0).TimeMks)
+        return getHistory(0).Orientation;
+
+    // Find the entries either side of timeMks; handleMessage keeps times in order.
+    int lo = 0, hi = HistoryCount - 1;
+    while (hi - lo > 1)
+    {
+        int mid = (lo + hi) / 2;
+        if (getHistory(mid).TimeMks <= timeMks)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    const HistoryEntry& a = getHistory(lo);
+    const HistoryEntry& b = getHistory(hi);
+    float f = (float)(timeMks - a.TimeMks) / (float)(b.TimeMks - a.TimeMks);
+
+    // Samples are a millisecond apart, so a normalized lerp is as good as a slerp.
+    Quatf qa = a.Orientation, qb = b.Orientation;
+    if (qa.x*qb.x + qa.y*qb.y + qa.z*qb.z + qa.w*qb.w < 0)
+        qb = qb * -1.0f;
+    Quatf q = qa * (1.0f - f) + qb * f;
+    q.Normalize();
+    return q;
 }
 
 //  A predictive filter based on extrapolating the smoothed, current angular velocity
 Quatf SensorFusion::GetPredictedOrientation(float pdt)
 {		
-    Lock::Locker lockScope(Handler.GetHandlerLock());
-    Quatf        qP = Q;
-    
-    if (EnablePrediction)
+    Snapshot s;
+    if (!EnablePrediction)
     {
-        // This method assumes a constant angular velocity
-        Vector3f angVelF  = FAngV.SavitzkyGolaySmooth8();
-        float    angVelFL = angVelF.Length();
-
-        // Force back to raw measurement
-        angVelF  = AngV;
-        angVelFL = AngV.Length();
-
-        // Dynamic prediction interval: Based on angular velocity to reduce vibration
-        const float minPdt   = 0.001f;
-        const float slopePdt = 0.1f;
-        float       newpdt   = pdt;
-        float       tpdt     = minPdt + slopePdt * angVelFL;
-        if (tpdt < pdt)
-            newpdt = tpdt;
-        //LogText("PredictonDTs: %d\n",(int)(newpdt / PredictionTimeIncrement + 0.5f));
-
-        if (angVelFL > 0.001f)
-        {
-            Vector3f    rotAxisP      = angVelF / angVelFL;  
-            float       halfRotAngleP = angVelFL * newpdt * 0.5f;
-            float       sinaHRAP      = sin(halfRotAngleP);
-            Quatf       deltaQP(rotAxisP.x*sinaHRAP, rotAxisP.y*sinaHRAP,
-                                rotAxisP.z*sinaHRAP, cos(halfRotAngleP));
-            qP = Q * deltaQP;
-        }
+        GetSnapshot(&s);
+        return s.Orientation;
     }
-    return qP;
-}    
+
+    // Take the predictor and the state it made together, so a concurrent SetPredictor
+    // can neither pair them up wrong nor release the predictor while it runs.
+    Ptr<OrientationPredictor> predictor;
+    {
+        Lock::Locker lockScope(Handler.GetHandlerLock());
+        predictor = pPredictor;
+        GetSnapshot(&s);
+    }
+    return predictor->Predict(s.Orientation, s.Prediction, pdt);
+}
+
+void SensorFusion::SetPredictor(OrientationPredictor* predictor)
+{
+    Lock::Locker lockScope(Handler.GetHandlerLock());
+    if (!predictor)
+        predictor = &DefaultPredictor;
+    predictor->Reset();
+    Prediction = PredictionState();
+    pPredictor = predictor;
+    publishSnapshot(HistoryCount ? getHistory(HistoryCount - 1).TimeMks : 0);
+}
 
 
 Vector3f SensorFusion::GetCalibratedMagValue(const Vector3f& rawMag) const
@@ -30,10 +30,42 @@ limitations under the License.
 
 #include "OVR_Device.h"
 #include "OVR_SensorFilter.h"
+#include "OVR_OrientationPredictor.h"
 #include <time.h>
 
 namespace OVR {
 
+//-------------------------------------------------------------------------------------
+// ***** SensorFusionConfig
+
+// Gains and thresholds of SensorFusion. The defaults are the tuned values; they are
+// gathered here so that tuning tools can run many differently configured instances.
+struct SensorFusionConfig
+{
+    // Gravity (tilt) correction
+    float       AccelGain;              // The proportional gain is 5 times this
+    float       TiltIntegralGain;
+    float       TiltSpikeThreshold;     // Radians above the mean tilt error to skip correction
+    float       GravityThreshold;       // Relative deviation from 1 g to skip the integral term
+
+    // Magnetometer yaw correction
+    float       YawProportionalGain;
+    float       YawIntegralGain;
+    float       MaxMagRefDist;          // Gauss, distance to reuse a reference point
+    float       MaxMagTiltError;        // Tilt error beyond which a reference loses score
+    float       YawCorrectionDelay;     // Seconds after a reset before yaw correction starts
+
+    // Prediction
+    float       PredictionDT;           // Default lookahead of GetPredictedOrientation
+
+    SensorFusionConfig()
+      : AccelGain(0.05f), TiltIntegralGain(0.0125f), TiltSpikeThreshold(0.01f), GravityThreshold(0.1f),
+        YawProportionalGain(0.01f), YawIntegralGain(0.0005f), MaxMagRefDist(0.1f), MaxMagTiltError(0.05f),
+        YawCorrectionDelay(2.0f), PredictionDT(0.03f)
+    { }
+};
+
+
 //-------------------------------------------------------------------------------------
 // ***** SensorFusion
 
@@ -54,7 +86,8 @@ class SensorFusion : public NewOverrideBase
 {
     enum
     {
-        MagMaxReferences = 1000
+        MagMaxReferences = 1000,
+        HistorySize      = 1024     // Power of 2; a second of samples at 1000 Hz
     };        
 
 public:
@@ -76,23 +109,49 @@ public:
 
     // *** State Query
 
+    // State published after every sample. The getters below read it without taking the
+    // handler lock, so the render thread never waits on the sensor thread.
+    struct Snapshot
+    {
+        Quatf       Orientation;
+        Vector3f    Acceleration;
+        Vector3f    AngularVelocity;
+        Vector3f    RawMag;
+        Vector3f    CalMag;
+        PredictionState Prediction; // Motion estimate of the predictor, see SetPredictor
+        UInt64      TimeMks;        // Host time of the sample, see MessageBodyFrame
+
+        Snapshot() : TimeMks(0) { }
+    };
+
+    // Copies the latest state. Lock free; a reader only has to retry if the sensor
+    // thread published twice while it was copying.
+    void        GetSnapshot(Snapshot* snapshot) const;
+
     // Obtain the current accumulated orientation. Many apps will want to use GetPredictedOrientation
     // instead to reduce latency.
-    Quatf       GetOrientation() const      { return lockedGet(&Q); }
+    Quatf       GetOrientation() const      { Snapshot s; GetSnapshot(&s); return s.Orientation; }
 
     // Get predicted orientaion in the near future; predictDt is lookahead amount in seconds.
     Quatf       GetPredictedOrientation(float predictDt);
-    Quatf       GetPredictedOrientation()   { return GetPredictedOrientation(PredictionDT); }
+    Quatf       GetPredictedOrientation()   { return GetPredictedOrientation(Config.PredictionDT); }
+
+    // Orientation at a host time (Timer::GetTicks, in microseconds), interpolated from the
+    // orientation history, e.g. the head pose when a video frame was captured. Times
+    // before the history are given its oldest orientation, and later ones the current.
+    // The history starts over when host time goes back, as when the sensor's time
+    // filter restarts its mapping.
+    Quatf       GetOrientationAt(UInt64 timeMks) const;
 
     // Obtain the last absolute acceleration reading, in m/s^2.
-    Vector3f    GetAcceleration() const     { return lockedGet(&A); }
+    Vector3f    GetAcceleration() const     { Snapshot s; GetSnapshot(&s); return s.Acceleration; }
     // Obtain the last angular velocity reading, in rad/s.
-    Vector3f    GetAngularVelocity() const  { return lockedGet(&AngV); }
+    Vector3f    GetAngularVelocity() const  { Snapshot s; GetSnapshot(&s); return s.AngularVelocity; }
 
     // Obtain the last raw magnetometer reading, in Gauss
-    Vector3f    GetMagnetometer() const     { return lockedGet(&RawMag); }   
+    Vector3f    GetMagnetometer() const     { Snapshot s; GetSnapshot(&s); return s.RawMag; }   
     // Obtain the calibrated magnetometer reading (direction and field strength)
-    Vector3f    GetCalibratedMagnetometer() const  { OVR_ASSERT(MagCalibrated); return lockedGet(&CalMag); }
+    Vector3f    GetCalibratedMagnetometer() const  { OVR_ASSERT(MagCalibrated); Snapshot s; GetSnapshot(&s); return s.CalMag; }
 
 
     // Resets the current orientation.
@@ -102,6 +161,11 @@ public:
 
     // *** Configuration
 
+    // Gains and thresholds; see SensorFusionConfig. Should be set while no messages
+    // are being handled, e.g. before attaching to a sensor.
+    const SensorFusionConfig& GetConfig() const         { return Config; }
+    void        SetConfig(const SensorFusionConfig& config) { Config = config; }
+
     void        EnableMotionTracking(bool enable = true)    { MotionTrackingEnabled = enable; }
     bool        IsMotionTrackingEnabled() const             { return MotionTrackingEnabled;   }
 
@@ -113,11 +177,18 @@ public:
     // Prediction delta specifes how much prediction should be applied in seconds; it should in
     // general be under the average rendering latency. Call GetPredictedOrientation() to get
     // predicted orientation.
-    float       GetPredictionDelta() const                  { return PredictionDT; }
-    void        SetPrediction(float dt, bool enable = true) { PredictionDT = dt; EnablePrediction = enable; }
+    float       GetPredictionDelta() const                  { return Config.PredictionDT; }
+    void        SetPrediction(float dt, bool enable = true) { Config.PredictionDT = dt; EnablePrediction = enable; }
     void		SetPredictionEnabled(bool enable = true)    { EnablePrediction = enable; }    
     bool		IsPredictionEnabled()                       { return EnablePrediction; }
 
+    // Selects the motion model GetPredictedOrientation extrapolates with; null restores
+    // the default ConstantVelocityPredictor. The predictor is reset and updated on the
+    // sensor thread from then on. SensorFusion keeps a reference to it, so one on the
+    // stack or in another object must outlive this SensorFusion or be replaced first.
+    void        SetPredictor(OrientationPredictor* predictor);
+    const OrientationPredictor* GetPredictor() const        { return pPredictor; }
+
 
     // *** Accelerometer/Gravity Correction Control
 
@@ -126,8 +197,8 @@ public:
     bool        IsGravityEnabled() const                    { return EnableGravity;}
 
     // Gain used to correct gyro with accel. Default value is appropriate for typical use.
-    float       GetAccelGain() const                        { return Gain; }
-    void        SetAccelGain(float ag)                      { Gain = ag; }
+    float       GetAccelGain() const                        { return Config.AccelGain; }
+    void        SetAccelGain(float ag)                      { Config.AccelGain = ag; }
 
 
     // *** Magnetometer and Yaw Drift Correction Control
@@ -164,7 +235,8 @@ public:
     void        ClearMagCalibration()            { MagCalibrated = false; }
 
 	// These refer to reference points that associate mag readings with orientations
-	void        ClearMagReferences()             { MagNumReferences = 0; }
+	void        ClearMagReferences()             { MagNumReferences = 0; MagRefIdx = -1; MagRefGrid.Clear(); }
+    int         GetMagReferenceCount() const     { return MagNumReferences; }
 
 
     Vector3f    GetCalibratedMagValue(const Vector3f& rawMag) const;
@@ -190,17 +262,24 @@ private:
 
     SensorFusion* getThis()  { return this; }
 
-    // Helper used to read and return value within a Lock.
-    template<class C>
-    C lockedGet(const C* p) const
+    // Orientation after each sample, stamped with the sample's host time.
+    struct HistoryEntry
     {
-        Lock::Locker lockScope(Handler.GetHandlerLock());
-        return *p;
-    }
+        UInt64  TimeMks;
+        Quatf   Orientation;
+    };
+
+    // i-th entry of the history, 0 being the oldest.
+    const HistoryEntry& getHistory(int i) const
+    { return History[(HistoryNext - HistoryCount + i) & (HistorySize - 1)]; }
 
     // Internal handler for messages; bypasses error checking.
     void        handleMessage(const MessageBodyFrame& msg);
 
+    // Publishes the current state for GetSnapshot. Only one thread may publish at a
+    // time: the one passing messages, or any thread holding the handler lock.
+    void        publishSnapshot(UInt64 timeMks);
+
     // Set the magnetometer's reference orientation for use in yaw correction
     // The supplied mag is an uncalibrated value
     void        setMagReference(const Quatf& q, const Vector3f& rawMag);
@@ -231,18 +310,19 @@ private:
 	float             DeltaT;
     BodyFrameHandler  Handler;
     MessageHandler*   pDelegate;
-    float             Gain;
+    SensorFusionConfig Config;
     volatile bool     EnableGravity;
 
     bool              EnablePrediction;
-    float             PredictionDT;
 	float             PredictionTimeIncrement;
+    ConstantVelocityPredictor DefaultPredictor;
+    Ptr<OrientationPredictor> pPredictor;
+    PredictionState   Prediction;
 
-    SensorFilter      FRawMag;
-    SensorFilter      FAngV;
+    SensorFilterBase<Vector3f, 10> FRawMag;
 
     Vector3f          GyroOffset;
-    SensorFilterBase<float> TiltAngleFilter;
+    SensorFilterBase<float, 1000> TiltAngleFilter;
 
 
     bool              EnableYawCorrection;
@@ -255,7 +335,53 @@ private:
     int               MagRefIdx;
     int               MagRefScore;
 
+    // Spatial hash over MagRefsInBodyFrame, so finding the reference nearest to the
+    // current reading checks the 27 cells around it instead of every reference.
+    // Cells are MaxMagRefDist wide, so any reference within that distance is found.
+    class ReferenceGrid
+    {
+    public:
+        enum { BucketCount = 1024 };    // Power of 2
+
+        ReferenceGrid() : CellSize(0) { Clear(); }
+
+        void    Clear();
+        float   GetCellSize() const { return CellSize; }
+        // Drops all references and rebuilds the grid with the given cell size.
+        void    Rebuild(float cellSize, const Vector3f* points, int count);
+
+        void    Insert(int idx, const Vector3f& p);
+        void    Remove(int idx);
+        // Nearest of points closer than maxDist to p, the lowest index on ties,
+        // or -1. maxDist must not exceed the cell size.
+        int     FindNearest(const Vector3f* points, const Vector3f& p, float maxDist) const;
+
+    private:
+        int     cellCoord(float v) const;
+        int     bucketOf(int cx, int cy, int cz) const;
+
+        float   CellSize;
+        SInt16  Heads[BucketCount];
+        SInt16  Next[MagMaxReferences];
+        SInt16  Buckets[MagMaxReferences];
+    };
+    ReferenceGrid     MagRefGrid;
+
     bool              MotionTrackingEnabled;
+
+    HistoryEntry      History[HistorySize];
+    int               HistoryNext;
+    int               HistoryCount;
+
+    // Published state, double buffered. Each slot's version is odd while it's
+    // being written; readers check it didn't change while they copied.
+    struct SnapshotSlot
+    {
+        mutable AtomicInt<UInt32> Version;
+        Snapshot                  Data;
+    };
+    SnapshotSlot      Snapshots[2];
+    AtomicInt<int>    SnapshotIdx;
 };
 
 
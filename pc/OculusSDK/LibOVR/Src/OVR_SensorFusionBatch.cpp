@@ -0,0 +1,467 @@
+/************************************************************************************
+
+Filename    :   OVR_SensorFusionBatch.cpp
+Content     :   Gravity-corrected gyro integration for many fusion configurations at once
+Created     :   October 17, 2026
+
+Copyright   :   Copyright 2013 Oculus VR, Inc. All Rights reserved.
+
+Licensed under the Oculus VR SDK License Version 2.0 (the "License");
+you may not use the Oculus VR SDK except in compliance with the License,
+which is provided at the time of installation or download, or which
+otherwise accompanies this software in either electronic or hard copy form.
+
+You may obtain a copy of the License at
+
+http://www.oculusvr.com/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, the Oculus VR SDK
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*************************************************************************************/
+
+#include "OVR_SensorFusionBatch.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(OVR_CPU_X86) || defined(OVR_CPU_X86_64)
+#include <emmintrin.h>
+#endif
+
+namespace OVR {
+
+//-------------------------------------------------------------------------------------
+// Lane types. Each provides the same set of operations on a register of Width floats;
+// comparisons return a mask usable with Select.
+
+#if defined(__AVX__)
+
+struct LanesAVX
+{
+    typedef __m256 V;
+    enum { Width = 8 };
+    static const char* Name()                       { return "AVX"; }
+
+    static V    Set1(float f)                       { return _mm256_set1_ps(f); }
+    static V    Load(const float* p)                { return _mm256_load_ps(p); }
+    static void Store(float* p, V v)                { _mm256_store_ps(p, v); }
+    static V    Add(V a, V b)                       { return _mm256_add_ps(a, b); }
+    static V    Sub(V a, V b)                       { return _mm256_sub_ps(a, b); }
+    static V    Mul(V a, V b)                       { return _mm256_mul_ps(a, b); }
+    static V    Div(V a, V b)                       { return _mm256_div_ps(a, b); }
+    static V    Sqrt(V a)                           { return _mm256_sqrt_ps(a); }
+    static V    Min(V a, V b)                       { return _mm256_min_ps(a, b); }
+    static V    Max(V a, V b)                       { return _mm256_max_ps(a, b); }
+    static V    Abs(V a)                            { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static V    Greater(V a, V b)                   { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static V    Select(V mask, V a, V b)            { return _mm256_blendv_ps(b, a, mask); }
+    static V    RsqrtEstimate(V a)                  { return _mm256_rsqrt_ps(a); }
+};
+typedef LanesAVX KernelLanes;
+
+#elif defined(OVR_CPU_X86) || defined(OVR_CPU_X86_64)
+
+struct LanesSSE
+{
+    typedef __m128 V;
+    enum { Width = 4 };
+    static const char* Name()                       { return "SSE2"; }
+
+    static V    Set1(float f)                       { return _mm_set1_ps(f); }
+    static V    Load(const float* p)                { return _mm_load_ps(p); }
+    static void Store(float* p, V v)                { _mm_store_ps(p, v); }
+    static V    Add(V a, V b)                       { return _mm_add_ps(a, b); }
+    static V    Sub(V a, V b)                       { return _mm_sub_ps(a, b); }
+    static V    Mul(V a, V b)                       { return _mm_mul_ps(a, b); }
+    static V    Div(V a, V b)                       { return _mm_div_ps(a, b); }
+    static V    Sqrt(V a)                           { return _mm_sqrt_ps(a); }
+    static V    Min(V a, V b)                       { return _mm_min_ps(a, b); }
+    static V    Max(V a, V b)                       { return _mm_max_ps(a, b); }
+    static V    Abs(V a)                            { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+    static V    Greater(V a, V b)                   { return _mm_cmpgt_ps(a, b); }
+    static V    Select(V mask, V a, V b)            { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+    static V    RsqrtEstimate(V a)                  { return _mm_rsqrt_ps(a); }
+};
+typedef LanesSSE KernelLanes;
+
+#else
+
+struct LanesScalar
+{
+    typedef float V;
+    enum { Width = 1 };
+    static const char* Name()                       { return "Scalar"; }
+
+    static V    Set1(float f)                       { return f; }
+    static V    Load(const float* p)                { return *p; }
+    static void Store(float* p, V v)                { *p = v; }
+    static V    Add(V a, V b)                       { return a + b; }
+    static V    Sub(V a, V b)                       { return a - b; }
+    static V    Mul(V a, V b)                       { return a * b; }
+    static V    Div(V a, V b)                       { return a / b; }
+    static V    Sqrt(V a)                           { return sqrtf(a); }
+    static V    Min(V a, V b)                       { return (a < b) ? a : b; }
+    static V    Max(V a, V b)                       { return (a > b) ? a : b; }
+    static V    Abs(V a)                            { return fabsf(a); }
+    static V    Greater(V a, V b)                   { return (a > b) ? 1.0f : 0.0f; }
+    static V    Select(V mask, V a, V b)            { return (mask != 0) ? a : b; }
+    static V    RsqrtEstimate(V a)                  { return 1.0f / sqrtf(a); }
+};
+typedef LanesScalar KernelLanes;
+
+#endif
+
+
+//-------------------------------------------------------------------------------------
+// Approximations shared by all lane types.
+
+template<class L>
+struct LaneMath
+{
+    typedef typename L::V V;
+
+    static V MulAdd(V a, V b, V c)  { return L::Add(L::Mul(a, b), c); }
+
+    // total += x with Kahan summation, as SensorFilterBase::addToTotal.
+    static void KahanAdd(V& total, V& compensation, V x)
+    {
+        V y = L::Sub(x, compensation);
+        V t = L::Add(total, y);
+        compensation = L::Sub(L::Sub(t, total), y);
+        total = t;
+    }
+
+    // 1/sqrt(a): hardware estimate (12 bits) and one Newton step, relative error < 5e-7.
+    static V Rsqrt(V a)
+    {
+        V y = L::RsqrtEstimate(a);
+        V ayy = L::Mul(L::Mul(a, y), y);
+        return L::Mul(L::Mul(L::Set1(0.5f), y), L::Sub(L::Set1(3.0f), ayy));
+    }
+
+    // cos(h) and sin(h)/h from u = h^2, Taylor series through h^16.
+    // Truncation error is below 1.5e-7 for |h| <= pi, i.e. up to a full turn per sample.
+    static V CosFromSq(V u)
+    {
+        V p = L::Set1(1.0f / 20922789888000.0f);
+        p = MulAdd(p, u, L::Set1(-1.0f / 87178291200.0f));
+        p = MulAdd(p, u, L::Set1( 1.0f / 479001600.0f));
+        p = MulAdd(p, u, L::Set1(-1.0f / 3628800.0f));
+        p = MulAdd(p, u, L::Set1( 1.0f / 40320.0f));
+        p = MulAdd(p, u, L::Set1(-1.0f / 720.0f));
+        p = MulAdd(p, u, L::Set1( 1.0f / 24.0f));
+        p = MulAdd(p, u, L::Set1(-1.0f / 2.0f));
+        return MulAdd(p, u, L::Set1(1.0f));
+    }
+    static V SincFromSq(V u)
+    {
+        V p = L::Set1(1.0f / 355687428096000.0f);
+        p = MulAdd(p, u, L::Set1(-1.0f / 1307674368000.0f));
+        p = MulAdd(p, u, L::Set1( 1.0f / 6227020800.0f));
+        p = MulAdd(p, u, L::Set1(-1.0f / 39916800.0f));
+        p = MulAdd(p, u, L::Set1( 1.0f / 362880.0f));
+        p = MulAdd(p, u, L::Set1(-1.0f / 5040.0f));
+        p = MulAdd(p, u, L::Set1( 1.0f / 120.0f));
+        p = MulAdd(p, u, L::Set1(-1.0f / 6.0f));
+        return MulAdd(p, u, L::Set1(1.0f));
+    }
+
+    // acos(x) for x in [-1, 1] (clamped), Abramowitz & Stegun 4.4.46, error < 2e-8 rad.
+    static V Acos(V x)
+    {
+        x = L::Min(L::Max(x, L::Set1(-1.0f)), L::Set1(1.0f));
+        V a = L::Abs(x);
+        V p = L::Set1(-0.0012624911f);
+        p = MulAdd(p, a, L::Set1( 0.0066700901f));
+        p = MulAdd(p, a, L::Set1(-0.0170881256f));
+        p = MulAdd(p, a, L::Set1( 0.0308918810f));
+        p = MulAdd(p, a, L::Set1(-0.0501743046f));
+        p = MulAdd(p, a, L::Set1( 0.0889789874f));
+        p = MulAdd(p, a, L::Set1(-0.2145988016f));
+        p = MulAdd(p, a, L::Set1( 1.5707963050f));
+        V r = L::Mul(L::Sqrt(L::Sub(L::Set1(1.0f), a)), p);
+        return L::Select(L::Greater(L::Set1(0.0f), x), L::Sub(L::Set1(Mathf::Pi), r), r);
+    }
+};
+
+
+//-------------------------------------------------------------------------------------
+// Per-sample values that are the same for every lane, precomputed once per block.
+
+struct BatchSampleBlock : public NewOverrideBase
+{
+    enum { Size = 256 };
+
+    float MeasuredX[Size], MeasuredY[Size], MeasuredZ[Size];   // normalized accel
+    float AccelDeviation[Size];                                // |accel| / g - 1, abs
+    float GyroX[Size], GyroY[Size], GyroZ[Size];
+    float DeltaT[Size];
+    float InvDeltaT[Size];
+
+    void Fill(const Vector3f* accel, const Vector3f* gyro, const float* deltaT, int count)
+    {
+        const float gravity = 9.8f;
+        for (int i = 0; i < count; i++)
+        {
+            Vector3f measured = accel[i];
+            measured.Normalize();
+            MeasuredX[i]      = measured.x;
+            MeasuredY[i]      = measured.y;
+            MeasuredZ[i]      = measured.z;
+            AccelDeviation[i] = fabs(accel[i].Length() / gravity - 1);
+            GyroX[i]          = gyro[i].x;
+            GyroY[i]          = gyro[i].y;
+            GyroZ[i]          = gyro[i].z;
+            DeltaT[i]         = deltaT[i];
+            InvDeltaT[i]      = 1 / deltaT[i];
+        }
+    }
+};
+
+// Mirrors SensorFusion::handleMessage with EnableGravity set and EnableYawCorrection
+// clear, for Width lanes starting at lane. Stage and the tilt filter position advance
+// identically in every lane, so the branches on them are taken for the whole register.
+template<class L>
+static void processLanes(float* state, float* tiltAngles, int stride, int lane,
+                         const BatchSampleBlock& block, int count,
+                         unsigned stage, int tiltLastIdx, int tiltCount)
+{
+    typedef typename L::V V;
+    typedef LaneMath<L> M;
+    const int capacity = SensorFusionBatch::TiltFilterCapacity;
+
+    float* s = state + lane;
+    V qx = L::Load(s + SensorFusionBatch::State_Qx * stride);
+    V qy = L::Load(s + SensorFusionBatch::State_Qy * stride);
+    V qz = L::Load(s + SensorFusionBatch::State_Qz * stride);
+    V qw = L::Load(s + SensorFusionBatch::State_Qw * stride);
+    V ox = L::Load(s + SensorFusionBatch::State_OffsetX * stride);
+    V oy = L::Load(s + SensorFusionBatch::State_OffsetY * stride);
+    V oz = L::Load(s + SensorFusionBatch::State_OffsetZ * stride);
+    V tiltTotal = L::Load(s + SensorFusionBatch::State_TiltTotal * stride);
+    V tiltCompensation = L::Load(s + SensorFusionBatch::State_TiltCompensation * stride);
+
+    const V gainP    = L::Load(s + SensorFusionBatch::State_ProportionalGain * stride);
+    const V gainI    = L::Load(s + SensorFusionBatch::State_IntegralGain * stride);
+    const V spike    = L::Load(s + SensorFusionBatch::State_SpikeThreshold * stride);
+    const V gravityT = L::Load(s + SensorFusionBatch::State_GravityThreshold * stride);
+    const V zero     = L::Set1(0.0f);
+    const V two      = L::Set1(2.0f);
+    const V half     = L::Set1(0.5f);
+
+    for (int i = 0; i < count; i++)
+    {
+        stage++;
+
+        // up = Q.Inverted().Rotate(0, 1, 0)
+        V upX = L::Mul(two, L::Add(L::Mul(qx, qy), L::Mul(qw, qz)));
+        V upY = L::Sub(L::Add(L::Mul(qw, qw), L::Mul(qy, qy)), L::Add(L::Mul(qx, qx), L::Mul(qz, qz)));
+        V upZ = L::Mul(two, L::Sub(L::Mul(qy, qz), L::Mul(qw, qx)));
+
+        // SensorFusion_ComputeCorrection(accel, up)
+        V mx = L::Set1(block.MeasuredX[i]);
+        V my = L::Set1(block.MeasuredY[i]);
+        V mz = L::Set1(block.MeasuredZ[i]);
+        V upInvLen = M::Rsqrt(M::MulAdd(upX, upX, M::MulAdd(upY, upY, L::Mul(upZ, upZ))));
+        V ex = L::Mul(upX, upInvLen);
+        V ey = L::Mul(upY, upInvLen);
+        V ez = L::Mul(upZ, upInvLen);
+        V cosError = M::MulAdd(mx, ex, M::MulAdd(my, ey, L::Mul(mz, ez)));
+        V scale = M::Rsqrt(L::Mul(half, L::Add(cosError, L::Set1(1 + Mathf::Tolerance))));
+        V cx = L::Mul(L::Sub(L::Mul(my, ez), L::Mul(mz, ey)), scale);
+        V cy = L::Mul(L::Sub(L::Mul(mz, ex), L::Mul(mx, ez)), scale);
+        V cz = L::Mul(L::Sub(L::Mul(mx, ey), L::Mul(my, ex)), scale);
+
+        V proportionalGain, integralGain;
+        if (stage > 5)
+        {
+            // Spike detection, with the compensated running total of SensorFilterBase.
+            V tiltAngle = M::Acos(cosError);
+            int nextIdx = (tiltLastIdx + 1) % capacity;
+            float* slot = tiltAngles + nextIdx * stride + lane;
+            if (tiltCount == capacity)
+                M::KahanAdd(tiltTotal, tiltCompensation, L::Sub(zero, L::Load(slot)));
+            M::KahanAdd(tiltTotal, tiltCompensation, tiltAngle);
+            L::Store(slot, tiltAngle);
+            tiltLastIdx = nextIdx;
+            if (tiltCount < capacity)
+                tiltCount++;
+            V mean = L::Div(tiltTotal, L::Set1((float)tiltCount));
+            V spiked = L::Greater(tiltAngle, L::Add(mean, spike));
+            proportionalGain = L::Select(spiked, zero, gainP);
+            integralGain     = L::Select(spiked, zero, gainI);
+
+            // Acceleration detection
+            V accelerating = L::Greater(L::Set1(block.AccelDeviation[i]), gravityT);
+            integralGain = L::Select(accelerating, zero, integralGain);
+        }
+        else
+        {
+            proportionalGain = L::Set1(block.InvDeltaT[i]);
+            integralGain     = zero;
+        }
+
+        V dt = L::Set1(block.DeltaT[i]);
+        V gx = M::MulAdd(cx, proportionalGain, L::Sub(L::Set1(block.GyroX[i]), ox));
+        V gy = M::MulAdd(cy, proportionalGain, L::Sub(L::Set1(block.GyroY[i]), oy));
+        V gz = M::MulAdd(cz, proportionalGain, L::Sub(L::Set1(block.GyroZ[i]), oz));
+        V offsetStep = L::Mul(integralGain, dt);
+        ox = L::Sub(ox, L::Mul(cx, offsetStep));
+        oy = L::Sub(oy, L::Mul(cy, offsetStep));
+        oz = L::Sub(oz, L::Mul(cz, offsetStep));
+
+        // Q = Q * Quatf(g, |g| dt); with h = |g| dt / 2 the delta is (g sin(h)/|g|, cos(h)).
+        V halfDt = L::Mul(half, dt);
+        V h2 = L::Mul(M::MulAdd(gx, gx, M::MulAdd(gy, gy, L::Mul(gz, gz))), L::Mul(halfDt, halfDt));
+        V dw = M::CosFromSq(h2);
+        V sinScale = L::Mul(M::SincFromSq(h2), halfDt);
+        V dx = L::Mul(gx, sinScale);
+        V dy = L::Mul(gy, sinScale);
+        V dz = L::Mul(gz, sinScale);
+
+        V nx = L::Add(L::Add(L::Mul(qw, dx), L::Mul(qx, dw)), L::Sub(L::Mul(qy, dz), L::Mul(qz, dy)));
+        V ny = L::Add(L::Sub(L::Mul(qw, dy), L::Mul(qx, dz)), L::Add(L::Mul(qy, dw), L::Mul(qz, dx)));
+        V nz = L::Add(L::Add(L::Mul(qw, dz), L::Mul(qx, dy)), L::Sub(L::Mul(qz, dw), L::Mul(qy, dx)));
+        V nw = L::Sub(L::Mul(qw, dw), L::Add(L::Mul(qx, dx), L::Add(L::Mul(qy, dy), L::Mul(qz, dz))));
+        qx = nx; qy = ny; qz = nz; qw = nw;
+
+        if (stage % 500 == 0)
+        {
+            V len = L::Sqrt(M::MulAdd(qx, qx, M::MulAdd(qy, qy, M::MulAdd(qz, qz, L::Mul(qw, qw)))));
+            qx = L::Div(qx, len);
+            qy = L::Div(qy, len);
+            qz = L::Div(qz, len);
+            qw = L::Div(qw, len);
+        }
+    }
+
+    L::Store(s + SensorFusionBatch::State_Qx * stride, qx);
+    L::Store(s + SensorFusionBatch::State_Qy * stride, qy);
+    L::Store(s + SensorFusionBatch::State_Qz * stride, qz);
+    L::Store(s + SensorFusionBatch::State_Qw * stride, qw);
+    L::Store(s + SensorFusionBatch::State_OffsetX * stride, ox);
+    L::Store(s + SensorFusionBatch::State_OffsetY * stride, oy);
+    L::Store(s + SensorFusionBatch::State_OffsetZ * stride, oz);
+    L::Store(s + SensorFusionBatch::State_TiltTotal * stride, tiltTotal);
+    L::Store(s + SensorFusionBatch::State_TiltCompensation * stride, tiltCompensation);
+}
+
+
+//-------------------------------------------------------------------------------------
+// ***** SensorFusionBatch
+
+SensorFusionBatch::SensorFusionBatch()
+    : LaneCount(0), Stride(0), State(0), TiltAngles(0),
+      TiltLastIdx(-1), TiltCount(0), Stage(0)
+{
+    Block = new BatchSampleBlock;
+}
+
+SensorFusionBatch::~SensorFusionBatch()
+{
+    release();
+    delete Block;
+}
+
+void SensorFusionBatch::release()
+{
+    if (State)
+        OVR_FREE_ALIGNED(State);
+    if (TiltAngles)
+        OVR_FREE_ALIGNED(TiltAngles);
+    State      = 0;
+    TiltAngles = 0;
+    LaneCount  = 0;
+    Stride     = 0;
+}
+
+void SensorFusionBatch::Reset(const SensorFusionConfig* configs, int count)
+{
+    const int width = KernelLanes::Width;
+    int stride = ((count + width - 1) / width) * width;
+
+    if (stride != Stride)
+    {
+        release();
+        if (stride > 0)
+        {
+            State      = (float*)OVR_ALLOC_ALIGNED(State_Count * stride * sizeof(float), 32);
+            TiltAngles = (float*)OVR_ALLOC_ALIGNED(TiltFilterCapacity * stride * sizeof(float), 32);
+        }
+        Stride = stride;
+    }
+    LaneCount   = count;
+    TiltLastIdx = -1;
+    TiltCount   = 0;
+    Stage       = 0;
+
+    // Padding lanes run the default configuration and are never read.
+    SensorFusionConfig defaults;
+    for (int lane = 0; lane < Stride; lane++)
+    {
+        const SensorFusionConfig& c = (lane < count) ? configs[lane] : defaults;
+        State[State_Qx * Stride + lane]               = 0;
+        State[State_Qy * Stride + lane]               = 0;
+        State[State_Qz * Stride + lane]               = 0;
+        State[State_Qw * Stride + lane]               = 1;
+        State[State_OffsetX * Stride + lane]          = 0;
+        State[State_OffsetY * Stride + lane]          = 0;
+        State[State_OffsetZ * Stride + lane]          = 0;
+        State[State_ProportionalGain * Stride + lane] = 5 * c.AccelGain;
+        State[State_IntegralGain * Stride + lane]     = c.TiltIntegralGain;
+        State[State_SpikeThreshold * Stride + lane]   = c.TiltSpikeThreshold;
+        State[State_GravityThreshold * Stride + lane] = c.GravityThreshold;
+        State[State_TiltTotal * Stride + lane]        = 0;
+        State[State_TiltCompensation * Stride + lane] = 0;
+    }
+    for (int i = 0; i < TiltFilterCapacity * Stride; i++)
+        TiltAngles[i] = 0;
+}
+
+void SensorFusionBatch::ProcessSamples(const Vector3f* accel, const Vector3f* gyro,
+                                       const float* deltaT, int count)
+{
+    if (LaneCount == 0)
+        return;
+
+    for (int start = 0; start < count; start += BatchSampleBlock::Size)
+    {
+        int n = Alg::Min(count - start, (int)BatchSampleBlock::Size);
+        Block->Fill(accel + start, gyro + start, deltaT + start, n);
+
+        for (int lane = 0; lane < Stride; lane += KernelLanes::Width)
+            processLanes<KernelLanes>(State, TiltAngles, Stride, lane, *Block, n,
+                                      Stage, TiltLastIdx, TiltCount);
+
+        // Every lane advanced the shared counters the same way.
+        Stage += n;
+        if (Stage > 5)
+        {
+            int filtered = Alg::Min((int)(Stage - 5), n);
+            TiltLastIdx  = (TiltLastIdx + filtered) % TiltFilterCapacity;
+            TiltCount    = Alg::Min(TiltCount + filtered, (int)TiltFilterCapacity);
+        }
+    }
+}
+
+Quatf SensorFusionBatch::GetOrientation(int lane) const
+{
+    OVR_ASSERT(lane >= 0 && lane < LaneCount);
+    return Quatf(State[State_Qx * Stride + lane], State[State_Qy * Stride + lane],
+                 State[State_Qz * Stride + lane], State[State_Qw * Stride + lane]);
+}
+
+const char* SensorFusionBatch::GetKernelName()
+{
+    return KernelLanes::Name();
+}
+
+int SensorFusionBatch::GetKernelWidth()
+{
+    return KernelLanes::Width;
+}
+
+} // namespace OVR
@@ -0,0 +1,107 @@
+/************************************************************************************
+
+PublicHeader:   OVR.h
+Filename    :   OVR_SensorFusionBatch.h
+Content     :   Gravity-corrected gyro integration for many fusion configurations at once
+Created     :   October 17, 2026
+
+Copyright   :   Copyright 2013 Oculus VR, Inc. All Rights reserved.
+
+Licensed under the Oculus VR SDK License Version 2.0 (the "License");
+you may not use the Oculus VR SDK except in compliance with the License,
+which is provided at the time of installation or download, or which
+otherwise accompanies this software in either electronic or hard copy form.
+
+You may obtain a copy of the License at
+
+http://www.oculusvr.com/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, the Oculus VR SDK
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*************************************************************************************/
+
+#ifndef OVR_SensorFusionBatch_h
+#define OVR_SensorFusionBatch_h
+
+#include "OVR_SensorFusion.h"
+
+namespace OVR {
+
+struct BatchSampleBlock;
+
+//-------------------------------------------------------------------------------------
+// ***** SensorFusionBatch
+//
+// Runs the gyro integration and tilt correction of SensorFusion for a number of
+// configurations ("lanes") over the same block of samples. The state of all lanes is
+// kept as structure-of-arrays, so one SSE (or AVX, when LibOVR is built with it) register
+// holds the same quantity for 4 (8) lanes. Samples within a lane have to be processed in
+// order, which is why the lanes are configurations rather than consecutive samples.
+//
+// Only the gravity path is modelled; yaw correction and the mag, prediction and history
+// state of SensorFusion are not. The lanes match a SensorFusion with
+// SetYawCorrectionEnabled(false) fed the same samples, to within a tolerance: sin, cos,
+// acos and 1/sqrt are replaced by polynomial and Newton-refined approximations with
+// relative errors below 5e-7, so after a long run each lane typically differs from the
+// scalar path by well under 0.01 degrees, and by at most about 0.05 degrees when a
+// spike test lands the other way on a sample that sits right on its threshold.
+//
+class SensorFusionBatch : public NewOverrideBase
+{
+public:
+    SensorFusionBatch();
+    ~SensorFusionBatch();
+
+    // Starts over with one lane per configuration; all lanes have identity orientation.
+    void        Reset(const SensorFusionConfig* configs, int count);
+
+    int         GetLaneCount() const                { return LaneCount; }
+
+    // Feeds count samples, in order, to every lane. Arguments are the Acceleration,
+    // RotationRate and TimeDelta of MessageBodyFrame.
+    void        ProcessSamples(const Vector3f* accel, const Vector3f* gyro,
+                               const float* deltaT, int count);
+
+    Quatf       GetOrientation(int lane) const;
+
+    // Instruction set and width of the kernel this build uses, e.g. "SSE2", 4.
+    static const char* GetKernelName();
+    static int         GetKernelWidth();
+
+    enum { TiltFilterCapacity = 1000 };
+
+    // Lane state, one array of Stride floats per quantity.
+    enum
+    {
+        State_Qx, State_Qy, State_Qz, State_Qw,
+        State_OffsetX, State_OffsetY, State_OffsetZ,
+        State_ProportionalGain, State_IntegralGain,
+        State_SpikeThreshold, State_GravityThreshold,
+        State_TiltTotal, State_TiltCompensation,
+        State_Count
+    };
+
+private:
+    // Non-copyable.
+    SensorFusionBatch(const SensorFusionBatch&);
+    SensorFusionBatch& operator=(const SensorFusionBatch&);
+
+    void        release();
+
+    int         LaneCount;
+    int         Stride;         // LaneCount rounded up to the kernel width
+    float*      State;          // State_Count * Stride
+    float*      TiltAngles;     // TiltFilterCapacity * Stride, SensorFusion::TiltAngleFilter
+    int         TiltLastIdx;
+    int         TiltCount;
+    unsigned    Stage;
+    BatchSampleBlock* Block;    // per-sample values shared by the lanes
+};
+
+} // namespace OVR
+
+#endif
@@ -526,6 +526,8 @@ SensorDeviceImpl::SensorDeviceImpl(SensorDeviceCreateDesc* createDesc)
     SequenceValid  = false;
     LastSampleCount= 0;
     LastTimestamp   = 0;
+    FullTimestamp   = 0;
+    DroppedSamples  = 0;
 
     OldCommandId = 0;
 }
@@ -595,7 +597,8 @@ void SensorDeviceImpl::Shutdown()
 {   
     HIDDeviceImpl<OVR::SensorDevice>::Shutdown();
 
-    LogText("OVR::SensorDevice - Closed '%s'\n", getHIDDesc()->Path.ToCStr());
+    LogText("OVR::SensorDevice - Closed '%s', %llu samples dropped\n",
+            getHIDDesc()->Path.ToCStr(), (unsigned long long)DroppedSamples);
 }
 
 
@@ -828,22 +831,45 @@ void SensorDeviceImpl::onTrackerMessage(TrackerMessage* message)
         return;
     
     const float     timeUnit   = (1.0f / 1000.f);
+    const UInt64    timeUnitMks = 1000;
     TrackerSensors& s = message->Sensors;
+    UInt64          receiveTicks = Timer::GetTicks();
     
 
     // Call OnMessage() within a lock to avoid conflicts with handlers.
     Lock::Locker scopeLock(HandlerRef.GetLock());
 
 
+    // Timestamp counts samples (ms) and wraps every 65 seconds; keep a full count so
+    // samples can be mapped to host time.
+    unsigned timestampDelta = 0;
+
     if (SequenceValid)
     {
-        unsigned timestampDelta;
-
         if (s.Timestamp < LastTimestamp)
             timestampDelta = ((((int)s.Timestamp) + 0x10000) - (int)LastTimestamp);
         else
             timestampDelta = (s.Timestamp - LastTimestamp);
 
+        FullTimestamp += timestampDelta;
+    }
+    else
+    {
+        FullTimestamp = s.Timestamp;
+        TimeFilter.Reset();
+    }
+
+    // Timestamp is the time of the first sample in the report; the report is sent
+    // right after the last one.
+    UByte lastSample = (s.SampleCount > 0) ? (s.SampleCount - 1) : 0;
+    TimeFilter.Update((FullTimestamp + lastSample) * timeUnitMks, receiveTicks);
+
+
+    if (SequenceValid)
+    {
+        if (timestampDelta > LastSampleCount)
+            DroppedSamples += timestampDelta - LastSampleCount;
+
         // If we missed a small number of samples, replicate the last sample.
         if ((timestampDelta > LastSampleCount) && (timestampDelta <= 254))
         {
@@ -851,6 +877,7 @@ void SensorDeviceImpl::onTrackerMessage(TrackerMessage* message)
             {
                 MessageBodyFrame sensors(this);
                 sensors.TimeDelta     = (timestampDelta - LastSampleCount) * timeUnit;
+                sensors.AbsoluteTimeMks = TimeFilter.ToHostTicks((FullTimestamp - 1) * timeUnitMks);
                 sensors.Acceleration  = LastAcceleration;
                 sensors.RotationRate  = LastRotationRate;
                 sensors.MagneticField = LastMagneticField;
@@ -889,8 +916,13 @@ void SensorDeviceImpl::onTrackerMessage(TrackerMessage* message)
             sensors.TimeDelta = timeUnit;
         }
 
+        // With more than 3 samples, the first one in the report is an average of the
+        // older ones, so the 3 end at the last sample.
+        UInt64 sampleTimestamp = FullTimestamp + (s.SampleCount - iterations);
+
         for (UByte i = 0; i < iterations; i++)
         {            
+            sensors.AbsoluteTimeMks = TimeFilter.ToHostTicks((sampleTimestamp + i) * timeUnitMks);
             sensors.Acceleration = AccelFromBodyFrameUpdate(s, i, convertHMDToSensor);
             sensors.RotationRate = EulerFromBodyFrameUpdate(s, i, convertHMDToSensor);
             sensors.MagneticField= MagFromBodyFrameUpdate(s, convertHMDToSensor);
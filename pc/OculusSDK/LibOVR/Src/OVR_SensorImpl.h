@@ -28,6 +28,7 @@ limitations under the License.
 #define OVR_SensorImpl_h
 
 #include "OVR_HIDDeviceImpl.h"
+#include "OVR_SensorTimeFilter.h"
 
 namespace OVR {
     
@@ -245,8 +246,11 @@ protected:
     UInt64      NextKeepAliveTicks;
 
     bool        SequenceValid;
-    SInt16      LastTimestamp;
+    UInt16      LastTimestamp;
     UByte       LastSampleCount;
+    UInt64      FullTimestamp;      // Timestamp of the last report without wrapping, in ms.
+    UInt64      DroppedSamples;     // Samples missing between reports, lost before we read them.
+    SensorTimeFilter TimeFilter;    // Maps FullTimestamp to host time.
     float       LastTemperature;
     Vector3f    LastAcceleration;
     Vector3f    LastRotationRate;
@@ -0,0 +1,150 @@
+/************************************************************************************
+
+Filename    :   OVR_SensorTimeFilter.cpp
+Content     :   Mapping of sensor sample times to the host clock
+Created     :   October 17, 2026
+
+Copyright   :   Copyright 2013 Oculus VR, Inc. All Rights reserved.
+
+Licensed under the Oculus VR SDK License Version 2.0 (the "License"); 
+you may not use the Oculus VR SDK except in compliance with the License, 
+which is provided at the time of installation or download, or which 
+otherwise accompanies this software in either electronic or hard copy form.
+
+You may obtain a copy of the License at
+
+http://www.oculusvr.com/licenses/LICENSE-2.0 
+
+Unless required by applicable law or agreed to in writing, the Oculus VR SDK 
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*************************************************************************************/
+
+#include "OVR_SensorTimeFilter.h"
+#include <math.h>
+
+namespace OVR {
+
+void SensorTimeFilter::Reset()
+{
+    Valid           = false;
+    BaseTicks       = 0;
+    Offset          = 0;
+    Drift           = 0;
+    WindowStart     = 0;
+    WindowMinTicks  = 0;
+    WindowMinOffset = 0;
+    MinCount        = 0;
+}
+
+void SensorTimeFilter::Update(UInt64 trackerTicks, UInt64 receiveTicks)
+{
+    double offset = (double)(SInt64)(receiveTicks - trackerTicks);
+
+    // Start over on the first report, and if the clocks jumped (the host slept, or
+    // the tracker was reset without us noticing).
+    if (Valid && fabs(offset - offsetAt(trackerTicks)) > ResetMks)
+        Reset();
+
+    if (!Valid)
+    {
+        Valid           = true;
+        BaseTicks       = trackerTicks;
+        Offset          = offset;
+        WindowStart     = trackerTicks;
+        WindowMinTicks  = trackerTicks;
+        WindowMinOffset = offset;
+        return;
+    }
+
+    if (offset < WindowMinOffset)
+    {
+        WindowMinTicks  = trackerTicks;
+        WindowMinOffset = offset;
+    }
+
+    // A report can't arrive before it was sent, so if one came in earlier than the
+    // mapping says, lower the mapping right away rather than waiting for the window.
+    double predicted = offsetAt(trackerTicks);
+    if (offset < predicted)
+        Offset -= predicted - offset;
+
+    if (trackerTicks - WindowStart >= (UInt64)WindowMks)
+    {
+        if (MinCount == MaxWindows)
+        {
+            for (int i = 1; i < MaxWindows; i++)
+            {
+                MinTicks[i - 1]   = MinTicks[i];
+                MinOffsets[i - 1] = MinOffsets[i];
+            }
+            MinCount--;
+        }
+        MinTicks[MinCount]   = WindowMinTicks;
+        MinOffsets[MinCount] = WindowMinOffset;
+        MinCount++;
+
+        fitWindows();
+
+        WindowStart     = trackerTicks;
+        WindowMinTicks  = trackerTicks;
+        WindowMinOffset = offset;
+    }
+}
+
+void SensorTimeFilter::fitWindows()
+{
+    // Least squares line through the window minimums, relative to the newest one to
+    // keep the sums small.
+    UInt64 base = MinTicks[MinCount - 1];
+    double drift = 0;
+
+    if (MinCount >= 2)
+    {
+        double sumT = 0, sumO = 0, sumTT = 0, sumTO = 0;
+        for (int i = 0; i < MinCount; i++)
+        {
+            double t = (double)(SInt64)(MinTicks[i] - base);
+            sumT  += t;
+            sumO  += MinOffsets[i];
+            sumTT += t * t;
+            sumTO += t * MinOffsets[i];
+        }
+        double denom = MinCount * sumTT - sumT * sumT;
+        if (denom > 0)
+            drift = (MinCount * sumTO - sumT * sumO) / denom;
+
+        // Nothing real drifts by more than 0.1%; a bigger slope is noise in the fit.
+        const double maxDrift = 0.001;
+        if (drift > maxDrift)
+            drift = maxDrift;
+        else if (drift < -maxDrift)
+            drift = -maxDrift;
+    }
+
+    // The line goes through the lowest minimum, so it stays a lower bound.
+    double offset = MinOffsets[MinCount - 1];
+    for (int i = 0; i < MinCount; i++)
+    {
+        double o = MinOffsets[i] - drift * (double)(SInt64)(MinTicks[i] - base);
+        if (o < offset)
+            offset = o;
+    }
+
+    BaseTicks = base;
+    Offset    = offset;
+    Drift     = drift;
+}
+
+UInt64 SensorTimeFilter::ToHostTicks(UInt64 trackerTicks) const
+{
+    if (!Valid)
+        return trackerTicks;
+    return trackerTicks + (SInt64)floor(offsetAt(trackerTicks) + 0.5);
+}
+
+
+} // namespace OVR
@@ -0,0 +1,101 @@
+/************************************************************************************
+
+Filename    :   OVR_SensorTimeFilter.h
+Content     :   Mapping of sensor sample times to the host clock
+Created     :   October 17, 2026
+
+Copyright   :   Copyright 2013 Oculus VR, Inc. All Rights reserved.
+
+Licensed under the Oculus VR SDK License Version 2.0 (the "License"); 
+you may not use the Oculus VR SDK except in compliance with the License, 
+which is provided at the time of installation or download, or which 
+otherwise accompanies this software in either electronic or hard copy form.
+
+You may obtain a copy of the License at
+
+http://www.oculusvr.com/licenses/LICENSE-2.0 
+
+Unless required by applicable law or agreed to in writing, the Oculus VR SDK 
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*************************************************************************************/
+
+#ifndef OVR_SensorTimeFilter_h
+#define OVR_SensorTimeFilter_h
+
+#include "Kernel/OVR_Types.h"
+
+namespace OVR {
+
+//-------------------------------------------------------------------------------------
+// ***** SensorTimeFilter
+
+// SensorTimeFilter maps the tracker's sample clock onto the host clock (Timer::GetTicks),
+// both in microseconds.
+//
+// A report always arrives some time after its newest sample was taken, so the host
+// time of arrival minus the tracker time of that sample is an upper bound on the clock
+// offset; the smallest value seen is the best estimate, as it had the least USB and
+// scheduling delay. The two clocks also drift apart by crystal tolerance (tens of ppm,
+// or several ms per minute), so the minimum is taken over windows of a second and a
+// line is fitted through the last few window minimums to follow the drift.
+
+class SensorTimeFilter
+{
+public:
+    SensorTimeFilter() { Reset(); }
+
+    // Forgets the mapping; used when the tracker time sequence restarts.
+    void    Reset();
+
+    // Adds a report whose newest sample was taken at trackerTicks and which arrived
+    // at receiveTicks on the host.
+    void    Update(UInt64 trackerTicks, UInt64 receiveTicks);
+
+    // Host time of a tracker time. Before the first Update this returns trackerTicks.
+    UInt64  ToHostTicks(UInt64 trackerTicks) const;
+
+    bool    IsValid() const         { return Valid; }
+
+    // Current drift of the tracker clock relative to the host, in parts per million.
+    double  GetDriftPpm() const     { return Drift * 1000000.0; }
+
+private:
+    enum
+    {
+        WindowMks    = 1000000,     // Minimum taken over a second of tracker time
+        MaxWindows   = 8,           // Fit over the last 8 seconds
+        ResetMks     = 500000       // Offset jumps bigger than this restart the mapping
+    };
+
+    // Offset (host - tracker) predicted for trackerTicks by the current fit.
+    double  offsetAt(UInt64 trackerTicks) const
+    { return Offset + Drift * (double)(SInt64)(trackerTicks - BaseTicks); }
+
+    void    fitWindows();
+
+    bool    Valid;
+
+    // Current mapping: host = tracker + Offset + Drift * (tracker - BaseTicks).
+    UInt64  BaseTicks;
+    double  Offset;
+    double  Drift;
+
+    // Window being measured.
+    UInt64  WindowStart;
+    UInt64  WindowMinTicks;
+    double  WindowMinOffset;
+
+    // Minimums of the finished windows, oldest first.
+    UInt64  MinTicks[MaxWindows];
+    double  MinOffsets[MaxWindows];
+    int     MinCount;
+};
+
+
+} // namespace OVR
+
+#endif // OVR_SensorTimeFilter_h
@@ -26,168 +26,95 @@ limitations under the License.
 
 #include "OVR_ThreadCommandQueue.h"
 
-namespace OVR {
-
-
-//------------------------------------------------------------------------
-// ***** CircularBuffer
+#if defined(OVR_OS_LINUX)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <limits.h>
+#endif
 
-// CircularBuffer is a FIFO buffer implemented in a single block of memory,
-// which allows writing and reading variable-size data chucks. Write fails
-// if buffer is full.
-
-class CircularBuffer
-{
-    enum {
-        AlignSize = 16,
-        AlignMask = AlignSize - 1
-    };
-
-    UByte*  pBuffer;
-    UPInt   Size;
-    UPInt   Tail;   // Byte offset of next item to be popped.
-    UPInt   Head;   // Byte offset of where next push will take place.
-    UPInt   End;    // When Head < Tail, this is used instead of Size.    
-
-    inline UPInt roundUpSize(UPInt size)
-    { return (size + AlignMask) & ~(UPInt)AlignMask; }
-
-public:
-
-    CircularBuffer(UPInt size)
-        : Size(size), Tail(0), Head(0), End(0)
-    {
-        pBuffer = (UByte*)OVR_ALLOC_ALIGNED(roundUpSize(size), AlignSize);
-    }
-    ~CircularBuffer()
-    {
-        // For ThreadCommands, we must consume everything before shutdown.
-        OVR_ASSERT(IsEmpty());
-        OVR_FREE_ALIGNED(pBuffer);
-    }
+namespace OVR {
 
-    bool    IsEmpty() const { return (Head == Tail); }
 
-    // Allocates a state block of specified size and advances pointers,
-    // returning 0 if buffer is full.
-    UByte*  Write(UPInt size);
+#if defined(OVR_OS_WIN32)
 
-    // Returns a pointer to next available data block; 0 if none available.
-    UByte*  ReadBegin()
-    { return (Head != Tail) ? (pBuffer + Tail) : 0; }
-    // Consumes data of specified size; this must match size passed to Write.
-    void    ReadEnd(UPInt size);
-};
+// WaitOnAddress is the futex of Windows 8 and later. Load it dynamically so that we
+// still run on Windows 7, where waiting threads park on a condition instead.
+typedef BOOL (WINAPI *Function_WaitOnAddress)(volatile VOID* address, PVOID compareAddress,
+                                              SIZE_T addressSize, DWORD milliseconds);
+typedef VOID (WINAPI *Function_WakeByAddressAll)(PVOID address);
 
+static Function_WaitOnAddress    pWaitOnAddress    = 0;
+static Function_WakeByAddressAll pWakeByAddressAll = 0;
 
-// Allocates a state block of specified size and advances pointers,
-// returning 0 if buffer is full.
-UByte* CircularBuffer::Write(UPInt size)
+static void initWaitOnAddress()
 {
-    UByte* p = 0;
-
-    size = roundUpSize(size);
-    // Since this is circular buffer, always allow at least one item.
-    OVR_ASSERT(size < Size/2);
-
-    if (Head >= Tail)
+    static bool initTried = 0;
+    if (!initTried)
     {
-        OVR_ASSERT(End == 0);
-        
-        if (size <= (Size - Head))
+        HMODULE hmodule   = ::GetModuleHandle(OVR_STR("kernelbase.dll"));
+        if (hmodule)
         {
-            p    = pBuffer + Head;
-            Head += size;
-        }
-        else if (size < Tail)
-        {
-            p    = pBuffer;
-            End  = Head;
-            Head = size;
-            OVR_ASSERT(Head != Tail);
-        }
-    }
-    else
-    {
-        OVR_ASSERT(End != 0);
-
-        if ((Tail - Head) > size)
-        {
-            p    = pBuffer + Head;
-            Head += size;
-            OVR_ASSERT(Head != Tail);
+            pWaitOnAddress    = (Function_WaitOnAddress)::GetProcAddress(hmodule, "WaitOnAddress");
+            pWakeByAddressAll = (Function_WakeByAddressAll)::GetProcAddress(hmodule, "WakeByAddressAll");
         }
+        if (!pWaitOnAddress || !pWakeByAddressAll)
+            pWaitOnAddress = 0;
+        initTried = true;
     }
-
-    return p;
 }
 
-void CircularBuffer::ReadEnd(UPInt size)
-{
-    OVR_ASSERT(Head != Tail);
-    size = roundUpSize(size);
-    
-    Tail += size;        
-    if (Tail == End)
-    {
-        Tail = End = 0;
-    }
-    else if (Tail == Head)
-    {        
-        OVR_ASSERT(End == 0);
-        Tail = Head = 0;
-    }
-}
+#endif
 
 
 //-------------------------------------------------------------------------------------
-// ***** ThreadCommand
-
-ThreadCommand::PopBuffer::~PopBuffer()
-{
-    if (Size)
-        Destruct<ThreadCommand>(toCommand());
-}
-
-void ThreadCommand::PopBuffer::InitFromBuffer(void* data)
-{
-    ThreadCommand* cmd = (ThreadCommand*)data;
-    OVR_ASSERT(cmd->Size <= MaxSize);
-
-    if (Size)
-        Destruct<ThreadCommand>(toCommand());    
-    Size = cmd->Size;    
-    memcpy(Buffer, (void*)cmd, Size);
-}
-
-void ThreadCommand::PopBuffer::Execute()
-{
-    ThreadCommand* command = toCommand();
-    OVR_ASSERT(command);
-    command->Execute();
-    if (NeedsWait())
-        GetEvent()->PulseEvent();
-}
-
-//-------------------------------------------------------------------------------------
+// ***** ThreadCommandQueueImpl
+
+// Commands live in a ring of SlotCount fixed-size slots. Each slot has a sequence
+// number saying whose turn it is: a producer may claim the slot for position pos
+// when it equals pos, the consumer may pop it when it equals pos + 1, and popping
+// hands it to position pos + SlotCount.
+//
+// The enqueue position is kept shifted left by one, with the low bit set once the
+// exit command has been queued; after that no producer can claim a slot.
+//
+// Commands too big for a slot are built in a block of the slab, a free list of
+// MaxSize blocks that grows to the most such commands queued at once, and a
+// SlabCommand referring to the block is put in the slot.
 
 class ThreadCommandQueueImpl : public NewOverrideBase
 {
     typedef ThreadCommand::NotifyEvent NotifyEvent;
     friend class ThreadCommandQueue;
+    friend class ThreadCommand::PopBuffer;
     
 public:
 
-    ThreadCommandQueueImpl(ThreadCommandQueue* queue)
-        : pQueue(queue), CommandBuffer(2048),
-          ExitEnqueued(false), ExitProcessed(false)
-    {
-    }
+    enum {
+        SlotSize  = ThreadCommand::InlineSize,
+        SlotCount = 64,
+        CacheLine = 64,
+        SlotMask  = SlotCount - 1,
+        SpinCount = 1000
+    };
+
+    ThreadCommandQueueImpl(ThreadCommandQueue* queue);
     ~ThreadCommandQueueImpl();
 
 
-    bool PushCommand(const ThreadCommand& command);
-    bool PopCommand(ThreadCommand::PopBuffer* popBuffer);
+    void* ReservePush(ThreadCommandQueue::PushSlot* pushSlot, UPInt size, bool exitFlag);
+    bool  CommitPush(ThreadCommandQueue::PushSlot* pushSlot, ThreadCommand* command);
+    bool  PopCommand(ThreadCommand::PopBuffer* popBuffer);
+
+    // Frees the slot of the command the consumer popped last.
+    void ReleaseCommand(ThreadCommand* command);
+
+    // Wakes the producer waiting for event.
+    void Complete(NotifyEvent* event);
+
+    // Slab blocks for commands over SlotSize.
+    void* allocBlock();
+    void  freeBlock(void* block);
 
 
     // ExitCommand is used by notify us that Thread is shutting down.
@@ -200,107 +127,261 @@ public:
 
         virtual void Execute() const
         {
-            Lock::Locker lock(&pImpl->QueueLock);
             pImpl->ExitProcessed = true;
         }
         virtual ThreadCommand* CopyConstruct(void* p) const 
         { return Construct<ExitCommand>(p, *this); }
     };
 
-
-    NotifyEvent* AllocNotifyEvent_NTS()
+    // SlabCommand stands in a slot for a command built in a slab block, and gives
+    // the block back when it is destroyed.
+    struct SlabCommand : public ThreadCommand
     {
-        NotifyEvent* p = AvailableEvents.GetFirst();
-
-        if (!AvailableEvents.IsNull(p))
-            p->RemoveNode();        
-        else
-            p = new NotifyEvent;
-        return p;
-    }
+        ThreadCommandQueueImpl* pImpl;
+        ThreadCommand*          pCommand;
 
-    void         FreeNotifyEvent_NTS(NotifyEvent* p)
-    {
-        AvailableEvents.PushBack(p);
-    }
+        SlabCommand(ThreadCommandQueueImpl* impl, ThreadCommand* command)
+            : ThreadCommand(sizeof(SlabCommand), command->NeedsWait()),
+              pImpl(impl), pCommand(command) { }
+        ~SlabCommand()
+        {
+            Destruct<ThreadCommand>(pCommand);
+            pImpl->freeBlock(pCommand);
+        }
 
-    void        FreeNotifyEvents_NTS()
-    {
-        while(!AvailableEvents.IsEmpty())
+        virtual void Execute() const
         {
-            NotifyEvent* p = AvailableEvents.GetFirst();
-            p->RemoveNode();
-            delete p;
+            pCommand->Execute();
         }
-    }
+        // Slab commands are only ever built in place.
+        virtual ThreadCommand* CopyConstruct(void*) const
+        { OVR_ASSERT(false); return 0; }
+    };
+
+private:
+
+    // The sequence number has a cache line to itself and the buffer starts on the next,
+    // so no slot shares a line with its neighbours.
+    struct Slot
+    {
+        AtomicInt<UInt32> Sequence;
+        UByte   Pad[CacheLine - sizeof(UInt32)];
+        union {
+            UByte   Buffer[SlotSize];
+            UPInt   Align;
+        };
+    };
+
+    // Signed distance from position b to a, in the 31 bits positions have.
+    static SInt32 posDiff(UInt32 a, UInt32 b) { return (SInt32)((a - b) << 1) >> 1; }
+
+    Slot*   slotFor(UInt32 pos) const { return &Slots[pos & SlotMask]; }
+    bool    isReady(UInt32 pos) const { return posDiff(slotFor(pos)->Sequence.Load_Acquire(), pos + 1) == 0; }
+
+    // Futex-style waiting: waitWhile blocks while *word holds value, and wakeAll
+    // releases every thread blocked on word after it has changed. Linux has futexes
+    // and Windows 8 WaitOnAddress; elsewhere threads park on one condition.
+    void    waitWhile(volatile UInt32* word, UInt32 value);
+    void    wakeAll(volatile UInt32* word);
 
     ThreadCommandQueue* pQueue;
-    Lock                QueueLock;
-    volatile bool       ExitEnqueued;
+    Slot*               Slots;
+    AtomicInt<UInt32>   EnqueueState;   // enqueue position << 1 | closed
+    UInt32              DequeuePos;     // consumer only
+    AtomicInt<UInt32>   SlotsFreed;     // slots freed << 1 | producers waiting for one
+    AtomicInt<UInt32>   ConsumerIdle;   // set when the consumer found the queue empty
+    AtomicInt<UInt32>   ExitEnqueued;
     volatile bool       ExitProcessed;
-    List<NotifyEvent>   AvailableEvents;
-    List<NotifyEvent>   BlockedProducers;
-    CircularBuffer      CommandBuffer;
+
+    // Free slab blocks, each starting with a pointer to the next.
+    Lock                SlabLock;
+    void*               pFreeBlocks;
+
+#if !defined(OVR_OS_LINUX)
+    Mutex               ParkMutex;
+    WaitCondition       ParkCondition;
+    AtomicInt<UInt32>   ParkedCount;
+#endif
 };
 
 
+ThreadCommandQueueImpl::ThreadCommandQueueImpl(ThreadCommandQueue* queue)
+    : pQueue(queue), EnqueueState(0), DequeuePos(0), SlotsFreed(0),
+      ConsumerIdle(1), ExitEnqueued(0), ExitProcessed(false), pFreeBlocks(0)
+#if !defined(OVR_OS_LINUX)
+      , ParkedCount(0)
+#endif
+{
+#if defined(OVR_OS_WIN32)
+    initWaitOnAddress();
+#endif
+    OVR_COMPILER_ASSERT((SlotCount & SlotMask) == 0);
+    OVR_COMPILER_ASSERT((sizeof(Slot) % CacheLine) == 0);
+
+    Slots = (Slot*)OVR_ALLOC_ALIGNED(sizeof(Slot) * SlotCount, CacheLine);
+    OVR_ASSERT(((UPInt)Slots % CacheLine) == 0);
+    for (UInt32 i = 0; i < SlotCount; i++)
+        Slots[i].Sequence.Store_Release(i);
+}
 
 ThreadCommandQueueImpl::~ThreadCommandQueueImpl()
 {
-    Lock::Locker lock(&QueueLock);
-    OVR_ASSERT(BlockedProducers.IsEmpty());
-    FreeNotifyEvents_NTS();
+    // Commands left if the consumer never got to them.
+    while (isReady(DequeuePos))
+    {
+        Destruct<ThreadCommand>((ThreadCommand*)slotFor(DequeuePos)->Buffer);
+        DequeuePos++;
+    }
+    OVR_FREE_ALIGNED(Slots);
+
+    while (pFreeBlocks)
+    {
+        void* next = *(void**)pFreeBlocks;
+        OVR_FREE_ALIGNED(pFreeBlocks);
+        pFreeBlocks = next;
+    }
+}
+
+void* ThreadCommandQueueImpl::allocBlock()
+{
+    {
+        Lock::Locker lock(&SlabLock);
+        if (pFreeBlocks)
+        {
+            void* block = pFreeBlocks;
+            pFreeBlocks = *(void**)block;
+            return block;
+        }
+    }
+    return OVR_ALLOC_ALIGNED(ThreadCommand::MaxSize, 16);
 }
 
-bool ThreadCommandQueueImpl::PushCommand(const ThreadCommand& command)
+void ThreadCommandQueueImpl::freeBlock(void* block)
 {
-    ThreadCommand::NotifyEvent* completeEvent = 0;
-    ThreadCommand::NotifyEvent* queueAvailableEvent = 0;
+    Lock::Locker lock(&SlabLock);
+    *(void**)block = pFreeBlocks;
+    pFreeBlocks    = block;
+}
 
-    // Repeat  writing command into buffer until it is available.    
-    do {
+void ThreadCommandQueueImpl::waitWhile(volatile UInt32* word, UInt32 value)
+{
+#if defined(OVR_OS_LINUX)
+    while (*word == value)
+        syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, 0, 0, 0);
+#else
+#if defined(OVR_OS_WIN32)
+    if (pWaitOnAddress)
+    {
+        while (*word == value)
+            pWaitOnAddress(word, &value, sizeof(value), INFINITE);
+        return;
+    }
+#endif
+    // The count is raised before the word is checked, so a waker either sees it or
+    // changed the word before it is read here.
+    ParkedCount.ExchangeAdd_Sync(1);
+    {
+        Mutex::Locker lock(&ParkMutex);
+        while (*word == value)
+            ParkCondition.Wait(&ParkMutex);
+    }
+    ParkedCount.ExchangeAdd_Sync(-1);
+#endif
+}
 
-        { // Lock Scope
-            Lock::Locker lock(&QueueLock);
+void ThreadCommandQueueImpl::wakeAll(volatile UInt32* word)
+{
+#if defined(OVR_OS_LINUX)
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, 0, 0, 0);
+#else
+#if defined(OVR_OS_WIN32)
+    if (pWaitOnAddress)
+    {
+        pWakeByAddressAll((PVOID)word);
+        return;
+    }
+#endif
+    OVR_UNUSED(word);
+    if (ParkedCount.ExchangeAdd_Sync(0))
+    {
+        Mutex::Locker lock(&ParkMutex);
+        ParkCondition.NotifyAll();
+    }
+#endif
+}
 
-            if (queueAvailableEvent)
-            {
-                FreeNotifyEvent_NTS(queueAvailableEvent);
-                queueAvailableEvent = 0;
-            }
+void* ThreadCommandQueueImpl::ReservePush(ThreadCommandQueue::PushSlot* pushSlot,
+                                          UPInt size, bool exitFlag)
+{
+    OVR_ASSERT(size <= ThreadCommand::MaxSize);
 
-            // Don't allow any commands after PushExitCommand() is called.
-            if (ExitEnqueued && !command.ExitFlag)
-                return false;
+    // Claim a slot, waiting for one if the ring is full.
+    UInt32 state = EnqueueState;
+    UInt32 pos;
+    Slot*  slot;
+    while (true)
+    {
+        // Don't allow any commands after the exit command.
+        if (state & 1)
+            return 0;
 
+        pos  = state >> 1;
+        slot = slotFor(pos);
+        SInt32 diff = posDiff(slot->Sequence.Load_Acquire(), pos);
 
-            bool   bufferWasEmpty = CommandBuffer.IsEmpty();
-            UByte* buffer = CommandBuffer.Write(command.GetSize());
-            if  (buffer)
-            {
-                ThreadCommand* c = command.CopyConstruct(buffer);
-                if (c->NeedsWait())
-                    completeEvent = c->pEvent = AllocNotifyEvent_NTS();
-                // Signal-waker consumer when we add data to buffer.
-                if (bufferWasEmpty)
-                    pQueue->OnPushNonEmpty_Locked();
+        if (diff == 0)
+        {
+            UInt32 newState = ((pos + 1) << 1) | (exitFlag ? 1 : 0);
+            if (EnqueueState.CompareAndSet_Sync(state, newState))
                 break;
+        }
+        else if (diff < 0)
+        {
+            // Full: the slot still holds the command from SlotCount positions back.
+            // Mark that we're waiting in the count we wait on; freeing a slot changes
+            // the count and clears the mark in one step, waking us if it was set.
+            UInt32 freed = SlotsFreed;
+            if ((freed & 1) || SlotsFreed.CompareAndSet_Sync(freed, freed | 1))
+            {
+                if (posDiff(slot->Sequence.Load_Acquire(), pos) < 0 && EnqueueState == state)
+                    waitWhile(&SlotsFreed.Value, freed | 1);
             }
+        }
+        state = EnqueueState;
+    }
 
-            queueAvailableEvent = AllocNotifyEvent_NTS();
-            BlockedProducers.PushBack(queueAvailableEvent);
-        } // Lock Scope
-
-        queueAvailableEvent->Wait();
+    pushSlot->Position = pos;
+    pushSlot->pBlock   = (size > SlotSize) ? allocBlock() : 0;
+    return pushSlot->pBlock ? pushSlot->pBlock : slot->Buffer;
+}
 
-    } while(1);
+bool ThreadCommandQueueImpl::CommitPush(ThreadCommandQueue::PushSlot* pushSlot,
+                                        ThreadCommand* command)
+{
+    Slot* slot = slotFor(pushSlot->Position);
+    if (pushSlot->pBlock)
+        command = ::new(slot->Buffer) SlabCommand(this, command);
+
+    // Once the slot is published the consumer may run and free the command, so
+    // nothing is read from it after that.
+    NotifyEvent completeEvent;
+    bool        wait = command->NeedsWait();
+    if (wait)
+        command->pEvent = &completeEvent;
+    slot->Sequence.Store_Release(pushSlot->Position + 1);
+
+    // Wake the consumer if it went idle; the full barrier orders this read after
+    // the store above.
+    if (ConsumerIdle.ExchangeAdd_Sync(0) && ConsumerIdle.CompareAndSet_Sync(1, 0))
+        pQueue->OnPushNonEmpty_Locked();
 
     // Command was enqueued, wait if necessary.
-    if (completeEvent)
+    if (wait)
     {
-        completeEvent->Wait();
-        Lock::Locker lock(&QueueLock);
-        FreeNotifyEvent_NTS(completeEvent);
+        for (int i = 0; i < SpinCount && completeEvent.State == NotifyEvent::Pending; i++)
+            ;
+        if (completeEvent.State.CompareAndSet_Sync(NotifyEvent::Pending, NotifyEvent::Parked))
+            waitWhile(&completeEvent.State.Value, NotifyEvent::Parked);
     }
 
     return true;
@@ -310,27 +391,74 @@ bool ThreadCommandQueueImpl::PushCommand(const ThreadCommand& command)
 // Pops the next command from the thread queue, if any is available.
 bool ThreadCommandQueueImpl::PopCommand(ThreadCommand::PopBuffer* popBuffer)
 {    
-    Lock::Locker lock(&QueueLock);
+    popBuffer->Release();
 
-    UByte* buffer = CommandBuffer.ReadBegin();
-    if (!buffer)
+    if (!isReady(DequeuePos))
     {
-        // Notify thread while in lock scope, enabling initialization of wait.
+        // Let the thread reset its wakeup before looking again, so a command pushed
+        // from here on either is seen below or wakes it.
         pQueue->OnPopEmpty_Locked();
-        return false;
+        ConsumerIdle.Exchange_Sync(1);
+        if (!isReady(DequeuePos))
+            return false;
+        ConsumerIdle.Exchange_Sync(0);
     }
 
-    popBuffer->InitFromBuffer(buffer);
-    CommandBuffer.ReadEnd(popBuffer->GetSize());
+    popBuffer->pCommand = (ThreadCommand*)slotFor(DequeuePos)->Buffer;
+    popBuffer->pQueue   = this;
+    return true;
+}
+
+void ThreadCommandQueueImpl::ReleaseCommand(ThreadCommand* command)
+{
+    OVR_ASSERT(command == (ThreadCommand*)slotFor(DequeuePos)->Buffer);
+    Destruct<ThreadCommand>(command);
+
+    slotFor(DequeuePos)->Sequence.Store_Release(DequeuePos + SlotCount);
+    DequeuePos++;
+
+    // Producers blocked on a full ring are woken once it has drained to half, rather
+    // than for every slot, so they don't take turns a command at a time.
+    bool   wake = posDiff(EnqueueState >> 1, DequeuePos) <= SlotCount / 2;
+    UInt32 freed;
+    do {
+        freed = SlotsFreed;
+    } while (!SlotsFreed.CompareAndSet_Sync(freed, (freed + 2) & (wake ? ~1u : ~0u)));
+    if (wake && (freed & 1))
+        wakeAll(&SlotsFreed.Value);
+}
+
+void ThreadCommandQueueImpl::Complete(NotifyEvent* event)
+{
+    if (event->State.Exchange_Sync(NotifyEvent::Done) == NotifyEvent::Parked)
+        wakeAll(&event->State.Value);
+}
+
+
+//-------------------------------------------------------------------------------------
+// ***** ThreadCommand
+
+ThreadCommand::PopBuffer::~PopBuffer()
+{
+    Release();
+}
 
-    if (!BlockedProducers.IsEmpty())
+void ThreadCommand::PopBuffer::Release()
+{
+    if (pCommand)
     {
-        ThreadCommand::NotifyEvent* queueAvailableEvent = BlockedProducers.GetFirst();
-        queueAvailableEvent->RemoveNode();
-        queueAvailableEvent->PulseEvent();
-        // Event is freed later by waiter.
-    }    
-    return true;
+        pQueue->ReleaseCommand(pCommand);
+        pCommand = 0;
+    }
+}
+
+void ThreadCommand::PopBuffer::Execute()
+{
+    ThreadCommand* command = pCommand;
+    OVR_ASSERT(command);
+    command->Execute();
+    if (NeedsWait())
+        pQueue->Complete(GetEvent());
 }
 
 
@@ -347,7 +475,19 @@ ThreadCommandQueue::~ThreadCommandQueue()
 
 bool ThreadCommandQueue::PushCommand(const ThreadCommand& command)
 {
-    return pImpl->PushCommand(command);
+    PushSlot slot;
+    void*    buffer = reservePush(&slot, command.GetSize(), command.ExitFlag);
+    return buffer && commitPush(&slot, command.CopyConstruct(buffer));
+}
+
+void* ThreadCommandQueue::reservePush(PushSlot* slot, UPInt size, bool exitFlag)
+{
+    return pImpl->ReservePush(slot, size, exitFlag);
+}
+
+bool ThreadCommandQueue::commitPush(PushSlot* slot, ThreadCommand* command)
+{
+    return pImpl->CommitPush(slot, command);
 }
 
 bool ThreadCommandQueue::PopCommand(ThreadCommand::PopBuffer* popBuffer)
@@ -358,16 +498,12 @@ bool ThreadCommandQueue::PopCommand(ThreadCommand::PopBuffer* popBuffer)
 void ThreadCommandQueue::PushExitCommand(bool wait)
 {
     // Exit is processed in two stages:
-    //  - First, ExitEnqueued flag is set to block further commands from queuing up.
+    //  - First, the exit command closes the queue to further commands as it is queued.
     //  - Second, the actual exit call is processed on the consumer thread, flushing
     //    any prior commands.
     //    IsExiting() only returns true after exit has flushed.
-    {
-        Lock::Locker lock(&pImpl->QueueLock);
-        if (pImpl->ExitEnqueued)
-            return;
-        pImpl->ExitEnqueued = true;
-    }
+    if (!pImpl->ExitEnqueued.CompareAndSet_Sync(0, 1))
+        return;
 
     PushCommand(ThreadCommandQueueImpl::ExitCommand(pImpl, wait));
 }
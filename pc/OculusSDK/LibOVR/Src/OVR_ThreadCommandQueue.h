@@ -37,6 +37,7 @@ namespace OVR {
 
 class ThreadCommand;
 class ThreadCommandQueue;
+class ThreadCommandQueueImpl;
 
 
 //-------------------------------------------------------------------------------------
@@ -47,42 +48,45 @@ class ThreadCommand
 {
 public:    
 
+    // Commands of up to InlineSize bytes are built in a slot of the queue's ring;
+    // bigger ones, up to MaxSize, in a block of its slab. PushCall checks the size of
+    // the command it builds against MaxSize at compile time.
+    enum { InlineSize = 256, MaxSize = 2048 };
+
     // NotifyEvent is used by ThreadCommandQueue::PushCallAndWait to notify the
-    // calling (producer)  thread when command is completed or queue slot is available.
-    class NotifyEvent : public ListNode<NotifyEvent>, public NewOverrideBase
+    // calling (producer) thread when command is completed. It lives on the stack of
+    // the producer, which spins on it briefly and then parks until it is Done.
+    class NotifyEvent
     {
-        Event E;
-    public:   
-        NotifyEvent() { }
+    public:
+        enum { Pending, Parked, Done };
+
+        AtomicInt<UInt32> State;
 
-        void Wait()        { E.Wait(); }
-        void PulseEvent()  { E.PulseEvent(); }
+        NotifyEvent() : State(Pending) { }
     };
 
-    // ThreadCommand::PopBuffer is temporary storage for a command popped off
-    // by ThreadCommandQueue::PopCommand. 
+    // ThreadCommand::PopBuffer refers to a command popped off by
+    // ThreadCommandQueue::PopCommand. The command is executed in its queue slot,
+    // which is given back by the next PopCommand or when the PopBuffer is destroyed.
     class PopBuffer
     {
-        enum { MaxSize = 256 };
+        friend class ThreadCommandQueueImpl;
 
-        UPInt Size;
-        union {            
-            UByte Buffer[MaxSize];
-            UPInt Align;
-        };
-
-        ThreadCommand* toCommand() const { return (ThreadCommand*)Buffer; }
+        ThreadCommand*          pCommand;
+        ThreadCommandQueueImpl* pQueue;
 
     public:
-        PopBuffer() : Size(0) { }
+        PopBuffer() : pCommand(0), pQueue(0) { }
         ~PopBuffer();
 
-        void        InitFromBuffer(void* data);
+        // Destroys the command and frees its slot in the queue.
+        void        Release();
 
-        bool        HasCommand() const  { return Size != 0; }
-        UPInt       GetSize() const     { return Size; }
-        bool        NeedsWait() const   { return toCommand()->NeedsWait(); }
-        NotifyEvent* GetEvent() const   { return toCommand()->pEvent; }
+        bool        HasCommand() const  { return pCommand != 0; }
+        UPInt       GetSize() const     { return pCommand ? pCommand->GetSize() : 0; }
+        bool        NeedsWait() const   { return pCommand->NeedsWait(); }
+        NotifyEvent* GetEvent() const   { return pCommand->pEvent; }
 
         // Execute the command and also notifies caller to finish waiting,
         // if necessary.
@@ -121,6 +125,11 @@ template<class T> struct CleanType<const T&> { typedef T Type; };
 // is already defined.
 template<class T> struct SelfType { typedef T Type; };
 
+// ArgType is the type PushCall takes an argument of type T as: a const reference to
+// the type the command stores, so the argument is copied once, into the command.
+// Like SelfType, it keeps the argument out of template argument deduction.
+template<class T> struct ArgType { typedef const typename CleanType<T>::Type& Type; };
+
 
 
 //-------------------------------------------------------------------------------------
@@ -139,14 +148,14 @@ template<class C, class R>
 class ThreadCommandMF0 : public ThreadCommand
 {   
     typedef R (C::*FnPtr)();
-    C*      pClass;
-    FnPtr   pFn;
-    R*      pRet;
+    C*                            pClass;
+    FnPtr                         pFn;
+    R*                            pRet;
 
     void executeImpl() const
     {
         pRet ? (void)(*pRet = (pClass->*pFn)()) :
-	           (void)(pClass->*pFn)();
+               (void)(pClass->*pFn)();
     }
 
 public:    
@@ -159,25 +168,24 @@ public:
     { return Construct<ThreadCommandMF0>(p, *this); }
 };
 
-
 // ThreadCommand for member function with 1 argument.
 template<class C, class R, class A0>
 class ThreadCommandMF1 : public ThreadCommand
 {   
     typedef R (C::*FnPtr)(A0);
-    C*                           pClass;
-    FnPtr                        pFn;
-    R*                           pRet;
-    typename CleanType<A0>::Type AVal0;
+    C*                            pClass;
+    FnPtr                         pFn;
+    R*                            pRet;
+    typename CleanType<A0>::Type  AVal0;
 
     void executeImpl() const
     {
-      pRet ? (void)(*pRet = (pClass->*pFn)(AVal0)) :
-	         (void)(pClass->*pFn)(AVal0);
+        pRet ? (void)(*pRet = (pClass->*pFn)(AVal0)) :
+               (void)(pClass->*pFn)(AVal0);
     }
 
 public:    
-    ThreadCommandMF1(C* pclass, FnPtr fn, R* ret, A0 a0, bool needsWait)
+    ThreadCommandMF1(C* pclass, FnPtr fn, R* ret, typename ArgType<A0>::Type a0, bool needsWait)
         : ThreadCommand(sizeof(ThreadCommandMF1), needsWait),
           pClass(pclass), pFn(fn), pRet(ret), AVal0(a0) { }
 
@@ -200,19 +208,100 @@ class ThreadCommandMF2 : public ThreadCommand
     void executeImpl() const
     {
         pRet ? (void)(*pRet = (pClass->*pFn)(AVal0, AVal1)) :
-	           (void)(pClass->*pFn)(AVal0, AVal1);
+               (void)(pClass->*pFn)(AVal0, AVal1);
     }
 
 public:    
-    ThreadCommandMF2(C* pclass, FnPtr fn, R* ret, A0 a0, A1 a1, bool needsWait)
+    ThreadCommandMF2(C* pclass, FnPtr fn, R* ret,
+                     typename ArgType<A0>::Type a0, typename ArgType<A1>::Type a1,
+                     bool needsWait)
         : ThreadCommand(sizeof(ThreadCommandMF2), needsWait),
           pClass(pclass), pFn(fn), pRet(ret), AVal0(a0), AVal1(a1) { }
-    
+
     virtual void           Execute() const { executeImpl(); }
-    virtual ThreadCommand* CopyConstruct(void* p) const 
+    virtual ThreadCommand* CopyConstruct(void* p) const
     { return Construct<ThreadCommandMF2>(p, *this); }
 };
 
+// ThreadCommand for member function with 3 arguments.
+template<class C, class R, class A0, class A1, class A2>
+class ThreadCommandMF3 : public ThreadCommand
+{   
+    typedef R (C::*FnPtr)(A0, A1, A2);
+    C*                            pClass;
+    FnPtr                         pFn;
+    R*                            pRet;
+    typename CleanType<A0>::Type  AVal0;
+    typename CleanType<A1>::Type  AVal1;
+    typename CleanType<A2>::Type  AVal2;
+
+    void executeImpl() const
+    {
+        pRet ? (void)(*pRet = (pClass->*pFn)(AVal0, AVal1, AVal2)) :
+               (void)(pClass->*pFn)(AVal0, AVal1, AVal2);
+    }
+
+public:    
+    ThreadCommandMF3(C* pclass, FnPtr fn, R* ret,
+                     typename ArgType<A0>::Type a0, typename ArgType<A1>::Type a1,
+                     typename ArgType<A2>::Type a2, bool needsWait)
+        : ThreadCommand(sizeof(ThreadCommandMF3), needsWait),
+          pClass(pclass), pFn(fn), pRet(ret), AVal0(a0), AVal1(a1), AVal2(a2) { }
+
+    virtual void           Execute() const { executeImpl(); }
+    virtual ThreadCommand* CopyConstruct(void* p) const
+    { return Construct<ThreadCommandMF3>(p, *this); }
+};
+
+// ThreadCommand for member function with 4 arguments.
+template<class C, class R, class A0, class A1, class A2, class A3>
+class ThreadCommandMF4 : public ThreadCommand
+{   
+    typedef R (C::*FnPtr)(A0, A1, A2, A3);
+    C*                            pClass;
+    FnPtr                         pFn;
+    R*                            pRet;
+    typename CleanType<A0>::Type  AVal0;
+    typename CleanType<A1>::Type  AVal1;
+    typename CleanType<A2>::Type  AVal2;
+    typename CleanType<A3>::Type  AVal3;
+
+    void executeImpl() const
+    {
+        pRet ? (void)(*pRet = (pClass->*pFn)(AVal0, AVal1, AVal2, AVal3)) :
+               (void)(pClass->*pFn)(AVal0, AVal1, AVal2, AVal3);
+    }
+
+public:    
+    ThreadCommandMF4(C* pclass, FnPtr fn, R* ret,
+                     typename ArgType<A0>::Type a0, typename ArgType<A1>::Type a1,
+                     typename ArgType<A2>::Type a2, typename ArgType<A3>::Type a3,
+                     bool needsWait)
+        : ThreadCommand(sizeof(ThreadCommandMF4), needsWait),
+          pClass(pclass), pFn(fn), pRet(ret), AVal0(a0), AVal1(a1), AVal2(a2), AVal3(a3) { }
+
+    virtual void           Execute() const { executeImpl(); }
+    virtual ThreadCommand* CopyConstruct(void* p) const
+    { return Construct<ThreadCommandMF4>(p, *this); }
+};
+
+// ThreadCommand for a function object or lambda taking no arguments, with its
+// result, if any, ignored. The object is called on the consumer thread, so anything
+// it captures by reference must outlive the call; with 'wait' set it does.
+template<class F>
+class ThreadCommandFn : public ThreadCommand
+{
+    mutable F Fn;
+
+public:
+    ThreadCommandFn(const F& fn, bool needsWait)
+        : ThreadCommand(sizeof(ThreadCommandFn), needsWait), Fn(fn) { }
+
+    virtual void           Execute() const { Fn(); }
+    virtual ThreadCommand* CopyConstruct(void* p) const
+    { return Construct<ThreadCommandFn>(p, *this); }
+};
+
 
 //-------------------------------------------------------------------------------------
 // ***** ThreadCommandQueue
@@ -221,9 +310,16 @@ public:
 // serviced by a single consumer thread. Commands are added to the queue with PushCall
 // and removed with PopCall; they are processed in FIFO order. Multiple producer threads
 // are supported and will be blocked if internal data buffer is full.
+//
+// The queue is a lock-free ring of fixed-size slots: producers claim a slot with a
+// compare-and-swap and PushCall constructs the command in it, so its arguments are
+// copied once; the consumer executes it there.
+// Producers waiting for room or for their command to complete spin briefly and then
+// park on a futex (a condition variable where there are none).
 
 class ThreadCommandQueue
 {
+    friend class ThreadCommandQueueImpl;
 public:
 
     ThreadCommandQueue();
@@ -247,7 +343,9 @@ public:
 
 
     // These two virtual functions serve as notifications for derived
-    // thread waiting.    
+    // thread waiting. No lock is held when they are called any more: PopCommand calls
+    // OnPopEmpty_Locked on the consumer thread before it checks the queue one last
+    // time, and OnPushNonEmpty_Locked is called by the first push to follow it.
     virtual void OnPushNonEmpty_Locked() { }
     virtual void OnPopEmpty_Locked()     { }
 
@@ -259,27 +357,88 @@ public:
     // wait for completion.
     template<class C, class R>
     bool PushCall(R (C::*fn)(), bool wait = false)
-    { return PushCommand(ThreadCommandMF0<C,R>(static_cast<C*>(this), fn, 0, wait)); }       
+    { return PushCall(static_cast<C*>(this), fn, wait); }
     template<class C, class R, class A0>
-    bool PushCall(R (C::*fn)(A0), typename SelfType<A0>::Type a0, bool wait = false)
-    { return PushCommand(ThreadCommandMF1<C,R,A0>(static_cast<C*>(this), fn, 0, a0, wait)); }
+    bool PushCall(R (C::*fn)(A0), typename ArgType<A0>::Type a0, bool wait = false)
+    { return PushCall(static_cast<C*>(this), fn, a0, wait); }
     template<class C, class R, class A0, class A1>
     bool PushCall(R (C::*fn)(A0, A1),
-                  typename SelfType<A0>::Type a0, typename SelfType<A1>::Type a1, bool wait = false)
-    { return PushCommand(ThreadCommandMF2<C,R,A0,A1>(static_cast<C*>(this), fn, 0, a0, a1, wait)); }
+                  typename ArgType<A0>::Type a0, typename ArgType<A1>::Type a1,
+                  bool wait = false)
+    { return PushCall(static_cast<C*>(this), fn, a0, a1, wait); }
+    template<class C, class R, class A0, class A1, class A2>
+    bool PushCall(R (C::*fn)(A0, A1, A2),
+                  typename ArgType<A0>::Type a0, typename ArgType<A1>::Type a1,
+                  typename ArgType<A2>::Type a2, bool wait = false)
+    { return PushCall(static_cast<C*>(this), fn, a0, a1, a2, wait); }
+    template<class C, class R, class A0, class A1, class A2, class A3>
+    bool PushCall(R (C::*fn)(A0, A1, A2, A3),
+                  typename ArgType<A0>::Type a0, typename ArgType<A1>::Type a1,
+                  typename ArgType<A2>::Type a2, typename ArgType<A3>::Type a3,
+                  bool wait = false)
+    { return PushCall(static_cast<C*>(this), fn, a0, a1, a2, a3, wait); }
     // Enqueue a specified member function call of class C.
     // By default the function returns immediately; set 'wait' argument to 'true' to
     // wait for completion.
     template<class C, class R>
     bool PushCall(C* p, R (C::*fn)(), bool wait = false)
-    { return PushCommand(ThreadCommandMF0<C,R>(p, fn, 0, wait)); }
+    {
+        typedef ThreadCommandMF0<C,R> Command;
+        PushSlot slot;
+        void*    buffer = reservePush<Command>(&slot);
+        return buffer && commitPush(&slot, ::new(buffer) Command(p, fn, 0, wait));
+    }
     template<class C, class R, class A0>
-    bool PushCall(C* p, R (C::*fn)(A0), typename SelfType<A0>::Type a0, bool wait = false)
-    { return PushCommand(ThreadCommandMF1<C,R,A0>(p, fn, 0, a0, wait)); }
+    bool PushCall(C* p, R (C::*fn)(A0), typename ArgType<A0>::Type a0, bool wait = false)
+    {
+        typedef ThreadCommandMF1<C,R,A0> Command;
+        PushSlot slot;
+        void*    buffer = reservePush<Command>(&slot);
+        return buffer && commitPush(&slot, ::new(buffer) Command(p, fn, 0, a0, wait));
+    }
     template<class C, class R, class A0, class A1>
     bool PushCall(C* p, R (C::*fn)(A0, A1),
-                  typename SelfType<A0>::Type a0, typename SelfType<A1>::Type a1, bool wait = false)
-    { return PushCommand(ThreadCommandMF2<C,R,A0,A1>(p, fn, 0, a0, a1, wait)); }
+                  typename ArgType<A0>::Type a0, typename ArgType<A1>::Type a1,
+                  bool wait = false)
+    {
+        typedef ThreadCommandMF2<C,R,A0,A1> Command;
+        PushSlot slot;
+        void*    buffer = reservePush<Command>(&slot);
+        return buffer && commitPush(&slot, ::new(buffer) Command(p, fn, 0, a0, a1, wait));
+    }
+    template<class C, class R, class A0, class A1, class A2>
+    bool PushCall(C* p, R (C::*fn)(A0, A1, A2),
+                  typename ArgType<A0>::Type a0, typename ArgType<A1>::Type a1,
+                  typename ArgType<A2>::Type a2, bool wait = false)
+    {
+        typedef ThreadCommandMF3<C,R,A0,A1,A2> Command;
+        PushSlot slot;
+        void*    buffer = reservePush<Command>(&slot);
+        return buffer && commitPush(&slot, ::new(buffer) Command(p, fn, 0, a0, a1, a2, wait));
+    }
+    template<class C, class R, class A0, class A1, class A2, class A3>
+    bool PushCall(C* p, R (C::*fn)(A0, A1, A2, A3),
+                  typename ArgType<A0>::Type a0, typename ArgType<A1>::Type a1,
+                  typename ArgType<A2>::Type a2, typename ArgType<A3>::Type a3,
+                  bool wait = false)
+    {
+        typedef ThreadCommandMF4<C,R,A0,A1,A2,A3> Command;
+        PushSlot slot;
+        void*    buffer = reservePush<Command>(&slot);
+        return buffer && commitPush(&slot, ::new(buffer) Command(p, fn, 0, a0, a1, a2, a3, wait));
+    }
+
+    // Enqueue a function object or lambda to be called on consumer thread.
+    // By default the function returns immediately; set 'wait' argument to 'true' to
+    // wait for completion.
+    template<class F>
+    bool PushFunction(const F& fn, bool wait = false)
+    {
+        typedef ThreadCommandFn<F> Command;
+        PushSlot slot;
+        void*    buffer = reservePush<Command>(&slot);
+        return buffer && commitPush(&slot, ::new(buffer) Command(fn, wait));
+    }
     
     
     // *** PushCall with Result
@@ -288,29 +447,97 @@ public:
     // on consumer thread before returning.
     template<class C, class R>
     bool PushCallAndWaitResult(R (C::*fn)(), R* ret)
-    { return PushCommand(ThreadCommandMF0<C,R>(static_cast<C*>(this), fn, ret, true)); }       
+    { return PushCallAndWaitResult(static_cast<C*>(this), fn, ret); }
     template<class C, class R, class A0>
-    bool PushCallAndWaitResult(R (C::*fn)(A0), R* ret, typename SelfType<A0>::Type a0)
-    { return PushCommand(ThreadCommandMF1<C,R,A0>(static_cast<C*>(this), fn, ret, a0, true)); }
+    bool PushCallAndWaitResult(R (C::*fn)(A0), R* ret, typename ArgType<A0>::Type a0)
+    { return PushCallAndWaitResult(static_cast<C*>(this), fn, ret, a0); }
     template<class C, class R, class A0, class A1>
     bool PushCallAndWaitResult(R (C::*fn)(A0, A1), R* ret,
-                               typename SelfType<A0>::Type a0, typename SelfType<A1>::Type a1)
-    { return PushCommand(ThreadCommandMF2<C,R,A0,A1>(static_cast<C*>(this), fn, ret, a0, a1, true)); }
+                               typename ArgType<A0>::Type a0, typename ArgType<A1>::Type a1)
+    { return PushCallAndWaitResult(static_cast<C*>(this), fn, ret, a0, a1); }
+    template<class C, class R, class A0, class A1, class A2>
+    bool PushCallAndWaitResult(R (C::*fn)(A0, A1, A2), R* ret,
+                               typename ArgType<A0>::Type a0, typename ArgType<A1>::Type a1,
+                               typename ArgType<A2>::Type a2)
+    { return PushCallAndWaitResult(static_cast<C*>(this), fn, ret, a0, a1, a2); }
+    template<class C, class R, class A0, class A1, class A2, class A3>
+    bool PushCallAndWaitResult(R (C::*fn)(A0, A1, A2, A3), R* ret,
+                               typename ArgType<A0>::Type a0, typename ArgType<A1>::Type a1,
+                               typename ArgType<A2>::Type a2, typename ArgType<A3>::Type a3)
+    { return PushCallAndWaitResult(static_cast<C*>(this), fn, ret, a0, a1, a2, a3); }
     // Enqueue a member function call for class C and wait for the call to complete
     // on consumer thread before returning.
     template<class C, class R>
     bool PushCallAndWaitResult(C* p, R (C::*fn)(), R* ret)
-    { return PushCommand(ThreadCommandMF0<C,R>(p, fn, ret, true)); }
+    {
+        typedef ThreadCommandMF0<C,R> Command;
+        PushSlot slot;
+        void*    buffer = reservePush<Command>(&slot);
+        return buffer && commitPush(&slot, ::new(buffer) Command(p, fn, ret, true));
+    }
     template<class C, class R, class A0>
-    bool PushCallAndWaitResult(C* p, R (C::*fn)(A0), R* ret, typename SelfType<A0>::Type a0)
-    { return PushCommand(ThreadCommandMF1<C,R,A0>(p, fn, ret, a0, true)); }
+    bool PushCallAndWaitResult(C* p, R (C::*fn)(A0), R* ret, typename ArgType<A0>::Type a0)
+    {
+        typedef ThreadCommandMF1<C,R,A0> Command;
+        PushSlot slot;
+        void*    buffer = reservePush<Command>(&slot);
+        return buffer && commitPush(&slot, ::new(buffer) Command(p, fn, ret, a0, true));
+    }
     template<class C, class R, class A0, class A1>
     bool PushCallAndWaitResult(C* p, R (C::*fn)(A0, A1), R* ret,
-                               typename SelfType<A0>::Type a0, typename SelfType<A1>::Type a1)
-    { return PushCommand(ThreadCommandMF2<C,R,A0,A1>(p, fn, ret, a0, a1, true)); }
+                               typename ArgType<A0>::Type a0, typename ArgType<A1>::Type a1)
+    {
+        typedef ThreadCommandMF2<C,R,A0,A1> Command;
+        PushSlot slot;
+        void*    buffer = reservePush<Command>(&slot);
+        return buffer && commitPush(&slot, ::new(buffer) Command(p, fn, ret, a0, a1, true));
+    }
+    template<class C, class R, class A0, class A1, class A2>
+    bool PushCallAndWaitResult(C* p, R (C::*fn)(A0, A1, A2), R* ret,
+                               typename ArgType<A0>::Type a0, typename ArgType<A1>::Type a1,
+                               typename ArgType<A2>::Type a2)
+    {
+        typedef ThreadCommandMF3<C,R,A0,A1,A2> Command;
+        PushSlot slot;
+        void*    buffer = reservePush<Command>(&slot);
+        return buffer && commitPush(&slot, ::new(buffer) Command(p, fn, ret, a0, a1, a2, true));
+    }
+    template<class C, class R, class A0, class A1, class A2, class A3>
+    bool PushCallAndWaitResult(C* p, R (C::*fn)(A0, A1, A2, A3), R* ret,
+                               typename ArgType<A0>::Type a0, typename ArgType<A1>::Type a1,
+                               typename ArgType<A2>::Type a2, typename ArgType<A3>::Type a3)
+    {
+        typedef ThreadCommandMF4<C,R,A0,A1,A2,A3> Command;
+        PushSlot slot;
+        void*    buffer = reservePush<Command>(&slot);
+        return buffer && commitPush(&slot, ::new(buffer) Command(p, fn, ret, a0, a1, a2, a3, true));
+    }
 
 private:
-    class ThreadCommandQueueImpl* pImpl;
+
+    // PushSlot is room reserved in the queue for one command, which is then
+    // constructed in it rather than copied there. It is a slot of the ring, with a
+    // block of the slab for commands over ThreadCommand::InlineSize.
+    struct PushSlot
+    {
+        UInt32 Position;
+        void*  pBlock;
+    };
+
+    // Reserves room for a command of the given size; returns the memory to construct
+    // it in, or 0 if the queue no longer accepts commands. The reservation must be
+    // followed by commitPush, which queues the command and waits for it if it needs.
+    void*   reservePush(PushSlot* slot, UPInt size, bool exitFlag = false);
+    bool    commitPush(PushSlot* slot, ThreadCommand* command);
+
+    template<class Command>
+    void*   reservePush(PushSlot* slot)
+    {
+        OVR_COMPILER_ASSERT(sizeof(Command) <= ThreadCommand::MaxSize);
+        return reservePush(slot, sizeof(Command));
+    }
+
+    ThreadCommandQueueImpl* pImpl;
 };
 
 
@@ -0,0 +1,578 @@
+/************************************************************************************
+
+Filename    :   OVR_VirtualTracker.cpp
+Content     :   In-process tracker HID device for running the sensor stack without
+                hardware
+Created     :   
+Authors     :   
+
+Copyright   :   Copyright 2013 Oculus VR, Inc. All Rights reserved.
+
+Licensed under the Oculus VR SDK License Version 2.0 (the "License"); 
+you may not use the Oculus VR SDK except in compliance with the License, 
+which is provided at the time of installation or download, or which 
+otherwise accompanies this software in either electronic or hard copy form.
+
+You may obtain a copy of the License at
+
+http://www.oculusvr.com/licenses/LICENSE-2.0 
+
+Unless required by applicable law or agreed to in writing, the Oculus VR SDK 
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*************************************************************************************/
+
+#include "OVR_VirtualTracker.h"
+#include "OVR_DeviceImpl.h"
+
+#include "Kernel/OVR_Timer.h"
+
+namespace OVR {
+
+//-------------------------------------------------------------------------------------
+// ***** SyntheticTrackerMotion
+
+SyntheticTrackerMotion::SyntheticTrackerMotion(UInt32 seed)
+    : Seed(seed)
+{
+}
+
+float SyntheticTrackerMotion::nextNoise()
+{
+    Seed = Seed * 1664525 + 1013904223;
+    return ((Seed >> 8) / 16777216.0f - 0.5f) * 0.02f;
+}
+
+void SyntheticTrackerMotion::GetSample(UInt64 sampleIndex, unsigned sampleRateHz,
+                                       Util::SensorTraceRecord* sample)
+{
+    const Vector3f gravity(0, 9.81f, 0);
+    const Vector3f field(0.25f, -0.4f, 0.1f);
+    const Vector3f bias(0.01f, -0.005f, 0.008f);
+
+    float    dt = 1.0f / sampleRateHz;
+    float    t  = (float)(sampleIndex * dt);
+    Vector3f rate(0.8f * sinf(1.3f * t), 1.5f * sinf(0.7f * t + 1.0f), 0.4f * sinf(2.1f * t));
+
+    Orientation = Orientation * Quatf(rate, rate.Length() * dt);
+    Orientation.Normalize();
+
+    Quatf    toBody = Orientation.Inverted();
+    Vector3f noise(nextNoise(), nextNoise(), nextNoise());
+
+    sample->Acceleration  = toBody.Rotate(gravity) + noise * 5.0f;
+    sample->RotationRate  = rate + bias + noise;
+    sample->MagneticField = toBody.Rotate(field) + noise * 0.1f;
+    sample->Temperature   = 30.0f;
+}
+
+
+//-------------------------------------------------------------------------------------
+// ***** TraceTrackerMotion
+
+bool TraceTrackerMotion::Load(const char* tracePath)
+{
+    Util::SensorTraceReader reader;
+    Records.Clear();
+    return reader.Open(tracePath) && reader.ReadAll(&Records);
+}
+
+void TraceTrackerMotion::GetSample(UInt64 sampleIndex, unsigned sampleRateHz,
+                                   Util::SensorTraceRecord* sample)
+{
+    OVR_UNUSED(sampleRateHz);
+    if (Records.GetSize() == 0)
+    {
+        *sample = Util::SensorTraceRecord();
+        return;
+    }
+    *sample = Records[(UPInt)(sampleIndex % Records.GetSize())];
+}
+
+
+//-------------------------------------------------------------------------------------
+// ***** Tracker report encoding
+
+// Inverse of UnpackSensor in OVR_SensorImpl.cpp: three 21-bit values in 8 bytes.
+static void PackSensor(UByte* buffer, SInt32 x, SInt32 y, SInt32 z)
+{
+    UInt32 ux = UInt32(x) & 0x1FFFFF;
+    UInt32 uy = UInt32(y) & 0x1FFFFF;
+    UInt32 uz = UInt32(z) & 0x1FFFFF;
+
+    buffer[0] = UByte(ux >> 13);
+    buffer[1] = UByte(ux >> 5);
+    buffer[2] = UByte(((ux << 3) & 0xF8) | ((uy >> 18) & 0x07));
+    buffer[3] = UByte(uy >> 10);
+    buffer[4] = UByte(uy >> 2);
+    buffer[5] = UByte(((uy << 6) & 0xC0) | ((uz >> 15) & 0x3F));
+    buffer[6] = UByte(uz >> 7);
+    buffer[7] = UByte(uz << 1);
+}
+
+static void EncodeUInt16(UByte* buffer, UInt16 value)
+{
+    buffer[0] = UByte(value & 0xFF);
+    buffer[1] = UByte(value >> 8);
+}
+
+static UInt16 DecodeUInt16(const UByte* buffer)
+{
+    return UInt16(buffer[0] | (UInt16(buffer[1]) << 8));
+}
+
+// Converts a reading to sensor units of 10^-4, clamped to the range limit in those
+// units.
+static SInt32 ToSensorUnits(float value, float limit)
+{
+    float units = value * 10000.0f;
+    if (units > limit)
+        units = limit;
+    else if (units < -limit)
+        units = -limit;
+    return (SInt32)(units + (units < 0 ? -0.5f : 0.5f));
+}
+
+
+//-------------------------------------------------------------------------------------
+// ***** VirtualTrackerDevice
+
+class VirtualTrackerDevice::PacerThread : public Thread
+{
+public:
+    PacerThread(VirtualTrackerDevice* device, unsigned sampleRateHz)
+        : Thread(CreateParams(0, 0, 128 * 1024, -1, NotRunning, HighestPriority)),
+          pDevice(device), SampleRateHz(sampleRateHz)
+    { }
+
+    virtual int Run()
+    {
+        SetThreadName("Virtual Tracker");
+
+        UInt64 start    = Timer::GetTicks();
+        UInt64 produced = 0;
+
+        while (!GetExitFlag())
+        {
+            UInt64 due = (Timer::GetTicks() - start) * SampleRateHz / Timer::MksPerSecond;
+            if (due > produced)
+            {
+                pDevice->Advance((UInt32)(due - produced), SampleRateHz);
+                produced = due;
+            }
+            MSleep(1);
+        }
+        return 0;
+    }
+
+private:
+    Ptr<VirtualTrackerDevice> pDevice;
+    unsigned                  SampleRateHz;
+};
+
+// Holds a reference to the device so it can't go away while the command is queued,
+// even if the command is discarded without running.
+struct VirtualTrackerDevice::DeliverReports
+{
+    Ptr<VirtualTrackerDevice> pDevice;
+
+    DeliverReports(VirtualTrackerDevice* device) : pDevice(device) { }
+    void operator()() const { pDevice->deliverReports(); }
+};
+
+
+VirtualTrackerDevice::VirtualTrackerDevice(VirtualTrackerMotion* motion)
+    : pMotion(motion), pQueue(0), DeliveryPending(false),
+      FirstTimestamp(0), SampleIndex(0), PendingCount(0),
+      LastCommandId(0), ConfigFlags(0), PacketInterval(0), KeepAliveIntervalMs(10 * 1000),
+      KeepAliveEndTicks(0), AccelScale(4), GyroScale(1000), MagScale(1300),
+      QueueHead(0), QueueCount(0)
+{
+    Desc.VendorId      = VendorId;
+    Desc.ProductId     = ProductId;
+    Desc.VersionNumber = 0;
+    Desc.Usage         = 0;
+    Desc.UsagePage     = 0;
+    Desc.Manufacturer  = "Oculus VR, Inc.";
+    Desc.Product       = "Virtual Tracker";
+    Desc.SerialNumber  = "VIRTUAL";
+
+    memset(&Counters, 0, sizeof(Counters));
+}
+
+VirtualTrackerDevice::~VirtualTrackerDevice()
+{
+    Stop();
+}
+
+bool VirtualTrackerDevice::Start(unsigned sampleRateHz)
+{
+    if (pPacer || sampleRateHz == 0)
+        return false;
+
+    {
+        Lock::Locker lock(&DeviceLock);
+        KeepAliveEndTicks = Timer::GetTicks() + UInt64(KeepAliveIntervalMs) * 1000;
+    }
+
+    pPacer = *new PacerThread(this, sampleRateHz);
+    if (!pPacer->Start())
+    {
+        pPacer.Clear();
+        return false;
+    }
+    return true;
+}
+
+void VirtualTrackerDevice::Stop()
+{
+    if (!pPacer)
+        return;
+
+    pPacer->SetExitFlag(true);
+    while (!pPacer->IsFinished())
+    {
+        Thread::MSleep(1);
+    }
+    pPacer.Clear();
+}
+
+void VirtualTrackerDevice::SetDeliveryQueue(ThreadCommandQueue* queue)
+{
+    Lock::Locker lock(&DeviceLock);
+    pQueue = queue;
+}
+
+VirtualTrackerDevice::Stats VirtualTrackerDevice::GetStats() const
+{
+    Lock::Locker lock(&DeviceLock);
+    return Counters;
+}
+
+void VirtualTrackerDevice::Advance(UInt32 sampleCount, unsigned sampleRateHz)
+{
+    ThreadCommandQueue* queue = 0;
+    {
+        Lock::Locker lock(&DeviceLock);
+
+        if (KeepAliveEndTicks == 0)
+            KeepAliveEndTicks = Timer::GetTicks() + UInt64(KeepAliveIntervalMs) * 1000;
+
+        UInt64 reportsBefore = Counters.Reports;
+        for (UInt32 i = 0; i < sampleCount; i++)
+            takeSample_NeedsLock(sampleRateHz);
+
+        if ((Counters.Reports == reportsBefore) || DeliveryPending)
+            return;
+
+        DeliveryPending = true;
+        queue           = pQueue;
+    }
+
+    // Push outside the lock; the manager thread takes it to deliver.
+    if (!queue)
+        deliverReports();
+    else if (!queue->PushFunction(DeliverReports(this)))
+    {
+        Lock::Locker lock(&DeviceLock);
+        DeliveryPending = false;
+    }
+}
+
+void VirtualTrackerDevice::takeSample_NeedsLock(unsigned sampleRateHz)
+{
+    Util::SensorTraceRecord sample;
+    pMotion->GetSample(SampleIndex, sampleRateHz, &sample);
+    SampleIndex++;
+    Counters.Samples++;
+
+    Recent[0] = Recent[1];
+    Recent[1] = Recent[2];
+    Recent[2] = sample;
+    PendingAccelSum += sample.Acceleration;
+    PendingGyroSum  += sample.RotationRate;
+    PendingCount++;
+
+    // SampleCount is a byte, so a report is due at 255 samples at most.
+    UInt32 samplesPerReport = Alg::Min<UInt32>(UInt32(PacketInterval) + 1, 255);
+    if (PendingCount < samplesPerReport)
+        return;
+
+    if (keepAliveRunning_NeedsLock())
+        queueReport_NeedsLock();
+    else
+        Counters.SilentSamples += PendingCount;
+
+    PendingCount    = 0;
+    PendingAccelSum = Vector3f();
+    PendingGyroSum  = Vector3f();
+}
+
+bool VirtualTrackerDevice::keepAliveRunning_NeedsLock() const
+{
+    return Timer::GetTicks() < KeepAliveEndTicks;
+}
+
+void VirtualTrackerDevice::queueReport_NeedsLock()
+{
+    Counters.Reports++;
+    if (QueueCount == QueueSize)
+    {
+        Counters.ReportsDropped++;
+        return;
+    }
+
+    UByte* buffer = Queue[(QueueHead + QueueCount) % QueueSize];
+    QueueCount++;
+    memset(buffer, 0, ReportSize);
+
+    const float accelLimit = Alg::Min(AccelScale * 9.81f * 10000.0f, 1048575.0f);
+    const float gyroLimit  = Alg::Min(GyroScale * Math<float>::DegreeToRadFactor * 10000.0f, 1048575.0f);
+    const float magLimit   = Alg::Min(MagScale * 10.0f, 32767.0f);
+
+    const Util::SensorTraceRecord& last = Recent[2];
+    UInt16 timestamp = UInt16(FirstTimestamp + (SampleIndex - PendingCount));
+
+    buffer[0] = 1;
+    buffer[1] = UByte(PendingCount);
+    EncodeUInt16(buffer + 2, timestamp);
+    EncodeUInt16(buffer + 4, LastCommandId);
+    EncodeUInt16(buffer + 6, UInt16(SInt16(last.Temperature * 100.0f)));
+
+    // Up to 3 samples are sent as they are; with more, the first slot carries the
+    // average of all but the last two.
+    UInt32 slots = Alg::Min<UInt32>(PendingCount, 3);
+    for (UInt32 i = 0; i < slots; i++)
+    {
+        Vector3f accel = Recent[3 - slots + i].Acceleration;
+        Vector3f gyro  = Recent[3 - slots + i].RotationRate;
+        if ((i == 0) && (PendingCount > 3))
+        {
+            float older = 1.0f / (PendingCount - 2);
+            accel = (PendingAccelSum - Recent[1].Acceleration - Recent[2].Acceleration) * older;
+            gyro  = (PendingGyroSum  - Recent[1].RotationRate - Recent[2].RotationRate) * older;
+        }
+
+        PackSensor(buffer + 8 + 16 * i,
+                   ToSensorUnits(accel.x, accelLimit), ToSensorUnits(accel.y, accelLimit),
+                   ToSensorUnits(accel.z, accelLimit));
+        PackSensor(buffer + 16 + 16 * i,
+                   ToSensorUnits(gyro.x, gyroLimit), ToSensorUnits(gyro.y, gyroLimit),
+                   ToSensorUnits(gyro.z, gyroLimit));
+    }
+
+    // The firmware sends the magnetometer with Y and Z swapped; SensorDevice swaps
+    // them back.
+    EncodeUInt16(buffer + 56, UInt16(ToSensorUnits(last.MagneticField.x, magLimit)));
+    EncodeUInt16(buffer + 58, UInt16(ToSensorUnits(last.MagneticField.z, magLimit)));
+    EncodeUInt16(buffer + 60, UInt16(ToSensorUnits(last.MagneticField.y, magLimit)));
+}
+
+void VirtualTrackerDevice::deliverReports()
+{
+    UByte  reports[QueueSize][ReportSize];
+    UInt32 count;
+    {
+        Lock::Locker lock(&DeviceLock);
+
+        // Cleared first, so reports queued from here on push a new command.
+        DeliveryPending = false;
+        count           = QueueCount;
+        for (UInt32 i = 0; i < count; i++)
+            memcpy(reports[i], Queue[(QueueHead + i) % QueueSize], ReportSize);
+        QueueHead  = (QueueHead + count) % QueueSize;
+        QueueCount = 0;
+
+        Counters.Deliveries++;
+        if (Handler)
+            Counters.ReportsDelivered += count;
+    }
+
+    // Handler is set and cleared on the manager thread this runs on.
+    if (!Handler)
+        return;
+    for (UInt32 i = 0; i < count; i++)
+        Handler->OnInputReport(reports[i], ReportSize);
+}
+
+bool VirtualTrackerDevice::SetFeatureReport(UByte* data, UInt32 length)
+{
+    Lock::Locker lock(&DeviceLock);
+
+    switch (data[0])
+    {
+    case 2: // Config
+        if (length < 7)
+            return false;
+        ConfigFlags         = data[3];
+        PacketInterval      = data[4];
+        KeepAliveIntervalMs = DecodeUInt16(data + 5);
+        break;
+
+    case 4: // Range
+        if (length < 8)
+            return false;
+        AccelScale = data[3];
+        GyroScale  = DecodeUInt16(data + 4);
+        MagScale   = DecodeUInt16(data + 6);
+        break;
+
+    case 8: // Keep-alive
+        if (length < 5)
+            return false;
+        KeepAliveIntervalMs = DecodeUInt16(data + 3);
+        KeepAliveEndTicks   = Timer::GetTicks() + UInt64(KeepAliveIntervalMs) * 1000;
+        Counters.KeepAlives++;
+        break;
+
+    default:
+        return false;
+    }
+
+    LastCommandId = DecodeUInt16(data + 1);
+    Counters.FeatureReports++;
+    return true;
+}
+
+bool VirtualTrackerDevice::GetFeatureReport(UByte* data, UInt32 length)
+{
+    Lock::Locker lock(&DeviceLock);
+
+    switch (data[0])
+    {
+    case 2: // Config
+        if (length < 7)
+            return false;
+        EncodeUInt16(data + 1, LastCommandId);
+        data[3] = ConfigFlags;
+        data[4] = PacketInterval;
+        EncodeUInt16(data + 5, KeepAliveIntervalMs);
+        return true;
+
+    case 4: // Range
+        if (length < 8)
+            return false;
+        EncodeUInt16(data + 1, LastCommandId);
+        data[3] = AccelScale;
+        EncodeUInt16(data + 4, GyroScale);
+        EncodeUInt16(data + 6, MagScale);
+        return true;
+
+    case 8: // Keep-alive
+        if (length < 5)
+            return false;
+        EncodeUInt16(data + 1, LastCommandId);
+        EncodeUInt16(data + 3, KeepAliveIntervalMs);
+        return true;
+
+    case 9: // DisplayInfo; none.
+        if (length < 56)
+            return false;
+        memset(data + 1, 0, 55);
+        return true;
+    }
+    return false;
+}
+
+
+//-------------------------------------------------------------------------------------
+// ***** VirtualHIDDeviceManager
+
+// Sets the HIDDeviceManager override on the manager thread, where devices are
+// enumerated and opened.
+struct SetHIDDeviceManagerOverride
+{
+    DeviceManagerImpl*  pManager;
+    HIDDeviceManager*   pHIDManager;
+
+    SetHIDDeviceManagerOverride(DeviceManagerImpl* manager, HIDDeviceManager* hidManager)
+        : pManager(manager), pHIDManager(hidManager) { }
+    void operator()() const { pManager->SetHIDDeviceManagerOverride(pHIDManager); }
+};
+
+VirtualHIDDeviceManager::VirtualHIDDeviceManager(HIDDeviceManager* platformManager,
+                                                 ThreadCommandQueue* queue)
+    : pPlatformManager(platformManager), pQueue(queue), NextIndex(0)
+{
+}
+
+VirtualHIDDeviceManager* VirtualHIDDeviceManager::Install(DeviceManager* manager)
+{
+    DeviceManagerImpl*  managerImpl = static_cast<DeviceManagerImpl*>(manager);
+    ThreadCommandQueue* queue       = managerImpl->GetThreadQueue();
+    if (!queue)
+        return 0;
+
+    VirtualHIDDeviceManager* hidManager =
+        new VirtualHIDDeviceManager(managerImpl->GetHIDDeviceManager(), queue);
+
+    if (!queue->PushFunction(SetHIDDeviceManagerOverride(managerImpl, hidManager), true))
+    {
+        hidManager->Release();
+        return 0;
+    }
+    return hidManager;
+}
+
+void VirtualHIDDeviceManager::AddDevice(VirtualTrackerDevice* device)
+{
+    Lock::Locker lock(&DevicesLock);
+
+    char path[32];
+    OVR_sprintf(path, sizeof(path), "virtual:tracker%u", NextIndex++);
+    device->Desc.Path = path;
+    device->SetDeliveryQueue(pQueue);
+    Devices.PushBack(device);
+}
+
+void VirtualHIDDeviceManager::RemoveDevice(VirtualTrackerDevice* device)
+{
+    Lock::Locker lock(&DevicesLock);
+
+    for (UPInt i = 0; i < Devices.GetSize(); i++)
+    {
+        if (Devices[i] == device)
+        {
+            Devices.RemoveAt(i);
+            return;
+        }
+    }
+}
+
+bool VirtualHIDDeviceManager::Enumerate(HIDEnumerateVisitor* enumVisitor)
+{
+    bool result = pPlatformManager ? pPlatformManager->Enumerate(enumVisitor) : true;
+
+    Lock::Locker lock(&DevicesLock);
+
+    for (UPInt i = 0; i < Devices.GetSize(); i++)
+    {
+        const HIDDeviceDesc& desc = Devices[i]->GetDesc();
+        if (enumVisitor->MatchVendorProduct(desc.VendorId, desc.ProductId))
+            enumVisitor->Visit(*Devices[i], desc);
+    }
+    return result;
+}
+
+HIDDevice* VirtualHIDDeviceManager::Open(const String& path)
+{
+    {
+        Lock::Locker lock(&DevicesLock);
+
+        for (UPInt i = 0; i < Devices.GetSize(); i++)
+        {
+            if (Devices[i]->GetDesc().Path.CompareNoCase(path) == 0)
+            {
+                Devices[i]->AddRef();
+                return Devices[i];
+            }
+        }
+    }
+
+    return pPlatformManager ? pPlatformManager->Open(path) : 0;
+}
+
+} // namespace OVR
@@ -0,0 +1,270 @@
+/************************************************************************************
+
+Filename    :   OVR_VirtualTracker.h
+Content     :   In-process tracker HID device for running the sensor stack without
+                hardware
+Created     :   
+Authors     :   
+
+Copyright   :   Copyright 2013 Oculus VR, Inc. All Rights reserved.
+
+Licensed under the Oculus VR SDK License Version 2.0 (the "License"); 
+you may not use the Oculus VR SDK except in compliance with the License, 
+which is provided at the time of installation or download, or which 
+otherwise accompanies this software in either electronic or hard copy form.
+
+You may obtain a copy of the License at
+
+http://www.oculusvr.com/licenses/LICENSE-2.0 
+
+Unless required by applicable law or agreed to in writing, the Oculus VR SDK 
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*************************************************************************************/
+
+#ifndef OVR_VirtualTracker_h
+#define OVR_VirtualTracker_h
+
+#include "OVR_HIDDevice.h"
+#include "OVR_ThreadCommandQueue.h"
+#include "Util/Util_SensorTrace.h"
+
+#include "Kernel/OVR_Threads.h"
+#include "Kernel/OVR_Array.h"
+
+namespace OVR {
+
+class DeviceManager;
+class VirtualTrackerDevice;
+
+//-------------------------------------------------------------------------------------
+// ***** VirtualTrackerMotion
+
+// Supplies the readings a VirtualTrackerDevice reports. Samples are asked for in
+// order, one per tick of the device sample clock, so implementations may keep state
+// from one to the next. Readings are in the frame and units SensorDevice reports
+// them in (m/s^2, rad/s, gauss, degrees C); only Acceleration, RotationRate,
+// MagneticField and Temperature of the record are used.
+
+class VirtualTrackerMotion : public RefCountBase<VirtualTrackerMotion>
+{
+public:
+    virtual ~VirtualTrackerMotion() { }
+
+    virtual void GetSample(UInt64 sampleIndex, unsigned sampleRateHz,
+                           Util::SensorTraceRecord* sample) = 0;
+};
+
+// A head looking around: rotation rates swinging on every axis, with a small gyro
+// bias and noise, and gravity and the earth's field turning with it. The same seed
+// gives the same motion.
+class SyntheticTrackerMotion : public VirtualTrackerMotion
+{
+public:
+    SyntheticTrackerMotion(UInt32 seed = 12345);
+
+    virtual void GetSample(UInt64 sampleIndex, unsigned sampleRateHz,
+                           Util::SensorTraceRecord* sample);
+
+private:
+    float   nextNoise();
+
+    Quatf   Orientation;
+    UInt32  Seed;
+};
+
+// Replays recorded body frames (see Util::SensorTraceRecorder), one per sample,
+// starting over at the end.
+class TraceTrackerMotion : public VirtualTrackerMotion
+{
+public:
+    TraceTrackerMotion() { }
+
+    bool    Load(const char* tracePath);
+    void    SetRecords(const Array<Util::SensorTraceRecord>& records) { Records = records; }
+    UPInt   GetRecordCount() const { return Records.GetSize(); }
+
+    virtual void GetSample(UInt64 sampleIndex, unsigned sampleRateHz,
+                           Util::SensorTraceRecord* sample);
+
+private:
+    Array<Util::SensorTraceRecord> Records;
+};
+
+
+//-------------------------------------------------------------------------------------
+// ***** VirtualTrackerDevice
+
+// A HIDDevice that behaves like the DK1 tracker as far as SensorDevice can tell. It
+// takes a sample from its VirtualTrackerMotion on every tick of its sample clock and
+// sends tracker reports (report 1) the way the firmware does: every PacketInterval+1
+// samples, with Timestamp counting samples and wrapping at 16 bits, SampleCount
+// samples packed into 21-bit fields, the first standing for the average of the older
+// ones when there are more than 3, and the ID of the last feature report received.
+//
+// Config (2), range (4) and keep-alive (8) feature reports are stored and read back;
+// readings are clamped to the range set, and reports stop when the keep-alive runs
+// out, 10 seconds after Start until one arrives. DisplayInfo (9) reads back zeros, as
+// on sensors without display info.
+//
+// The sample clock runs at any rate, so the stack can be pushed past the 1 kHz of
+// the hardware. Timestamp still counts one per sample, which SensorDevice takes as a
+// millisecond, so fused time runs faster than wall time above 1 kHz.
+//
+// Like hidraw, the device queues up to 64 reports until they are read, dropping new
+// ones while the queue is full. With a delivery queue set, which VirtualHIDDeviceManager
+// sets to the DeviceManager thread, queued reports are handed to the handler by a
+// command pushed on that thread, so they arrive where reports from hardware do; a
+// command is only pushed when none is pending, the way one epoll wake-up serves
+// every report pending on an fd. Without one, reports are handed over on the thread
+// that produced them.
+
+class VirtualTrackerDevice : public HIDDevice
+{
+public:
+    enum
+    {
+        VendorId    = 0x2833,
+        ProductId   = 0x0001,
+        ReportSize  = 62,
+        QueueSize   = 64
+    };
+
+    struct Stats
+    {
+        UInt64  Samples;            // Samples taken
+        UInt64  Reports;            // Reports queued
+        UInt64  ReportsDelivered;   // Reports handed to the handler
+        UInt64  ReportsDropped;     // Reports dropped on a full queue
+        UInt64  SilentSamples;      // Samples not reported while the keep-alive ran out
+        UInt32  Deliveries;         // Commands run to deliver queued reports
+        UInt32  FeatureReports;     // Feature reports set
+        UInt32  KeepAlives;         // Keep-alive feature reports among those
+    };
+
+    VirtualTrackerDevice(VirtualTrackerMotion* motion);
+    ~VirtualTrackerDevice();
+
+    // Enumeration descriptor; Path is assigned by VirtualHIDDeviceManager::AddDevice.
+    const HIDDeviceDesc& GetDesc() const      { return Desc; }
+
+    // Timestamp of the first sample; set it just below 0xFFFF to reach the
+    // wrap-around within a few samples. Call before Start or Advance.
+    void    SetFirstTimestamp(UInt16 timestamp) { FirstTimestamp = timestamp; }
+
+    // Starts the thread that runs the sample clock at sampleRateHz. Samples are
+    // produced in bursts once a millisecond, as a full speed USB device is polled.
+    // The thread keeps a reference to the device until Stop.
+    bool    Start(unsigned sampleRateHz = 1000);
+    void    Stop();
+    bool    IsRunning() const                 { return pPacer != 0; }
+
+    // Produces sampleCount samples right away, as if the clock had ticked that many
+    // times at sampleRateHz. For driving the device without its thread.
+    void    Advance(UInt32 sampleCount, unsigned sampleRateHz = 1000);
+
+    // Queue reports are delivered through; see the class comment. The queue must
+    // outlive the device, or be reset to null first.
+    void    SetDeliveryQueue(ThreadCommandQueue* queue);
+
+    Stats   GetStats() const;
+
+    // *** HIDDevice
+    virtual bool SetFeatureReport(UByte* data, UInt32 length);
+    virtual bool GetFeatureReport(UByte* data, UInt32 length);
+
+private:
+    class PacerThread;
+    struct DeliverReports;
+    friend class VirtualHIDDeviceManager;
+
+    void    takeSample_NeedsLock(unsigned sampleRateHz);
+    void    queueReport_NeedsLock();
+    bool    keepAliveRunning_NeedsLock() const;
+    void    deliverReports();
+
+    HIDDeviceDesc           Desc;
+    Ptr<VirtualTrackerMotion> pMotion;
+    Ptr<PacerThread>        pPacer;
+
+    mutable Lock            DeviceLock;
+    ThreadCommandQueue*     pQueue;
+    bool                    DeliveryPending;
+
+    // Sample clock and the samples since the last report.
+    UInt16                  FirstTimestamp;
+    UInt64                  SampleIndex;
+    UInt32                  PendingCount;
+    Vector3f                PendingAccelSum, PendingGyroSum;
+    Util::SensorTraceRecord Recent[3];
+
+    // Feature report state, raw as the firmware keeps it.
+    UInt16                  LastCommandId;
+    UByte                   ConfigFlags;
+    UByte                   PacketInterval;
+    UInt16                  KeepAliveIntervalMs;
+    UInt64                  KeepAliveEndTicks;
+    UByte                   AccelScale;
+    UInt16                  GyroScale;
+    UInt16                  MagScale;
+
+    // Reports waiting for delivery.
+    UByte                   Queue[QueueSize][ReportSize];
+    UInt32                  QueueHead, QueueCount;
+
+    Stats                   Counters;
+};
+
+
+//-------------------------------------------------------------------------------------
+// ***** VirtualHIDDeviceManager
+
+// HIDDeviceManager that enumerates and opens its virtual devices next to the ones of
+// the platform HIDDeviceManager it wraps. Installed into a DeviceManager, sensor
+// enumeration finds the virtual trackers as it would a DK1, and SensorDevice, its
+// keep-alives, SensorFusion and everything above run on them unchanged:
+//
+//      Ptr<VirtualHIDDeviceManager> hid = *VirtualHIDDeviceManager::Install(pManager);
+//      Ptr<VirtualTrackerDevice>    tracker = *new VirtualTrackerDevice(motion);
+//      hid->AddDevice(tracker);
+//      tracker->Start(4000);
+//      pSensor = *pManager->EnumerateDevices<SensorDevice>().CreateDevice();
+//
+// Stop the devices before releasing the DeviceManager, since they deliver through
+// its thread.
+
+class VirtualHIDDeviceManager : public HIDDeviceManager
+{
+public:
+    // Wraps the HIDDeviceManager of manager and makes manager use this one instead,
+    // from its next enumeration on. Returns null if manager has no thread to install
+    // it on.
+    static VirtualHIDDeviceManager* Install(DeviceManager* manager);
+
+    // Adds device, giving it the path "virtual:tracker<n>" and the manager thread to
+    // deliver through. It is reported to the next enumeration.
+    void    AddDevice(VirtualTrackerDevice* device);
+    void    RemoveDevice(VirtualTrackerDevice* device);
+
+    // *** HIDDeviceManager
+    virtual bool        Enumerate(HIDEnumerateVisitor* enumVisitor);
+    virtual HIDDevice*  Open(const String& path);
+
+private:
+    VirtualHIDDeviceManager(HIDDeviceManager* platformManager, ThreadCommandQueue* queue);
+
+    Ptr<HIDDeviceManager>               pPlatformManager;
+    ThreadCommandQueue*                 pQueue;
+
+    // Devices are added from the application thread and enumerated on the manager's.
+    Lock                                DevicesLock;
+    Array<Ptr<VirtualTrackerDevice> >   Devices;
+    UInt32                              NextIndex;
+};
+
+} // namespace OVR
+
+#endif
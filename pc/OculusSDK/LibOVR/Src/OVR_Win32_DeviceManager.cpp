@@ -133,8 +133,9 @@ ThreadId DeviceManager::GetThreadId() const
     
 bool DeviceManager::GetHIDDeviceDesc(const String& path, HIDDeviceDesc* pdevDesc) const
 {
-    if (GetHIDDeviceManager())
-        return static_cast<HIDDeviceManager*>(GetHIDDeviceManager())->GetHIDDeviceDesc(path, pdevDesc);
+    // The platform manager, even with an override installed.
+    if (HidDeviceManager)
+        return static_cast<HIDDeviceManager*>(HidDeviceManager.GetPtr())->GetHIDDeviceDesc(path, pdevDesc);
     return false;
 }
 
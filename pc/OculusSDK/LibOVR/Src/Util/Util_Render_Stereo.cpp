@@ -69,6 +69,73 @@ float DistortionConfig::DistortionFnInverse(float r)
 }
 
 
+//-----------------------------------------------------------------------------------
+// **** DistortionMesh Implementation
+
+void DistortionMesh::Generate(const DistortionConfig& distortion, const Viewport& vp,
+                              int targetWidth, int targetHeight, int gridW, int gridH)
+{
+    OVR_ASSERT(gridW > 0 && gridH > 0);
+    OVR_ASSERT((gridW + 1) * (gridH + 1) <= 65536);
+
+    GridW = gridW;
+    GridH = gridH;
+    Vertices.Resize((gridW + 1) * (gridH + 1));
+
+    // Same setup as the distortion shader uniforms in RenderDevice::FinishScene1.
+    float w = float(vp.w) / float(targetWidth),
+          h = float(vp.h) / float(targetHeight),
+          x = float(vp.x) / float(targetWidth),
+          y = float(vp.y) / float(targetHeight);
+    float as = float(vp.w) / float(vp.h);
+
+    Vector2f lensCenter(x + (w + distortion.XCenterOffset * 0.5f)*0.5f, y + h*0.5f);
+    ScreenCenter = Vector2f(x + w*0.5f, y + h*0.5f);
+
+    float    scaleFactor = 1.0f / distortion.Scale;
+    Vector2f scale((w/2) * scaleFactor, (h/2) * scaleFactor * as);
+    Vector2f scaleIn((2/w), (2/h) / as);
+
+    for (int j = 0; j <= gridH; j++)
+    {
+        for (int i = 0; i <= gridW; i++)
+        {
+            DistortionMeshVertex& v = Vertices[j * (gridW + 1) + i];
+            v.Pos = Vector2f(x + w * float(i) / float(gridW), y + h * float(j) / float(gridH));
+
+            // Scales to [-1, 1] around the lens center, distorts, and scales back.
+            Vector2f theta((v.Pos.x - lensCenter.x) * scaleIn.x, (v.Pos.y - lensCenter.y) * scaleIn.y);
+            float    rsq    = theta.x * theta.x + theta.y * theta.y;
+            Vector2f theta1 = theta * distortion.DistortionFnScaleRSq(rsq);
+            Vector2f tcG(theta1.x * scale.x, theta1.y * scale.y);
+
+            v.TexG = lensCenter + tcG;
+            v.TexR = lensCenter + tcG * distortion.ChromAbScaleRedRSq(rsq);
+            v.TexB = lensCenter + tcG * distortion.ChromAbScaleBlueRSq(rsq);
+        }
+    }
+}
+
+void DistortionMesh::GetTriangleIndices(Array<UInt16>& indices, int baseVertex) const
+{
+    int stride = GridW + 1;
+    for (int j = 0; j < GridH; j++)
+    {
+        for (int i = 0; i < GridW; i++)
+        {
+            UInt16 tl = UInt16(baseVertex + j * stride + i);
+            UInt16 tr = UInt16(tl + 1);
+            UInt16 bl = UInt16(tl + stride);
+            UInt16 br = UInt16(bl + 1);
+
+            // With y pointing down, tl-tr-bl is clockwise on screen.
+            indices.PushBack(tl); indices.PushBack(tr); indices.PushBack(bl);
+            indices.PushBack(tr); indices.PushBack(br); indices.PushBack(bl);
+        }
+    }
+}
+
+
 //-----------------------------------------------------------------------------------
 // **** StereoConfig Implementation
 
@@ -110,10 +110,20 @@ public:
     float  DistortionFn(float r) const
     {        
         float rsq   = r * r;
-        float scale = r * (K[0] + K[1] * rsq + K[2] * rsq * rsq + K[3] * rsq * rsq * rsq);
+        float scale = r * DistortionFnScaleRSq(rsq);
         return scale;
     }
 
+    // The scale DistortionFn applies to a radius, as a function of radius squared.
+    float  DistortionFnScaleRSq(float rsq) const
+    {
+        return K[0] + K[1] * rsq + K[2] * rsq * rsq + K[3] * rsq * rsq * rsq;
+    }
+
+    // Additional scale applied after distortion to the red and blue channels.
+    float  ChromAbScaleRedRSq(float rsq) const  { return ChromaticAberration[0] + ChromaticAberration[1] * rsq; }
+    float  ChromAbScaleBlueRSq(float rsq) const { return ChromaticAberration[2] + ChromaticAberration[3] * rsq; }
+
     // DistortionFnInverse computes the inverse of the distortion function on an argument.
     float DistortionFnInverse(float r);
 
@@ -159,6 +169,48 @@ public:
 };
 
 
+//-----------------------------------------------------------------------------------
+// ***** DistortionMesh
+
+// DistortionMesh is a grid covering one eye's viewport, holding at each vertex the
+// texture coordinates that the distortion shader would compute there for the red,
+// green and blue channels. Rendering the scene texture through it with plain
+// texturing replaces evaluating the distortion polynomial per pixel; the result
+// is interpolated linearly between vertices, so the grid needs to be fine enough
+// for the curvature.
+//
+// Positions and texture coordinates are in [0,1] units of the full render target,
+// with y pointing down. Texture coordinates are those of the post-process shader,
+// so may fall outside of the eye's half of the screen (ScreenCenter +- (0.25, 0.5)),
+// where the shader renders black.
+
+struct DistortionMeshVertex
+{
+    Vector2f Pos;
+    Vector2f TexR, TexG, TexB;
+};
+
+class DistortionMesh
+{
+public:
+    DistortionMesh() : GridW(0), GridH(0) { }
+
+    // Builds a gridW x gridH cell mesh for the eye viewport vp within a render target
+    // of the given size. distortion.XCenterOffset must already be mirrored for the
+    // right eye, as RenderDevice::SetDistortionConfig does.
+    void Generate(const DistortionConfig& distortion, const Viewport& vp,
+                  int targetWidth, int targetHeight, int gridW = 32, int gridH = 32);
+
+    // Appends indices for a triangle list covering the grid, with clockwise winding
+    // on screen. baseVertex is added to every index.
+    void GetTriangleIndices(Array<UInt16>& indices, int baseVertex = 0) const;
+
+    int                          GridW, GridH;
+    Vector2f                     ScreenCenter;
+    Array<DistortionMeshVertex>  Vertices;  // (GridW+1) * (GridH+1), row by row from the top.
+};
+
+
 //-----------------------------------------------------------------------------------
 // *****  StereoConfig
 
@@ -235,6 +287,7 @@ public:
 
     // Sets the fieldOfView that the 2D coordinate area stretches to.
     void        Set2DAreaFov(float fovRadians);
+    float       Get2DAreaFov() const            { return Area2DFov; }
 
 
     // *** Computed State
@@ -0,0 +1,240 @@
+/************************************************************************************
+
+Filename    :   Util_SensorFusionFarm.cpp
+Content     :   Parallel runs of differently configured SensorFusions over a trace
+Created     :   October 17, 2026
+
+Copyright   :   Copyright 2013 Oculus VR, Inc. All Rights reserved.
+
+Licensed under the Oculus VR SDK License Version 2.0 (the "License"); 
+you may not use the Oculus VR SDK except in compliance with the License, 
+which is provided at the time of installation or download, or which 
+otherwise accompanies this software in either electronic or hard copy form.
+
+You may obtain a copy of the License at
+
+http://www.oculusvr.com/licenses/LICENSE-2.0 
+
+Unless required by applicable law or agreed to in writing, the Oculus VR SDK 
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*************************************************************************************/
+
+#include "Util_SensorFusionFarm.h"
+
+#include "../Kernel/OVR_Threads.h"
+#include "../Kernel/OVR_Timer.h"
+
+namespace OVR { namespace Util {
+
+// Configurations still to run by one worker, [Begin, End).
+struct FarmQueue
+{
+    Lock    QueueLock;
+    int     Begin, End;
+
+    // Takes the first configuration, returning -1 if there is none.
+    int     Pop()
+    {
+        Lock::Locker lockScope(&QueueLock);
+        return (Begin < End) ? Begin++ : -1;
+    }
+
+    // Gives away the back half of the queue, or false if there's nothing to spare.
+    bool    Steal(int* begin, int* end)
+    {
+        Lock::Locker lockScope(&QueueLock);
+        int count = End - Begin;
+        if (count <= 0)
+            return false;
+        *end   = End;
+        End   -= (count + 1) / 2;
+        *begin = End;
+        return true;
+    }
+
+    void    Set(int begin, int end)
+    {
+        Lock::Locker lockScope(&QueueLock);
+        Begin = begin;
+        End   = end;
+    }
+};
+
+struct FarmJob
+{
+    const Array<SensorTraceRecord>*      pTrace;
+    const Array<OrientationTraceRecord>* pReference;
+    const Array<SensorFusionConfig>*     pConfigs;
+    SensorFusionFarmResult*              pResults;
+    FarmQueue*                           pQueues;
+    int                                  QueueCount;
+};
+
+struct FarmWorker
+{
+    FarmJob*    pJob;
+    int         Index;
+};
+
+static int farmWorkerFn(Thread*, void* h)
+{
+    FarmWorker* worker = (FarmWorker*)h;
+    FarmJob*    job    = worker->pJob;
+    FarmQueue&  own    = job->pQueues[worker->Index];
+
+    while (true)
+    {
+        int i = own.Pop();
+        if (i < 0)
+        {
+            // Steal from the others, starting with the next one so thieves spread out.
+            bool stolen = false;
+            for (int n = 1; n < job->QueueCount && !stolen; n++)
+            {
+                int begin, end;
+                if (job->pQueues[(worker->Index + n) % job->QueueCount].Steal(&begin, &end))
+                {
+                    own.Set(begin, end);
+                    stolen = true;
+                }
+            }
+            if (!stolen)
+                break;
+            continue;
+        }
+
+        job->pResults[i] = SensorFusionFarm::RunOne(*job->pTrace, *job->pReference, (*job->pConfigs)[i]);
+    }
+    return 0;
+}
+
+void SensorFusionFarm::Run(const Array<SensorTraceRecord>& trace,
+                           const Array<OrientationTraceRecord>& reference,
+                           const Array<SensorFusionConfig>& configs,
+                           Array<SensorFusionFarmResult>* results, int threadCount)
+{
+    UInt64 start = Timer::GetTicks();
+
+    int configCount = (int)configs.GetSize();
+    results->Resize(configCount);
+    if (configCount == 0)
+    {
+        LastRunSeconds = 0;
+        return;
+    }
+
+    if (threadCount <= 0)
+        threadCount = Thread::GetCPUCount();
+    threadCount = Alg::Min(threadCount, configCount);
+
+    FarmQueue*  queues  = new FarmQueue[threadCount];
+    FarmWorker* workers = new FarmWorker[threadCount];
+
+    FarmJob job;
+    job.pTrace     = &trace;
+    job.pReference = &reference;
+    job.pConfigs   = &configs;
+    job.pResults   = &(*results)[0];
+    job.pQueues    = queues;
+    job.QueueCount = threadCount;
+
+    for (int i = 0; i < threadCount; i++)
+    {
+        queues[i].Set(configCount * i / threadCount, configCount * (i + 1) / threadCount);
+        workers[i].pJob  = &job;
+        workers[i].Index = i;
+    }
+
+    // The calling thread works as the first worker.
+    Array<Ptr<Thread> > threads;
+    for (int i = 1; i < threadCount; i++)
+    {
+        Ptr<Thread> thread = *new Thread(farmWorkerFn, &workers[i]);
+        if (thread->Start())
+            threads.PushBack(thread);
+    }
+    farmWorkerFn(0, &workers[0]);
+
+    for (UPInt i = 0; i < threads.GetSize(); i++)
+    {
+        while (!threads[i]->IsFinished())
+            Thread::MSleep(1);
+    }
+
+    delete[] workers;
+    delete[] queues;
+
+    LastRunSeconds = (double)(Timer::GetTicks() - start) / Timer::MksPerSecond;
+}
+
+// Angle between two orientations, in degrees. The fusion only renormalizes its
+// quaternion now and then, and acos of their dot product would turn that into errors
+// of tenths of a degree, so the angle is taken from the normalized difference instead.
+static float orientationError(const Quatf& a, const Quatf& b)
+{
+    Quatd qa(a.x, a.y, a.z, a.w), qb(b.x, b.y, b.z, b.w);
+    qa.Normalize();
+    qb.Normalize();
+    Quatd  d    = qa.Inverted() * qb;
+    double sinH = sqrt(d.x*d.x + d.y*d.y + d.z*d.z);
+    return (float)RadToDegree(2.0 * atan2(sinH, fabs(d.w)));
+}
+
+SensorFusionFarmResult SensorFusionFarm::RunOne(const Array<SensorTraceRecord>& trace,
+                                                const Array<OrientationTraceRecord>& reference,
+                                                const SensorFusionConfig& config)
+{
+    SensorFusion* fusion = new SensorFusion();
+    fusion->SetConfig(config);
+
+    SensorFusionFarmResult result;
+    result.Compared  = 0;
+    result.MeanError = 0;
+    result.RmsError  = 0;
+    result.MaxError  = 0;
+
+    double           sum = 0, sumSq = 0;
+    UPInt            ref = 0, refCount = reference.GetSize();
+    MessageBodyFrame msg(0);
+
+    for (UPInt i = 0; i < trace.GetSize(); i++)
+    {
+        trace[i].ToMessage(&msg);
+        fusion->OnMessage(msg);
+
+        // Compare with the reference records up to the next sample.
+        UInt64 nextTime = (i + 1 < trace.GetSize()) ? trace[i + 1].AbsoluteTimeMks : ~(UInt64)0;
+        if (ref < refCount && reference[ref].TimeMks < nextTime)
+        {
+            Quatf q = fusion->GetOrientation();
+            for (; ref < refCount && reference[ref].TimeMks < nextTime; ref++)
+            {
+                if (reference[ref].TimeMks < trace[i].AbsoluteTimeMks)
+                    continue; // Before the trace started
+
+                float error = orientationError(q, reference[ref].Orientation);
+
+                sum   += error;
+                sumSq += error * error;
+                result.MaxError = Alg::Max(result.MaxError, error);
+                result.Compared++;
+            }
+        }
+    }
+
+    if (result.Compared > 0)
+    {
+        result.MeanError = (float)(sum / result.Compared);
+        result.RmsError  = (float)sqrt(sumSq / result.Compared);
+    }
+
+    delete fusion;
+    return result;
+}
+
+
+}} // namespace OVR::Util
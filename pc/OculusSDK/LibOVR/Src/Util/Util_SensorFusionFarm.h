@@ -0,0 +1,84 @@
+/************************************************************************************
+
+PublicHeader:   OVR.h
+Filename    :   Util_SensorFusionFarm.h
+Content     :   Parallel runs of differently configured SensorFusions over a trace
+Created     :   October 17, 2026
+
+Copyright   :   Copyright 2013 Oculus VR, Inc. All Rights reserved.
+
+Licensed under the Oculus VR SDK License Version 2.0 (the "License"); 
+you may not use the Oculus VR SDK except in compliance with the License, 
+which is provided at the time of installation or download, or which 
+otherwise accompanies this software in either electronic or hard copy form.
+
+You may obtain a copy of the License at
+
+http://www.oculusvr.com/licenses/LICENSE-2.0 
+
+Unless required by applicable law or agreed to in writing, the Oculus VR SDK 
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*************************************************************************************/
+
+#ifndef OVR_Util_SensorFusionFarm_h
+#define OVR_Util_SensorFusionFarm_h
+
+#include "Util_SensorTrace.h"
+
+namespace OVR { namespace Util {
+
+//-------------------------------------------------------------------------------------
+// ***** SensorFusionFarm
+//
+// Runs a recorded trace through one SensorFusion per configuration, spread over worker
+// threads, and scores each against a reference orientation trace. This is meant for
+// sweeping the gains in SensorFusionConfig over recorded flights.
+//
+// Each worker starts with an even share of the configurations and takes them from the
+// front; a worker that runs out steals half of the remaining share of another one.
+// Workers only share the read-only trace, so the run time goes down with the number
+// of cores until there are fewer configurations than workers.
+
+// Orientation error of one configuration, in degrees.
+struct SensorFusionFarmResult
+{
+    UInt32      Compared;           // Reference records compared
+    float       MeanError;
+    float       RmsError;
+    float       MaxError;
+};
+
+class SensorFusionFarm
+{
+public:
+    SensorFusionFarm() : LastRunSeconds(0) { }
+
+    // Runs trace through a SensorFusion for each of configs and compares the orientation
+    // at each reference record's time (that of the last sample at or before it) with
+    // the reference. results gets one entry per configuration. threadCount 0 uses one
+    // thread per CPU.
+    void    Run(const Array<SensorTraceRecord>& trace,
+                const Array<OrientationTraceRecord>& reference,
+                const Array<SensorFusionConfig>& configs,
+                Array<SensorFusionFarmResult>* results, int threadCount = 0);
+
+    // Wall clock time of the last Run.
+    double  GetLastRunSeconds() const   { return LastRunSeconds; }
+
+    // Runs a single configuration on the calling thread.
+    static SensorFusionFarmResult RunOne(const Array<SensorTraceRecord>& trace,
+                                         const Array<OrientationTraceRecord>& reference,
+                                         const SensorFusionConfig& config);
+
+private:
+    double  LastRunSeconds;
+};
+
+
+}} // namespace OVR::Util
+
+#endif // OVR_Util_SensorFusionFarm_h
@@ -0,0 +1,314 @@
+/************************************************************************************
+
+Filename    :   Util_SensorTrace.cpp
+Content     :   Recording of sensor data to a file, and replay into SensorFusion
+Created     :   October 17, 2026
+
+Copyright   :   Copyright 2013 Oculus VR, Inc. All Rights reserved.
+
+Licensed under the Oculus VR SDK License Version 2.0 (the "License"); 
+you may not use the Oculus VR SDK except in compliance with the License, 
+which is provided at the time of installation or download, or which 
+otherwise accompanies this software in either electronic or hard copy form.
+
+You may obtain a copy of the License at
+
+http://www.oculusvr.com/licenses/LICENSE-2.0 
+
+Unless required by applicable law or agreed to in writing, the Oculus VR SDK 
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*************************************************************************************/
+
+#include "Util_SensorTrace.h"
+
+#include "../Kernel/OVR_SysFile.h"
+#include "../Kernel/OVR_Timer.h"
+#include "../Kernel/OVR_Std.h"
+
+#include <string.h>
+
+namespace OVR { namespace Util {
+
+static const UByte  TraceMagic[4]   = { 'O', 'V', 'R', 'T' };
+static const UInt16 TraceVersion    = 1;
+static const UInt16 TraceRecordSize = 52;
+
+
+//-------------------------------------------------------------------------------------
+// ***** SensorTraceRecord
+
+void SensorTraceRecord::FromMessage(const MessageBodyFrame& msg)
+{
+    AbsoluteTimeMks = msg.AbsoluteTimeMks;
+    TimeDelta       = msg.TimeDelta;
+    Acceleration    = msg.Acceleration;
+    RotationRate    = msg.RotationRate;
+    MagneticField   = msg.MagneticField;
+    Temperature     = msg.Temperature;
+}
+
+void SensorTraceRecord::ToMessage(MessageBodyFrame* msg) const
+{
+    msg->AbsoluteTimeMks = AbsoluteTimeMks;
+    msg->TimeDelta       = TimeDelta;
+    msg->Acceleration    = Acceleration;
+    msg->RotationRate    = RotationRate;
+    msg->MagneticField   = MagneticField;
+    msg->Temperature     = Temperature;
+}
+
+static void writeVector(File* file, const Vector3f& v)
+{
+    file->WriteFloat(v.x);
+    file->WriteFloat(v.y);
+    file->WriteFloat(v.z);
+}
+
+static float decodeFloat(const UByte* p)
+{
+    float v;
+    memcpy(&v, p, 4);
+    return Alg::ByteUtil::LEToSystem(v);
+}
+
+static Vector3f decodeVector(const UByte* p)
+{
+    return Vector3f(decodeFloat(p), decodeFloat(p + 4), decodeFloat(p + 8));
+}
+
+
+//-------------------------------------------------------------------------------------
+// ***** SensorTraceRecorder
+
+SensorTraceRecorder::SensorTraceRecorder() : RecordCount(0)
+{
+}
+
+SensorTraceRecorder::~SensorTraceRecorder()
+{
+    RemoveHandlerFromDevices();
+    Close();
+}
+
+bool SensorTraceRecorder::Open(const char* path)
+{
+    Ptr<File> file = *new SysFile(path, File::Open_Write | File::Open_Create |
+                                        File::Open_Truncate | File::Open_Buffered);
+    if (!file->IsValid())
+        return false;
+
+    file->Write(TraceMagic, 4);
+    file->WriteUInt16(TraceVersion);
+    file->WriteUInt16(TraceRecordSize);
+
+    Lock::Locker lockScope(&FileLock);
+    if (pFile)
+        pFile->Close();
+    pFile       = file;
+    RecordCount = 0;
+    return true;
+}
+
+void SensorTraceRecorder::Close()
+{
+    Lock::Locker lockScope(&FileLock);
+    if (pFile)
+    {
+        pFile->Close();
+        pFile.Clear();
+    }
+}
+
+bool SensorTraceRecorder::IsOpen() const
+{
+    Lock::Locker lockScope(&FileLock);
+    return pFile.GetPtr() != 0;
+}
+
+void SensorTraceRecorder::OnMessage(const Message& msg)
+{
+    if (msg.Type != Message_BodyFrame)
+        return;
+
+    const MessageBodyFrame& frame = static_cast<const MessageBodyFrame&>(msg);
+
+    Lock::Locker lockScope(&FileLock);
+    if (!pFile)
+        return;
+
+    pFile->WriteUInt64(frame.AbsoluteTimeMks);
+    pFile->WriteFloat(frame.TimeDelta);
+    writeVector(pFile, frame.Acceleration);
+    writeVector(pFile, frame.RotationRate);
+    writeVector(pFile, frame.MagneticField);
+    pFile->WriteFloat(frame.Temperature);
+    RecordCount++;
+}
+
+
+//-------------------------------------------------------------------------------------
+// ***** SensorTraceReader
+
+bool SensorTraceReader::Open(const char* path)
+{
+    pFile = *new SysFile(path, File::Open_Read | File::Open_Buffered);
+    if (!pFile->IsValid())
+    {
+        pFile.Clear();
+        return false;
+    }
+
+    UByte magic[4];
+    if (pFile->Read(magic, 4) != 4 || memcmp(magic, TraceMagic, 4) != 0)
+    {
+        pFile.Clear();
+        return false;
+    }
+    pFile->ReadUInt16(); // Version; newer ones only add fields
+    RecordSize = pFile->ReadUInt16();
+    if (RecordSize < TraceRecordSize)
+    {
+        pFile.Clear();
+        return false;
+    }
+    return true;
+}
+
+bool SensorTraceReader::ReadRecord(SensorTraceRecord* record)
+{
+    if (!pFile)
+        return false;
+
+    UByte buffer[TraceRecordSize];
+    if (pFile->Read(buffer, TraceRecordSize) != TraceRecordSize)
+        return false;
+    if (RecordSize > TraceRecordSize)
+        pFile->SkipBytes(RecordSize - TraceRecordSize);
+
+    UInt64 time;
+    memcpy(&time, buffer, 8);
+    record->AbsoluteTimeMks = Alg::ByteUtil::LEToSystem(time);
+    record->TimeDelta       = decodeFloat(buffer + 8);
+    record->Acceleration    = decodeVector(buffer + 12);
+    record->RotationRate    = decodeVector(buffer + 24);
+    record->MagneticField   = decodeVector(buffer + 36);
+    record->Temperature     = decodeFloat(buffer + 48);
+    return true;
+}
+
+bool SensorTraceReader::ReadAll(Array<SensorTraceRecord>* records)
+{
+    if (!pFile)
+        return false;
+
+    SensorTraceRecord record;
+    while (ReadRecord(&record))
+        records->PushBack(record);
+    return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+// ***** Replay
+
+bool ReplaySensorTrace(const char* tracePath, SensorFusion& fusion,
+                       const char* orientationPath, SensorTraceReplayStats* stats)
+{
+    SensorTraceReader         reader;
+    Array<SensorTraceRecord>  records;
+    if (!reader.Open(tracePath) || !reader.ReadAll(&records))
+        return false;
+
+    Ptr<File> out;
+    if (orientationPath)
+    {
+        out = *new SysFile(orientationPath, File::Open_Write | File::Open_Create |
+                                            File::Open_Truncate | File::Open_Buffered);
+        if (!out->IsValid())
+            return false;
+    }
+
+    // Orientations are kept in memory so writing them doesn't count towards the time.
+    Array<Quatf> orientations;
+    if (out)
+        orientations.Resize(records.GetSize());
+
+    MessageBodyFrame msg(0);
+    UInt64 start = Timer::GetTicks();
+    for (UPInt i = 0; i < records.GetSize(); i++)
+    {
+        records[i].ToMessage(&msg);
+        fusion.OnMessage(msg);
+        if (out)
+            orientations[i] = fusion.GetOrientation();
+    }
+    double seconds = (double)(Timer::GetTicks() - start) / Timer::MksPerSecond;
+
+    if (out)
+    {
+        char line[128];
+        for (UPInt i = 0; i < records.GetSize(); i++)
+        {
+            const Quatf& q = orientations[i];
+            int length = (int)OVR_sprintf(line, sizeof(line), "%llu %.9g %.9g %.9g %.9g\n",
+                                          (unsigned long long)records[i].AbsoluteTimeMks,
+                                          q.x, q.y, q.z, q.w);
+            out->Write((const UByte*)line, length);
+        }
+        out->Close();
+    }
+
+    if (stats)
+    {
+        stats->Samples          = (UInt32)records.GetSize();
+        stats->Seconds          = seconds;
+        stats->SamplesPerSecond = (seconds > 0) ? records.GetSize() / seconds : 0;
+        stats->FinalOrientation = fusion.GetOrientation();
+    }
+    return true;
+}
+
+bool LoadOrientationTrace(const char* path, Array<OrientationTraceRecord>* records)
+{
+    SysFile file(path, File::Open_Read | File::Open_Buffered);
+    if (!file.IsValid())
+        return false;
+
+    int         length = file.GetLength();
+    Array<char> text;
+    text.Resize(length + 1);
+    if (file.Read((UByte*)&text[0], length) != length)
+        return false;
+    text[length] = 0;
+
+    char* p = &text[0];
+    while (*p)
+    {
+        char* end;
+        OrientationTraceRecord record;
+        record.TimeMks = OVR_strtouq(p, &end, 10);
+        if (end != p)
+        {
+            p = end;
+            record.Orientation.x = (float)OVR_strtod(p, &p);
+            record.Orientation.y = (float)OVR_strtod(p, &p);
+            record.Orientation.z = (float)OVR_strtod(p, &p);
+            record.Orientation.w = (float)OVR_strtod(p, &p);
+            records->PushBack(record);
+        }
+
+        // On to the next line.
+        while (*p && *p != '\n')
+            p++;
+        if (*p)
+            p++;
+    }
+    return true;
+}
+
+
+}} // namespace OVR::Util
@@ -0,0 +1,156 @@
+/************************************************************************************
+
+PublicHeader:   OVR.h
+Filename    :   Util_SensorTrace.h
+Content     :   Recording of sensor data to a file, and replay into SensorFusion
+Created     :   October 17, 2026
+
+Copyright   :   Copyright 2013 Oculus VR, Inc. All Rights reserved.
+
+Licensed under the Oculus VR SDK License Version 2.0 (the "License"); 
+you may not use the Oculus VR SDK except in compliance with the License, 
+which is provided at the time of installation or download, or which 
+otherwise accompanies this software in either electronic or hard copy form.
+
+You may obtain a copy of the License at
+
+http://www.oculusvr.com/licenses/LICENSE-2.0 
+
+Unless required by applicable law or agreed to in writing, the Oculus VR SDK 
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*************************************************************************************/
+
+#ifndef OVR_Util_SensorTrace_h
+#define OVR_Util_SensorTrace_h
+
+#include "../OVR_Device.h"
+#include "../OVR_SensorFusion.h"
+
+#include "../Kernel/OVR_File.h"
+#include "../Kernel/OVR_Array.h"
+
+namespace OVR { namespace Util {
+
+//-------------------------------------------------------------------------------------
+// ***** Sensor trace files
+//
+// A trace holds the MessageBodyFrame values a sensor delivered, so the same input can
+// be run through SensorFusion again without an HMD: to check that a change to the
+// fusion doesn't change its output, and to measure how fast it runs.
+//
+// The file is little endian: an 8 byte header (the characters "OVRT", then a UInt16
+// version and a UInt16 record size) followed by one record per body frame:
+//
+//   UInt64  AbsoluteTimeMks
+//   float   TimeDelta
+//   float   Acceleration x, y, z
+//   float   RotationRate x, y, z
+//   float   MagneticField x, y, z
+//   float   Temperature
+//
+// Readers skip any bytes past the fields they know, so records can grow.
+
+struct SensorTraceRecord
+{
+    UInt64      AbsoluteTimeMks;
+    float       TimeDelta;
+    Vector3f    Acceleration;
+    Vector3f    RotationRate;
+    Vector3f    MagneticField;
+    float       Temperature;
+
+    SensorTraceRecord() : AbsoluteTimeMks(0), TimeDelta(0), Temperature(0) { }
+
+    void        FromMessage(const MessageBodyFrame& msg);
+    void        ToMessage(MessageBodyFrame* msg) const;
+};
+
+
+// Writes body frames to a trace as they arrive. It is meant to be installed with
+// SensorFusion::SetDelegateMessageHandler, so it records exactly what the fusion saw:
+//
+//      recorder.Open("head.trace");
+//      SFusion.SetDelegateMessageHandler(&recorder);
+
+class SensorTraceRecorder : public MessageHandler
+{
+public:
+    SensorTraceRecorder();
+    ~SensorTraceRecorder();
+
+    bool        Open(const char* path);
+    void        Close();
+    bool        IsOpen() const;
+
+    UInt32      GetRecordCount() const  { return RecordCount; }
+
+    virtual void OnMessage(const Message& msg);
+    virtual bool SupportsMessageType(MessageType type) const { return type == Message_BodyFrame; }
+
+private:
+    // Messages come in on the sensor thread while Open and Close are called from
+    // another one.
+    mutable Lock    FileLock;
+    Ptr<File>       pFile;
+    UInt32          RecordCount;
+};
+
+
+// Reads a trace record by record.
+
+class SensorTraceReader
+{
+public:
+    SensorTraceReader() : RecordSize(0) { }
+
+    bool        Open(const char* path);
+    void        Close()                 { pFile.Clear(); }
+
+    // Reads the next record, returning false at the end of the trace.
+    bool        ReadRecord(SensorTraceRecord* record);
+
+    // Reads all the remaining records.
+    bool        ReadAll(Array<SensorTraceRecord>* records);
+
+private:
+    Ptr<File>   pFile;
+    int         RecordSize;
+};
+
+
+// Result of ReplaySensorTrace.
+struct SensorTraceReplayStats
+{
+    UInt32      Samples;
+    double      Seconds;            // Time spent in the fusion, without file IO
+    double      SamplesPerSecond;
+    Quatf       FinalOrientation;
+};
+
+// Loads a trace and feeds it to fusion as fast as the CPU allows. fusion must not be
+// attached to a sensor. If orientationPath is given, the orientation after every
+// sample is written there as a line of text ("time x y z w"), so two builds can be
+// compared with diff. Returns false if the trace or output file couldn't be opened.
+bool ReplaySensorTrace(const char* tracePath, SensorFusion& fusion,
+                       const char* orientationPath = 0, SensorTraceReplayStats* stats = 0);
+
+
+// Orientation at a time, as written by ReplaySensorTrace.
+struct OrientationTraceRecord
+{
+    UInt64      TimeMks;
+    Quatf       Orientation;
+};
+
+// Loads the orientations written by ReplaySensorTrace, or any text file with the same
+// "time x y z w" lines, such as a motion capture reference. Records are in file order.
+bool LoadOrientationTrace(const char* path, Array<OrientationTraceRecord>* records);
+
+
+}} // namespace OVR::Util
+
+#endif // OVR_Util_SensorTrace_h
@@ -121,6 +121,67 @@ static const char* TexturePixelShaderSrc =
     "   return color2;\n"
     "}\n";
 
+// Packed 4:2:2 YUV. Each RGBA texel holds two pixels sharing U and V. Filtering
+// texels would blend neighbouring pairs, so the texture is point sampled and
+// YuvPixel unpacks one pixel at a time; main filters the four pixels around the
+// sample point, the same way as the GL shaders. TexSize is in pixels. YUV frames
+// are top-down, unlike our RGB textures.
+#define YUV_COMMON                                                      \
+    "Texture2D Texture : register(t0);\n"                               \
+    "SamplerState Point : register(s0);\n"                              \
+    "float2 TexSize;\n"                                                 \
+    "struct Varyings\n"                                                 \
+    "{\n"                                                               \
+    "   float4 Position : SV_Position;\n"                               \
+    "   float4 Color    : COLOR0;\n"                                    \
+    "   float2 TexCoord : TEXCOORD0;\n"                                 \
+    "};\n"                                                              \
+    "float4 YuvToRgb(float3 yuv)\n"                                     \
+    "{\n"                                                               \
+    "   float y = 1.164 * (yuv.x - 0.0625);\n"                          \
+    "   float u = yuv.y - 0.5;\n"                                       \
+    "   float v = yuv.z - 0.5;\n"                                       \
+    "   return float4(saturate(float3(y + 1.596 * v, y - 0.392 * u - 0.813 * v, y + 2.017 * u)), 1);\n" \
+    "}\n"                                                               \
+    "float4 YuvTexel(float2 p, out float odd)\n"                        \
+    "{\n"                                                               \
+    "   p = clamp(p, 0, TexSize - 1);\n"                                \
+    "   float pair = floor(p.x * 0.5);\n"                               \
+    "   odd = p.x - 2 * pair;\n"                                        \
+    "   return Texture.Sample(Point, float2((pair + 0.5) / (TexSize.x * 0.5), (p.y + 0.5) / TexSize.y));\n" \
+    "}\n"
+
+#define YUV_MAIN                                                        \
+    "float4 main(in Varyings ov) : SV_Target\n"                         \
+    "{\n"                                                               \
+    "   float2 p = float2(ov.TexCoord.x, 1 - ov.TexCoord.y) * TexSize - 0.5;\n" \
+    "   float2 f = frac(p);\n"                                          \
+    "   p = floor(p);\n"                                                \
+    "   float3 yuv = lerp(lerp(YuvPixel(p), YuvPixel(p + float2(1, 0)), f.x),\n" \
+    "                     lerp(YuvPixel(p + float2(0, 1)), YuvPixel(p + float2(1, 1)), f.x), f.y);\n" \
+    "   return ov.Color * YuvToRgb(yuv);\n"                             \
+    "}\n"
+
+static const char* TextureYUY2PixelShaderSrc =
+    YUV_COMMON
+    "float3 YuvPixel(float2 p)\n"
+    "{\n"
+    "   float  odd;\n"
+    "   float4 yuyv = YuvTexel(p, odd);\n"
+    "   return float3(lerp(yuyv.r, yuyv.b, odd), yuyv.g, yuyv.a);\n"
+    "}\n"
+    YUV_MAIN;
+
+static const char* TextureUYVYPixelShaderSrc =
+    YUV_COMMON
+    "float3 YuvPixel(float2 p)\n"
+    "{\n"
+    "   float  odd;\n"
+    "   float4 uyvy = YuvTexel(p, odd);\n"
+    "   return float3(lerp(uyvy.g, uyvy.a, odd), uyvy.r, uyvy.b);\n"
+    "}\n"
+    YUV_MAIN;
+
 static const char* MultiTexturePixelShaderSrc =
     "Texture2D Texture[2] : register(t0);\n"
     "SamplerState Linear : register(s0);\n"
@@ -297,11 +358,126 @@ static const char* PostProcessPixelShaderWithChromAbSrc =
     "}\n";
 
 
+// Distortion for both eyes of a side by side scene in one pass. The eye is picked by
+// which side of SplitX the pixel is on; LensCenters and ScreenCenters hold the
+// left eye's value in xy and the right eye's in zw.
+#define POSTPROCESS_STEREO_COMMON                                        \
+    "Texture2D Texture : register(t0);\n"                               \
+    "SamplerState Linear : register(s0);\n"                             \
+    "float4 LensCenters;\n"                                             \
+    "float4 ScreenCenters;\n"                                           \
+    "float  SplitX;\n"                                                  \
+    "float2 Scale;\n"                                                   \
+    "float2 ScaleIn;\n"                                                 \
+    "float4 HmdWarpParam;\n"                                            \
+    "void SelectEye(float2 tc, out float2 lensCenter, out float2 screenCenter)\n" \
+    "{\n"                                                               \
+    "   bool rightEye = tc.x >= SplitX;\n"                              \
+    "   lensCenter   = rightEye ? LensCenters.zw   : LensCenters.xy;\n" \
+    "   screenCenter = rightEye ? ScreenCenters.zw : ScreenCenters.xy;\n" \
+    "}\n"
+
+static const char* PostProcessStereoPixelShaderSrc =
+    POSTPROCESS_STEREO_COMMON
+    "float4 main(in float4 oPosition : SV_Position, in float4 oColor : COLOR,\n"
+    " in float2 oTexCoord : TEXCOORD0) : SV_Target\n"
+    "{\n"
+    "   float2 lensCenter, screenCenter;\n"
+    "   SelectEye(oTexCoord, lensCenter, screenCenter);\n"
+    "   float2 theta = (oTexCoord - lensCenter) * ScaleIn;\n"
+    "   float  rSq = theta.x * theta.x + theta.y * theta.y;\n"
+    "   float2 theta1 = theta * (HmdWarpParam.x + HmdWarpParam.y * rSq + "
+    "                   HmdWarpParam.z * rSq * rSq + HmdWarpParam.w * rSq * rSq * rSq);\n"
+    "   float2 tc = lensCenter + Scale * theta1;\n"
+    "   if (any(clamp(tc, screenCenter-float2(0.25,0.5), screenCenter+float2(0.25, 0.5)) - tc))\n"
+    "       return 0;\n"
+    "   return Texture.Sample(Linear, tc);\n"
+    "}\n";
+
+static const char* PostProcessStereoPixelShaderWithChromAbSrc =
+    POSTPROCESS_STEREO_COMMON
+    "float4 ChromAbParam;\n"
+    "float4 main(in float4 oPosition : SV_Position, in float4 oColor : COLOR,\n"
+    "            in float2 oTexCoord : TEXCOORD0) : SV_Target\n"
+    "{\n"
+    "   float2 lensCenter, screenCenter;\n"
+    "   SelectEye(oTexCoord, lensCenter, screenCenter);\n"
+    "   float2 theta = (oTexCoord - lensCenter) * ScaleIn;\n"
+    "   float  rSq = theta.x * theta.x + theta.y * theta.y;\n"
+    "   float2 theta1 = theta * (HmdWarpParam.x + HmdWarpParam.y * rSq + "
+    "                   HmdWarpParam.z * rSq * rSq + HmdWarpParam.w * rSq * rSq * rSq);\n"
+    "   float2 thetaBlue = theta1 * (ChromAbParam.z + ChromAbParam.w * rSq);\n"
+    "   float2 tcBlue = lensCenter + Scale * thetaBlue;\n"
+    "   if (any(clamp(tcBlue, screenCenter-float2(0.25,0.5), screenCenter+float2(0.25, 0.5)) - tcBlue))\n"
+    "       return 0;\n"
+    "   float  blue = Texture.Sample(Linear, tcBlue).b;\n"
+    "   float2 tcGreen = lensCenter + Scale * theta1;\n"
+    "   float4 greenColor = Texture.Sample(Linear, tcGreen);\n"
+    "   float2 thetaRed = theta1 * (ChromAbParam.x + ChromAbParam.y * rSq);\n"
+    "   float2 tcRed = lensCenter + Scale * thetaRed;\n"
+    "   float  red = Texture.Sample(Linear, tcRed).r;\n"
+    "   return float4(red, greenColor.g, blue, greenColor.a);\n"
+    "}\n";
+
+// Distortion through a precomputed DistortionMesh. The mesh carries the distorted
+// texture coordinates (green in TexCoord, red in TexCoord1, blue in Normal.xy) and
+// the eye's screen centre in (Normal.z, Position.z).
+static const char* DistortionMeshVertexShaderSrc =
+    "float4x4 View : register(c4);\n"
+    "void main(in float4 Position : POSITION, in float4 Color : COLOR0, in float2 TexCoord : TEXCOORD0, in float2 TexCoord1 : TEXCOORD1, in float3 Normal : NORMAL,\n"
+    "          out float4 oPosition : SV_Position, out float2 oTexCoord : TEXCOORD0, out float2 oTexCoord1 : TEXCOORD1,\n"
+    "          out float2 oTexCoord2 : TEXCOORD2, out float2 oScreenCenter : TEXCOORD3)\n"
+    "{\n"
+    "   oPosition = mul(View, float4(Position.xy, 0, 1));\n"
+    "   oTexCoord = TexCoord;\n"
+    "   oTexCoord1 = TexCoord1;\n"
+    "   oTexCoord2 = Normal.xy;\n"
+    "   oScreenCenter = float2(Normal.z, Position.z);\n"
+    "}\n";
+
+#define DISTORTIONMESH_COMMON                                           \
+    "Texture2D Texture : register(t0);\n"                               \
+    "SamplerState Linear : register(s0);\n"                             \
+    "struct Varyings\n"                                                 \
+    "{\n"                                                               \
+    "   float4 Position     : SV_Position;\n"                           \
+    "   float2 TexCoord     : TEXCOORD0;\n"                             \
+    "   float2 TexCoord1    : TEXCOORD1;\n"                             \
+    "   float2 TexCoord2    : TEXCOORD2;\n"                             \
+    "   float2 ScreenCenter : TEXCOORD3;\n"                             \
+    "};\n"                                                              \
+    "bool InsideEye(float2 tc, float2 screenCenter)\n"                  \
+    "{\n"                                                               \
+    "   return !any(clamp(tc, screenCenter-float2(0.25,0.5), screenCenter+float2(0.25, 0.5)) - tc);\n" \
+    "}\n"
+
+static const char* DistortionMeshPixelShaderSrc =
+    DISTORTIONMESH_COMMON
+    "float4 main(in Varyings ov) : SV_Target\n"
+    "{\n"
+    "   if (!InsideEye(ov.TexCoord, ov.ScreenCenter))\n"
+    "       return 0;\n"
+    "   return Texture.Sample(Linear, ov.TexCoord);\n"
+    "}\n";
+
+static const char* DistortionMeshPixelShaderWithChromAbSrc =
+    DISTORTIONMESH_COMMON
+    "float4 main(in Varyings ov) : SV_Target\n"
+    "{\n"
+    "   if (!InsideEye(ov.TexCoord2, ov.ScreenCenter))\n"
+    "       return 0;\n"
+    "   float  blue = Texture.Sample(Linear, ov.TexCoord2).b;\n"
+    "   float4 greenColor = Texture.Sample(Linear, ov.TexCoord);\n"
+    "   float  red = Texture.Sample(Linear, ov.TexCoord1).r;\n"
+    "   return float4(red, greenColor.g, blue, greenColor.a);\n"
+    "}\n";
+
 static const char* VShaderSrcs[VShader_Count] =
 {
     DirectVertexShaderSrc,
     StdVertexShaderSrc,
-    PostProcessVertexShaderSrc
+    PostProcessVertexShaderSrc,
+    DistortionMeshVertexShaderSrc
 };
 static const char* FShaderSrcs[FShader_Count] =
 {
@@ -313,7 +489,13 @@ static const char* FShaderSrcs[FShader_Count] =
     PostProcessPixelShaderWithChromAbSrc,
     LitSolidPixelShaderSrc,
     LitTexturePixelShaderSrc,
-    MultiTexturePixelShaderSrc
+    MultiTexturePixelShaderSrc,
+    TextureYUY2PixelShaderSrc,
+    TextureUYVYPixelShaderSrc,
+    PostProcessStereoPixelShaderSrc,
+    PostProcessStereoPixelShaderWithChromAbSrc,
+    DistortionMeshPixelShaderSrc,
+    DistortionMeshPixelShaderWithChromAbSrc
 };
 
 RenderDevice::RenderDevice(const RendererParams& p, HWND window)
@@ -842,6 +1024,7 @@ void RenderDevice::Clear(float r, float g, float b, float a, float depth)
 		Context->OMSetBlendState(NULL, NULL, 0xffffffff);
 		Context->Draw(4, 0);
     }
+    Stats.Clears++;
 
     // reset
     CurDepthState = oldDepthState;
@@ -1274,9 +1457,8 @@ ID3D1xSamplerState* RenderDevice::GetSamplerState(int sm)
     return SamplerStates[sm];
 }
 
-Texture::Texture(RenderDevice* ren, int fmt, int w, int h) : Ren(ren), Tex(NULL), TexSv(NULL), TexRtv(NULL), TexDsv(NULL), Width(w), Height(h)
+Texture::Texture(RenderDevice* ren, int fmt, int w, int h) : Ren(ren), Tex(NULL), TexSv(NULL), TexRtv(NULL), TexDsv(NULL), Width(w), Height(h), Format(fmt)
 {
-    OVR_UNUSED(fmt);
     Sampler = Ren->GetSamplerState(0);
 }
 
@@ -1503,12 +1685,24 @@ Texture* RenderDevice::CreateTexture(int format, int width, int height, const vo
     {
         DXGI_FORMAT d3dformat;
         int         bpp;
+        int         texwidth = width;
         switch(format & Texture_TypeMask)
         {
         case Texture_RGBA:
             bpp = 4;
             d3dformat = DXGI_FORMAT_R8G8B8A8_UNORM;
             break;
+        case Texture_BGRA:
+            bpp = 4;
+            d3dformat = DXGI_FORMAT_B8G8R8A8_UNORM;
+            break;
+        case Texture_YUY2:
+        case Texture_UYVY:
+            // Two pixels per RGBA texel.
+            bpp = 2;
+            texwidth = width / 2;
+            d3dformat = DXGI_FORMAT_R8G8B8A8_UNORM;
+            break;
         case Texture_R:
             bpp = 1;
             d3dformat = DXGI_FORMAT_R8_UNORM;
@@ -1531,9 +1725,10 @@ Texture* RenderDevice::CreateTexture(int format, int width, int height, const vo
         NewTex->Samples = samples;
 
         D3D1x_(TEXTURE2D_DESC) dsDesc;
-        dsDesc.Width     = width;
+        dsDesc.Width     = texwidth;
         dsDesc.Height    = height;
-        dsDesc.MipLevels = (format == (Texture_RGBA | Texture_GenMipmaps) && data) ? GetNumMipLevels(width, height) : 1;
+        bool genMips = (format == (Texture_RGBA | Texture_GenMipmaps) || format == (Texture_BGRA | Texture_GenMipmaps));
+        dsDesc.MipLevels = (genMips && data) ? GetNumMipLevels(width, height) : 1;
         dsDesc.ArraySize = 1;
         dsDesc.Format    = d3dformat;
         dsDesc.SampleDesc.Count = samples;
@@ -1571,7 +1766,7 @@ Texture* RenderDevice::CreateTexture(int format, int width, int height, const vo
         if (data)
         {
             Context->UpdateSubresource(NewTex->Tex, 0, NULL, data, width * bpp, width * height * bpp);
-            if (format == (Texture_RGBA | Texture_GenMipmaps))
+            if (genMips)
             {
                 int srcw = width, srch = height;
                 int level = 0;
@@ -1623,6 +1818,54 @@ Texture* RenderDevice::CreateTexture(int format, int width, int height, const vo
     }
 }
 
+Texture* RenderDevice::CreateStreamingTexture(int format, int width, int height)
+{
+    Texture* NewTex = CreateTexture(format & ~Texture_GenMipmaps, width, height, NULL);
+    if (NewTex)
+    {
+        // Packed YUV is filtered by its shader once unpacked, so its texels are read
+        // unfiltered.
+        bool packed = ((format & Texture_TypeMask) == Texture_YUY2 || (format & Texture_TypeMask) == Texture_UYVY);
+        NewTex->SetSampleMode((packed ? Sample_Nearest : Sample_Linear) | Sample_Clamp);
+    }
+    return NewTex;
+}
+
+bool RenderDevice::UpdateTexture(Render::Texture* tex, int x, int y, int w, int h, const void* data)
+{
+    Texture* t = (Texture*)tex;
+    int      bpp;
+    switch(t->Format & Texture_TypeMask)
+    {
+    case Texture_RGBA:
+    case Texture_BGRA:
+        bpp = 4;
+        break;
+    case Texture_YUY2:
+    case Texture_UYVY:
+        bpp = 2;
+        break;
+    case Texture_R:
+        bpp = 1;
+        break;
+    default:
+        return false;
+    }
+
+    // Packed YUV textures hold two pixels per texel.
+    int pixelsPerTexel = (bpp == 2) ? 2 : 1;
+
+    D3D1x_(BOX) box;
+    box.left   = x / pixelsPerTexel;
+    box.top    = y;
+    box.front  = 0;
+    box.right  = (x + w) / pixelsPerTexel;
+    box.bottom = y + h;
+    box.back   = 1;
+    Context->UpdateSubresource(t->Tex, 0, &box, data, w * bpp, w * h * bpp);
+    return true;
+}
+
 // Rendering
 
 void RenderDevice::BeginRendering()
@@ -1634,6 +1877,7 @@ void RenderDevice::SetRenderTarget(Render::Texture* color, Render::Texture* dept
 {
     OVR_UNUSED(stencil);
 
+    Stats.RenderTargetChanges++;
     CurRenderTarget = (Texture*)color;
     if (color == NULL)
     {
@@ -1705,6 +1949,8 @@ void RenderDevice::RenderWithAlpha(	const Fill* fill, Render::Buffer* vertices,
 void RenderDevice::Render(const Fill* fill, Render::Buffer* vertices, Render::Buffer* indices,
                           const Matrix4f& matrix, int offset, int count, PrimitiveType rprim)
 {
+    Stats.DrawCalls++;
+
     Context->IASetInputLayout(ModelVertexIL);
     if (indices)
     {
@@ -209,6 +209,7 @@ public:
     mutable Ptr<ID3D1xSamplerState> Sampler;
     int                             Width, Height;
     int                             Samples;
+    int                             Format;
 
     Texture(RenderDevice* r, int fmt, int w, int h);
     ~Texture();
@@ -225,6 +226,10 @@ public:
     {
         return Samples;
     }
+    virtual int GetFormat() const
+    {
+        return Format;
+    }
 
     virtual void SetSampleMode(int sm);
 
@@ -311,6 +316,8 @@ public:
 
     virtual Buffer* CreateBuffer();
     virtual Texture* CreateTexture(int format, int width, int height, const void* data, int mipcount=1);
+    virtual Texture* CreateStreamingTexture(int format, int width, int height);
+    virtual bool     UpdateTexture(Render::Texture* tex, int x, int y, int w, int h, const void* data);
     
     static void GenerateSubresourceData(
                     unsigned imageWidth, unsigned imageHeight, int format, unsigned imageDimUpperLimit,
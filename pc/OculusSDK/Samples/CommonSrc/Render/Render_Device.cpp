@@ -492,17 +492,31 @@ RenderDevice::RenderDevice()
       
       Distortion(1.0f, 0.18f, 0.115f),            
       DistortionClearColor(0, 0, 0),
-      PostProcessShaderActive(PostProcessShader_DistortionAndChromAb),
-      TotalTextureMemoryUsage(0)
+      TotalTextureMemoryUsage(0),
+      UseDistortionMesh(false),
+      NextDistortionMesh(0),
+      PostProcessShaderActive(PostProcessShader_DistortionAndChromAb)
 {
     PostProcessShaderRequested = PostProcessShaderActive;
 }
 
 Fill* RenderDevice::CreateTextureFill(Render::Texture* t, bool useAlpha)
 {
+    int fshader = useAlpha ? FShader_AlphaTexture : FShader_Texture;
+    switch (t->GetFormat() & Texture_TypeMask)
+    {
+    case Texture_YUY2: fshader = FShader_TextureYUY2; break;
+    case Texture_UYVY: fshader = FShader_TextureUYVY; break;
+    }
+
     ShaderSet* shaders = CreateShaderSet();
     shaders->SetShader(LoadBuiltinShader(Shader_Vertex, VShader_MVP));
-    shaders->SetShader(LoadBuiltinShader(Shader_Fragment, useAlpha ? FShader_AlphaTexture : FShader_Texture));
+    shaders->SetShader(LoadBuiltinShader(Shader_Fragment, fshader));
+    if (fshader != FShader_Texture && fshader != FShader_AlphaTexture)
+    {
+        // Size in pixels, to unpack and filter them from the packed texels.
+        shaders->SetUniform2f("TexSize", (float)t->GetWidth(), (float)t->GetHeight());
+    }
     Fill* f = new ShaderFill(*shaders);
     f->SetTexture(0, t);
     return f;
@@ -816,6 +830,8 @@ bool RenderDevice::initPostProcessSupport(PostProcessType pptype)
     if (PostProcessShaderRequested !=  PostProcessShaderActive)
     {
         pPostProcessShader.Clear();
+        pStereoPostProcessShader.Clear();
+        pDistortionMeshShader.Clear();
         PostProcessShaderActive = PostProcessShaderRequested;
     }
 
@@ -934,6 +950,12 @@ void RenderDevice::FinishScene1()
     DistortionClearColor.GetRGBA(&r, &g, &b, &a);
     Clear(r, g, b, a);
 
+    if (UseDistortionMesh)
+    {
+        renderDistortionMesh(1, &Distortion, &VP, VP);
+        return;
+    }
+
     float w = float(VP.w) / float(WindowWidth),
           h = float(VP.h) / float(WindowHeight),
           x = float(VP.x) / float(WindowWidth),
@@ -982,6 +1004,213 @@ void RenderDevice::FinishScene1()
     RenderWithAlpha(&fill, pFullScreenVertexBuffer, NULL, view, 0, 4, Prim_TriangleStrip);
 }
 
+void RenderDevice::FinishSceneStereo(const StereoEyeParams& left, const StereoEyeParams& right)
+{
+    SetExtraShaders(0);
+    if(CurPostProcess == PostProcess_None)
+    {
+        return;
+    }
+
+    if (!pStereoPostProcessShader)
+    {
+        Shader *vs   = LoadBuiltinShader(Shader_Vertex, VShader_PostProcess);
+        Shader *ppfs = LoadBuiltinShader(Shader_Fragment,
+                                         (PostProcessShaderActive == PostProcessShader_DistortionAndChromAb) ?
+                                         FShader_PostProcessStereoWithChromAb : FShader_PostProcessStereo);
+
+        pStereoPostProcessShader = *CreateShaderSet();
+        pStereoPostProcessShader->SetShader(vs);
+        pStereoPostProcessShader->SetShader(ppfs);
+    }
+
+    if (left.pDistortion)
+        SetDistortionConfig(*left.pDistortion, left.Eye);
+
+    // One viewport covering both eyes.
+    Viewport bothVP(left.VP.x, left.VP.y, right.VP.x + right.VP.w - left.VP.x, left.VP.h);
+
+    SetRenderTarget(0);
+    SetRealViewport(bothVP);
+
+    float r, g, b, a;
+    DistortionClearColor.GetRGBA(&r, &g, &b, &a);
+    Clear(r, g, b, a);
+
+    if (UseDistortionMesh)
+    {
+        DistortionConfig eyeDistortion[2] = { Distortion, Distortion };
+        eyeDistortion[1].XCenterOffset = -Distortion.XCenterOffset;
+        Viewport         eyeVP[2]         = { left.VP, right.VP };
+
+        renderDistortionMesh(2, eyeDistortion, eyeVP, bothVP);
+        CurPostProcess = PostProcess_None;
+        return;
+    }
+
+    // Per eye lens and screen centres, as in FinishScene1. The right eye's lens
+    // offset is mirrored.
+    float lensCenters[4], screenCenters[4];
+    const Viewport* eyeVPs[2] = { &left.VP, &right.VP };
+    for (int i = 0; i < 2; i++)
+    {
+        float w = float(eyeVPs[i]->w) / float(WindowWidth),
+              h = float(eyeVPs[i]->h) / float(WindowHeight),
+              x = float(eyeVPs[i]->x) / float(WindowWidth),
+              y = float(eyeVPs[i]->y) / float(WindowHeight);
+        float xCenterOffset = (i == 0) ? Distortion.XCenterOffset : -Distortion.XCenterOffset;
+
+        lensCenters[i*2]     = x + (w + xCenterOffset * 0.5f)*0.5f;
+        lensCenters[i*2+1]   = y + h*0.5f;
+        screenCenters[i*2]   = x + w*0.5f;
+        screenCenters[i*2+1] = y + h*0.5f;
+    }
+    pStereoPostProcessShader->SetUniform("LensCenters",   4, lensCenters);
+    pStereoPostProcessShader->SetUniform("ScreenCenters", 4, screenCenters);
+    pStereoPostProcessShader->SetUniform1f("SplitX", float(right.VP.x) / float(WindowWidth));
+
+    // Both eyes have the same size, so scaling is shared.
+    float w  = float(left.VP.w) / float(WindowWidth),
+          h  = float(left.VP.h) / float(WindowHeight);
+    float as = float(left.VP.w) / float(left.VP.h);
+    float scaleFactor = 1.0f / Distortion.Scale;
+
+    pStereoPostProcessShader->SetUniform2f("Scale",   (w/2) * scaleFactor, (h/2) * scaleFactor * as);
+    pStereoPostProcessShader->SetUniform2f("ScaleIn", (2/w),               (2/h) / as);
+
+    pStereoPostProcessShader->SetUniform4f("HmdWarpParam",
+                                           Distortion.K[0], Distortion.K[1], Distortion.K[2], Distortion.K[3]);
+
+    if (PostProcessShaderActive == PostProcessShader_DistortionAndChromAb)
+    {
+        pStereoPostProcessShader->SetUniform4f("ChromAbParam",
+                                               Distortion.ChromaticAberration[0],
+                                               Distortion.ChromaticAberration[1],
+                                               Distortion.ChromaticAberration[2],
+                                               Distortion.ChromaticAberration[3]);
+    }
+
+    float bw = float(bothVP.w) / float(WindowWidth),
+          bh = float(bothVP.h) / float(WindowHeight),
+          bx = float(bothVP.x) / float(WindowWidth),
+          by = float(bothVP.y) / float(WindowHeight);
+    Matrix4f texm(bw, 0, 0, bx,
+                  0, bh, 0, by,
+                  0, 0, 0, 0,
+                  0, 0, 0, 1);
+    pStereoPostProcessShader->SetUniform4x4f("Texm", texm);
+
+    Matrix4f view(2, 0, 0, -1,
+                  0, 2, 0, -1,
+                   0, 0, 0, 0,
+                   0, 0, 0, 1);
+
+    ShaderFill fill(pStereoPostProcessShader);
+    fill.SetTexture(0, pSceneColorTex);
+    RenderWithAlpha(&fill, pFullScreenVertexBuffer, NULL, view, 0, 4, Prim_TriangleStrip);
+
+    CurPostProcess = PostProcess_None;
+}
+
+static bool distortionConfigEqual(const DistortionConfig& a, const DistortionConfig& b)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        if (a.K[i] != b.K[i] || a.ChromaticAberration[i] != b.ChromaticAberration[i])
+            return false;
+    }
+    return a.XCenterOffset == b.XCenterOffset && a.YCenterOffset == b.YCenterOffset &&
+           a.Scale == b.Scale;
+}
+
+void RenderDevice::renderDistortionMesh(int eyeCount, const DistortionConfig* distortion,
+                                        const Viewport* eyeVP, const Viewport& renderVP)
+{
+    OVR_ASSERT(eyeCount >= 1 && eyeCount <= 2);
+
+    if (!pDistortionMeshShader)
+    {
+        Shader *vs   = LoadBuiltinShader(Shader_Vertex, VShader_DistortionMesh);
+        Shader *ppfs = LoadBuiltinShader(Shader_Fragment,
+                                         (PostProcessShaderActive == PostProcessShader_DistortionAndChromAb) ?
+                                         FShader_DistortionMeshWithChromAb : FShader_DistortionMesh);
+
+        pDistortionMeshShader = *CreateShaderSet();
+        pDistortionMeshShader->SetShader(vs);
+        pDistortionMeshShader->SetShader(ppfs);
+    }
+
+    // The mesh only depends on the distortion and the layout, so it is rebuilt
+    // when either changes rather than every frame.
+    DistortionMeshCache* mesh = NULL;
+    for (int m = 0; m < DistortionMeshCacheSize && !mesh; m++)
+    {
+        DistortionMeshCache& c = DistortionMeshes[m];
+        bool match = (c.EyeCount == eyeCount) && (c.RenderVP == renderVP) &&
+                     (c.TargetW == WindowWidth) && (c.TargetH == WindowHeight);
+        for (int i = 0; i < eyeCount && match; i++)
+        {
+            match = (c.EyeVP[i] == eyeVP[i]) && distortionConfigEqual(c.Distortion[i], distortion[i]);
+        }
+        if (match)
+            mesh = &c;
+    }
+
+    if (!mesh)
+    {
+        mesh = &DistortionMeshes[NextDistortionMesh];
+        NextDistortionMesh = (NextDistortionMesh + 1) % DistortionMeshCacheSize;
+
+        mesh->EyeCount = eyeCount;
+        mesh->RenderVP = renderVP;
+        mesh->TargetW  = WindowWidth;
+        mesh->TargetH  = WindowHeight;
+
+        // Positions are made relative to renderVP, to be drawn like the full screen quad.
+        float rx = float(renderVP.x) / float(WindowWidth),
+              ry = float(renderVP.y) / float(WindowHeight),
+              rw = float(renderVP.w) / float(WindowWidth),
+              rh = float(renderVP.h) / float(WindowHeight);
+
+        Array<Vertex> vertices;
+        Array<UInt16> indices;
+        for (int i = 0; i < eyeCount; i++)
+        {
+            mesh->Distortion[i] = distortion[i];
+            mesh->EyeVP[i]      = eyeVP[i];
+
+            DistortionMesh eyeMesh;
+            eyeMesh.Generate(distortion[i], eyeVP[i], WindowWidth, WindowHeight);
+            eyeMesh.GetTriangleIndices(indices, (int)vertices.GetSize());
+
+            for (UPInt v = 0; v < eyeMesh.Vertices.GetSize(); v++)
+            {
+                const DistortionMeshVertex& mv = eyeMesh.Vertices[v];
+                vertices.PushBack(Vertex(Vector3f((mv.Pos.x - rx) / rw, 1.0f - (mv.Pos.y - ry) / rh,
+                                                  eyeMesh.ScreenCenter.y),
+                                         Color(255, 255, 255, 255),
+                                         mv.TexG.x, mv.TexG.y, mv.TexR.x, mv.TexR.y,
+                                         Vector3f(mv.TexB.x, mv.TexB.y, eyeMesh.ScreenCenter.x)));
+            }
+        }
+
+        mesh->pVertices = *CreateBuffer();
+        mesh->pVertices->Data(Buffer_Vertex, &vertices[0], vertices.GetSize() * sizeof(Vertex));
+        mesh->pIndices = *CreateBuffer();
+        mesh->pIndices->Data(Buffer_Index, &indices[0], indices.GetSize() * sizeof(UInt16));
+        mesh->IndexCount = (int)indices.GetSize();
+    }
+
+    Matrix4f view(2, 0, 0, -1,
+                  0, 2, 0, -1,
+                   0, 0, 0, 0,
+                   0, 0, 0, 1);
+
+    ShaderFill fill(pDistortionMeshShader);
+    fill.SetTexture(0, pSceneColorTex);
+    RenderWithAlpha(&fill, mesh->pVertices, mesh->pIndices, view, 0, mesh->IndexCount, Prim_Triangles);
+}
+
 bool CollisionModel::TestPoint(const Vector3f& p) const
 {
     for(unsigned i = 0; i < Planes.GetSize(); i++)
@@ -1095,7 +1324,10 @@ int GetTextureSize(int format, int w, int h)
     switch (format & Texture_TypeMask)
     {
         case Texture_R:            return w*h;
-        case Texture_RGBA:         return w*h*4;
+        case Texture_RGBA:
+        case Texture_BGRA:         return w*h*4;
+        case Texture_YUY2:
+        case Texture_UYVY:         return w*h*2;
         case Texture_DXT1: {
             int bw = (w+3)/4, bh = (h+3)/4;
             return bw * bh * 8;
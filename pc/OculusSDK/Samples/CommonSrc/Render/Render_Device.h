@@ -82,7 +82,8 @@ enum BuiltinShaders
     VShader_MV                      = 0,
     VShader_MVP                     = 1,
     VShader_PostProcess             = 2,
-    VShader_Count                   = 3,
+    VShader_DistortionMesh          = 3,
+    VShader_Count                   = 4,
 
     FShader_Solid                   = 0,
     FShader_Gouraud                 = 1,
@@ -93,7 +94,13 @@ enum BuiltinShaders
     FShader_LitGouraud              = 6,
     FShader_LitTexture              = 7,
 	FShader_MultiTexture            = 8,
-    FShader_Count                   = 9,
+    FShader_TextureYUY2             = 9,
+    FShader_TextureUYVY             = 10,
+    FShader_PostProcessStereo       = 11,
+    FShader_PostProcessStereoWithChromAb = 12,
+    FShader_DistortionMesh          = 13,
+    FShader_DistortionMeshWithChromAb = 14,
+    FShader_Count                   = 15,
 };
 
 
@@ -119,6 +126,11 @@ enum TextureFormat
 {
     Texture_RGBA            = 0x100,
     Texture_R               = 0x200,
+    Texture_BGRA            = 0x300, // Byte order of Windows DIBs and most capture devices.
+    // Packed 4:2:2 YUV, 2 bytes per pixel, top-down. Stored as RGBA texels holding two
+    // pixels each and converted to RGB by the fill from CreateTextureFill.
+    Texture_YUY2            = 0x400,
+    Texture_UYVY            = 0x500,
     Texture_DXT1            = 0x1100,
     Texture_DXT3            = 0x1200,
     Texture_DXT5            = 0x1300,
@@ -310,6 +322,7 @@ public:
     virtual int GetWidth() const = 0;
     virtual int GetHeight() const = 0;
     virtual int GetSamples() const { return 1; }
+    virtual int GetFormat() const { return 0; }
 
     virtual void SetSampleMode(int sm) = 0;
     virtual void Set(int slot, ShaderStage stage = Shader_Fragment) const = 0;
@@ -679,6 +692,20 @@ struct RendererParams
 
 
 
+// Counts of work submitted to the GPU, for comparing rendering paths.
+// The application resets them, typically once per frame. Clears are counted apart
+// from draws, since D3D clears a viewport by drawing a quad and GL doesn't.
+struct RenderStats
+{
+    int DrawCalls;
+    int Clears;
+    int RenderTargetChanges;
+
+    RenderStats() : DrawCalls(0), Clears(0), RenderTargetChanges(0) {}
+    void Reset() { DrawCalls = Clears = RenderTargetChanges = 0; }
+};
+
+
 //-----------------------------------------------------------------------------------
 // ***** RenderDevice
 
@@ -689,6 +716,7 @@ protected:
     int                 WindowWidth, WindowHeight;
     RendererParams      Params;
     Viewport            VP;
+    RenderStats         Stats;
 
     Matrix4f            Proj;
     Ptr<Buffer>         pTextVertexBuffer;
@@ -700,6 +728,7 @@ protected:
     int                 SceneColorTexW;
     int                 SceneColorTexH;
     Ptr<ShaderSet>      pPostProcessShader;
+    Ptr<ShaderSet>      pStereoPostProcessShader;
     Ptr<Buffer>         pFullScreenVertexBuffer;
     float               SceneRenderScale;
     DistortionConfig    Distortion;
@@ -709,8 +738,36 @@ protected:
     // For lighting on platforms with uniform buffers
     Ptr<Buffer>         LightingBuffer;
 
+    // Distortion meshes, built on first use for a given distortion and set of eye
+    // viewports. There is room for the left and right eye meshes of per eye
+    // FinishScene calls and one holding both eyes for FinishSceneStereo.
+    struct DistortionMeshCache
+    {
+        int                 EyeCount;
+        DistortionConfig    Distortion[2];
+        Viewport            EyeVP[2];
+        Viewport            RenderVP;
+        int                 TargetW, TargetH;
+        Ptr<Buffer>         pVertices;
+        Ptr<Buffer>         pIndices;
+        int                 IndexCount;
+
+        DistortionMeshCache() : EyeCount(0), TargetW(0), TargetH(0), IndexCount(0) { }
+    };
+    enum { DistortionMeshCacheSize = 3 };
+
+    bool                UseDistortionMesh;
+    Ptr<ShaderSet>      pDistortionMeshShader;
+    DistortionMeshCache DistortionMeshes[DistortionMeshCacheSize];
+    int                 NextDistortionMesh;
+
     void FinishScene1();
 
+    // Draws the scene texture through the distortion mesh for the given eyes, into
+    // renderVP which must already be the current viewport.
+    void renderDistortionMesh(int eyeCount, const DistortionConfig* distortion,
+                              const Viewport* eyeVP, const Viewport& renderVP);
+
 public:
     enum CompareFunc
     {
@@ -773,6 +830,10 @@ public:
     }
 
     virtual bool IsFullscreen() const { return Params.Fullscreen != Display_Window; }
+
+    const RenderStats& GetStats() const { return Stats; }
+    void               ResetStats()     { Stats.Reset(); }
+
     virtual void Present() = 0;
     // Waits for rendering to complete; important for reducing latency.
     virtual void ForceFlushGPU() { }
@@ -781,7 +842,16 @@ public:
     virtual Buffer*  CreateBuffer() { return NULL; }
     virtual Texture* CreateTexture(int format, int width, int height, const void* data, int mipcount=1)
     { OVR_UNUSED5(format,width,height,data, mipcount); return NULL; }
-   
+
+    // Streaming textures are allocated once and then have their contents replaced
+    // through UpdateTexture, typically every frame (video input). They have no mipmaps.
+    virtual Texture* CreateStreamingTexture(int format, int width, int height)
+    { return CreateTexture(format, width, height, NULL); }
+    // Uploads a w x h block of tightly packed pixels to (x,y) of a texture.
+    // Returns false if the device can't update textures in place.
+    virtual bool     UpdateTexture(Texture* tex, int x, int y, int w, int h, const void* data)
+    { OVR_UNUSED6(tex, x, y, w, h, data); return false; }
+
     virtual bool     GetSamplePositions(Render::Texture*, Vector3f* pos) { pos[0] = Vector3f(0); return 1; }
 
     virtual ShaderSet* CreateShaderSet() { return new ShaderSetMatrixTranspose; }
@@ -796,6 +866,9 @@ public:
     virtual void BeginScene(PostProcessType pp = PostProcess_None); //StereoDisplay disp = Stereo_Center);
     // Postprocess the scene and return to the screen render target.
     virtual void FinishScene();
+    // Like FinishScene, for a scene holding both eyes (rendered into their own viewports
+    // within one BeginScene). Distortion is applied to both in a single full screen draw.
+    virtual void FinishSceneStereo(const StereoEyeParams& left, const StereoEyeParams& right);
 
     // Texture must have been created with Texture_RenderTarget. Use NULL for the default render target.
     // NULL depth buffer means use an internal, temporary one.
@@ -849,6 +922,11 @@ public:
         DistortionClearColor = clearColor;
     }
 
+    // When enabled, distortion is applied by drawing the scene through a precomputed
+    // mesh rather than evaluating it for every pixel.
+    void          SetDistortionMeshEnabled(bool enabled) { UseDistortionMesh = enabled; }
+    bool          IsDistortionMeshEnabled() const        { return UseDistortionMesh; }
+
     // Don't call these directly, use App/Platform instead
     virtual bool SetFullscreen(DisplayMode fullscreen) { OVR_UNUSED(fullscreen); return false; }
     virtual void SetWindowSize(int w, int h) { WindowWidth = w; WindowHeight = h; }
@@ -262,6 +262,62 @@ static const char* MultiTextureFragShaderSrc =
 	"	gl_FragColor = color2;\n"
     "}\n";
 
+// Packed 4:2:2 YUV. Each RGBA texel holds two pixels sharing U and V. Filtering
+// texels would blend neighbouring pairs, so the texture is point sampled and
+// YuvPixel unpacks one pixel at a time; main filters the four pixels around the
+// sample point, the same way as the D3D shaders. TexSize is in pixels. YUV frames
+// are top-down, unlike our RGB textures.
+#define YUV_COMMON                                                      \
+    "uniform sampler2D Texture0;\n"                                     \
+    "uniform vec2 TexSize;\n"                                           \
+    "varying vec4 oColor;\n"                                            \
+    "varying vec2 oTexCoord;\n"                                         \
+    "vec4 YuvToRgb(vec3 yuv)\n"                                         \
+    "{\n"                                                               \
+    "   float y = 1.164 * (yuv.x - 0.0625);\n"                          \
+    "   float u = yuv.y - 0.5;\n"                                       \
+    "   float v = yuv.z - 0.5;\n"                                       \
+    "   return vec4(clamp(vec3(y + 1.596 * v, y - 0.392 * u - 0.813 * v, y + 2.017 * u), 0.0, 1.0), 1.0);\n" \
+    "}\n"                                                               \
+    "vec4 YuvTexel(vec2 p, out float odd)\n"                            \
+    "{\n"                                                               \
+    "   p = clamp(p, vec2(0.0), TexSize - 1.0);\n"                      \
+    "   float pair = floor(p.x * 0.5);\n"                               \
+    "   odd = p.x - 2.0 * pair;\n"                                      \
+    "   return texture2D(Texture0, vec2((pair + 0.5) / (TexSize.x * 0.5), (p.y + 0.5) / TexSize.y));\n" \
+    "}\n"
+
+#define YUV_MAIN                                                        \
+    "void main()\n"                                                     \
+    "{\n"                                                               \
+    "   vec2 p = vec2(oTexCoord.x, 1.0 - oTexCoord.y) * TexSize - 0.5;\n" \
+    "   vec2 f = fract(p);\n"                                           \
+    "   p = floor(p);\n"                                                \
+    "   vec3 yuv = mix(mix(YuvPixel(p), YuvPixel(p + vec2(1.0, 0.0)), f.x),\n" \
+    "                  mix(YuvPixel(p + vec2(0.0, 1.0)), YuvPixel(p + vec2(1.0, 1.0)), f.x), f.y);\n" \
+    "   gl_FragColor = oColor * YuvToRgb(yuv);\n"                       \
+    "}\n"
+
+static const char* TextureYUY2FragShaderSrc =
+    YUV_COMMON
+    "vec3 YuvPixel(vec2 p)\n"
+    "{\n"
+    "   float odd;\n"
+    "   vec4  yuyv = YuvTexel(p, odd);\n"
+    "   return vec3(mix(yuyv.r, yuyv.b, odd), yuyv.g, yuyv.a);\n"
+    "}\n"
+    YUV_MAIN;
+
+static const char* TextureUYVYFragShaderSrc =
+    YUV_COMMON
+    "vec3 YuvPixel(vec2 p)\n"
+    "{\n"
+    "   float odd;\n"
+    "   vec4  uyvy = YuvTexel(p, odd);\n"
+    "   return vec3(mix(uyvy.g, uyvy.a, odd), uyvy.r, uyvy.b);\n"
+    "}\n"
+    YUV_MAIN;
+
 static const char* PostProcessVertexShaderSrc =
     "uniform mat4 View;\n"
     "uniform mat4 Texm;\n"
@@ -346,11 +402,133 @@ static const char* PostProcessFullFragShaderSrc =
     "   gl_FragColor = vec4(red, center.g, blue, center.a);\n"
     "}\n";
 
+// Distortion for both eyes of a side by side scene in one pass. The eye is picked by
+// which side of SplitX the pixel is on; LensCenters and ScreenCenters hold the
+// left eye's value in xy and the right eye's in zw.
+#define POSTPROCESS_STEREO_COMMON                                        \
+    "uniform vec4 LensCenters;\n"                                       \
+    "uniform vec4 ScreenCenters;\n"                                     \
+    "uniform float SplitX;\n"                                           \
+    "uniform vec2 Scale;\n"                                             \
+    "uniform vec2 ScaleIn;\n"                                           \
+    "uniform vec4 HmdWarpParam;\n"                                      \
+    "uniform sampler2D Texture0;\n"                                     \
+    "varying vec2 oTexCoord;\n"                                         \
+    "void SelectEye(out vec2 lensCenter, out vec2 screenCenter)\n"      \
+    "{\n"                                                               \
+    "   bool rightEye = oTexCoord.x >= SplitX;\n"                       \
+    "   lensCenter   = rightEye ? LensCenters.zw   : LensCenters.xy;\n" \
+    "   screenCenter = rightEye ? ScreenCenters.zw : ScreenCenters.xy;\n" \
+    "}\n"
+
+static const char* PostProcessStereoFragShaderSrc =
+    POSTPROCESS_STEREO_COMMON
+    "void main()\n"
+    "{\n"
+    "   vec2  lensCenter, screenCenter;\n"
+    "   SelectEye(lensCenter, screenCenter);\n"
+    "   vec2  theta = (oTexCoord - lensCenter) * ScaleIn;\n"
+    "   float rSq = theta.x * theta.x + theta.y * theta.y;\n"
+    "   vec2  theta1 = theta * (HmdWarpParam.x + HmdWarpParam.y * rSq + "
+    "                           HmdWarpParam.z * rSq * rSq + HmdWarpParam.w * rSq * rSq * rSq);\n"
+    "   vec2  tc = lensCenter + Scale * theta1;\n"
+    "   if (!all(equal(clamp(tc, screenCenter-vec2(0.25,0.5), screenCenter+vec2(0.25,0.5)), tc)))\n"
+    "       gl_FragColor = vec4(0);\n"
+    "   else\n"
+    "       gl_FragColor = texture2D(Texture0, tc);\n"
+    "}\n";
+
+static const char* PostProcessStereoFullFragShaderSrc =
+    POSTPROCESS_STEREO_COMMON
+    "uniform vec4 ChromAbParam;\n"
+    "void main()\n"
+    "{\n"
+    "   vec2  lensCenter, screenCenter;\n"
+    "   SelectEye(lensCenter, screenCenter);\n"
+    "   vec2  theta = (oTexCoord - lensCenter) * ScaleIn;\n"
+    "   float rSq= theta.x * theta.x + theta.y * theta.y;\n"
+    "   vec2  theta1 = theta * (HmdWarpParam.x + HmdWarpParam.y * rSq + "
+    "                  HmdWarpParam.z * rSq * rSq + HmdWarpParam.w * rSq * rSq * rSq);\n"
+    "   vec2 thetaBlue = theta1 * (ChromAbParam.z + ChromAbParam.w * rSq);\n"
+    "   vec2 tcBlue = lensCenter + Scale * thetaBlue;\n"
+    "   if (!all(equal(clamp(tcBlue, screenCenter-vec2(0.25,0.5), screenCenter+vec2(0.25,0.5)), tcBlue)))\n"
+    "   {\n"
+    "       gl_FragColor = vec4(0);\n"
+    "       return;\n"
+    "   }\n"
+    "   float blue = texture2D(Texture0, tcBlue).b;\n"
+    "   vec2  tcGreen = lensCenter + Scale * theta1;\n"
+    "   vec4  center = texture2D(Texture0, tcGreen);\n"
+    "   vec2  thetaRed = theta1 * (ChromAbParam.x + ChromAbParam.y * rSq);\n"
+    "   vec2  tcRed = lensCenter + Scale * thetaRed;\n"
+    "   float red = texture2D(Texture0, tcRed).r;\n"
+    "   gl_FragColor = vec4(red, center.g, blue, center.a);\n"
+    "}\n";
+
+// Distortion through a precomputed DistortionMesh. The mesh carries the distorted
+// texture coordinates (green in TexCoord, red in TexCoord1, blue in Normal.xy), all
+// top-down like the mesh generator's, and the eye's screen centre in (Normal.z, Position.z).
+static const char* DistortionMeshVertexShaderSrc =
+    "uniform mat4 View;\n"
+    "attribute vec4 Position;\n"
+    "attribute vec2 TexCoord;\n"
+    "attribute vec2 TexCoord1;\n"
+    "attribute vec3 Normal;\n"
+    "varying  vec2 oTexCoord;\n"
+    "varying  vec2 oTexCoord1;\n"
+    "varying  vec2 oTexCoord2;\n"
+    "varying  vec2 oScreenCenter;\n"
+    "void main()\n"
+    "{\n"
+    "   gl_Position = View * vec4(Position.xy, 0, 1);\n"
+    "   oTexCoord     = vec2(TexCoord.x,  1.0-TexCoord.y);\n"
+    "   oTexCoord1    = vec2(TexCoord1.x, 1.0-TexCoord1.y);\n"
+    "   oTexCoord2    = vec2(Normal.x,    1.0-Normal.y);\n"
+    "   oScreenCenter = vec2(Normal.z,    1.0-Position.z);\n"
+    "}\n";
+
+#define DISTORTIONMESH_COMMON                                           \
+    "uniform sampler2D Texture0;\n"                                     \
+    "varying vec2 oTexCoord;\n"                                         \
+    "varying vec2 oTexCoord1;\n"                                        \
+    "varying vec2 oTexCoord2;\n"                                        \
+    "varying vec2 oScreenCenter;\n"                                     \
+    "bool InsideEye(vec2 tc)\n"                                         \
+    "{\n"                                                               \
+    "   return all(equal(clamp(tc, oScreenCenter-vec2(0.25,0.5), oScreenCenter+vec2(0.25,0.5)), tc));\n" \
+    "}\n"
+
+static const char* DistortionMeshFragShaderSrc =
+    DISTORTIONMESH_COMMON
+    "void main()\n"
+    "{\n"
+    "   if (!InsideEye(oTexCoord))\n"
+    "       gl_FragColor = vec4(0);\n"
+    "   else\n"
+    "       gl_FragColor = texture2D(Texture0, oTexCoord);\n"
+    "}\n";
+
+static const char* DistortionMeshFullFragShaderSrc =
+    DISTORTIONMESH_COMMON
+    "void main()\n"
+    "{\n"
+    "   if (!InsideEye(oTexCoord2))\n"
+    "   {\n"
+    "       gl_FragColor = vec4(0);\n"
+    "       return;\n"
+    "   }\n"
+    "   float blue   = texture2D(Texture0, oTexCoord2).b;\n"
+    "   vec4  center = texture2D(Texture0, oTexCoord);\n"
+    "   float red    = texture2D(Texture0, oTexCoord1).r;\n"
+    "   gl_FragColor = vec4(red, center.g, blue, center.a);\n"
+    "}\n";
+
 static const char* VShaderSrcs[VShader_Count] =
 {
     DirectVertexShaderSrc,
     StdVertexShaderSrc,
-    PostProcessVertexShaderSrc
+    PostProcessVertexShaderSrc,
+    DistortionMeshVertexShaderSrc
 };
 static const char* FShaderSrcs[FShader_Count] =
 {
@@ -362,7 +540,13 @@ static const char* FShaderSrcs[FShader_Count] =
     PostProcessFullFragShaderSrc,
     LitSolidFragShaderSrc,
     LitTextureFragShaderSrc,
-    MultiTextureFragShaderSrc
+    MultiTextureFragShaderSrc,
+    TextureYUY2FragShaderSrc,
+    TextureUYVYFragShaderSrc,
+    PostProcessStereoFragShaderSrc,
+    PostProcessStereoFullFragShaderSrc,
+    DistortionMeshFragShaderSrc,
+    DistortionMeshFullFragShaderSrc
 };
 
 
@@ -446,6 +630,7 @@ void RenderDevice::Clear(float r, float g, float b, float a, float depth)
     glClearColor(r,g,b,a);
     glClearDepth(depth);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    Stats.Clears++;
 }
 
 RBuffer* RenderDevice::GetDepthBuffer(int w, int h, int ms)
@@ -464,6 +649,7 @@ void RenderDevice::SetRenderTarget(Render::Texture* color, Render::Texture*, Ren
 {
     OVR_UNUSED(stencil);
 
+    Stats.RenderTargetChanges++;
     CurRenderTarget = (Texture*)color;
     if (color == NULL)
     {
@@ -554,6 +740,8 @@ void RenderDevice::Render(const Fill* fill, Render::Buffer* vertices, Render::Bu
         return;
     }
 
+    Stats.DrawCalls++;
+
     fill->Set();
     if (shaders->ProjLoc >= 0)
         glUniformMatrix4fv(shaders->ProjLoc, 1, 0, &Proj.M[0][0]);
@@ -803,7 +991,7 @@ bool ShaderSet::SetUniform4x4f(const char* name, const Matrix4f& m)
     return 0;
 }
 
-Texture::Texture(RenderDevice* r, int w, int h) : Ren(r), Width(w), Height(h)
+Texture::Texture(RenderDevice* r, int w, int h) : Ren(r), Width(w), Height(h), Format(0)
 {
     glGenTextures(1, &TexId);
 }
@@ -866,9 +1054,14 @@ void Texture::SetSampleMode(int sm)
 Texture* RenderDevice::CreateTexture(int format, int width, int height, const void* data, int mipcount)
 {
     GLenum   glformat, gltype = GL_UNSIGNED_BYTE;
+    GLenum   glinternal = 0;
+    int      texwidth = width;
     switch(format & Texture_TypeMask)
     {
     case Texture_RGBA:  glformat = GL_RGBA; break;
+    case Texture_BGRA:  glformat = GL_BGRA; glinternal = GL_RGBA; break;
+    case Texture_YUY2:
+    case Texture_UYVY:  glformat = GL_RGBA; texwidth = width / 2; break;
     case Texture_R:     glformat = GL_ALPHA; break;
     case Texture_Depth: glformat = GL_DEPTH; gltype = GL_DEPTH_COMPONENT; break;
     case Texture_DXT1:  glformat = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; break;
@@ -877,7 +1070,11 @@ Texture* RenderDevice::CreateTexture(int format, int width, int height, const vo
     default:
         return NULL;
     }
+    if (!glinternal)
+        glinternal = glformat;
+
     Texture* NewTex = new Texture(this, width, height);
+    NewTex->Format = format;
     glBindTexture(GL_TEXTURE_2D, NewTex->TexId);
     glGetError();
     
@@ -898,14 +1095,15 @@ Texture* RenderDevice::CreateTexture(int format, int width, int height, const vo
         }
     }
     else
-        glTexImage2D(GL_TEXTURE_2D, 0, glformat, width, height, 0, glformat, gltype, data);
+        glTexImage2D(GL_TEXTURE_2D, 0, glinternal, texwidth, height, 0, glformat, gltype, data);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    if (format == (Texture_RGBA|Texture_GenMipmaps)) // not render target
+    if (format == (Texture_RGBA|Texture_GenMipmaps) ||
+        format == (Texture_BGRA|Texture_GenMipmaps)) // not render target
     {
         int srcw = width, srch = height;
         int level = 0;
@@ -918,7 +1116,7 @@ Texture* RenderDevice::CreateTexture(int format, int width, int height, const vo
             if (mipmaps == NULL)
                 mipmaps = (UByte*)OVR_ALLOC(mipw * miph * 4);
             FilterRgba2x2(level == 1 ? (const UByte*)data : mipmaps, srcw, srch, mipmaps);
-            glTexImage2D(GL_TEXTURE_2D, level, glformat, mipw, miph, 0, glformat, gltype, mipmaps);
+            glTexImage2D(GL_TEXTURE_2D, level, glinternal, mipw, miph, 0, glformat, gltype, mipmaps);
             srcw = mipw;
             srch = miph;
         } while (srcw > 1 || srch > 1);
@@ -936,6 +1134,52 @@ Texture* RenderDevice::CreateTexture(int format, int width, int height, const vo
     return NewTex;
 }
 
+Texture* RenderDevice::CreateStreamingTexture(int format, int width, int height)
+{
+    Texture* NewTex = CreateTexture(format & ~Texture_GenMipmaps, width, height, NULL);
+    if (!NewTex)
+        return NULL;
+
+    // Single level only; clamp so the quad edges don't bleed. Packed YUV is filtered
+    // by its shader once unpacked, so its texels are read unfiltered.
+    bool   packed = ((format & Texture_TypeMask) == Texture_YUY2 || (format & Texture_TypeMask) == Texture_UYVY);
+    GLenum filter = packed ? GL_NEAREST : GL_LINEAR;
+    glBindTexture(GL_TEXTURE_2D, NewTex->TexId);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return NewTex;
+}
+
+bool RenderDevice::UpdateTexture(Render::Texture* tex, int x, int y, int w, int h, const void* data)
+{
+    GLenum glformat;
+    switch (((Texture*)tex)->Format & Texture_TypeMask)
+    {
+    case Texture_RGBA:  glformat = GL_RGBA; break;
+    case Texture_BGRA:  glformat = GL_BGRA; break;
+    case Texture_YUY2:
+    case Texture_UYVY:
+        // Two pixels per texel.
+        glformat = GL_RGBA;
+        x /= 2;
+        w /= 2;
+        break;
+    case Texture_R:     glformat = GL_ALPHA; break;
+    default:
+        return false;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, ((Texture*)tex)->TexId);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, glformat, GL_UNSIGNED_BYTE, data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return true;
+}
+
 bool RenderDevice::SetFullscreen(DisplayMode fullscreen)
 {
     Params.Fullscreen = fullscreen;
@@ -124,12 +124,14 @@ public:
     RenderDevice* Ren;
     GLuint        TexId;
     int           Width, Height;
+    int           Format;
 
     Texture(RenderDevice* r, int w, int h);
     ~Texture();
 
     virtual int GetWidth() const { return Width; }
     virtual int GetHeight() const { return Height; }
+    virtual int GetFormat() const { return Format; }
 
     virtual void SetSampleMode(int);
 
@@ -270,6 +272,8 @@ public:
 
     virtual Buffer* CreateBuffer();
     virtual Texture* CreateTexture(int format, int width, int height, const void* data, int mipcount=1);
+    virtual Texture* CreateStreamingTexture(int format, int width, int height);
+    virtual bool     UpdateTexture(Render::Texture* tex, int x, int y, int w, int h, const void* data);
     virtual ShaderSet* CreateShaderSet() { return new ShaderSet; }
 
     virtual Fill *CreateSimpleFill(int flags = Fill::F_Solid);
@@ -0,0 +1,141 @@
+#include "ServoLink.h"
+
+#if defined(OVR_OS_WIN32)
+#include "ftd2xx.h" // breakout
+#else
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+using namespace OVR;
+
+
+//-------------------------------------------------------------------------------------
+// ***** Transports
+
+#if defined(OVR_OS_WIN32)
+
+FtdiServoTransport::~FtdiServoTransport()
+{
+	FT_Close((FT_HANDLE)Handle);
+}
+
+FtdiServoTransport* FtdiServoTransport::Open(int device, int baudRate)
+{
+	FT_HANDLE handle;
+	if (FT_Open(device, &handle) != FT_OK)
+	{
+		return NULL;
+	}
+	FT_SetBaudRate(handle, baudRate);
+	FT_SetDataCharacteristics(handle, FT_BITS_8, FT_STOP_BITS_1, FT_PARITY_NONE);
+	return new FtdiServoTransport(handle);
+}
+
+bool FtdiServoTransport::Write(const UByte* data, int size)
+{
+	DWORD written = 0;
+	return FT_Write((FT_HANDLE)Handle, (LPVOID)data, size, &written) == FT_OK && (int)written == size;
+}
+
+#else
+
+SerialServoTransport::~SerialServoTransport()
+{
+	close(Fd);
+}
+
+static speed_t getBaudConstant(int baudRate)
+{
+	switch (baudRate)
+	{
+	case 4800:   return B4800;
+	case 19200:  return B19200;
+	case 38400:  return B38400;
+	case 57600:  return B57600;
+	case 115200: return B115200;
+	default:     return B9600;
+	}
+}
+
+SerialServoTransport* SerialServoTransport::Open(const char* path, int baudRate)
+{
+	int fd = open(path, O_RDWR | O_NOCTTY);
+	if (fd < 0)
+	{
+		return NULL;
+	}
+
+	// Raw 8N1, no flow control. A pty accepts these too.
+	termios tio;
+	if (tcgetattr(fd, &tio) == 0)
+	{
+		cfmakeraw(&tio);
+		tio.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS);
+		tio.c_cflag |= CS8 | CLOCAL | CREAD;
+		cfsetispeed(&tio, getBaudConstant(baudRate));
+		cfsetospeed(&tio, getBaudConstant(baudRate));
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+	return new SerialServoTransport(fd);
+}
+
+bool SerialServoTransport::Write(const UByte* data, int size)
+{
+	while (size > 0)
+	{
+		ssize_t written = write(Fd, data, size);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return false;
+		}
+		data += written;
+		size -= (int)written;
+	}
+	return true;
+}
+
+#endif
+
+bool LoopbackServoTransport::Write(const UByte* data, int size)
+{
+	for (int i = 0; i < size; i++)
+	{
+		unsigned char x, y;
+		if (ServoParserFeed(&Parser, data[i], &x, &y))
+		{
+			X = x;
+			Y = y;
+		}
+	}
+	return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+// ***** ServoLink
+
+bool ServoLink::SendPosition(UByte x, UByte y)
+{
+	if (!pTransport)
+	{
+		return false;
+	}
+
+	UByte packet[SERVO_PACKET_SIZE];
+	ServoPacketBuild(packet, Sequence++, x, y);
+
+	if (!pTransport->Write(packet, SERVO_PACKET_SIZE))
+	{
+		FailedCount++;
+		return false;
+	}
+	SentCount++;
+	return true;
+}
@@ -0,0 +1,103 @@
+#ifndef SERVO_LINK_H
+#define SERVO_LINK_H
+
+#include "OVR.h"
+#include "../mikro/ServoProtocol.h" // packet format, shared with the firmware
+
+// Byte stream to the servo controller.
+class ServoTransport : public OVR::RefCountBase<ServoTransport>
+{
+public:
+	virtual ~ServoTransport() {}
+
+	// Writes all of data, returning false if that failed.
+	virtual bool        Write(const OVR::UByte* data, int size) = 0;
+	virtual const char* GetName() const = 0;
+};
+
+#if defined(OVR_OS_WIN32)
+
+// The FTDI breakout board, through the D2XX driver.
+class FtdiServoTransport : public ServoTransport
+{
+public:
+	virtual ~FtdiServoTransport();
+
+	// Opens the given device at 8N1, returning NULL if it isn't there.
+	static FtdiServoTransport* Open(int device, int baudRate);
+
+	virtual bool        Write(const OVR::UByte* data, int size);
+	virtual const char* GetName() const { return "FTDI"; }
+
+private:
+	FtdiServoTransport(void* handle) : Handle(handle) {}
+
+	void* Handle;   // FT_HANDLE
+};
+
+#else
+
+// A serial port through termios, such as /dev/ttyUSB0 for the breakout board's
+// virtual COM port, or a pty standing in for the controller.
+class SerialServoTransport : public ServoTransport
+{
+public:
+	virtual ~SerialServoTransport();
+
+	// Opens path at 8N1, returning NULL on failure.
+	static SerialServoTransport* Open(const char* path, int baudRate);
+
+	virtual bool        Write(const OVR::UByte* data, int size);
+	virtual const char* GetName() const { return "Serial"; }
+
+private:
+	SerialServoTransport(int fd) : Fd(fd) {}
+
+	int Fd;
+};
+
+#endif
+
+// Runs what is written through the firmware's parser instead of sending it, for
+// testing without the controller.
+class LoopbackServoTransport : public ServoTransport
+{
+public:
+	LoopbackServoTransport() : X(80), Y(80) { ServoParserInit(&Parser); }
+
+	virtual bool        Write(const OVR::UByte* data, int size);
+	virtual const char* GetName() const { return "Loopback"; }
+
+	// Last position received, and the parser's statistics.
+	OVR::UByte          GetX() const { return X; }
+	OVR::UByte          GetY() const { return Y; }
+	const ServoParser&  GetParser() const { return Parser; }
+
+private:
+	ServoParser Parser;
+	OVR::UByte  X, Y;
+};
+
+// Sends servo positions (0-160, 80 centred) as numbered packets, both axes in
+// one write.
+class ServoLink
+{
+public:
+	ServoLink() : Sequence(0), SentCount(0), FailedCount(0) {}
+
+	void    SetTransport(ServoTransport* transport) { pTransport = transport; }
+	bool    IsOpen() const { return pTransport != 0; }
+	ServoTransport* GetTransport() const { return pTransport; }
+
+	bool    SendPosition(OVR::UByte x, OVR::UByte y);
+
+	OVR::UInt32 GetSentCount() const { return SentCount; }
+	OVR::UInt32 GetFailedCount() const { return FailedCount; }
+
+private:
+	OVR::Ptr<ServoTransport>  pTransport;
+	OVR::UByte                Sequence;
+	OVR::UInt32               SentCount, FailedCount;
+};
+
+#endif
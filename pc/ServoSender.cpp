@@ -0,0 +1,318 @@
+#include "ServoSender.h"
+
+#include <Kernel/OVR_Log.h>
+#include <math.h>
+#include <string.h>
+
+#if !defined(OVR_OS_WIN32)
+#include <time.h>
+#include <errno.h>
+#endif
+
+using namespace OVR;
+
+
+//-------------------------------------------------------------------------------------
+// ***** Clock
+
+// Microseconds on a clock that only goes forward. Timer::GetTicks follows the wall
+// clock on Linux, which can step.
+static UInt64 getMonotonicMks()
+{
+#if defined(OVR_OS_WIN32)
+	UInt64 ticks = Timer::GetRawTicks();
+	UInt64 freq  = Timer::GetRawFrequency();
+	return (ticks / freq) * Timer::MksPerSecond + (ticks % freq) * Timer::MksPerSecond / freq;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (UInt64)ts.tv_sec * Timer::MksPerSecond + ts.tv_nsec / 1000;
+#endif
+}
+
+static void sleepUntil(UInt64 deadlineMks)
+{
+#if defined(OVR_OS_WIN32)
+	// Sleep has 1 ms resolution with the timeBeginPeriod(1) of the OVR timer, so
+	// sleep to within a millisecond and yield for the rest.
+	while (true)
+	{
+		UInt64 now = getMonotonicMks();
+		if (now >= deadlineMks)
+		{
+			return;
+		}
+		UInt64 remaining = deadlineMks - now;
+		if (remaining > 2000)
+		{
+			::Sleep((DWORD)(remaining / 1000 - 1));
+		}
+		else
+		{
+			::SwitchToThread();
+		}
+	}
+#else
+	timespec ts;
+	ts.tv_sec  = (time_t)(deadlineMks / Timer::MksPerSecond);
+	ts.tv_nsec = (long)(deadlineMks % Timer::MksPerSecond) * 1000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR)
+	{
+	}
+#endif
+}
+
+
+//-------------------------------------------------------------------------------------
+// ***** ServoJitterHistogram
+
+void ServoJitterHistogram::Clear()
+{
+	memset(Bins, 0, sizeof(Bins));
+	Count = Skipped = LateMax = IntervalCount = 0;
+	IntervalMin = 0xFFFFFFFF;
+	IntervalMax = 0;
+	IntervalSum = IntervalSumSq = 0;
+}
+
+void ServoJitterHistogram::Add(UInt32 lateMks, UInt32 intervalMks)
+{
+	Bins[Alg::Min<UInt32>(lateMks / BinWidth, BinCount - 1)]++;
+	Count++;
+	LateMax = Alg::Max(LateMax, lateMks);
+
+	// The first send has no interval.
+	if (intervalMks)
+	{
+		IntervalMin = Alg::Min(IntervalMin, intervalMks);
+		IntervalMax = Alg::Max(IntervalMax, intervalMks);
+		IntervalSum   += intervalMks;
+		IntervalSumSq += (double)intervalMks * intervalMks;
+		IntervalCount++;
+	}
+}
+
+UInt32 ServoJitterHistogram::GetPercentile(float fraction) const
+{
+	UInt32 target = (UInt32)ceil(Count * fraction);
+	UInt32 seen = 0;
+	for (int i = 0; i < BinCount; i++)
+	{
+		seen += Bins[i];
+		if (seen >= target)
+		{
+			return (i + 1) * BinWidth;
+		}
+	}
+	return BinCount * BinWidth;
+}
+
+float ServoJitterHistogram::GetIntervalMean() const
+{
+	return IntervalCount ? float(IntervalSum / IntervalCount) : 0;
+}
+
+float ServoJitterHistogram::GetIntervalStdDev() const
+{
+	if (IntervalCount == 0)
+	{
+		return 0;
+	}
+	double mean = IntervalSum / IntervalCount;
+	return float(sqrt(Alg::Max(0.0, IntervalSumSq / IntervalCount - mean * mean)));
+}
+
+void ServoJitterHistogram::Log(const char* title, UInt32 periodMks) const
+{
+	LogText("%s: %u sends, %u slots skipped, period %.1f ms\n", title, Count, Skipped, periodMks / 1000.0f);
+	if (Count == 0)
+	{
+		return;
+	}
+	LogText("  interval: mean %.3f ms, std dev %.3f ms, min %.3f ms, max %.3f ms\n",
+	        GetIntervalMean() / 1000.0f, GetIntervalStdDev() / 1000.0f,
+	        IntervalMin / 1000.0f, IntervalMax / 1000.0f);
+	// A percentile in the last bin is only known to be past where the bin starts.
+	static const float fractions[] = { 0.5f, 0.99f, 0.999f };
+	static const char* names[]     = { "p50", "p99", "p99.9" };
+	char percentiles[3][32];
+	for (int i = 0; i < 3; i++)
+	{
+		UInt32 late = GetPercentile(fractions[i]);
+		if (late >= BinCount * BinWidth)
+			OVR_sprintf(percentiles[i], sizeof(percentiles[i]), "%s >= %.1f ms", names[i], (BinCount - 1) * BinWidth / 1000.0f);
+		else
+			OVR_sprintf(percentiles[i], sizeof(percentiles[i]), "%s < %.1f ms", names[i], late / 1000.0f);
+	}
+	LogText("  late by: %s, %s, %s, max %.3f ms\n", percentiles[0], percentiles[1], percentiles[2], LateMax / 1000.0f);
+
+	// Bins with anything in them, as bars scaled to the fullest.
+	UInt32 fullest = 0;
+	for (int i = 0; i < BinCount; i++)
+	{
+		fullest = Alg::Max(fullest, Bins[i]);
+	}
+	for (int i = 0; i < BinCount; i++)
+	{
+		if (Bins[i] == 0)
+		{
+			continue;
+		}
+		char bar[41];
+		int length = (int)((UInt64)Bins[i] * 40 / fullest);
+		memset(bar, '#', length);
+		bar[length] = 0;
+		if (i == BinCount - 1)
+		{
+			LogText("  >=%4.1f ms %7u %s\n", i * BinWidth / 1000.0f, Bins[i], bar);
+		}
+		else
+		{
+			LogText("  %4.1f-%4.1f %7u %s\n", i * BinWidth / 1000.0f, (i + 1) * BinWidth / 1000.0f, Bins[i], bar);
+		}
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+// ***** ServoSender
+
+ServoSender::ServoSender(ServoLink* link, SensorFusion* fusion, UInt32 periodMks)
+	: Thread(CreateParams(0, 0, 128 * 1024, -1, NotRunning, HighestPriority)),
+	  pLink(link), pFusion(fusion), PeriodMks(periodMks), PredictionTime(0), Started(false),
+	  PoseWrite(0), PoseRead(0)
+{
+}
+
+ServoSender::~ServoSender()
+{
+	Stop();
+}
+
+bool ServoSender::Start(ThreadState initialState)
+{
+	Started = Thread::Start(initialState);
+	return Started;
+}
+
+void ServoSender::Stop()
+{
+	if (!Started)
+	{
+		return;
+	}
+	SetExitFlag(true);
+	while (!IsFinished())
+	{
+		Thread::MSleep(1);
+	}
+	Started = false;
+}
+
+void ServoSender::GetServoPosition(Quatf orientation, UByte* x, UByte* y)
+{
+	float yaw, pitch, roll;
+	orientation.GetEulerAngles<Axis_Y, Axis_X, Axis_Z>(&yaw, &pitch, &roll);
+
+	yaw = RadToDegree(yaw);
+	if (yaw > SERVO_MEDIAN_BOUNDARY) {
+		*x = SERVO_MAX_BOUNDARY;
+	}
+	else if (yaw < -SERVO_MEDIAN_BOUNDARY) {
+		*x = SERVO_MIN_BOUNDARY;
+	}
+	else {
+		*x = (UByte)(SERVO_MEDIAN_BOUNDARY + yaw);
+	}
+
+	pitch = RadToDegree(pitch);
+	if (pitch < -SERVO_MEDIAN_BOUNDARY) {
+		*y = SERVO_MAX_BOUNDARY;
+	}
+	else if (pitch > SERVO_MEDIAN_BOUNDARY) {
+		*y = SERVO_MIN_BOUNDARY;
+	}
+	else {
+		*y = (UByte)(SERVO_MEDIAN_BOUNDARY - pitch);
+	}
+}
+
+int ServoSender::Run()
+{
+	SetThreadName("Servo Sender");
+
+	UInt64 deadline = getMonotonicMks() + PeriodMks;
+	UInt64 lastSend = 0;
+
+	while (!GetExitFlag())
+	{
+		sleepUntil(deadline);
+		UInt64 now = getMonotonicMks();
+		send();
+
+		// Slots that have passed by now are dropped rather than sent back to back.
+		UInt32 late    = (UInt32)(now - deadline);
+		UInt32 skipped = late / PeriodMks;
+		deadline += (UInt64)(skipped + 1) * PeriodMks;
+
+		Lock::Locker lockScope(&JitterLock);
+		Jitter.Add(late, lastSend ? (UInt32)(now - lastSend) : 0);
+		Jitter.Skipped += skipped;
+		lastSend = now;
+	}
+	return 0;
+}
+
+void ServoSender::send()
+{
+	float predictionTime = PredictionTime;
+	Quatf orientation = (predictionTime > 0) ? pFusion->GetPredictedOrientation(predictionTime)
+	                                         : pFusion->GetOrientation();
+	UByte x, y;
+	GetServoPosition(orientation, &x, &y);
+
+	if (!pLink->SendPosition(x, y))
+	{
+		return;
+	}
+
+	UInt32 written = PoseWrite;
+	Poses[written % PoseRingSize] = ServoPose(Timer::GetTicks(),
+	                                          DegreeToRad((float)(x - SERVO_MEDIAN_BOUNDARY)),
+	                                          DegreeToRad((float)(SERVO_MEDIAN_BOUNDARY - y)));
+	PoseWrite.Store_Release(written + 1);
+}
+
+bool ServoSender::PopSentPose(ServoPose* pose)
+{
+	while (true)
+	{
+		UInt32 written = PoseWrite.Load_Acquire();
+		if (PoseRead == written)
+		{
+			return false;
+		}
+
+		// The slot after the newest may be being written, so only PoseRingSize - 1
+		// poses can be read back.
+		if (written - PoseRead > PoseRingSize - 1)
+		{
+			PoseRead = written - (PoseRingSize - 1);
+		}
+		*pose = Poses[PoseRead % PoseRingSize];
+
+		// Keep it only if the sender didn't come round to the slot while it was copied;
+		// the full barrier keeps the copy before the read.
+		if (PoseWrite.ExchangeAdd_Sync(0) - PoseRead <= PoseRingSize - 1)
+		{
+			PoseRead++;
+			return true;
+		}
+	}
+}
+
+void ServoSender::GetJitter(ServoJitterHistogram* jitter) const
+{
+	Lock::Locker lockScope(&JitterLock);
+	*jitter = Jitter;
+}
@@ -0,0 +1,100 @@
+#ifndef SERVO_SENDER_H
+#define SERVO_SENDER_H
+
+#include "OVR.h"
+#include <Kernel/OVR_Threads.h>
+#include "ServoLink.h"
+#include "VideoTimewarp.h" // ServoPose
+
+// Servo range in degrees of head rotation: 0-160, 80 centred.
+const unsigned char SERVO_MAX_BOUNDARY = 160;
+const unsigned char SERVO_MIN_BOUNDARY = 0;
+const unsigned char SERVO_MEDIAN_BOUNDARY = 80;
+
+// Timing of the sends: how late each one went out against its slot on the
+// schedule, in BinWidth microsecond bins with the last bin taking the rest, and
+// the interval between consecutive sends.
+struct ServoJitterHistogram
+{
+	enum { BinWidth = 100, BinCount = 50 };
+
+	OVR::UInt32  Bins[BinCount];
+	OVR::UInt32  Count;
+	OVR::UInt32  Skipped;        // Slots dropped because the thread woke after the next one
+	OVR::UInt32  LateMax;        // The last bin has no upper bound; this is how far it goes
+	OVR::UInt32  IntervalMin, IntervalMax;
+	double       IntervalSum, IntervalSumSq;
+	OVR::UInt32  IntervalCount;
+
+	ServoJitterHistogram() { Clear(); }
+
+	void    Clear();
+	void    Add(OVR::UInt32 lateMks, OVR::UInt32 intervalMks);
+
+	// Lateness within which the given fraction of sends went out, to the bin. Returns
+	// BinCount * BinWidth if that takes the last bin, which only says the fraction is
+	// reached somewhere from the last bin's start up to LateMax.
+	OVR::UInt32 GetPercentile(float fraction) const;
+	float   GetIntervalMean() const;
+	float   GetIntervalStdDev() const;
+
+	void    Log(const char* title, OVR::UInt32 periodMks) const;
+};
+
+// Sends the head orientation to the servos from its own thread, every period on
+// a schedule kept with the monotonic clock, so the servos no longer wait for
+// frames. The orientation is read from SensorFusion's lock-free snapshot, and
+// predicted ahead by the prediction time when that is set.
+//
+// The poses sent are handed to the render thread through a ring it drains with
+// PopSentPose, since VideoTimewarp is not shared between threads. If the render
+// thread falls more than the ring behind, the oldest poses are lost.
+class ServoSender : public OVR::Thread
+{
+public:
+	ServoSender(ServoLink* link, OVR::SensorFusion* fusion, OVR::UInt32 periodMks = 15000);
+	~ServoSender();
+
+	virtual bool Start(ThreadState initialState = Running);
+
+	// Asks the thread to exit and waits until it has.
+	void    Stop();
+
+	OVR::UInt32 GetPeriod() const { return PeriodMks; }
+
+	// Seconds to predict the orientation ahead by, or 0 to send it as it is.
+	void    SetPredictionTime(float seconds) { PredictionTime = seconds; }
+	float   GetPredictionTime() const { return PredictionTime; }
+
+	// Takes the oldest pose sent that hasn't been taken yet; false if there is none.
+	bool    PopSentPose(ServoPose* pose);
+
+	// Copy of the timing so far.
+	void    GetJitter(ServoJitterHistogram* jitter) const;
+
+	// Servo positions for an orientation, clamped to the servo range.
+	static void GetServoPosition(OVR::Quatf orientation, OVR::UByte* x, OVR::UByte* y);
+
+	virtual int Run();
+
+private:
+	enum { PoseRingSize = 256 };
+
+	void    send();
+
+	ServoLink*                   pLink;
+	OVR::SensorFusion*           pFusion;
+	OVR::UInt32                  PeriodMks;
+	volatile float               PredictionTime;
+	bool                         Started;
+
+	// Written only by the sender; PoseRead only by the render thread.
+	ServoPose                    Poses[PoseRingSize];
+	OVR::AtomicInt<OVR::UInt32>  PoseWrite;
+	OVR::UInt32                  PoseRead;
+
+	mutable OVR::Lock            JitterLock;
+	ServoJitterHistogram         Jitter;
+};
+
+#endif
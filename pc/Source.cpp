@@ -2,8 +2,13 @@
 #include <atlbase.h> // for CComPtr implementation
 #include <dshow.h> // direct show
 #include "SampleGrabber.h" // our own sample grabber header file
-
-#include <sys\timeb.h>
+#include "GrabberFrameSource.h" // video frames from the grabbers, or test sources
+#include "Swizzle.h" // bgra -> rgba, if the renderer has no bgra textures
+#include "CpuDistortion.h" // lens distortion on the cpu, for benchmarks and reference images
+#include "VideoTimewarp.h" // shifts the video by head movement the servos lag behind
+#include "ServoLink.h" // servo packets to the breakout board
+#include "ServoSender.h" // sends them from its own thread, on a fixed period
+#include "FusionBenchmark.h" // sensor fusion read latency under contention
 
 
 #include "OVR.h"
@@ -18,17 +23,17 @@
 
 #include <time.h>
 
-#include "ftd2xx.h" // breakout
 
 
 using namespace OVR;
 using namespace OVR::Platform;
 using namespace OVR::Render;
 
-const int SEND_DELAY = 15;
-const unsigned char SERVO_MAX_BOUNDARY = 160;
-const unsigned char SERVO_MIN_BOUNDARY = 0;
-const unsigned char SERVO_MEDIAN_BOUNDARY = 80;
+// Time between servo commands, in microseconds; see ServoSender.
+const UInt32 SERVO_PERIOD = 15000;
+
+// Number of frames kept for the frame time percentile shown with the FPS.
+const int FRAME_TIME_HISTORY = 512;
 
 
 //-------------------------------------------------------------------------------------
@@ -80,6 +85,9 @@ public:
     virtual void OnResize(int width, int height);
 
     void         Render(const StereoEyeParams& stereo);
+    // Both eyes in one scene with a single distortion pass.
+    void         RenderStereo(const StereoEyeParams& left, const StereoEyeParams& right);
+    void         RenderEye(const StereoEyeParams& stereo);
 
     // Sets temporarily displayed message for adjustments
     void         SetAdjustMessage(const char* format, ...);
@@ -110,10 +118,16 @@ public:
 	HRESULT GetGraph(IGraphBuilder **pGraph, const WCHAR*, int nr);
 	HRESULT GetGrabber(ISampleGrabber **grabber, IGraphBuilder *pGraph, int nr);
 	HRESULT LoadGraphFile(IGraphBuilder *pGraph, const WCHAR* wszName, int nr);
-	HRESULT CheckGrabberStatus(int nr);
+	HRESULT SetupGrabberSources();
 
-	void GrabFrame(ISampleGrabber *grabber, long &pBufferSize, unsigned char *buffer);
 	void AdjustPictureSize(float dt);
+	void AdjustServoLatency(float dt);
+
+	void CreateVideoTextures();
+	void RenderVideo(int nr);
+	void UpdateVideoStats();
+
+	void UpdateFrameTimes(float dt);
 
 
     // Magnetometer calibration procedure
@@ -128,21 +142,101 @@ protected:
 
 	// Our grabber stuff
 	int grabberWidth1, grabberHeight1, grabberWidth2, grabberHeight2;
-	float screenRatio1, screenRatio2;
 	ISampleGrabber *grabber_isg1, *grabber_isg2;
 	IMediaControl *pControl1, *pControl2;
-	unsigned char *pBuffer1, *pBuffer2;
-	long pBufferSize1, pBufferSize2;
 	float pictureSize = 1.f;
-	time_t lastSampleTest1, lastSampleTest2;
 	bool hasStarted = false;
 
-	// breakout
-	FT_HANDLE ftHandle;
-	DWORD BytesWritten;
-	struct timeb lastSend, now;
-	int lastSendValue = 2;
-	bool shouldSend = false;
+	// One per camera. Frames arrive through the source's triple buffer; the texture is
+	// created once and streamed into, unless streamingVideo is toggled off (T) to
+	// compare with creating a texture every frame.
+	struct VideoStream
+	{
+		Ptr<FrameSource> Source;
+		Ptr<Texture>     Tex;
+		Ptr<ShaderFill>  Fill;
+		float            ScreenRatio;
+		int              TexFormat;
+		UInt32           UploadedSequence;
+		UInt64           ShownCaptureTicks; // Capture time of a frame first shown this frame
+
+		VideoStream() : ScreenRatio(1.f), TexFormat(Texture_BGRA), UploadedSequence(0), ShownCaptureTicks(0) {}
+	};
+	VideoStream video[2];
+	bool streamingVideo = true;
+	bool singlePassStereo = true;
+
+	// Draw calls and render target changes in the last frame.
+	RenderStats lastRenderStats;
+
+	// Test video instead of the grabbers (-video synthetic|<raw file>), at -videosize
+	// in -videoformat (bgra, yuy2 or uyvy).
+	String videoArg;
+	int videoArgWidth = 728, videoArgHeight = 488;
+	FramePixelFormat videoArgFormat = FramePixel_BGRA;
+
+	// Benchmark the CPU distortion at startup (-distortbench), optionally saving its
+	// output as a reference image (-distortgolden <tga file>).
+	bool distortBench = false;
+	String distortGoldenPath;
+
+	// Check and time every BGRA swizzle implementation against the scalar loop (-swizzlebench).
+	bool swizzleBench = false;
+
+	// Benchmark reading the head orientation while the sensor thread writes it
+	// (-fusionbench [reader threads]).
+	int fusionBenchReaders = 0;
+
+	// Tracker data is recorded to a trace (-record <file>) through the fusion's
+	// delegate handler, or a trace is run through a separate fusion at startup
+	// (-replay <file> [orientation output]).
+	Util::SensorTraceRecorder traceRecorder;
+	String recordPath, replayPath, replayOutPath;
+
+	// Gain sweep over a trace, scored against a reference orientation trace
+	// (-fusionsweep <trace> <reference> [threads]).
+	String sweepTracePath, sweepReferencePath;
+	int sweepThreads = 0;
+
+	// Throughput and agreement of SensorFusionBatch against SensorFusion, over a trace
+	// or synthetic motion (-fusionbatchbench [trace]).
+	bool fusionBatchBench = false;
+	String fusionBatchTracePath;
+
+	// SensorFilter median cost across window sizes (-medianbench).
+	bool medianBench = false;
+
+	// Sensor fusion cost as magnetometer references accumulate (-magrefbench).
+	bool magRefBench = false;
+
+	// Orientation predictor error at 20-80 ms over a trace or synthetic motion (-predicteval [trace]).
+	bool predictEval = false;
+	const char* predictEvalTracePath = 0;
+
+	// Render thread upload time and capture to display latency, averaged each second.
+	UInt64 uploadTicks = 0, latencyTicks = 0, uploadBytes = 0;
+	int uploadCount = 0, latencyCount = 0;
+	float videoUploadMs = 0, videoLatencyMs = 0, videoUploadMBps = 0;
+
+	// breakout, or the firmware's parser with "-servo loopback"
+	ServoLink servoLink;
+	String servoArg;
+	Ptr<ServoSender> servoSender;
+
+	// Servo sender timing while the render loop stalls (-servobench [period ms]).
+	bool servoBench = false;
+	UInt32 servoBenchPeriod = SERVO_PERIOD;
+
+	// Throughput and round trip latency of ThreadCommandQueue (-commandqueuebench).
+	bool commandQueueBench = false;
+
+	// Poses sent to the servos are recorded so each frame can be shifted by how far
+	// the head has turned past what it shows. The head orientation for that is
+	// sampled just before rendering.
+	VideoTimewarp timewarp;
+	bool useTimewarp = true;
+	float servoYaw = 0, servoPitch = 0;
+	float displayYaw = 0, displayPitch = 0;
 
 
     // *** Oculus HMD Variables
@@ -158,6 +252,12 @@ protected:
     int                 FrameCounter;
     double              NextFPSUpdate;
 
+    // Recent frame times, for the 99th percentile frame time.
+    Array<float>        FrameTimes;
+    Array<float>        SortedFrameTimes;
+    int                 FrameTimeIndex;
+    float               FrameTime99;
+
     // Loading process displays screenshot in first frame
     // and then proceeds to load until finished.
     enum LoadingStateType
@@ -253,12 +353,31 @@ OculusWorldDemoApp::OculusWorldDemoApp()
     FrameCounter = 0;
     NextFPSUpdate = 0;
 
+    FrameTimes.Resize(FRAME_TIME_HISTORY);
+    SortedFrameTimes.Resize(FRAME_TIME_HISTORY);
+    for (int i = 0; i < FRAME_TIME_HISTORY; i++)
+        FrameTimes[i] = 0;
+    FrameTimeIndex = 0;
+    FrameTime99 = 0;
+
     AdjustMessageTimeout = 0;
 }
 
 OculusWorldDemoApp::~OculusWorldDemoApp()
 {
-	FT_Close(ftHandle);
+	for (int i = 0; i < 2; i++) {
+		if (video[i].Source) {
+			video[i].Source->Stop();
+		}
+	}
+	if (servoSender) {
+		servoSender->Stop();
+		ServoJitterHistogram jitter;
+		servoSender->GetJitter(&jitter);
+		jitter.Log("Servo sends", servoSender->GetPeriod());
+	}
+	SFusion.SetDelegateMessageHandler(0);
+	traceRecorder.Close();
 	if (DejaVu.fill)
 	{
 		DejaVu.fill->Release();
@@ -374,6 +493,92 @@ int OculusWorldDemoApp::OnStartup(int argc, const char** argv)
         {
             RenderParams.Fullscreen = true;
         }
+        else if(!strcmp(argv[i], "-video") && i < argc - 1)
+        {
+            videoArg = argv[i + 1];
+        }
+        else if(!strcmp(argv[i], "-videosize") && i < argc - 2)
+        {
+            videoArgWidth = atoi(argv[i + 1]);
+            videoArgHeight = atoi(argv[i + 2]);
+        }
+        else if(!strcmp(argv[i], "-videoformat") && i < argc - 1)
+        {
+            if (!strcmp(argv[i + 1], "yuy2"))
+                videoArgFormat = FramePixel_YUY2;
+            else if (!strcmp(argv[i + 1], "uyvy"))
+                videoArgFormat = FramePixel_UYVY;
+            else
+                videoArgFormat = FramePixel_BGRA;
+        }
+        else if(!strcmp(argv[i], "-distortbench"))
+        {
+            distortBench = true;
+        }
+        else if(!strcmp(argv[i], "-swizzlebench"))
+        {
+            swizzleBench = true;
+        }
+        else if(!strcmp(argv[i], "-distortgolden") && i < argc - 1)
+        {
+            distortBench = true;
+            distortGoldenPath = argv[i + 1];
+        }
+        else if(!strcmp(argv[i], "-fusionbench"))
+        {
+            fusionBenchReaders = (i < argc - 1 && atoi(argv[i + 1]) > 0) ? atoi(argv[i + 1]) : 2;
+        }
+        else if(!strcmp(argv[i], "-record") && i < argc - 1)
+        {
+            recordPath = argv[i + 1];
+        }
+        else if(!strcmp(argv[i], "-replay") && i < argc - 1)
+        {
+            replayPath = argv[i + 1];
+            if (i < argc - 2 && argv[i + 2][0] != '-')
+                replayOutPath = argv[i + 2];
+        }
+        else if(!strcmp(argv[i], "-fusionsweep") && i < argc - 2)
+        {
+            sweepTracePath = argv[i + 1];
+            sweepReferencePath = argv[i + 2];
+            if (i < argc - 3)
+                sweepThreads = atoi(argv[i + 3]);
+        }
+        else if(!strcmp(argv[i], "-fusionbatchbench"))
+        {
+            fusionBatchBench = true;
+            if (i < argc - 1 && argv[i + 1][0] != '-')
+                fusionBatchTracePath = argv[i + 1];
+        }
+        else if(!strcmp(argv[i], "-medianbench"))
+        {
+            medianBench = true;
+        }
+        else if(!strcmp(argv[i], "-magrefbench"))
+        {
+            magRefBench = true;
+        }
+        else if(!strcmp(argv[i], "-predicteval"))
+        {
+            predictEval = true;
+            if (i < argc - 1 && argv[i + 1][0] != '-')
+                predictEvalTracePath = argv[i + 1];
+        }
+        else if(!strcmp(argv[i], "-servobench"))
+        {
+            servoBench = true;
+            if (i < argc - 1 && argv[i + 1][0] != '-')
+                servoBenchPeriod = (UInt32)(atof(argv[i + 1]) * 1000);
+        }
+        else if(!strcmp(argv[i], "-commandqueuebench"))
+        {
+            commandQueueBench = true;
+        }
+        else if(!strcmp(argv[i], "-servo") && i < argc - 1)
+        {
+            servoArg = argv[i + 1];
+        }
     }
 
     // Enable multi-sampling by default.
@@ -403,6 +608,83 @@ int OculusWorldDemoApp::OnStartup(int argc, const char** argv)
     pRender->SetSceneRenderScale(SConfig.GetDistortionScale());
     //pRender->SetSceneRenderScale(1.0f);
 
+    if (swizzleBench)
+    {
+        BenchmarkSwizzle();
+    }
+
+    if (distortBench)
+    {
+        BenchmarkCpuDistortion(SConfig, distortGoldenPath.IsEmpty() ? 0 : distortGoldenPath.ToCStr());
+    }
+
+    if (fusionBenchReaders > 0)
+    {
+        BenchmarkSensorFusionReads(fusionBenchReaders);
+    }
+
+    if (!replayPath.IsEmpty())
+    {
+        LogText("\nSensor Trace Replay\n-------------------\n");
+        SensorFusion replayFusion;
+        Util::SensorTraceReplayStats stats;
+        if (Util::ReplaySensorTrace(replayPath.ToCStr(), replayFusion,
+                                    replayOutPath.IsEmpty() ? 0 : replayOutPath.ToCStr(), &stats))
+        {
+            float yaw, pitch, roll;
+            stats.FinalOrientation.GetEulerAngles<Axis_Y, Axis_X, Axis_Z>(&yaw, &pitch, &roll);
+            LogText("%u samples in %.3f s, %.0f samples/s\n", stats.Samples, stats.Seconds, stats.SamplesPerSecond);
+            LogText("Final yaw %.3f, pitch %.3f, roll %.3f\n", RadToDegree(yaw), RadToDegree(pitch), RadToDegree(roll));
+        }
+        else
+        {
+            LogText("Couldn't replay %s\n", replayPath.ToCStr());
+        }
+    }
+
+    if (!sweepTracePath.IsEmpty())
+    {
+        SweepSensorFusionGains(sweepTracePath.ToCStr(), sweepReferencePath.ToCStr(), sweepThreads);
+    }
+
+    if (fusionBatchBench)
+    {
+        BenchmarkSensorFusionBatch(fusionBatchTracePath.IsEmpty() ? 0 : fusionBatchTracePath.ToCStr());
+    }
+
+    if (medianBench)
+    {
+        BenchmarkSensorFilterMedian();
+    }
+
+    if (magRefBench)
+    {
+        BenchmarkMagReferenceLookup();
+    }
+
+    if (predictEval)
+    {
+        EvaluateOrientationPredictors(predictEvalTracePath);
+    }
+
+    if (commandQueueBench)
+    {
+        BenchmarkThreadCommandQueue();
+    }
+
+    if (!recordPath.IsEmpty())
+    {
+        if (traceRecorder.Open(recordPath.ToCStr()))
+        {
+            SFusion.SetDelegateMessageHandler(&traceRecorder);
+            LogText("\nRecording tracker data to %s\n", recordPath.ToCStr());
+        }
+        else
+        {
+            LogText("\nCouldn't record tracker data to %s\n", recordPath.ToCStr());
+        }
+    }
+
     SConfig.Set2DAreaFov(DegreeToRad(85.0f));
 
 
@@ -413,79 +695,53 @@ int OculusWorldDemoApp::OnStartup(int argc, const char** argv)
 	// Breakout 
 	LogText("\nBreakout Board Setup\n--------------------\n");
 
-	FT_STATUS result;
-	result = FT_Open(0, &ftHandle);
-	if (result == FT_OK) {
-		FT_SetBaudRate(ftHandle, 9600);
-		FT_SetDataCharacteristics(ftHandle, FT_BITS_8, FT_STOP_BITS_1, FT_PARITY_NONE);
-
-		LogText("Got handler\n");
-		shouldSend = true;
+	// "-servo loopback" runs the packets through the firmware's parser instead.
+	Ptr<ServoTransport> transport;
+	if (servoArg == "loopback") {
+		transport = *new LoopbackServoTransport();
 	}
 	else {
-		LogText("Couldn't open handler\n");
+		transport = *FtdiServoTransport::Open(0, 9600);
 	}
 
+	if (transport) {
+		if (servoBench) {
+			BenchmarkServoSender(transport, servoBenchPeriod);
+		}
+		servoLink.SetTransport(transport);
+		LogText("Got handler (%s)\n", transport->GetName());
 
-	// DIRECT SHOW
-	HRESULT hr;
-	IGraphBuilder *pGraph1, *pGraph2;
-
-
-	LogText("\nGraph Setup\n-----------\n");
-	hr = GetGraph(&pGraph1, L"D:\\prog\\eit\\FINAL_graph_norender.grf", 1);
-	if (FAILED(hr)) {
-		LogText("Graph1 failed. \nABORTING...\n");
-		return -1;
-	}
-	hr = GetGraph(&pGraph2, L"D:\\prog\\eit\\FINAL_graph_2_norender.grf", 2);
-	if (FAILED(hr)) {
-		LogText("Graph2 failed. \nABORTING...\n");
-		return -1;
-	}
+		// Started once loading has finished.
+		servoSender = *new ServoSender(&servoLink, &SFusion, SERVO_PERIOD);
+		servoSender->SetPredictionTime(timewarp.GetServoLatency());
 
-	LogText("\nSample Grabber Setup\n--------------------\n");
-	hr = GetGrabber(&grabber_isg1, pGraph1, 1);
-	if (FAILED(hr)) {
-		LogText("ABORTING...\n");
-		return -1;
+		// Until it sends, the cameras are taken to follow the head.
+		timewarp.SetOrientationHistory(&SFusion);
 	}
-	hr = GetGrabber(&grabber_isg2, pGraph2, 2);
-	if (FAILED(hr)) {
-		LogText("ABORTING...\n");
-		return -1;
+	else {
+		LogText("Couldn't open handler\n");
 	}
 
 
-	AM_MEDIA_TYPE am1, am2;
-	grabber_isg1->GetConnectedMediaType(&am1);
-	grabber_isg2->GetConnectedMediaType(&am2);
-
-	VIDEOINFOHEADER *vh1 = (VIDEOINFOHEADER*)am1.pbFormat;
-	grabberWidth1 = vh1->bmiHeader.biWidth;
-	grabberHeight1 = vh1->bmiHeader.biHeight;
-
-	VIDEOINFOHEADER *vh2 = (VIDEOINFOHEADER*)am2.pbFormat;
-	grabberWidth2 = vh2->bmiHeader.biWidth;
-	grabberHeight2 = vh2->bmiHeader.biHeight;
-
-	screenRatio1 = ((float)grabberWidth1) / grabberHeight1;
-	screenRatio2 = ((float)grabberWidth2) / grabberHeight2;
-
-	LogText("Size is: %ix%i, ratio: %4.2f (1)\n", grabberWidth1, grabberHeight1, screenRatio1);
-	LogText("Size is: %ix%i, ratio: %4.2f (2)\n", grabberWidth2, grabberHeight2, screenRatio2);
-
-	hr = pGraph1->QueryInterface(IID_IMediaControl, (void **)&pControl1);
-	hr = pGraph2->QueryInterface(IID_IMediaControl, (void **)&pControl2);
-
-	pBufferSize1 = grabberWidth1 * grabberHeight1 * 4;
-	pBufferSize2 = grabberWidth2 * grabberHeight2 * 4;
-	LogText("Guessing on buffersize: %i (1)\n", pBufferSize1);
-	LogText("Guessing on buffersize: %i (2)\n", pBufferSize2);
+	// Test video, no capture hardware needed
+	if (!videoArg.IsEmpty()) {
+		LogText("\nTest Video Setup\n----------------\n");
+		for (int i = 0; i < 2; i++) {
+			if (videoArg == "synthetic") {
+				video[i].Source = *new SyntheticFrameSource(videoArgWidth, videoArgHeight, videoArgFormat);
+			}
+			else {
+				video[i].Source = *new FileFrameSource(videoArg, videoArgWidth, videoArgHeight, videoArgFormat);
+			}
+			video[i].ScreenRatio = ((float)videoArgWidth) / videoArgHeight;
+		}
+		LogText("Using %s video, %ix%i\n", videoArg.ToCStr(), videoArgWidth, videoArgHeight);
+		return 0;
+	}
 
+	// DIRECT SHOW
+	HRESULT hr = SetupGrabberSources();
 	if (SUCCEEDED(hr)) {
-		grabber_isg1->SetBufferSamples(true);
-		grabber_isg2->SetBufferSamples(true);
 		return 0;
 	}
 
@@ -575,6 +831,30 @@ void OculusWorldDemoApp::OnKey(OVR::KeyCode key, int chr, bool down, int modifie
         SetAdjustMessage("Sensor Fusion Reset");
         break;
 
+	case Key_T:
+		if (down)
+		{
+			streamingVideo = !streamingVideo;
+			SetAdjustMessage("Video Textures: %s", streamingVideo ? "Streaming" : "Per Frame");
+		}
+		break;
+
+	case Key_G:
+		if (down)
+		{
+			singlePassStereo = !singlePassStereo;
+			SetAdjustMessage("Stereo Rendering: %s", singlePassStereo ? "Single Pass" : "Per Eye");
+		}
+		break;
+
+	case Key_X:
+		if (down)
+		{
+			pRender->SetDistortionMeshEnabled(!pRender->IsDistortionMeshEnabled());
+			SetAdjustMessage("Distortion: %s", pRender->IsDistortionMeshEnabled() ? "Mesh" : "Per Pixel");
+		}
+		break;
+
     case Key_Space:
         if (!down)
         {
@@ -663,6 +943,22 @@ void OculusWorldDemoApp::OnKey(OVR::KeyCode key, int chr, bool down, int modifie
         AdjustDirection = -1;
         break;
 
+	case Key_E:
+		if (down)
+		{
+			useTimewarp = !useTimewarp;
+			SetAdjustMessage("Video Timewarp: %s", useTimewarp ? "On" : "Off");
+		}
+		break;
+	case Key_D:
+		pAdjustFunc = down ? &OculusWorldDemoApp::AdjustServoLatency : 0;
+		AdjustDirection = 1;
+		break;
+	case Key_A:
+		pAdjustFunc = down ? &OculusWorldDemoApp::AdjustServoLatency : 0;
+		AdjustDirection = -1;
+		break;
+
 	case Key_W:
 		pAdjustFunc = down ? &OculusWorldDemoApp::AdjustPictureSize : 0;
 		AdjustDirection = 1;
@@ -883,30 +1179,28 @@ void OculusWorldDemoApp::OnIdle()
 		LogText("\nStarting Loading\n----------------\n");
 		LogText("Showing Loading Screen\n");
 		LoadingState = LoadingState_Loading;
-
-		ftime(&lastSend); // init last send
 	} else if (LoadingState == LoadingState_Loading) {
 		if (!hasStarted) {
-			pControl1->Run();
-			pControl2->Run();
-			LogText("Graph is started\n");
-			LogText("Waiting for Sample Grabber\n");
+			CreateVideoTextures();
+			if (!video[0].Source->Start() || !video[1].Source->Start()) {
+				LogText("Couldn't start video sources\n");
+			}
+			LogText("Video sources are started\n");
+			LogText("Waiting for first frames\n");
 			hasStarted = true;
 		}
 		
-		HRESULT hr1 = CheckGrabberStatus(1);
-		HRESULT hr2 = CheckGrabberStatus(2);
-		if (hr1 >= 0 && hr2 >= 0) {
-			LogText("Buffer size is %i (1)\n", pBufferSize1);
-			LogText("Buffer size is %i (2)\n", pBufferSize2);
-			LogText("Sample Grabbers ready\n");
+		if (video[0].Source->HasFrame() && video[1].Source->HasFrame()) {
+			LogText("Video sources ready\n");
 
 			LogText("\nLoading Complete\n----------------\nPLAYBACK STARTED\n\n");
 
 			SConfig.SetIPD(0.f);
 			LoadingState = LoadingState_Finished;
-			pBuffer1 = new unsigned char[pBufferSize1];
-			pBuffer2 = new unsigned char[pBufferSize2];
+
+			if (servoSender) {
+				servoSender->Start();
+			}
 		}
     }
     
@@ -922,8 +1216,10 @@ void OculusWorldDemoApp::OnIdle()
 		NextFPSUpdate = curtime + 1.0;
 		FPS = FrameCounter;
 		FrameCounter = 0;
+		UpdateVideoStats();
 	}
 	FrameCounter++;
+	UpdateFrameTimes(dt);
 
     // Rotate and position View Camera, using YawPitchRoll in BodyFrame coordinates.
     //
@@ -953,71 +1249,19 @@ void OculusWorldDemoApp::OnIdle()
     //         Matrix4f::Translation(-EyePos);
 
 
-	// breakout send stuff
-	ftime(&now);
-
-	int msSinceLastSend = (1000 * (now.time - lastSend.time))
-		+ (now.millitm - lastSend.millitm);
-
-	if (shouldSend && msSinceLastSend >= SEND_DELAY && LoadingState == LoadingState_Finished) {
-		
-
-		Quatf quaternion = SFusion.GetOrientation();
-		float yaw, pitch, roll;
-		quaternion.GetEulerAngles<Axis_Y, Axis_X, Axis_Z>(&yaw, &pitch, &roll);
-
-
-		if (lastSendValue == 2) {
-			lastSendValue = 0;
-
-			unsigned char start = 255;
-			FT_Write(ftHandle, &start, 1, &BytesWritten);
-			//LogText("sent startbyte\n");
-		}
-		else if (lastSendValue == 0) {
-			lastSendValue = 1;
-
-			yaw = RadToDegree(yaw);
-			unsigned char ayaw;
-
-			if (yaw > SERVO_MEDIAN_BOUNDARY) {
-				ayaw = SERVO_MAX_BOUNDARY;
-			}
-			else if (yaw < -SERVO_MEDIAN_BOUNDARY) {
-				ayaw = SERVO_MIN_BOUNDARY;
-			}
-			else {
-				ayaw = SERVO_MEDIAN_BOUNDARY + yaw;
-			}
-
-			FT_Write(ftHandle, &ayaw, 1, &BytesWritten);
-			//LogText("Sent yaw: %i\n", ayaw);
-		}
-		else {
-			lastSendValue = 2;
-
-			pitch = RadToDegree(pitch);
-			unsigned char apitch;
-
-
-			if (pitch < -SERVO_MEDIAN_BOUNDARY){
-				apitch = SERVO_MAX_BOUNDARY;
-			}
-			else if (pitch > SERVO_MEDIAN_BOUNDARY){
-				apitch = SERVO_MIN_BOUNDARY;
-			}
-			else {
-				apitch = SERVO_MEDIAN_BOUNDARY - pitch;
-			}
-
-			FT_Write(ftHandle, &apitch, 1, &BytesWritten);
-			//LogText("Sent pitch: %i\n", apitch);
-		}
-
-		// update last send time
-		ftime(&lastSend);
+	// Poses the servo sender has sent since the last frame. It aims the cameras
+	// where the head will be when their frames are shown.
+	ServoPose sentPose;
+	while (servoSender && servoSender->PopSentPose(&sentPose)) {
+		servoYaw = sentPose.Yaw;
+		servoPitch = sentPose.Pitch;
+		timewarp.RecordServoPose(sentPose.Ticks, sentPose.Yaw, sentPose.Pitch);
 	}
 
+	// Late latch the head orientation the video is reprojected to.
+	float displayRoll;
+	SFusion.GetPredictedOrientation().GetEulerAngles<Axis_Y, Axis_X, Axis_Z>(&displayYaw, &displayPitch, &displayRoll);
+
 
     switch(SConfig.GetStereoMode())
     {
@@ -1027,15 +1271,36 @@ void OculusWorldDemoApp::OnIdle()
 
     case Stereo_LeftRight_Multipass:
         //case Stereo_LeftDouble_Multipass:
-        Render(SConfig.GetEyeRenderParams(StereoEye_Left));
-        Render(SConfig.GetEyeRenderParams(StereoEye_Right));
+        if (singlePassStereo)
+        {
+            RenderStereo(SConfig.GetEyeRenderParams(StereoEye_Left),
+                         SConfig.GetEyeRenderParams(StereoEye_Right));
+        }
+        else
+        {
+            Render(SConfig.GetEyeRenderParams(StereoEye_Left));
+            Render(SConfig.GetEyeRenderParams(StereoEye_Right));
+        }
         break;
 
     }
 
+    lastRenderStats = pRender->GetStats();
+    pRender->ResetStats();
+
     pRender->Present();
     // Force GPU to flush the scene, resulting in the lowest possible latency.
     pRender->ForceFlushGPU();
+
+	// Capture to display latency of the frames that were just shown.
+	UInt64 presentTicks = Timer::GetTicks();
+	for (int i = 0; i < 2; i++) {
+		if (video[i].ShownCaptureTicks) {
+			latencyTicks += presentTicks - video[i].ShownCaptureTicks;
+			latencyCount++;
+			video[i].ShownCaptureTicks = 0;
+		}
+	}
 }
 
 
@@ -1048,7 +1313,12 @@ static const char* HelpText =
     "F11        \t100 Fast FullScreen                   \t500 - +       \t660 Adj EyeHeight\n"                                           
     "C          \t100 Chromatic Ab                      \t500 [ ]       \t660 Adj FOV\n"
     "P          \t100 Motion Pred                       \t500 Shift     \t660 Adj Faster\n"
+    "T          \t100 Streaming Video\n"
+    "G          \t100 Single Pass Stereo\n"
+    "X          \t100 Distortion Mesh\n"
     "N/M        \t180 Adj Motion Pred\n"
+    "E          \t100 Video Timewarp\n"
+    "A/D        \t180 Adj Servo Latency\n"
     "( / )      \t180 Adj EyeDistance"
     ;
 
@@ -1170,54 +1440,213 @@ HRESULT OculusWorldDemoApp::GetGrabber(ISampleGrabber **grabber, IGraphBuilder *
 	return S_OK;
 }
 
+static FramePixelFormat GetGrabberPixelFormat(const AM_MEDIA_TYPE& mt) {
+	if (mt.subtype == MEDIASUBTYPE_YUY2) {
+		return FramePixel_YUY2;
+	}
+	if (mt.subtype == MEDIASUBTYPE_UYVY) {
+		return FramePixel_UYVY;
+	}
+	return FramePixel_BGRA;
+}
+
+HRESULT OculusWorldDemoApp::SetupGrabberSources() {
+	HRESULT hr;
+	IGraphBuilder *pGraph1, *pGraph2;
+
+
+	LogText("\nGraph Setup\n-----------\n");
+	hr = GetGraph(&pGraph1, L"D:\\prog\\eit\\FINAL_graph_norender.grf", 1);
+	if (FAILED(hr)) {
+		LogText("Graph1 failed. \nABORTING...\n");
+		return hr;
+	}
+	hr = GetGraph(&pGraph2, L"D:\\prog\\eit\\FINAL_graph_2_norender.grf", 2);
+	if (FAILED(hr)) {
+		LogText("Graph2 failed. \nABORTING...\n");
+		return hr;
+	}
+
+	LogText("\nSample Grabber Setup\n--------------------\n");
+	hr = GetGrabber(&grabber_isg1, pGraph1, 1);
+	if (FAILED(hr)) {
+		LogText("ABORTING...\n");
+		return hr;
+	}
+	hr = GetGrabber(&grabber_isg2, pGraph2, 2);
+	if (FAILED(hr)) {
+		LogText("ABORTING...\n");
+		return hr;
+	}
+
+
+	AM_MEDIA_TYPE am1, am2;
+	grabber_isg1->GetConnectedMediaType(&am1);
+	grabber_isg2->GetConnectedMediaType(&am2);
+
+	VIDEOINFOHEADER *vh1 = (VIDEOINFOHEADER*)am1.pbFormat;
+	grabberWidth1 = vh1->bmiHeader.biWidth;
+	grabberHeight1 = vh1->bmiHeader.biHeight;
+
+	VIDEOINFOHEADER *vh2 = (VIDEOINFOHEADER*)am2.pbFormat;
+	grabberWidth2 = vh2->bmiHeader.biWidth;
+	grabberHeight2 = vh2->bmiHeader.biHeight;
+
+	video[0].ScreenRatio = ((float)grabberWidth1) / grabberHeight1;
+	video[1].ScreenRatio = ((float)grabberWidth2) / grabberHeight2;
+
+	LogText("Size is: %ix%i, ratio: %4.2f (1)\n", grabberWidth1, grabberHeight1, video[0].ScreenRatio);
+	LogText("Size is: %ix%i, ratio: %4.2f (2)\n", grabberWidth2, grabberHeight2, video[1].ScreenRatio);
+
+	hr = pGraph1->QueryInterface(IID_IMediaControl, (void **)&pControl1);
+	if (FAILED(hr)) {
+		return hr;
+	}
+	hr = pGraph2->QueryInterface(IID_IMediaControl, (void **)&pControl2);
+	if (FAILED(hr)) {
+		return hr;
+	}
+
+	// The graphs may deliver packed YUV straight from the capture cards, which halves the
+	// bytes per frame compared to converting to RGB32 in the graph.
+	FramePixelFormat format1 = GetGrabberPixelFormat(am1);
+	FramePixelFormat format2 = GetGrabberPixelFormat(am2);
+
+	// Frames are pushed to us from the graph's streaming threads.
+	video[0].Source = *new GrabberFrameSource(grabber_isg1, pControl1, grabberWidth1, grabberHeight1, format1);
+	video[1].Source = *new GrabberFrameSource(grabber_isg2, pControl2, grabberWidth2, grabberHeight2, format2);
+	return S_OK;
+}
+
 void OculusWorldDemoApp::AdjustPictureSize(float dt) {
 	pictureSize = pictureSize + 0.1f * dt;
 	SetAdjustMessage("Picture Size: %6.4f", pictureSize);
 }
 
-HRESULT OculusWorldDemoApp::CheckGrabberStatus(int nr) {
-	time_t now;
-	time(&now);
+void OculusWorldDemoApp::AdjustServoLatency(float dt) {
+	timewarp.SetServoLatency(timewarp.GetServoLatency() + 0.01f * dt);
+	if (servoSender) {
+		servoSender->SetPredictionTime(timewarp.GetServoLatency());
+	}
+	SetAdjustMessage("Servo Latency: %6.3fs", timewarp.GetServoLatency());
+}
 
-	if (nr == 1) {
-		double diff = difftime(now, lastSampleTest1);
-		if (diff > 0.1) {
-			LogText("Checking Samplegrabber (1)\n");
-			time(&lastSampleTest1);
-			return grabber_isg1->GetCurrentBuffer(&pBufferSize1, NULL);
+// Must be called before the sources are started, as it decides whether they
+// have to convert frames to rgba.
+void OculusWorldDemoApp::CreateVideoTextures() {
+	// Bgra frames are uploaded as is if the renderer can sample that, otherwise the
+	// sources swap red and blue on their own threads. Yuv is converted by the shader.
+	Ptr<Texture> probe = *pRender->CreateTexture(Texture_BGRA, 4, 4, NULL);
+	int rgbFormat = probe ? Texture_BGRA : Texture_RGBA;
+
+	for (int i = 0; i < 2; i++) {
+		static const char* formatNames[] = { "BGRA", "YUY2", "UYVY" };
+		FramePixelFormat format = video[i].Source->GetPixelFormat();
+		switch (format) {
+		case FramePixel_YUY2: video[i].TexFormat = Texture_YUY2; break;
+		case FramePixel_UYVY: video[i].TexFormat = Texture_UYVY; break;
+		default:              video[i].TexFormat = rgbFormat; break;
 		}
-	} else {
-		double diff = difftime(now, lastSampleTest2);
-		if (diff > 0.1) {
-			LogText("Checking Samplegrabber (2)\n");
-			time(&lastSampleTest2);
-			return grabber_isg2->GetCurrentBuffer(&pBufferSize2, NULL);
+		video[i].Source->SetSwapRedBlue(video[i].TexFormat == Texture_RGBA);
+
+		LogText("Video format: %s, texture %s (%i)\n", formatNames[format],
+		        video[i].TexFormat == Texture_RGBA ? "RGBA" : formatNames[format], i + 1);
+		if (video[i].TexFormat == Texture_RGBA) {
+			LogText("Using %s color conversion\n", GetSwizzleImplName(GetSwizzleImpl()));
 		}
 	}
 
-	return E_FAIL;
+	for (int i = 0; i < 2; i++) {
+		video[i].Tex = *pRender->CreateStreamingTexture(video[i].TexFormat, video[i].Source->GetWidth(), video[i].Source->GetHeight());
+		if (!video[i].Tex) {
+			LogText("Couldn't create video textures, creating them every frame\n");
+			streamingVideo = false;
+			return;
+		}
+		video[i].Fill = *(ShaderFill*)pRender->CreateTextureFill(video[i].Tex, false);
+	}
 }
 
-void OculusWorldDemoApp::GrabFrame(ISampleGrabber *grabber, long &pBufferSize, unsigned char *buffer) {
-	HRESULT hr = grabber->GetCurrentBuffer(&pBufferSize, (long*)buffer);
-	if (FAILED(hr)) {
-		LogText("HR FAILED");
+// Picks up the newest frame from the source, if there is one, and draws it.
+// Frames are only uploaded once; later eyes/frames reuse the texture.
+void OculusWorldDemoApp::RenderVideo(int nr) {
+	VideoStream& v = video[nr];
+
+	// Frames are already in the texture's format; see CreateVideoTextures.
+	VideoFrame* frame = v.Source->GetLatestFrame();
+	if (!frame) {
+		frame = v.Source->GetCurrentFrame();
+		if (!frame) {
+			return;
+		}
 	}
-	//rbga -> rbga
-	/*for (int i = 0; i < pBufferSize; i += 4) {
-		image1[i] = pBuffer[i+2];
-		image1[i + 1] = pBuffer[i + 1];
-		image1[i + 2] = pBuffer[i];
-		image1[i + 3] = 0xFF;
-	}*/
-	unsigned char tmp;
-	for (int i = 0; i < pBufferSize; i += 4) {
-		tmp = buffer[i + 2];
-		buffer[i + 2] = buffer[i];
-		buffer[i] = tmp;
+
+	Vector2f offset(0, 0);
+	if (useTimewarp) {
+		offset = timewarp.GetFrameOffset(frame->CaptureTicks, displayYaw, displayPitch,
+		                                 tanf(SConfig.Get2DAreaFov() * 0.5f));
+	}
+	float left   = -pictureSize * v.ScreenRatio + offset.x, right  = pictureSize * v.ScreenRatio + offset.x;
+	float top    = -pictureSize + offset.y,                 bottom = pictureSize + offset.y;
+
+	if (streamingVideo && v.Tex) {
+		if (frame->Sequence != v.UploadedSequence) {
+			UInt64 start = Timer::GetTicks();
+			bool updated = pRender->UpdateTexture(v.Tex, 0, 0, frame->Width, frame->Height, frame->pData);
+			uploadTicks += Timer::GetTicks() - start;
+			uploadBytes += frame->Size;
+			uploadCount++;
+
+			if (!updated) {
+				LogText("Texture updates not supported, creating them every frame\n");
+				streamingVideo = false;
+			}
+			v.UploadedSequence = frame->Sequence;
+			v.ShownCaptureTicks = frame->CaptureTicks;
+		}
+		if (streamingVideo) {
+			pRender->RenderImage(left, top, right, bottom, v.Fill, 255);
+			return;
+		}
 	}
+
+	UInt64 start = Timer::GetTicks();
+	Ptr<Texture> frameTex = *pRender->CreateTexture(v.TexFormat, frame->Width, frame->Height, frame->pData, 1);
+	uploadTicks += Timer::GetTicks() - start;
+	uploadBytes += frame->Size;
+	uploadCount++;
+	v.ShownCaptureTicks = frame->CaptureTicks;
+
+	Ptr<ShaderFill> image = *(ShaderFill*)pRender->CreateTextureFill(frameTex, false);
+	pRender->RenderImage(left, top, right, bottom, image, 255);
 }
 
+// Averages the texture upload time and capture to display latency over the
+// last second, and sums up the bytes uploaded in it.
+void OculusWorldDemoApp::UpdateVideoStats() {
+	videoUploadMs   = uploadCount  ? (float)uploadTicks  / uploadCount  / Timer::MksPerMs : 0.0f;
+	videoLatencyMs  = latencyCount ? (float)latencyTicks / latencyCount / Timer::MksPerMs : 0.0f;
+	videoUploadMBps = uploadBytes / (1024.0f * 1024.0f);
+	uploadTicks = latencyTicks = uploadBytes = 0;
+	uploadCount = latencyCount = 0;
+}
+
+// Keeps a window of recent frame times and refreshes the 99th percentile
+// along with the FPS counter, once per second.
+void OculusWorldDemoApp::UpdateFrameTimes(float dt) {
+	FrameTimes[FrameTimeIndex] = dt;
+	FrameTimeIndex = (FrameTimeIndex + 1) % FRAME_TIME_HISTORY;
+
+	if (FrameCounter != 1) {
+		return;
+	}
+
+	for (int i = 0; i < FRAME_TIME_HISTORY; i++) {
+		SortedFrameTimes[i] = FrameTimes[i];
+	}
+	Alg::QuickSort(SortedFrameTimes);
+	FrameTime99 = SortedFrameTimes[(FRAME_TIME_HISTORY * 99) / 100];
+}
 
 void OculusWorldDemoApp::Render(const StereoEyeParams& stereo)
 {
@@ -1232,8 +1661,28 @@ void OculusWorldDemoApp::Render(const StereoEyeParams& stereo)
 
     //pRender->SetDepthMode(true, true);
 
+    RenderEye(stereo);
 
+    pRender->FinishScene();
+}
+
+// Draws both eyes into the scene target within one BeginScene, clearing it once,
+// so distortion is applied to both in a single pass by FinishSceneStereo.
+void OculusWorldDemoApp::RenderStereo(const StereoEyeParams& left, const StereoEyeParams& right)
+{
+    pRender->BeginScene(PostProcess);
+
+    pRender->SetViewport(Viewport(left.VP.x, left.VP.y, right.VP.x + right.VP.w - left.VP.x, left.VP.h));
+    pRender->Clear();
+
+    RenderEye(left);
+    RenderEye(right);
+
+    pRender->FinishSceneStereo(left, right);
+}
 
+void OculusWorldDemoApp::RenderEye(const StereoEyeParams& stereo)
+{
     // *** 2D Text & Grid - Configure Orthographic rendering.
 
     // Render UI in 2D orthographic coordinate system that maps [-1,1] range
@@ -1255,24 +1704,10 @@ void OculusWorldDemoApp::Render(const StereoEyeParams& stereo)
 	else {
 
 		if /*(1) {*/(stereo.Eye == StereoEye_Left) {
-			GrabFrame(grabber_isg1, pBufferSize1, pBuffer1);
-
-			Texture* tex = pRender->CreateTexture(Texture_RGBA, grabberWidth1, grabberHeight1, pBuffer1, 1);
-			ShaderFill* image = (ShaderFill*)pRender->CreateTextureFill(tex, false);
-			pRender->RenderImage(-pictureSize * screenRatio1, -pictureSize, pictureSize * screenRatio1, pictureSize, image, 255);
-
-			delete image;
-			delete tex;
+			RenderVideo(0);
 		}
 		else {
-			GrabFrame(grabber_isg2, pBufferSize2, pBuffer2);
-
-			Texture* tex = pRender->CreateTexture(Texture_RGBA, grabberWidth2, grabberHeight2, pBuffer2, 1);
-			ShaderFill* image = (ShaderFill*)pRender->CreateTextureFill(tex, false);
-			pRender->RenderImage(-pictureSize * screenRatio2, -pictureSize, pictureSize * screenRatio2, pictureSize, image, 255);
-
-			delete image;
-			delete tex;
+			RenderVideo(1);
 		}
 	}
 
@@ -1291,8 +1726,20 @@ void OculusWorldDemoApp::Render(const StereoEyeParams& stereo)
         char buf[256], gpustat[256];
         OVR_sprintf(buf, sizeof(buf),
                     ""
-                    " FPS: %d",
-                   FPS);
+                    " FPS: %d\n"
+                    " Frame 99%%: %.2f ms\n"
+                    " Video: %s\n"
+                    " Upload: %.2f ms  %.1f MB/s\n"
+                    " Latency: %.1f ms\n"
+                    " Dropped: %u / %u\n"
+                    " Draws: %d  Clears: %d  Targets: %d",
+                   FPS, FrameTime99 * 1000.0f,
+                   streamingVideo ? "Streaming" : "Per Frame",
+                   videoUploadMs, videoUploadMBps, videoLatencyMs,
+                   video[0].Source ? video[0].Source->GetDroppedCount() : 0,
+                   video[1].Source ? video[1].Source->GetDroppedCount() : 0,
+                   lastRenderStats.DrawCalls, lastRenderStats.Clears,
+                   lastRenderStats.RenderTargetChanges);
         size_t texMemInMB = pRender->GetTotalTextureMemoryUsage() / 1058576;
         if (texMemInMB)
         {
@@ -1334,9 +1781,6 @@ void OculusWorldDemoApp::Render(const StereoEyeParams& stereo)
     default:
         break;
     }
-
-
-    pRender->FinishScene();
 }
 
 
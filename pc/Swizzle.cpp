@@ -0,0 +1,242 @@
+#include "Swizzle.h"
+
+#include "CpuFeatures.h"
+
+#include <Kernel/OVR_Types.h>
+#include <Kernel/OVR_Atomic.h>
+#include <Kernel/OVR_Log.h>
+#include <Kernel/OVR_Timer.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <emmintrin.h> // SSE2
+#include <tmmintrin.h> // SSSE3
+#include <immintrin.h> // AVX2
+
+using OVR::UInt32;
+
+typedef void (*SwizzleFn)(UInt32* dest, const UInt32* src, int pixelCount);
+
+
+//-------------------------------------------------------------------------------------
+// ***** Implementations
+
+// Each vector version handles whole vectors and leaves the rest to this.
+static void swizzleScalar(UInt32* dest, const UInt32* src, int pixelCount)
+{
+	for (int i = 0; i < pixelCount; i++)
+	{
+		UInt32 p = src[i];
+		dest[i] = (p & 0xFF00FF00) | ((p >> 16) & 0xFF) | ((p & 0xFF) << 16);
+	}
+}
+
+CPU_TARGET("sse2")
+static void swizzleSSE2(UInt32* dest, const UInt32* src, int pixelCount)
+{
+	// No byte shuffle in SSE2; mask out the red/blue pair and rotate it by 16 bits.
+	const __m128i agMask = _mm_set1_epi32(0xFF00FF00);
+	const __m128i rbMask = _mm_set1_epi32(0x00FF00FF);
+
+	int i = 0;
+	for (; i + 4 <= pixelCount; i += 4)
+	{
+		__m128i p  = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i ag = _mm_and_si128(p, agMask);
+		__m128i rb = _mm_and_si128(p, rbMask);
+		rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+		_mm_storeu_si128((__m128i*)(dest + i), _mm_or_si128(ag, rb));
+	}
+	swizzleScalar(dest + i, src + i, pixelCount - i);
+}
+
+CPU_TARGET("ssse3")
+static void swizzleSSSE3(UInt32* dest, const UInt32* src, int pixelCount)
+{
+	const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+	int i = 0;
+	// Two vectors per iteration keeps both load ports busy.
+	for (; i + 8 <= pixelCount; i += 8)
+	{
+		__m128i p0 = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i p1 = _mm_loadu_si128((const __m128i*)(src + i + 4));
+		_mm_storeu_si128((__m128i*)(dest + i),     _mm_shuffle_epi8(p0, shuffle));
+		_mm_storeu_si128((__m128i*)(dest + i + 4), _mm_shuffle_epi8(p1, shuffle));
+	}
+	swizzleScalar(dest + i, src + i, pixelCount - i);
+}
+
+CPU_TARGET("avx2")
+static void swizzleAVX2(UInt32* dest, const UInt32* src, int pixelCount)
+{
+	// vpshufb works within each 128 bit lane, so the pattern is repeated.
+	const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+	                                         2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+	int i = 0;
+	for (; i + 16 <= pixelCount; i += 16)
+	{
+		__m256i p0 = _mm256_loadu_si256((const __m256i*)(src + i));
+		__m256i p1 = _mm256_loadu_si256((const __m256i*)(src + i + 8));
+		_mm256_storeu_si256((__m256i*)(dest + i),     _mm256_shuffle_epi8(p0, shuffle));
+		_mm256_storeu_si256((__m256i*)(dest + i + 8), _mm256_shuffle_epi8(p1, shuffle));
+	}
+	// Avoid the AVX to SSE transition penalty in whatever runs next.
+	_mm256_zeroupper();
+	swizzleScalar(dest + i, src + i, pixelCount - i);
+}
+
+
+//-------------------------------------------------------------------------------------
+// ***** Dispatch
+
+static bool detectSupport(SwizzleImpl impl)
+{
+	switch (impl)
+	{
+	case Swizzle_Scalar: return true;
+	case Swizzle_SSE2:   return HasCpuFeature(CpuFeature_SSE2);
+	case Swizzle_SSSE3:  return HasCpuFeature(CpuFeature_SSSE3);
+	case Swizzle_AVX2:   return HasCpuFeature(CpuFeature_AVX2);
+	default:             return false;
+	}
+}
+
+static const SwizzleFn SwizzleFns[Swizzle_Count] =
+{
+	swizzleScalar, swizzleSSE2, swizzleSSSE3, swizzleAVX2
+};
+
+static const char* SwizzleNames[Swizzle_Count] =
+{
+	"Scalar", "SSE2", "SSSE3", "AVX2"
+};
+
+// Swizzle_Count until first use. Capture threads and SetSwizzleImpl can get here at
+// the same time; the first value stored wins, so a forced implementation isn't undone
+// by a thread that was still detecting.
+static OVR::AtomicInt<int> CurrentImpl(Swizzle_Count);
+
+static SwizzleImpl selectImpl()
+{
+	int impl = CurrentImpl.Load_Acquire();
+	if (impl == Swizzle_Count)
+	{
+		SwizzleImpl best = Swizzle_Scalar;
+		for (int i = Swizzle_Count - 1; i > Swizzle_Scalar; i--)
+		{
+			if (detectSupport((SwizzleImpl)i))
+			{
+				best = (SwizzleImpl)i;
+				break;
+			}
+		}
+		CurrentImpl.CompareAndSet_Sync(Swizzle_Count, best);
+		impl = CurrentImpl.Load_Acquire();
+	}
+	return (SwizzleImpl)impl;
+}
+
+
+//-------------------------------------------------------------------------------------
+
+void SwizzleCopyBGRA(void* dest, const void* src, int pixelCount)
+{
+	SwizzleFns[selectImpl()]((UInt32*)dest, (const UInt32*)src, pixelCount);
+}
+
+SwizzleImpl GetSwizzleImpl()
+{
+	return selectImpl();
+}
+
+bool IsSwizzleImplSupported(SwizzleImpl impl)
+{
+	return impl >= Swizzle_Scalar && impl < Swizzle_Count && detectSupport(impl);
+}
+
+const char* GetSwizzleImplName(SwizzleImpl impl)
+{
+	return (impl >= Swizzle_Scalar && impl < Swizzle_Count) ? SwizzleNames[impl] : "Unknown";
+}
+
+bool SetSwizzleImpl(SwizzleImpl impl)
+{
+	if (!IsSwizzleImplSupported(impl))
+	{
+		return false;
+	}
+	CurrentImpl.Store_Release(impl);
+	return true;
+}
+
+
+//-------------------------------------------------------------------------------------
+// ***** Benchmark
+
+bool BenchmarkSwizzle()
+{
+	static const int sizes[][2] = { { 728, 488 }, { 720, 576 } };
+	const int        iterations = 200;
+
+	OVR::LogText("\nSwizzle Benchmark\n-----------------\n");
+
+	SwizzleImpl previous = GetSwizzleImpl();
+	bool        allMatch = true;
+
+	for (int s = 0; s < 2; s++)
+	{
+		int     pixelCount = sizes[s][0] * sizes[s][1] + 7;
+		UInt32* src        = (UInt32*)malloc(pixelCount * sizeof(UInt32));
+		UInt32* expected   = (UInt32*)malloc(pixelCount * sizeof(UInt32));
+		UInt32* dest       = (UInt32*)malloc(pixelCount * sizeof(UInt32));
+
+		UInt32 seed = 12345;
+		for (int i = 0; i < pixelCount; i++)
+		{
+			seed   = seed * 1664525 + 1013904223;
+			src[i] = seed;
+		}
+		swizzleScalar(expected, src, pixelCount);
+
+		OVR::LogText("%ix%i + 7 pixels, %i frames\n", sizes[s][0], sizes[s][1], iterations);
+
+		for (int i = 0; i < Swizzle_Count; i++)
+		{
+			SwizzleImpl impl = (SwizzleImpl)i;
+			if (!SetSwizzleImpl(impl))
+			{
+				continue;
+			}
+
+			memset(dest, 0xCD, pixelCount * sizeof(UInt32));
+			SwizzleCopyBGRA(dest, src, pixelCount);
+			bool copyMatches = memcmp(dest, expected, pixelCount * sizeof(UInt32)) == 0;
+
+			memcpy(dest, src, pixelCount * sizeof(UInt32));
+			SwizzleBGRA(dest, pixelCount);
+			bool inPlaceMatches = memcmp(dest, expected, pixelCount * sizeof(UInt32)) == 0;
+
+			OVR::UInt64 start = OVR::Timer::GetTicks();
+			for (int n = 0; n < iterations; n++)
+			{
+				SwizzleCopyBGRA(dest, src, pixelCount);
+			}
+			double usPerFrame = double(OVR::Timer::GetTicks() - start) / iterations;
+
+			OVR::LogText("%-6s %8.1f us/frame, copy %s, in place %s\n", GetSwizzleImplName(impl),
+			             usPerFrame, copyMatches ? "matches" : "DIFFERS",
+			             inPlaceMatches ? "matches" : "DIFFERS");
+			allMatch = allMatch && copyMatches && inPlaceMatches;
+		}
+
+		free(src);
+		free(expected);
+		free(dest);
+	}
+
+	SetSwizzleImpl(previous);
+	return allMatch;
+}
@@ -0,0 +1,38 @@
+#ifndef SWIZZLE_H
+#define SWIZZLE_H
+
+// BGRA <-> RGBA conversion of 32 bit pixels (swaps bytes 0 and 2 of every pixel).
+// The fastest implementation the CPU supports is picked on first use.
+
+enum SwizzleImpl
+{
+	Swizzle_Scalar,
+	Swizzle_SSE2,
+	Swizzle_SSSE3,
+	Swizzle_AVX2,
+	Swizzle_Count
+};
+
+// Copies pixelCount pixels from src to dest, swapping red and blue on the way.
+// dest and src may be the same buffer (in place); otherwise they must not overlap.
+void SwizzleCopyBGRA(void* dest, const void* src, int pixelCount);
+
+// In place version.
+inline void SwizzleBGRA(void* pixels, int pixelCount) { SwizzleCopyBGRA(pixels, pixels, pixelCount); }
+
+// The implementation in use, and whether a given one can run on this CPU.
+SwizzleImpl GetSwizzleImpl();
+bool        IsSwizzleImplSupported(SwizzleImpl impl);
+const char* GetSwizzleImplName(SwizzleImpl impl);
+
+// Forces a specific implementation, for comparing them. Returns false if the
+// CPU doesn't support it, in which case the current one is kept.
+bool        SetSwizzleImpl(SwizzleImpl impl);
+
+// Runs every implementation the CPU supports, copying and in place, on 728x488 and
+// 720x576 frames with 7 extra pixels so the vector loops leave a tail, checks each
+// output against the scalar loop and logs the time per frame. Returns false if any
+// output differs. The implementation in use before is restored.
+bool        BenchmarkSwizzle();
+
+#endif
@@ -0,0 +1,140 @@
+#include "VideoTimewarp.h"
+#include "ServoSender.h"
+#include <Kernel/OVR_SysFile.h>
+
+#include <math.h>
+
+using namespace OVR;
+
+VideoTimewarp::VideoTimewarp() : Count(0), Next(0), pFusion(0)
+{
+	SetServoLatency(0.1f);
+}
+
+void VideoTimewarp::RecordServoPose(UInt64 ticks, float yaw, float pitch)
+{
+	History[Next] = ServoPose(ticks, yaw, pitch);
+	Next = (Next + 1) % HistorySize;
+	if (Count < HistorySize)
+	{
+		Count++;
+	}
+}
+
+bool VideoTimewarp::GetFramePose(UInt64 captureTicks, ServoPose* pose) const
+{
+	if (captureTicks < ServoLatencyTicks)
+	{
+		return false;
+	}
+	UInt64 sentBefore = captureTicks - ServoLatencyTicks;
+
+	// Newest first; a few hundred entries cover far more than any latency.
+	for (int i = 1; i <= Count; i++)
+	{
+		const ServoPose& p = History[(Next - i + HistorySize) % HistorySize];
+		if (p.Ticks <= sentBefore)
+		{
+			if (sentBefore - p.Ticks > MaxCommandAgeTicks)
+			{
+				break;
+			}
+			*pose = p;
+			return true;
+		}
+	}
+
+	if (!pFusion)
+	{
+		return false;
+	}
+	UByte x, y;
+	ServoSender::GetServoPosition(pFusion->GetOrientationAt(captureTicks), &x, &y);
+	*pose = ServoPose(sentBefore,
+	                  DegreeToRad((float)(x - SERVO_MEDIAN_BOUNDARY)),
+	                  DegreeToRad((float)(SERVO_MEDIAN_BOUNDARY - y)));
+	return true;
+}
+
+Vector2f VideoTimewarp::GetFrameOffset(UInt64 captureTicks, float headYaw, float headPitch, float tanHalfFov) const
+{
+	ServoPose pose;
+	if (!GetFramePose(captureTicks, &pose))
+	{
+		return Vector2f(0, 0);
+	}
+
+	// Turning left past where the camera looked moves the picture right, looking
+	// up past it moves the picture down.
+	return Vector2f(tanf(headYaw - pose.Yaw) / tanHalfFov,
+	                tanf(headPitch - pose.Pitch) / tanHalfFov);
+}
+
+void VideoTimewarp::SetServoLatency(float seconds)
+{
+	ServoLatencyTicks = (UInt64)(Alg::Max(seconds, 0.0f) * Timer::MksPerSecond);
+}
+
+bool SaveServoTrace(const char* path, const Array<ServoPose>& poses)
+{
+	SysFile file;
+	if (!file.Open(path, File::Open_Write | File::Open_Create | File::Open_Truncate | File::Open_Buffered))
+	{
+		return false;
+	}
+
+	bool ok = true;
+	for (UPInt i = 0; ok && i < poses.GetSize(); i++)
+	{
+		char line[64];
+		int  length = (int)OVR_sprintf(line, sizeof(line), "%llu %.6f %.6f\n",
+		                               (unsigned long long)poses[i].Ticks, poses[i].Yaw, poses[i].Pitch);
+		ok = file.Write((const UByte*)line, length) == length;
+	}
+
+	file.Close();
+	return ok;
+}
+
+bool LoadServoTrace(const char* path, Array<ServoPose>* poses)
+{
+	SysFile file;
+	if (!file.Open(path, File::Open_Read))
+	{
+		return false;
+	}
+
+	int         length = file.GetLength();
+	Array<char> text;
+	text.Resize(length + 1);
+	if (file.Read((UByte*)&text[0], length) != length)
+	{
+		return false;
+	}
+	text[length] = 0;
+
+	char* p = &text[0];
+	while (*p)
+	{
+		char*  end;
+		UInt64 ticks = OVR_strtouq(p, &end, 10);
+		if (end != p)
+		{
+			p = end;
+			float yaw   = (float)OVR_strtod(p, &p);
+			float pitch = (float)OVR_strtod(p, &p);
+			poses->PushBack(ServoPose(ticks, yaw, pitch));
+		}
+
+		// On to the next line.
+		while (*p && *p != '\n')
+		{
+			p++;
+		}
+		if (*p)
+		{
+			p++;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,75 @@
+#ifndef VIDEO_TIMEWARP_H
+#define VIDEO_TIMEWARP_H
+
+#include "OVR.h"
+#include <Kernel/OVR_Timer.h>
+
+// Reprojection of the camera frames for head movement the servos haven't caught up
+// with. The cameras are turned by servos following the head, so a frame shows the
+// view in the direction the servos were sent to some time before it was captured.
+// Just before rendering, the difference between that and the head's orientation at
+// display time is turned into a shift of the video quad.
+//
+// Angles are in radians with the conventions of Quatf::GetEulerAngles<Axis_Y,
+// Axis_X, Axis_Z>: positive yaw turns left and positive pitch looks up. Nothing in
+// here reads the clock, so it can be driven with recorded data.
+
+struct ServoPose
+{
+	OVR::UInt64  Ticks;      // Timer::GetTicks() when the command was sent
+	float        Yaw, Pitch; // As sent, after clamping to the servo range
+
+	ServoPose() : Ticks(0), Yaw(0), Pitch(0) {}
+	ServoPose(OVR::UInt64 ticks, float yaw, float pitch) : Ticks(ticks), Yaw(yaw), Pitch(pitch) {}
+};
+
+class VideoTimewarp
+{
+public:
+	VideoTimewarp();
+
+	// Records the pose sent to the servos. Ticks must not decrease between calls.
+	void    RecordServoPose(OVR::UInt64 ticks, float yaw, float pitch);
+
+	// Head orientation history to fall back on when no servo command was recorded
+	// around the time one was needed, e.g. before the servo sender has started or
+	// while it is stalled. May be null.
+	void    SetOrientationHistory(const OVR::SensorFusion* fusion) { pFusion = fusion; }
+
+	// The pose frames captured at captureTicks show: the last one sent at least
+	// the servo latency before, if it was sent no more than MaxCommandAgeTicks before
+	// that. Otherwise the servo position for the head's orientation at captureTicks,
+	// which the commands aim for, from the orientation history. Returns false if
+	// there is neither.
+	bool    GetFramePose(OVR::UInt64 captureTicks, ServoPose* pose) const;
+
+	// Offset to draw a frame captured at captureTicks with, when the head is at
+	// (headYaw, headPitch). It is in units of the 2D area, with y down, so
+	// tanHalfFov is the tangent of half the angle the area's [-1,1] range covers.
+	OVR::Vector2f GetFrameOffset(OVR::UInt64 captureTicks, float headYaw, float headPitch, float tanHalfFov) const;
+
+	// Time from sending a servo command until the frames delivered by the grabbers
+	// show it: servo movement, camera exposure and the video link together.
+	float   GetServoLatency() const { return float(ServoLatencyTicks) / OVR::Timer::MksPerSecond; }
+	void    SetServoLatency(float seconds);
+
+private:
+	enum
+	{
+		HistorySize        = 256,
+		MaxCommandAgeTicks = 50000  // A few servo periods
+	};
+
+	ServoPose                History[HistorySize];   // Ring of the newest poses sent
+	int                      Count, Next;
+	OVR::UInt64              ServoLatencyTicks;
+	const OVR::SensorFusion* pFusion;
+};
+
+// Servo commands as text, one "ticks yaw pitch" line per ServoPose, so a recorded
+// sequence can be replayed through VideoTimewarp. Load appends to poses; both return
+// false if the file couldn't be opened, read or written.
+bool SaveServoTrace(const char* path, const OVR::Array<ServoPose>& poses);
+bool LoadServoTrace(const char* path, OVR::Array<ServoPose>* poses);
+
+#endif